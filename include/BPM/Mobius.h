@@ -1,3 +1,4 @@
+#pragma once
 #include <array>
 #include <complex>
 #include <iostream>
@@ -138,6 +139,23 @@ Mat2c ComputeMobiusCoefficients(const std::array<Complex, 3>& z, const std::arra
 
 Matrix2c ComputeMobiusCoefficients_Eigen(const std::array<Complex, 3>& z, const std::array<Complex, 3>& w);
 
+// Two Mobius maps that agree on a shared edge (p0, p1) have a log ratio log(M^-1 * M_nbr) that fixes p0 and p1,
+// so it is trace-free and determined by a single complex number mu:
+//     L = mu / (p1 - p0) * [[p0 + p1, -2 p0 p1], [2, -(p0 + p1)]]
+// mu belongs to p1: L (p1, 1)^T = mu (p1, 1)^T and L (p0, 1)^T = -mu (p0, 1)^T. It is the log of the eigenvalue
+// of M^-1 * M_nbr at p1, computed in double precision from the two maps at p0 (where the eigenvalue is its
+// reciprocal). A neighbor that goes along the edge as (p1, p0), as in a consistently oriented mesh, gets the
+// same mu; one that goes along it as (p0, p1) gets -mu, which LogRatioLayout stores as the negate bit.
+Complex ComputeEdgeLogRatio(const std::array<Complex, 3>& z, const std::array<Complex, 3>& w,
+                            const std::array<Complex, 3>& z_nbr, const std::array<Complex, 3>& w_nbr, const Complex& p0);
+
+// The full log ratio matrix of an edge from its mu
+Mat2c EdgeLogRatioMatrix(const Complex& mu, const Complex& p0, const Complex& p1);
+
+// CPU reference of the BPM texture coordinates computed in bpm_fs.glsl. p are the flattened triangle vertices,
+// mu the log ratios of edges (p0 p1), (p1 p2), (p2 p0), zero on boundary edges.
+Complex EvaluateBPM(const Mat2c& coeffs, const std::array<Complex, 3>& mu, const std::array<Complex, 3>& p, const Complex& z);
+
 Complex ApplyMobius(const Matrix2c& mobius, const Complex& z);
 
 cvec ApplyMobius(const Matrix2c& mobius, const cvec& z);
@@ -0,0 +1,118 @@
+// Precompute.h
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "BPM/Mobius.h"
+#include "Scene/Vertex.h"
+
+// CPU side of the BPM precompute, without GL: the per-triangle math that follows the neighbors pass, a CPU
+// version of that pass, the log ratio layout and the on-disk store. Mesh uses it for its GPU precompute and its
+// incremental updates, bpm_precompute (tools/) for the whole mesh, in shards (see BPM/Shard.h).
+
+// Per-triangle data a texture type needs, each level includes the ones before it
+enum class BPMData {
+    NONE,   // LINEAR
+    MOBIUS, // frames and Mobius coefficients, DIRECT_MOBIUS
+    FULL    // and the edge log ratios, packed records and adaptive flags, BPM
+};
+
+// BPMRecord of bpm_fs.glsl (std430)
+struct BPMRecord {
+    glm::vec4 frame_x; // first two rows of the flattening transform
+    glm::vec4 frame_y;
+    Mat2c coeffs;
+    glm::uvec4 log_ratios; // packHalf2x16 mu of edges ij, jk, ki, unused
+};
+static_assert(sizeof(BPMRecord) == 80, "BPMRecord must match the std430 layout");
+
+// Per-triangle BPM data from the flattened output of the neighbors pass, six (x, y, u, v): the triangle ijk
+// and the third vertices l, m, n of its neighbors across ij, jk, ki. A missing neighbor is flattened onto vi.
+struct TriangleBPM {
+    std::array<Complex, 3> p;
+    Mat2c coeffs;
+    std::array<Complex, 3> mu = {Complex(0.0f), Complex(0.0f), Complex(0.0f)}; // ij, jk, ki
+    std::array<bool, 3> has_neighbor = {false, false, false};
+};
+
+TriangleBPM ComputeTriangleBPM(const glm::vec4* flat, bool log_ratios);
+
+// Packed record: frame rows and coefficients stay fp32 (fp16 coefficients shift texture coordinates by
+// several texels), the edge log ratios are fp16. Their error is measured against the fp32 layout.
+BPMRecord MakeBPMRecord(const glm::mat4& frame, const TriangleBPM& bpm, float& max_uv_error, double& sum_uv_error);
+
+// Adaptive evaluation: deviation of the triangle's own Mobius map from BPM
+float ComputeFlatUVError(const TriangleBPM& bpm);
+
+// CPU version of neighbors_cs.glsl for one triangle: its frame and flattened output. neighbors are the
+// triangles across its edges ij, jk, ki, -1 on the boundary.
+void FlattenTriangle(const Vertex* vertices, const unsigned int* indices, unsigned int face, const int neighbors[3],
+                     glm::mat4& frame, glm::vec4 flat[6]);
+
+// the vertex of a triangle that is not on its edge (a, b)
+unsigned int ThirdVertex(const unsigned int* triangle, unsigned int a, unsigned int b);
+
+// Per triangle edge (ij, jk, ki), the first other triangle with both of its vertices, -1 on the boundary
+std::vector<int> ComputeEdgeAdjacency(const std::vector<unsigned int>& indices, size_t num_vertices);
+
+// Log ratios, one complex mu per edge (see ComputeEdgeLogRatio). The two triangles of an interior edge have
+// the same mu up to the sign (see EdgeLogRatioMatrix), so it is stored once. Layout (uints):
+//   [0, 3nF)  per triangle edge (ij, jk, ki): (offset of its mu << 1) | negate bit
+//   [3nF, ..) mu pairs as float bits, the first one is zero for boundary edges
+// Set is called in triangle order, the layout depends on it.
+class LogRatioLayout {
+public:
+    explicit LogRatioLayout(unsigned int num_faces = 0);
+    void Set(size_t slot, unsigned int a, unsigned int b, Complex mu); // slot 3 * face + edge, (a, b) its vertices
+    std::vector<uint32_t> data_;
+    size_t num_shared_ = 0;
+
+private:
+    std::unordered_map<uint64_t, std::vector<std::pair<uint32_t, Complex>>> edge_entries_; // undirected edge -> stored mus
+};
+// mu of triangle edge slot (3 * face + edge) of a layout's data, with its negate bit applied
+Complex GetEdgeLogRatio(const uint32_t* log_ratios, size_t slot);
+
+// Incremental updates after some vertices moved (see Mesh::UpdateVertices). faces are the sorted triangles to
+// compute again, neighbors their three edge neighbors each (see ComputeEdgeAdjacency), all -1 without log ratios.
+void RecomputeTriangles(const Vertex* vertices, const unsigned int* indices, const std::vector<unsigned int>& faces,
+                        const std::vector<int>& neighbors, bool log_ratios, std::vector<glm::mat4>& frames,
+                        std::vector<TriangleBPM>& bpms);
+// The edges of changed_faces (sorted) get their log ratios again in a layout's data, from faces, neighbors and
+// bpms of RecomputeTriangles, whose faces include the edge neighbors of the changed ones. An edge keeps its
+// pairs: a pair it no longer needs goes to free_pairs, and an edge that needs one more takes it from there before
+// the layout grows. changed gets the uints written, slots and pairs, sorted.
+void UpdateEdgeLogRatios(std::vector<uint32_t>& log_ratios, std::vector<uint32_t>& free_pairs, uint32_t num_faces,
+                         const std::vector<unsigned int>& changed_faces, const std::vector<unsigned int>& faces,
+                         const std::vector<int>& neighbors, const std::vector<TriangleBPM>& bpms, std::vector<uint32_t>& changed);
+
+// On-disk per-triangle store of a mesh (see Mesh::OpenBPMStore): magic, version, level, key, triangle count,
+// fp16 record error, then the trans, mobius, ratios, records, max log ratio and flat UV error sections, each as
+// its byte count and bytes. Ratios, records and the per-triangle stats are empty below BPMData::FULL, records
+// also when the writer did not use the packed layout (the reader builds them from the other sections).
+struct BPMStoreData {
+    BPMData level = BPMData::NONE;
+    uint64_t key = 0;
+    uint32_t num_faces = 0;
+    float record_max_uv_error = 0.0f;
+    std::vector<char> trans, mobius, records;
+    std::vector<uint32_t> log_ratios;
+    std::vector<float> max_log_ratio, flat_uv_error;
+};
+constexpr const char* kBPMStoreExtension = ".bpm";
+
+// Written next to path and renamed, a reader never sees a partial store
+bool WriteBPMStoreFile(const std::string& path, const BPMStoreData& data);
+// The header only, level, key, triangle count and record error, of any store
+bool ReadBPMStoreHeader(const std::string& path, BPMStoreData& data);
+// Fails if the key or the triangle count do not match, header_only stops after the header
+bool ReadBPMStoreFile(const std::string& path, uint64_t key, uint32_t num_faces, BPMStoreData& data, bool header_only = false);
+// FNV-1a of the file's bytes, the same on every machine
+uint64_t ComputeFileKey(const std::string& path);
@@ -0,0 +1,61 @@
+// Shard.h
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "BPM/Precompute.h"
+
+// Sharded BPM precompute for processes that share only a filesystem (see tools/bpm_precompute.cpp). The edge
+// adjacency of the mesh is computed once and written next to the OBJ, every shard reads it and computes the
+// frames, coefficients, log ratios, packed records and per-triangle stats of its triangle range, on the CPU.
+// The shared part of the log ratio layout depends on the triangle order (see LogRatioLayout), so it is left to
+// ShardMerger, which adds the shards in triangle order: the store it makes is the same, byte for byte, for any
+// number of shards and threads.
+constexpr const char* kAdjacencyExtension = ".adj";
+
+struct BPMShard {
+    uint64_t key = 0;        // of the OBJ, see ComputeFileKey
+    uint32_t num_faces = 0;  // of the mesh
+    uint32_t first = 0, end = 0;
+    float record_max_uv_error = 0.0f;
+    // per triangle of [first, end)
+    std::vector<glm::mat4> frames;
+    std::vector<Mat2c> coeffs;
+    std::vector<std::array<Complex, 3>> mu; // ij, jk, ki
+    std::vector<uint8_t> neighbor_bits;     // bit e: the edge has a neighbor
+    std::vector<BPMRecord> records;
+    std::vector<float> max_log_ratio, flat_uv_error;
+};
+
+// Triangles [first, end) of shard i of n, the first ones get one more when they do not divide evenly
+void GetShardRange(uint32_t num_faces, unsigned int shard, unsigned int num_shards, uint32_t& first, uint32_t& end);
+std::string GetShardPath(const std::string& obj_path, unsigned int shard, unsigned int num_shards);
+
+// adjacency: of ComputeEdgeAdjacency. The range is split between num_threads threads.
+void ComputeShard(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const std::vector<int>& adjacency,
+                  uint64_t key, unsigned int shard, unsigned int num_shards, unsigned int num_threads, BPMShard& result);
+
+// Binary files, written next to path and renamed. The reads fail on another key or triangle count.
+bool WriteAdjacencyFile(const std::string& path, uint64_t key, const std::vector<int>& adjacency);
+bool ReadAdjacencyFile(const std::string& path, uint64_t key, uint32_t num_faces, std::vector<int>& adjacency);
+bool WriteShardFile(const std::string& path, const BPMShard& shard);
+bool ReadShardFile(const std::string& path, uint64_t key, uint32_t num_faces, BPMShard& shard);
+
+// Assembles the BPMData::FULL store of the mesh from its shards, added in triangle order
+class ShardMerger {
+public:
+    ShardMerger(const std::vector<unsigned int>& indices, uint64_t key);
+    bool Add(const BPMShard& shard); // false if it is not the next range of the mesh
+    bool Finish(BPMStoreData& store); // false if triangles are missing
+
+private:
+    const std::vector<unsigned int>& indices_;
+    BPMStoreData store_;
+    LogRatioLayout log_ratios_;
+    uint32_t end_ = 0;
+};
@@ -0,0 +1,47 @@
+// GpuTimer.h
+#pragma once
+#include <glad/glad.h>
+
+// A GL query over a frame section (e.g. GL_TIME_ELAPSED, GL_FRAGMENT_SHADER_INVOCATIONS). Queries are
+// read back a few frames later so that measuring never stalls the pipeline, a frame whose query slot is
+// still in flight is not measured. Begin/End pairs of the same target must not nest.
+class GpuQuery {
+public:
+	static constexpr int kNumQueries = 4;
+
+	explicit GpuQuery(GLenum target) : target_(target) {}
+	virtual ~GpuQuery();
+	GpuQuery(const GpuQuery&) = delete;
+	GpuQuery& operator=(const GpuQuery&) = delete;
+
+	void Begin();
+	void End();
+	GLuint64 GetResult() const { return last_result_; } // latest available result
+
+protected:
+	virtual void OnResult(GLuint64) {}
+
+private:
+	GLenum target_;
+	GLuint queries_[kNumQueries] = {};
+	bool pending_[kNumQueries] = {};
+	bool initialized_ = false;
+	bool active_ = false; // between a Begin that started a query and its End
+	int current_ = 0;
+	GLuint64 last_result_ = 0;
+};
+
+// GPU time of a frame section
+class GpuTimer : public GpuQuery {
+public:
+	GpuTimer() : GpuQuery(GL_TIME_ELAPSED) {}
+	double GetMilliseconds() const { return last_ms_; } // latest available result
+	double GetSmoothedMilliseconds() const { return smoothed_ms_; }
+
+protected:
+	void OnResult(GLuint64 elapsed_ns) override;
+
+private:
+	double last_ms_ = 0.0;
+	double smoothed_ms_ = 0.0;
+};
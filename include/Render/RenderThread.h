@@ -0,0 +1,41 @@
+// RenderThread.h
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include "Utils/Constants.h"
+#include "Utils/CommandQueue.h"
+
+// Owns the window's GL context. The main thread only polls GLFW events: input, UI state changes and finished
+// loads (see AssetLoader) reach the scene and the renderer as commands, run here between frames, so a slow
+// event loop or a model being precomputed never stalls drawing.
+class RenderThread {
+public:
+	explicit RenderThread(GLFWwindow* window) : window_(window) {}
+	~RenderThread() { Stop(); }
+	RenderThread(const RenderThread&) = delete;
+	RenderThread& operator=(const RenderThread&) = delete;
+
+	// body runs on the new thread with the window's context current, until it sees IsStopping
+	void Start(std::function<void()> body);
+	void Stop(); // asks the body to return and joins
+	bool IsStopping() const { return stopping_.load(); }
+
+	// Any thread. Sleeps only while the queue is full.
+	void Post(CommandQueue::Command command);
+
+	// Render thread. At most kMaxCommandsPerFrame per call, so that a flood of cursor events cannot hold back a frame.
+	static constexpr size_t kMaxCommandsPerFrame = 256;
+	size_t RunCommands();
+	void WaitForCommands(double seconds) { commands_.WaitFor(std::chrono::duration<double>(seconds)); }
+
+private:
+	GLFWwindow* window_;
+	CommandQueue commands_;
+	std::thread thread_;
+	std::atomic<bool> stopping_{false};
+};
+
+extern RenderThread* render_thread;
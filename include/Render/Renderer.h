@@ -1,8 +1,24 @@
 // Renderer.h
 #pragma once
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "Utils/Constants.h"
 #include "Scene/Scene.h"
 #include "ShaderManager.h"
+#include "GpuTimer.h"
+#include "ResidencyManager.h"
+
+// Passes drawn by Renderer::DrawInstances
+enum class DrawPass {
+	ALL,
+	VISIBILITY, // only the fill, into the visibility buffer
+	OVERLAYS // everything but the fill
+};
 
 class Renderer {
 public:
@@ -16,24 +32,174 @@ public:
 	bool is_backface_culling_ = false;
 	bool is_depth_testing_ = true;
 	bool draw_axes_ = false;
+	bool meshlet_culling_ = true; // frustum culling, plus normal-cone culling when backface culling is on
+	// LOD selection: full detail while the bounding sphere covers at least this fraction of the viewport
+	// height, one LOD coarser per halving. Hysteresis is in LOD units.
+	float lod_full_detail_coverage_ = 0.5f;
+	static constexpr float kLODHysteresis = 0.2f;
 
 	bool draw_vertex_normals_ = false;
 	bool draw_face_normals_ = false;
 	float normal_scale_ = 0.1f;
 	TextureType texture_type_ = TextureType::BPM;
+	// Automatic texture type: per model from the average screen area of its triangles, BPM from
+	// bpm_min_triangle_pixels_, Direct Mobius from mobius_min_triangle_pixels_, Linear below. Hysteresis is in log2 pixels.
+	bool auto_texture_type_ = false;
+	float bpm_min_triangle_pixels_ = 16.0f;
+	float mobius_min_triangle_pixels_ = 2.0f;
+	static constexpr float kTextureTypeHysteresis = 0.25f;
+	unsigned int num_texture_type_models_[static_cast<int>(TextureType::TYPES_COUNT)] = {}; // last frame
+	ExpMethod exp_method_ = ExpMethod::TAYLOR;
+	static constexpr int kExpTaylorTerms = 10;
+	// Per-triangle BPM data from three fp32 buffers, or from one interleaved record with fp16 log ratios
+	bool packed_bpm_records_ = false;
+	float layout_milliseconds_[2] = {0.0f, 0.0f}; // last smoothed GPU time with split / packed records
+	// Adaptive BPM: triangles whose edge log ratios are all below the tolerance skip the blend and the
+	// matrix exponential, see Mesh::ClassifyTriangles
+	bool adaptive_bpm_ = false;
+	float flat_log_ratio_tolerance_ = 0.02f;
+	float adaptive_milliseconds_[2] = {0.0f, 0.0f}; // last smoothed GPU time of BPM without / with adaptive evaluation
+	unsigned int num_adaptive_flat_faces_ = 0; // last frame, drawn triangles on the flat path
+	unsigned int num_adaptive_faces_ = 0;
+	// BPM data on demand and evicted data (see ModelAsset::RequestBPMData): a new request is handed to
+	// compute_bpm_data_, e.g. a loader thread, and the model is drawn with what it has meanwhile. Without it the
+	// draw updates the asset.
+	std::function<void(std::shared_ptr<ModelAsset>)> compute_bpm_data_;
+	// Chunks of partitioned meshes (see mesh_partition) load as they come into view: every frame, the pending
+	// chunks whose bounding box is in the view frustum go to load_chunk_ and leave the list. The residency
+	// manager evicts loaded chunks out of view.
+	struct PendingChunk {
+		std::string path;
+		glm::vec3 v_min, v_max; // model space
+		float scale;            // placement of the model, see MeshModel::SetScale and SetTranslation
+		glm::vec3 translation;
+	};
+	std::vector<PendingChunk> pending_chunks_;
+	std::function<void(const PendingChunk&)> load_chunk_;
+	ResidencyManager residency_;
+	// Deforming playback (see ModelAsset::BeginDeformation): while deform_models_ is on, every asset in the scene is
+	// twisted around the vertical axis of its bounding box, swinging by up to deform_twist_ radians, and its BPM
+	// data is recomputed on the GPU each frame
+	bool deform_models_ = false;
+	float deform_twist_ = 0.5f;
+	float deform_period_seconds_ = 4.0f;
+	unsigned int num_deforming_assets_ = 0; // last frame
+	double deform_milliseconds_ = 0.0; // smoothed GPU time of the recompute, over the assets
+	static constexpr int kDeformBenchmarkRepetitions = 20;
+	std::vector<std::pair<unsigned int, double>> deform_benchmark_; // triangles, GPU ms of one recompute
+	// The playback target: a recompute of this many triangles per frame of target_frame_milliseconds_.
+	// Estimated from the largest benchmarked mesh, whose time per triangle has the least fixed cost in it.
+	static constexpr unsigned int kDeformTargetTriangles = 500000;
+	double EstimateDeformMilliseconds(unsigned int num_triangles) const; // 0 without a benchmark
+	// OBJ sequences (see ModelAsset::sequence_): while play_sequences_ is on, an asset with a sequence shows the
+	// frame due at sequence_fps_ through the same recompute instead of the twist, or keeps the last one while the
+	// due frame is not read yet
+	bool play_sequences_ = false;
+	float sequence_fps_ = 30.0f;
+	unsigned int num_playing_sequences_ = 0; // last frame
+	unsigned int sequence_stalls_ = 0; // over the sequences, see MeshSequence::GetNumStalls
+	double sequence_read_milliseconds_ = 0.0; // of one frame, over the sequences
+	// Deferred texturing: the fill pass writes only triangle id and barycentrics, then the texture
+	// coordinates are evaluated once per visible pixel, independent of overdraw
+	bool visibility_buffer_ = false;
+	GLuint visibility_fbo_ = 0;
+	GLuint visibility_ids_ = 0, visibility_barycentrics_ = 0, visibility_depth_ = 0; // textures
+	GLuint fullscreen_vao_ = 0;
+	unsigned int visibility_width_ = 0, visibility_height_ = 0;
+	struct VisibilityDraw {
+		Mesh* mesh;
+		TextureType texture_type;
+		bool progressive; // drawn while its BPM data was incomplete
+		unsigned int first_instance; // in visibility_instances_
+	};
+	// by draw id, in the current frame. The visibility buffer keeps 16 bits of the draw id and of the instance.
+	std::vector<VisibilityDraw> visibility_meshes_;
+	std::vector<glm::mat4> visibility_instances_; // model matrices of every draw's instances
+	static constexpr size_t kMaxVisibilityDraws = 0xFFFF;
+	// limits of the resolve's per-mesh slots, queried with the visibility buffer
+	GLint max_fragment_storage_blocks_ = 0, max_storage_bindings_ = 0, max_texture_units_ = 0;
+	static constexpr unsigned int kMaxResolveSlots = 8;
+	unsigned int num_resolve_passes_ = 0; // last frame
+	// Dynamic resolution: the scene is rendered at resolution_scale_ of the window into an offscreen target and
+	// upscaled, the scale follows the GPU time of the scene pass towards target_frame_milliseconds_
+	bool dynamic_resolution_ = false;
+	float target_frame_milliseconds_ = 16.6f;
+	float resolution_scale_ = 1.0f;
+	static constexpr float kMinResolutionScale = 0.25f;
+	static constexpr double kResolutionGain = 0.1;      // fraction of the correction applied per frame, in log scale
+	static constexpr double kResolutionDeadband = 0.05; // relative frame time error that is left alone
+	GLuint scene_fbo_ = 0, scene_color_ = 0, scene_depth_ = 0;
+	unsigned int scene_target_width_ = 0, scene_target_height_ = 0;
+	unsigned int render_width_ = 0, render_height_ = 0; // size of the scene pass in the current frame
+
+	// On-demand rendering: the render thread draws only while NeedsRedraw, otherwise it waits for commands.
+	// Input handlers call RequestRedraw, scene changes are found by Scene::GetChangeStamp.
+	bool render_on_demand_ = true;
+	int frame_cap_ = 60; // frames per second while drawing, 0 for no cap
+	static constexpr int kRedrawFrames = GpuQuery::kNumQueries + 1; // after a change, until the GPU timers and ImGui settle
+	std::atomic<int> redraw_frames_{kRedrawFrames};
+	size_t last_scene_stamp_ = 0;
+	unsigned long long num_frames_drawn_ = 0;
+
+	// Profiling
+	GpuTimer frame_timer_; // GPU time of the scene pass (without UI)
+	GpuQuery fragment_query_{GL_FRAGMENT_SHADER_INVOCATIONS};
+	unsigned int num_drawn_meshlets_ = 0; // last frame, over all models
+	unsigned int num_total_meshlets_ = 0;
+	unsigned int num_drawn_faces_ = 0;
+	unsigned int num_batches_ = 0; // instanced draws of (asset, LOD)
 
 
 
 	// -------- METHODS -------- //
 	// Methods
 	Renderer(Scene* scene);
+	~Renderer(); // with the context current
 	void DrawSetup();
 	void Draw();
-	void DrawModel(MeshModel* model);
+	// Instances of one asset at one LOD. Culled instances are removed, except for the OVERLAYS pass which
+	// expects the instances culled by the VISIBILITY pass.
+	void DrawInstances(std::vector<MeshModel*>& instances, DrawPass pass = DrawPass::ALL);
+	void SetupVisibilityBuffer(); // (re)allocates the visibility buffer at the framebuffer size
+	void ReleaseVisibilityBuffer();
+	void ResolveVisibilityBuffer();
+	unsigned int GetResolveSlots(TextureType texture_type, bool progressive) const; // meshes one resolve pass shades
+	void SetupSceneTarget(); // (re)allocates the dynamic resolution target at the window size
+	void ReleaseSceneTarget();
+	void UpdateResolutionScale();
+	void CullModel(MeshModel* model); // meshlet culling of a single instance
+	void CullInstances(std::vector<MeshModel*>& instances); // drops instances outside the frustum
+	bool IsInFrustum(MeshModel* model); // bounding sphere
+	float ScreenCoverage(MeshModel* model); // projected bounding sphere radius over half the viewport height
+	void SelectLOD(MeshModel* model);
+	void SelectTextureType(MeshModel* model); // sets model->texture_type_, texture_type_ unless automatic
+	TextureType GetDrawnTextureType(MeshModel* model, bool& progressive); // requests the BPM data of model->texture_type_
+	void ComputeBPMData(MeshModel* model); // after a request, see compute_bpm_data_
+	void UpdateDeformations(); // before the draws, outside of the frame timer
+	void LoadChunksInView(); // see pending_chunks_
+	double sequence_seconds_ = 0.0; // playback clock, stands still while play_sequences_ is off
+	float last_deform_seconds_ = 0.0f;
+	// every mesh and LOD, the results are collected into deform_benchmark_ by later frames
+	void BenchmarkDeformation(std::shared_ptr<ModelAsset> asset);
+	struct PendingDeformBenchmark {
+		std::shared_ptr<ModelAsset> asset;
+		Mesh* mesh;
+		unsigned int lod;
+	};
+	std::vector<PendingDeformBenchmark> pending_deform_benchmarks_;
+	void CollectDeformBenchmarks();
 	// Setters
 	void HandleWindowReshape(int new_width, int new_height);
+	void RequestRedraw(); // thread safe. Other threads post a command as well, to wake up the render thread
+	bool NeedsRedraw() const;
 	void SetTextureType(TextureType texture_type);
+	void SetExpMethod(ExpMethod exp_method);
 	void SwitchTextureType(); 
+	// Getters
+	Shader& GetTextureTypeShader(TextureType texture_type, bool visibility_resolve = false, bool wireframe = false, bool points = false,
+	                             bool progressive = false);
+	Shader& GetOverlayShader(bool wireframe, bool points); // wireframe / vertex markers of models drawn without fill
+	Shader& GetNormalsShader();
 	void ToggleDrawVertexNormals();
 	void ToggleDrawFaceNormals();
 };
@@ -0,0 +1,24 @@
+// ResidencyManager.h
+#pragma once
+#include <cstddef>
+
+class Scene;
+
+// Keeps the GPU memory of the scene's assets within a budget, render thread only. When the resident bytes
+// exceed it, the assets drawn least recently give up memory first (hidden models are not drawn), each its
+// larger part first: the BPM buffers, read again from the mesh's BPM store or else computed again, or the
+// geometry and texture, made again from the mesh data and the texture file. A draw that needs them again has
+// them made in the background, see ModelAsset::PrecomputeStep. Out-of-core chunks (see
+// ModelLoadOptions::out_of_core) are evicted whole once they were not drawn for min_idle_frames_, within the
+// budget or not: only the chunks in view stay resident.
+class ResidencyManager {
+public:
+	size_t budget_bytes_ = 0; // no budget when 0
+	unsigned int min_idle_frames_ = 60; // assets drawn within the last frames are kept
+	// last Update
+	size_t resident_bytes_ = 0;
+	unsigned int num_assets_ = 0, num_evicted_assets_ = 0;
+	unsigned long long num_evictions_ = 0; // in total
+
+	void Update(Scene* scene, unsigned long long frame);
+};
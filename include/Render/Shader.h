@@ -9,18 +9,29 @@
 #include <iostream>
 #include <filesystem>
 #include <vector>
+#include <map>
+
+// Compile-time shader variant: NAME -> value, injected as #define lines after #version
+using ShaderDefines = std::map<std::string, std::string>;
 
 std::string getShaderTypeName(GLenum type);
 std::string readShaderFile(const std::string& shaderPath);
 void checkCompileErrors(GLuint shader, GLenum type, const std::string& shader_name = "");
 std::string extractShaderName(const std::string& shaderPath);
+std::string injectShaderDefines(const std::string& shaderCode, const ShaderDefines& defines);
+std::string getShaderVariantName(const std::string& shader_name, const ShaderDefines& defines);
 unsigned int compileShaderProgram(const std::vector<std::string>& shaderPaths, const std::vector<GLenum>& shaderTypes, const std::string& shader_name="");
+unsigned int compileShaderProgramFromSources(const std::vector<std::string>& shaderSources, const std::vector<GLenum>& shaderTypes, const std::string& shader_name="", bool retrievable_binary=false);
+// Program binary cache (glGetProgramBinary / glProgramBinary). Return 0 / false on failure.
+unsigned int loadProgramBinary(const std::string& binaryPath);
+bool saveProgramBinary(GLuint programID, const std::string& binaryPath);
 
 class Shader {
 public:
     unsigned int ID;
     std::string shader_name;
     Shader() {}
+    Shader(unsigned int program_id, const std::string& name) : ID(program_id), shader_name(name) {}
     Shader(const std::vector<std::string>& shaderPaths, const std::vector<GLenum>& shaderTypes) {
         if (shaderPaths.size() != shaderTypes.size()) { std::cerr << "ERROR::SHADER::PATHS_AND_TYPES_SIZE_MISMATCH" << std::endl; return; }
         if (shaderPaths.size() < 1) { std::cerr << "ERROR::SHADER::NO_SHADER_PATHS_PROVIDED" << std::endl; return;  }
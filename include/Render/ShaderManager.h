@@ -1,4 +1,5 @@
 #pragma once
+#include <mutex>
 #include <unordered_map>
 
 #include "Shader.h"
@@ -6,16 +7,56 @@
 
 class Scene;
 class MeshModel;
-class Renderer;
+
+// Stage sources of a program, compiled on first GetShader()
+struct ShaderSource {
+    std::vector<std::string> paths;
+    std::vector<GLenum> types;
+};
 
 class ShaderManager {
 public:
     // -------- MEMBERS -------- //
     // Shaders
-	std::unordered_map<std::string, Shader> shaders_;
-    GLuint UBO_matrices_;
+	std::unordered_map<std::string, Shader> shaders_; // linked programs
+    std::unordered_map<std::string, ShaderSource> shader_sources_; // registered programs
+    // Program binary cache
+    bool binary_cache_enabled_ = false;
+    std::string driver_string_; // GL_VENDOR + GL_RENDERER + GL_VERSION, part of the cache key
+    // Load statistics
+    double shader_load_ms_ = 0.0;
+    unsigned int num_cached_programs_ = 0;
+    unsigned int num_compiled_programs_ = 0;
+    // Uniform state, applied when a program is loaded
+    float normal_scale_ = 1.0f;
+    GLuint UBO_matrices_; // view, projection
+    GLuint SSBO_instances_; // model matrices of the instances in the current draw, indexed by gl_InstanceID
+    static constexpr GLuint kInstancesBinding = 6; // after the per-mesh slots
+    static constexpr GLuint kRecordsBinding = 7; // packed per-triangle BPM records, one binding per mesh slot
+    static constexpr GLuint kResolveVerticesBinding = 9; // vertex and element buffer of a mesh read as storage (normal lines, deform_bpm)
+    static constexpr GLuint kResolveIndicesBinding = 10;
+    static constexpr GLuint kFlatTrianglesBinding = 11; // per-triangle flat flags of adaptive BPM, one binding per mesh slot
+    static constexpr GLuint kNormalLinesBinding = 13; // output of the normal lines compute pass
+    static constexpr GLuint kNormalTransformsBinding = 14;
+    static constexpr GLuint kReadyTrianglesBinding = 15; // per-triangle ready flags of a progressive load, one binding per mesh slot
+    // Per-mesh input table of a compute pass: the neighbor table of neighbors and deform_bpm, the rest vertices of
+    // deform_twist.
+    // One binding for both: each pass binds its table right before its own dispatch, and the draws never read it.
+    static constexpr GLuint kComputeTableBinding = 17;
+    // Visibility resolve: kResolveBufferKinds arrays of blocks, one block per mesh slot of the pass (see
+    // Mesh::BindResolveBuffers), and the slots' textures from kResolveTextureUnit
+    static constexpr GLuint kResolveBinding = 18;
+    static constexpr GLuint kResolveBufferKinds = 8;
+    static constexpr GLuint kResolveTextureUnit = 4;
+    GLuint SSBO_normal_transforms_; // modelview and normal matrix per instance, for the normal lines
     GLuint ssbo_idx_ = 0;
     GLuint ssbo_per_mesh_ = 3;
+    // Per-mesh SSBO binding slots declared by the shaders (NUM_MESH_SLOTS). Buffers are rebound before
+    // every draw/dispatch, so meshes share slots round-robin.
+    GLuint num_mesh_slots_ = 1;
+    // Programs are shared with the loader contexts (see AssetLoader), and so is their uniform state. Loaders
+    // hold this from setting the uniforms of a shared program until its dispatch is flushed.
+    std::mutex shared_program_mutex_;
 
     // -------- METHODS -------- //
     // Setup
@@ -25,21 +66,24 @@ public:
     }
 	ShaderManager(const ShaderManager&) = delete;
     ShaderManager& operator=(const ShaderManager&) = delete;
-    void SetupShaders(Renderer* renderer);
+    void SetupShaders();
+    void RegisterShader(const std::string& shader_name, const std::vector<std::string>& shaderPaths, const std::vector<GLenum>& shaderTypes);
 
 
     // Setters 
     void SetCameraUniforms(Scene* scene);
 
-    void SetModelTransformation(const glm::mat4& model_transform);
+    void SetModelTransformation(const glm::mat4& model_transform) { SetModelTransformations({model_transform}); }
+    void SetModelTransformations(const std::vector<glm::mat4>& model_transforms);
 
-    void SetTextureType(TextureType texture_type);
-    void SetDrawVertexNormals(bool draw_vertex_normals);
-    void SetDrawFaceNormals(bool draw_face_normals);
+    void SetNormalTransformations(const glm::mat4& view, const std::vector<glm::mat4>& model_transforms);
     void SetNormalScale(float normal_scale);
 
     // Getters
     Shader& GetShader(std::string shader_name);
+    Shader& GetShader(const std::string& shader_name, const ShaderDefines& defines); // compile-time variant
+    bool IsShaderLoaded(const std::string& variant_name) const;
+    ShaderDefines GetMeshSlotDefines() const;
 
 
     GLuint linkShaderProgram(GLuint shader);
@@ -48,5 +92,12 @@ public:
 	
 private:
 	ShaderManager() = default;
+    Shader& LoadShader(const std::string& shader_name, const ShaderDefines& defines);
+    void ApplyShaderState(const std::string& shader_name, Shader& shader);
+    std::vector<Shader*> GetLoadedVariants(const std::string& shader_name);
+    std::string GetProgramCachePath(const std::string& shader_name, const std::vector<std::string>& shaderSources, const std::vector<GLenum>& shaderTypes) const;
+    // shaders_ and the SSBO indices: GetShader and AssignSSBOIndex are called by the render and loader threads.
+    // GetLoadedVariants returns pointers, which stay valid as shaders_ grows (nodes are not moved).
+    mutable std::recursive_mutex mutex_;
 	static ShaderManager* instance;
 };
\ No newline at end of file
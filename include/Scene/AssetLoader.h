@@ -0,0 +1,65 @@
+// AssetLoader.h
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Utils/Constants.h"
+#include "Scene/ModelAsset.h"
+
+// Loads model assets (parse, LODs, texture and buffer upload) and updates them (BPM data, evicted data) on
+// worker threads. Every worker has a hidden window whose GL context shares objects with the main window, so
+// the finished buffers and textures are used by the render thread as they are. Files with the same content
+// that are loading at the same time are loaded once. An update runs ModelAsset::PrecomputeStep until the asset
+// has what was requested, see ModelAsset::RequestBPMData.
+class AssetLoader {
+public:
+	using OnLoaded = std::function<void(std::shared_ptr<ModelAsset>)>; // called on the worker thread
+
+	static constexpr unsigned int kDefaultNumWorkers = 2;
+
+	// Main thread, with the GLFW hints of the main window still set. Shaders must be registered before the first Load.
+	AssetLoader(GLFWwindow* shared_window, unsigned int num_workers = kDefaultNumWorkers);
+	~AssetLoader(); // main thread, waits for the loads in progress and drops the queued ones
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	// Any thread. A load that fails is reported on std::cerr and on_loaded is not called.
+	void Load(const std::string& path, const ModelLoadOptions& load_options, OnLoaded on_loaded);
+	// Any thread. on_progress is called after every step, and once more with the worker's last reference to the
+	// asset when it is done, so that the asset is released where it is used.
+	void Update(std::shared_ptr<ModelAsset> asset, OnLoaded on_progress);
+	unsigned int GetNumPending() const { return num_pending_.load(); } // queued or loading
+	unsigned int GetNumPendingUpdates() const { return num_pending_updates_.load(); }
+
+private:
+	struct Job {
+		std::string path;
+		ModelLoadOptions load_options;
+		OnLoaded on_loaded;
+		std::shared_ptr<ModelAsset> asset; // set for updates
+		OnLoaded on_progress;
+	};
+	void WorkerLoop(GLFWwindow* context);
+	std::shared_ptr<ModelAsset> LoadAsset(const Job& job); // nullptr if it failed
+	bool IsStopping();
+
+	std::vector<GLFWwindow*> contexts_;
+	std::vector<std::thread> workers_;
+	std::mutex mutex_;
+	std::condition_variable jobs_condition_;
+	std::deque<Job> jobs_;
+	bool stopping_ = false;
+	std::unordered_map<size_t, std::shared_future<std::shared_ptr<ModelAsset>>> loading_; // by ModelAsset::content_hash_
+	std::atomic<unsigned int> num_pending_{0};
+	std::atomic<unsigned int> num_pending_updates_{0};
+};
@@ -58,6 +58,7 @@ public:
 	// Options
 	float movement_speed;
 	float sensitivity_;
+	unsigned int version_ = 0; // incremented on every view or projection change, see Scene::GetChangeStamp
 
 	// ----- Construction ----- //
 	Camera(float aspect, glm::vec3 eye = DEFAULT_EYE, glm::vec3 at = DEFAULT_AT, glm::vec3 up = DEFAULT_UP);
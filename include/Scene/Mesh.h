@@ -1,25 +1,24 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "Utils/Constants.h"
+#include "BPM/Precompute.h"
+#include "Scene/MeshOptimizer.h"
+#include "Scene/Vertex.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 
 
 class ShaderManager;
-class MeshModel;
+class ModelAsset;
 class Shader;
 
-struct Vertex {
-    glm::vec3 position_;
-    glm::vec3 normal_;
-    glm::vec2 tex_coords_;
-};
-
-
 class Mesh {
 public:
     // ------------ MEMBERS ------------ //
@@ -28,24 +27,194 @@ public:
     std::vector<unsigned int> indices_;
     unsigned int              texture_id_;
     std::vector<glm::vec3>    face_normals_;
-    MeshModel* parent_mesh_model_;
+    ModelAsset* parent_asset_;
     unsigned int num_faces_;
+    // Out-of-core chunks (see mesh_partition): the last triangles are the boundary ring of the chunk, neighbors
+    // for the BPM data of the others only, they are not drawn
+    unsigned int num_ring_faces_ = 0;
+    unsigned int GetNumDrawnFaces() const { return num_faces_ - num_ring_faces_; }
     unsigned int ssbo_idx_;
-    unsigned int VAO, VBO; // every mesh has its own VAO, VBO, EBO
+    unsigned int VAO = 0, VBO = 0, EBO = 0; // every mesh has its own VAO, VBO, EBO. The VAO is made on first bind
     // Mobius
-    GLuint transSSBO, mobiusSSBO, ratiosSSBO; // SSBO for mobius coefficients
+    GLuint transSSBO = 0, mobiusSSBO = 0, ratiosSSBO = 0; // SSBO for mobius coefficients
+    // The same data interleaved per triangle, with fp16 log ratios (PACKED_RECORDS shaders). Made only while the
+    // packed layout is in use: SetPackedRecords, render thread, before the mesh's BPM buffers are bound.
+    GLuint recordsSSBO = 0;
+    void SetPackedRecords(bool packed);
+    float record_max_uv_error_ = 0.0f; // of the fp16 log ratios, in texture coordinates
+    float split_bytes_per_triangle_ = 0.0f;
+    float packed_bytes_per_triangle_ = 0.0f;
 
     ShaderManager& shader_manager_;
 
     // ------------ METHODS ------------ //
     
     // Setup
-    Mesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, unsigned int texture_id, std::vector<glm::vec3>& face_normals, MeshModel* parent);
+    Mesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, unsigned int texture_id, std::vector<glm::vec3>& face_normals, ModelAsset* parent);
     ~Mesh();
     void InitBuffers();
+    void UploadGeometry(); // VBO and EBO from vertices_ and indices_
     void BindDataBuffers();
     void BindTextures(Shader& shader);
+    void BindResolveBuffers(unsigned int slot, unsigned int num_slots) const; // geometry, BPM data and texture
+    void Draw(GLsizei instance_count = 1); // meshlet culling applies to single instances only
+
+    // Load-time optimization: spatial (Morton) + vertex-cache (Tipsify) triangle order. Must run before
+    // InitBuffers / ComputeBPMData so that all per-triangle BPM data is computed in the new order.
+    void ReorderTriangles();
+    float acmr_before_reorder_ = 0.0f;
+    float acmr_ = 0.0f;
+    std::vector<unsigned int> source_vertices_; // OBJ vertex of each vertex after ReorderTriangles, empty before
+
+    // Meshlets: built in InitBuffers from the final triangle order. CullMeshlets writes the visible ranges
+    // to an indirect buffer which Draw uses until ResetCulling.
+    std::vector<mesh_optimizer::Meshlet> meshlets_;
+    GLuint indirectBO = 0;
+    void CullMeshlets(const glm::mat4& model_view_projection, const glm::vec3& eye_local, bool cull_backfacing);
+    void ResetCulling();
+    unsigned int num_visible_meshlets_ = 0;
+    unsigned int num_visible_faces_ = 0;
+
+    // Normal lines: built once by a compute pass on first use, face lines then vertex lines
+    GLuint normalLinesVAO = 0, normalLinesVBO = 0;
+    void BuildNormalLines();
+    void DrawNormalLines(Shader& shader, bool face_normals, bool vertex_normals, GLsizei instance_count = 1);
+
+    // BPM. The per-triangle data is made on demand, one level at a time, and computed in chunks: BeginPrecompute
+    // allocates the buffers of the level and every PrecomputeChunk fills the next triangles and sets their ready
+    // bits. A mesh whose level is incomplete can be drawn between chunks, triangles without the ready bit are
+    // textured linearly (PROGRESSIVE_BPM shaders).
+    static BPMData GetRequiredBPMData(TextureType texture_type);
+    void ComputeBPMData(BPMData level); // all triangles at once
+    void BeginPrecompute(BPMData level);
+    unsigned int PrecomputeChunk(unsigned int max_triangles); // returns the number of triangles computed
+    unsigned int GetPrecomputeChunkSize() const;
+    BPMData GetBPMData() const { return bpm_data_.load(std::memory_order_acquire); }
+    BPMData GetPrecomputeLevel() const { return precompute_level_.load(std::memory_order_acquire); }
+    bool HasBPMData(BPMData level) const { return GetBPMData() >= level; }
+    // the triangles [0, num_ready_faces_) have it, the others are being computed
+    bool IsComputingBPMData(BPMData level) const { return GetPrecomputeLevel() >= level; }
+    // until the last chunk is published, thread of the precompute only
+    bool IsPrecomputing() const { return precompute_ != nullptr || ready_fence_ != nullptr; }
+    // triangles of one neighbors dispatch, which reads their neighbors from a table: bounds the flattened buffer
+    static constexpr unsigned int kPrecomputeChunkSize = 1u << 16;
+    std::atomic<unsigned int> num_ready_faces_{0}; // of the level being computed, published after the chunk's GPU work
+    GLuint readySSBO = 0; // one bit per triangle
+
+    // Residency (see ResidencyManager), render thread, while no precompute runs. EvictBPMData deletes the BPM
+    // buffers and the mesh is drawn as if it had none, until BeginPrecompute reads them from the BPM store, or
+    // computes them again without one. EvictGeometry deletes the vertex, index and normal line buffers,
+    // UploadGeometry makes them again.
+    size_t GetBPMDataBytes() const;
+    size_t GetGeometryBytes() const;
+    size_t EvictBPMData(); // returns the bytes freed
+    size_t EvictGeometry();
+    // On-disk per-triangle store: a mesh with a store writes every finished level to it and reads evicted
+    // data back from the file, in this run or a later one. OpenBPMStore takes an existing store whose key and
+    // triangle count match as evicted data, so it is read instead of computed.
+    void OpenBPMStore(const std::string& path, size_t key);
+    void ReleaseMeshData(); // drops the CPU geometry of an evicted mesh, the owner parses it again
+
+    // Edits of a few vertices, render thread, while no precompute runs. vertex_ids are OBJ vertices (0-based, in
+    // the order of the v lines, see source_vertices_): a new position or texture coordinate goes to every vertex
+    // made from the OBJ vertex, so the surface stays closed where it has several. The changed vertices are
+    // uploaded and the triangles around them get new face normals, meshlet bounds and BPM data of the current
+    // level, computed on the CPU and written to the changed ranges of the buffers. An empty positions or
+    // tex_coords is left as it is. Vertex normals are kept. Returns false if nothing was changed. The asset must
+    // be loaded with ModelLoadOptions::incremental_edits, which keeps log_ratios_ and record_uv_error_.
+    bool UpdateVertices(const std::vector<unsigned int>& vertex_ids, const std::vector<glm::vec3>& positions,
+                        const std::vector<glm::vec2>& tex_coords);
+
+    // Deforming playback, render thread: topology and texture coordinates stay, the positions change every frame.
+    // BeginDeformation replaces the BPM data by buffers the deform_bpm compute pass fills on the GPU from the
+    // current positions, with a log ratio pair per triangle edge. The pass writes a second set of vertex and BPM
+    // buffers while the first one is drawn, UpdateDeformation swaps them once the pass is done and starts the
+    // next one with the latest SetDeformedPositions, or with the rest positions twisted on the GPU after
+    // SetDeformTwist. EndDeformation goes back to the rest positions, without BPM data. Meshlet culling and
+    // UpdateVertices are off meanwhile.
+    bool BeginDeformation();
+    void EndDeformation();
+    bool IsDeforming() const { return deform_ != nullptr; }
+    // per vertex, the normals are kept if normals is empty
+    void SetDeformedPositions(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals = {});
+    void SetDeformTwist(float angle, const glm::vec3& center, float height); // around the vertical axis through center
+    bool UpdateDeformation(); // returns true when new data was swapped in
+    double GetDeformMilliseconds() const; // smoothed GPU time of the pass
+    // GPU time of the pass, with buffers of its own: the result is polled on later frames, GetDeformationBenchmark
+    // returns the ms of one pass once the timer query is done, a negative value before and 0 without a benchmark
+    bool BeginDeformationBenchmark(int repetitions);
+    double GetDeformationBenchmark();
+
+    // Adaptive evaluation (ADAPTIVE_BPM shaders): one bit per triangle, set when the magnitudes of its three
+    // edge log ratios are below the tolerance. Flagged triangles use their own Mobius map without the blend.
+    void ClassifyTriangles(float tolerance);
+    GLuint flatSSBO = 0;
+    std::vector<float> max_log_ratio_;   // per triangle, max |mu| of its edges
+    std::vector<float> flat_uv_error_;   // per triangle, texture coordinate deviation of the direct Mobius map from BPM
+    float classified_tolerance_ = -1.0f; // tolerance of the current flags, negative before the first classification
+    unsigned int num_flat_faces_ = 0;
+    float flat_max_uv_error_ = 0.0f;     // over the flagged triangles
+
+private:
+    void SetupVertexArray();
+    void FinishPrecompute();
+    void BuildRecords(); // from the split buffers of a finished BPMData::FULL
+    std::atomic<bool> packed_records_{false}; // read by the precompute as it begins
+
+    struct PrecomputeState; // intermediate buffers and CPU state between chunks
+    std::unique_ptr<PrecomputeState> precompute_;
+    // GPU work of the last chunk: PrecomputeChunk publishes num_ready_faces_, and bpm_data_ after the last chunk,
+    // once it is done, without waiting for it while there are triangles left to compute
+    GLsync ready_fence_ = nullptr;
+    unsigned int fenced_faces_ = 0;
+    void PublishReadyFaces(bool wait);
+    std::vector<GLuint> ComputeThirdVertices(); // per triangle edge, the other vertex of its neighbor, ~0u on the boundary
+    std::atomic<BPMData> bpm_data_{BPMData::NONE};         // complete level
+    std::atomic<BPMData> precompute_level_{BPMData::NONE}; // level of the last BeginPrecompute
+    // Compacted log ratios of a finished precompute, swapped in by BindDataBuffers. Written by the precompute
+    // thread together with record_max_uv_error_, split_bytes_per_triangle_ and max_log_ratio_, before the
+    // release store of bpm_data_: other threads read them only after HasBPMData(BPMData::FULL).
+    GLuint final_ratiosSSBO_ = 0;
+    size_t ratios_bytes_ = 0;
+
+    // CPU state of UpdateVertices
+    std::vector<unsigned int> vertex_face_offsets_, vertex_faces_; // vertex -> triangles (CSR), built on first use
+    std::vector<unsigned int> source_copy_offsets_, source_copies_; // OBJ vertex -> its vertices (CSR), built on first use
+    std::vector<GLuint> log_ratios_; // contents of the ratios buffer of BPMData::FULL, which may be larger
+    std::vector<GLuint> free_ratio_pairs_; // offsets of the pairs in log_ratios_ no edge uses since an edit
+    std::vector<float> record_uv_error_; // per triangle, of the packed records, for record_max_uv_error_
+    std::vector<GLuint> flat_bits_;  // contents of flatSSBO
+    bool IsEditable() const;
+    void BuildVertexFaces();
+    void BuildSourceCopies();
+    int GetEdgeNeighbor(unsigned int face, int edge) const;
+
+    struct DeformState; // the second buffer set and the adjacency of the deform_bpm pass
+    std::unique_ptr<DeformState> deform_;
+    struct DeformBuffers;
+    std::unique_ptr<DeformState> MakeDeformState();
+    void AllocateDeformBuffers(DeformBuffers& buffers) const;
+    void DispatchDeformation(const DeformBuffers& buffers, GLuint adjacency);
+    struct DeformBenchmark;
+    std::unique_ptr<DeformBenchmark> deform_benchmark_;
+
+    struct EvictedBPMData; // level in the store, and its contents while they are read back
+    std::unique_ptr<EvictedBPMData> evicted_;
+    bool RestoreBPMData(); // false if the store could not be read, then the level is computed again
+    std::string bpm_store_path_;
+    size_t bpm_store_key_ = 0;
+    BPMData bpm_store_level_ = BPMData::NONE; // in the file
+    void WriteBPMStore();
+    bool ReadBPMStore(EvictedBPMData& evicted);
 
-    // BPM
-    void NeighborsComputeShader();
+    // layout of glDrawElementsIndirect commands
+    struct DrawElementsCommand {
+        GLuint count;
+        GLuint instance_count;
+        GLuint first_index;
+        GLint  base_vertex;
+        GLuint base_instance; // first triangle of the range, used by the shaders for the triangle id
+    };
+    std::vector<DrawElementsCommand> draw_commands_;
+    bool use_draw_commands_ = false;
 };
\ No newline at end of file
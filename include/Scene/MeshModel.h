@@ -1,39 +1,31 @@
 #pragma once
 
 #include <string>
-#include <map>
 #include <vector>
 #include <memory>
 
 #include <glad/glad.h>
 
-#include "Mesh.h"
+#include "ModelAsset.h"
 #include "Utils/Geometry.h"
 #include "Utils/Constants.h"
 #include "Render/ShaderManager.h"
 
 class Renderer;
 
-unsigned int TextureFromFile(const std::string &texture_path);
+// One placement of a ModelAsset: transform, rendering flags and LOD state. Instances of the same asset
+// share all geometry and BPM buffers and are drawn together (see Renderer::Draw).
 class MeshModel{
 public:
-    // model data
-    std::vector<std::unique_ptr<Mesh>> meshes_;
-    std::string directory_;
+    std::shared_ptr<ModelAsset> asset_;
     std::string model_name_;
 
-    geometry::BoundingBox bbox_;
-    
-
     // Model Transformations
     glm::mat4 model_transform_ = glm::mat4(1.0f);
 	glm::vec3 model_translation_ = glm::vec3(0, 0, 0);
 	glm::vec3 model_pitch_yaw_roll_ = glm::vec3(0, 0, 0);
 	float model_scale_ = 1.0f;
 
-    // buffers and shaders
-    unsigned int bbox_VAO_, bbox_VBO_, bbox_EBO_;
-
     // rendering flags
     bool should_draw_ = true;
     bool draw_fill_ = true;
@@ -42,19 +34,27 @@ public:
     bool draw_bbox_ = false;
     bool draw_normals_ = true;
 
+    unsigned int version_ = 0; // incremented on every transformation change, see Scene::GetChangeStamp
+
+    // The renderer picks lod_ from the projected bounding box, forced_lod_ >= 0 overrides it
+    unsigned int lod_ = 0;
+    int forced_lod_ = -1;
+    // Texture type of the model's draws, the renderer's global type unless it selects one per model
+    TextureType texture_type_ = TextureType::BPM;
+    float triangle_pixels_ = 0.0f; // average screen area of a front-facing triangle, last frame
+
     ShaderManager& shader_manager_;
 
     // Setup
-    MeshModel();
-    explicit MeshModel(const std::string& path);
-    ~MeshModel();
+    MeshModel(std::shared_ptr<ModelAsset> asset, const std::string& model_name);
 
     // Getters
-    std::vector<std::unique_ptr<Mesh>>& GetMeshes();
-
-    // Load model from file
-    void GetModelName(const std::string& path);
-    void LoadModel(const std::string& path);
+    ModelAsset* GetAsset() const { return asset_.get(); }
+    const geometry::BoundingBox& GetBBox() const { return asset_->bbox_; }
+    std::vector<std::unique_ptr<Mesh>>& GetMeshes() { return asset_->GetMeshes(); }
+    std::vector<std::unique_ptr<Mesh>>& GetLODMeshes(unsigned int lod) { return asset_->GetLODMeshes(lod); }
+    std::vector<std::unique_ptr<Mesh>>& GetDrawnMeshes() { return asset_->GetLODMeshes(lod_); }
+    unsigned int GetNumLODs() const { return asset_->GetNumLODs(); }
 
     // Model Transformations
     void CenterModel();
@@ -70,9 +70,5 @@ public:
 	glm::vec3 GetRotation() const { return model_pitch_yaw_roll_;}
 	float GetScale() const { return model_scale_; }
     void ResetModelTransformation();
-
-    // Utils
-    void SetupBBOX();
-    void Normalize_UV(const glm::vec2& vt_min, float vt_max_delta);
 };
 
@@ -0,0 +1,107 @@
+// MeshOptimizer.h
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Load-time triangle reordering for vertex-cache and per-triangle buffer locality.
+// All orders are "new position -> old triangle index".
+namespace mesh_optimizer {
+	constexpr unsigned int kVertexCacheSize = 16;
+
+	// 30-bit Morton code of a point in [0,1]^3, 10 bits per axis
+	uint32_t MortonCode(const glm::vec3& p);
+
+	// Triangles sorted by the Morton code of their centroid (spatially coherent order)
+	std::vector<unsigned int> MortonTriangleOrder(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
+
+	// Tipsify (Sander et al. 2007) vertex-cache optimization. Dead ends restart from the earliest
+	// unemitted triangle of the input order, so a Morton-sorted input keeps its spatial coherence.
+	std::vector<unsigned int> TipsifyTriangleOrder(const std::vector<unsigned int>& indices, size_t num_vertices, unsigned int cache_size = kVertexCacheSize);
+
+	// Average cache miss ratio (transformed vertices per triangle) of a FIFO post-transform cache
+	float ComputeACMR(const std::vector<unsigned int>& indices, size_t num_vertices, unsigned int cache_size = kVertexCacheSize);
+
+	// Vertices renumbered in order of first use, "new vertex index -> old vertex index". Remaps indices in place.
+	std::vector<unsigned int> FirstUseVertexOrder(std::vector<unsigned int>& indices, size_t num_vertices);
+
+	// ---- Meshlets ---- //
+	constexpr unsigned int kMaxMeshletTriangles = 124;
+	constexpr unsigned int kMaxMeshletVertices = 64;
+
+	// A contiguous range of triangles, so that a meshlet is a range of the element buffer
+	struct Meshlet {
+		unsigned int first_triangle;
+		unsigned int triangle_count;
+		glm::vec3 center; // bounding sphere
+		float radius;
+		glm::vec3 cone_axis; // normal cone
+		float cone_cutoff; // sin of the cone half angle, 1 if the cone cannot be culled
+	};
+
+	// Greedy partition of the triangle order into meshlets. Works best after triangle reordering.
+	std::vector<Meshlet> BuildMeshlets(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+	                                   const std::vector<glm::vec3>& face_normals);
+
+	// Bounding sphere and normal cone of the meshlet's triangles, position_of(vertex index) is the vertex position
+	template <typename PositionOf>
+	void ComputeMeshletBounds(Meshlet& meshlet, PositionOf position_of, const std::vector<unsigned int>& indices,
+	                          const std::vector<glm::vec3>& face_normals) {
+		unsigned int first = meshlet.first_triangle, end = meshlet.first_triangle + meshlet.triangle_count;
+		// bounding sphere around the box center
+		glm::vec3 b_min(FLT_MAX), b_max(-FLT_MAX);
+		for (unsigned int f = first; f < end; ++f) {
+			for (int k = 0; k < 3; ++k) {
+				b_min = glm::min(b_min, position_of(indices[3 * f + k]));
+				b_max = glm::max(b_max, position_of(indices[3 * f + k]));
+			}
+		}
+		meshlet.center = 0.5f * (b_min + b_max);
+		meshlet.radius = 0.0f;
+		for (unsigned int f = first; f < end; ++f) {
+			for (int k = 0; k < 3; ++k) {
+				meshlet.radius = std::max(meshlet.radius, glm::length(position_of(indices[3 * f + k]) - meshlet.center));
+			}
+		}
+		// normal cone, degenerate triangles are skipped
+		meshlet.cone_axis = glm::vec3(0.0f);
+		meshlet.cone_cutoff = 1.0f;
+		glm::vec3 normal_sum(0.0f);
+		for (unsigned int f = first; f < end; ++f) {
+			if (std::isfinite(face_normals[f].x)) normal_sum += face_normals[f];
+		}
+		if (glm::length(normal_sum) > 1e-6f) {
+			meshlet.cone_axis = glm::normalize(normal_sum);
+			float min_dot = 1.0f;
+			for (unsigned int f = first; f < end; ++f) {
+				if (std::isfinite(face_normals[f].x)) min_dot = std::min(min_dot, glm::dot(meshlet.cone_axis, face_normals[f]));
+			}
+			// cones wider than a half space cannot be backface culled
+			meshlet.cone_cutoff = (min_dot <= 0.0f) ? 1.0f : std::sqrt(1.0f - min_dot * min_dot);
+		}
+	}
+
+	// View frustum planes (ax+by+cz+d >= 0 inside, normalized) of a model-view-projection matrix
+	void ExtractFrustumPlanes(const glm::mat4& mvp, glm::vec4 planes[6]);
+	bool IsSphereInFrustum(const glm::vec3& center, float radius, const glm::vec4 planes[6]);
+	bool IsMeshletInFrustum(const Meshlet& meshlet, const glm::vec4 planes[6]);
+	// True if every triangle of the meshlet faces away from eye (all in the meshlet's local space)
+	bool IsMeshletBackfacing(const Meshlet& meshlet, const glm::vec3& eye);
+
+	// Reorder a per-triangle array (stride elements per triangle) by a triangle order
+	template <typename T>
+	void PermuteTriangles(std::vector<T>& data, const std::vector<unsigned int>& order, size_t stride = 1) {
+		std::vector<T> permuted;
+		permuted.reserve(data.size());
+		for (unsigned int old_idx : order) {
+			for (size_t k = 0; k < stride; ++k) {
+				permuted.push_back(data[stride * old_idx + k]);
+			}
+		}
+		data.swap(permuted);
+	}
+} // namespace mesh_optimizer
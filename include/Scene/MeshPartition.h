@@ -0,0 +1,44 @@
+// MeshPartition.h
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Out-of-core preparation of meshes too large to parse or precompute at once. PartitionObjFile streams an OBJ
+// through temporary files and writes it as chunk OBJs of about max_chunk_triangles triangles each. A chunk is a
+// range of Morton cells of the triangle centroids, so it is spatially compact. Its file has the triangles in
+// Morton + Tipsify order, then its boundary ring: the triangles of other chunks that share a vertex with it, in
+// the kBoundaryRingGroup group (see Parser.h). The ring gives the BPM precompute of the chunk the neighbors
+// across its boundary, so that the chunk's data is that of the whole mesh, and it is not drawn. The faces and
+// the vertex attributes stay on disk and meet through temporary files bucketed by vertex and by face, so memory
+// is one chunk plus one bucket, independent of the size of the OBJ.
+namespace mesh_partition {
+	// A chunk without a .bpm store is precomputed when it comes into view, in time linear in its triangles and
+	// ring: the neighbors pass reads a neighbor table built from the chunk's vertex -> triangles table (see
+	// Mesh::BeginPrecompute). bpm_precompute makes the stores of a chunk directory ahead of time on the CPU.
+	constexpr unsigned int kDefaultChunkTriangles = 1u << 20;
+	constexpr const char* kManifestExtension = ".chunks";
+
+	struct Chunk {
+		std::string path;
+		unsigned int num_faces = 0; // drawn, without the ring
+		unsigned int num_ring_faces = 0;
+		glm::vec3 v_min = glm::vec3(0.0f), v_max = glm::vec3(0.0f); // of the drawn triangles, for loading the chunks in view
+	};
+
+	// Text file in the directory of the chunks: the source, the chunk size, its bounding box, a line per chunk
+	// with its bounding box. ReadManifest fails on a manifest of an older format, which has no chunk bounds.
+	struct Manifest {
+		std::string source_path;
+		unsigned int max_chunk_triangles = 0;
+		glm::vec3 v_min = glm::vec3(0.0f), v_max = glm::vec3(0.0f); // of the whole mesh, the chunks are placed by it
+		std::vector<Chunk> chunks;
+	};
+
+	// Writes the chunks and the manifest to the directory of manifest_path. Returns false on a read or write error.
+	bool PartitionObjFile(const std::string& obj_path, const std::string& manifest_path, unsigned int max_chunk_triangles, Manifest& manifest);
+	bool ReadManifest(const std::string& manifest_path, Manifest& manifest);
+	// <name>_chunks/<name>.chunks next to the OBJ, partitioned again when it is older than the OBJ or of another chunk size
+	bool LoadOrPartition(const std::string& obj_path, unsigned int max_chunk_triangles, Manifest& manifest);
+} // namespace mesh_partition
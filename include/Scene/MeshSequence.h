@@ -0,0 +1,89 @@
+// MeshSequence.h
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class Mesh;
+
+// Playback of numbered OBJ frames (frame_0001.obj, frame_0002.obj, ...) with the connectivity and texture
+// coordinates of the first one, which is loaded as a regular asset. The other frames only bring positions:
+// worker threads read them ahead of the playback into a ring of kRingSize frames, from a binary positions
+// file next to the OBJ when there is one, else by a positions-only parse, which writes that file if
+// write_positions_files is set. The positions are put in the vertex order of the mesh (see
+// Mesh::ReorderTriangles) on the workers as well, which also compute the vertex normals and the bounds of the
+// frame, so the render thread only hands them to Mesh::SetDeformedPositions and ModelAsset::SetBBox.
+class MeshSequence {
+public:
+	static constexpr unsigned int kDefaultNumWorkers = 2;
+	static constexpr size_t kRingSize = 8;
+	static constexpr const char* kPositionsExtension = ".pos";
+
+	// The first frame and the ones numbered after it, up to the first missing number. A single path if the
+	// name does not end in a number.
+	static std::vector<std::string> FindFrames(const std::string& first_frame_path);
+
+	MeshSequence(std::vector<std::string> frame_paths, const Mesh& mesh, bool write_positions_files,
+	             unsigned int num_workers = kDefaultNumWorkers);
+	~MeshSequence(); // waits for the frames being read
+	MeshSequence(const MeshSequence&) = delete;
+	MeshSequence& operator=(const MeshSequence&) = delete;
+
+	size_t GetNumFrames() const { return frame_paths_.size(); }
+
+	// Render thread. Moves the prefetch window to start at frame and, if the frame has been read, makes it the
+	// shown frame and returns true, its positions are then in GetPositions. A frame that could not be read is
+	// shown with the positions of the one before, it returns false.
+	bool AcquireFrame(size_t frame);
+	size_t GetShownFrame() const { return shown_frame_; } // frame 0, the rest positions of the mesh, at first
+	const std::vector<glm::vec3>& GetPositions() const { return positions_; }
+	const std::vector<glm::vec3>& GetNormals() const { return normals_; } // area weighted, per vertex
+	const glm::vec3& GetMin() const { return v_min_; }
+	const glm::vec3& GetMax() const { return v_max_; }
+	unsigned int GetNumStalls() const { return num_stalls_; } // acquisitions of a frame that was not read yet
+
+	double GetReadMilliseconds() const { return read_milliseconds_.load(); } // smoothed, per frame and worker
+	size_t GetNumReadyFrames();
+
+private:
+	enum class SlotState { EMPTY, READING, READY, FAILED };
+	struct Frame {
+		std::vector<glm::vec3> positions, normals;
+		glm::vec3 v_min, v_max;
+		void Swap(Frame& other);
+	};
+	struct Slot {
+		size_t frame = 0;
+		SlotState state = SlotState::EMPTY;
+		Frame data;
+	};
+	void WorkerLoop();
+	bool IsInWindow(size_t frame) const; // mutex_ held
+	Slot* ClaimSlot(size_t& frame);      // mutex_ held, the first frame of the window that has no slot
+	void ReadFrame(size_t frame, std::vector<glm::vec3>& read, Frame& data);
+
+	std::vector<std::string> frame_paths_;
+	size_t num_vertices_;
+	std::vector<unsigned int> source_vertices_; // see Mesh::source_vertices_
+	std::vector<unsigned int> indices_;         // of the mesh, for the normals
+	bool write_positions_files_;
+	size_t shown_frame_ = 0;
+	std::vector<glm::vec3> positions_, normals_; // of the shown frame
+	glm::vec3 v_min_, v_max_;
+	unsigned int num_stalls_ = 0;
+
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	std::vector<Slot> slots_;
+	size_t window_begin_ = 1; // frames [window_begin_, window_begin_ + kRingSize), modulo the frame count
+	bool stopping_ = false;
+	std::vector<std::thread> workers_;
+	std::atomic<double> read_milliseconds_{0.0};
+};
@@ -0,0 +1,32 @@
+// MeshSimplifier.h
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Quadric error (Garland-Heckbert) decimation by half-edge collapses. A collapse moves a vertex onto a
+// neighbor, so the surviving vertices keep their original positions and texture coordinates exactly.
+// Boundary and non-manifold vertices are locked, and so are UV seam vertices: the parser keeps one vertex
+// per position, so a seam is found from the texture coordinate indices of the face corners. This keeps
+// seams (and the BPM flattening along them) intact.
+namespace mesh_simplifier {
+	struct SimplifyOptions {
+		float target_ratio = 0.5f; // fraction of the input triangles to keep
+		// A new triangle may not stretch its UV-to-surface area ratio by more than this factor from the
+		// mesh average, unless the triangle it replaces was already worse
+		float max_uv_stretch = 2.0f;
+		float min_normal_dot = 0.2f; // collapses may not turn a triangle further than this
+	};
+
+	struct SimplifiedMesh {
+		std::vector<unsigned int> vertex_order; // "new vertex index -> old vertex index"
+		std::vector<unsigned int> indices; // into the new vertices
+		float max_error = 0.0f; // largest collapse error, approximately a distance in model units
+	};
+
+	// Triangle order of the survivors follows the input order. corner_tex_coords: "vt" index per index (see
+	// ParseObjFile), empty if the texture coordinates are per vertex.
+	SimplifiedMesh Simplify(const std::vector<glm::vec3>& positions, const std::vector<glm::vec2>& tex_coords,
+	                        const std::vector<unsigned int>& indices, const std::vector<unsigned int>& corner_tex_coords,
+	                        const SimplifyOptions& options = SimplifyOptions());
+} // namespace mesh_simplifier
@@ -0,0 +1,139 @@
+// ModelAsset.h
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "Mesh.h"
+#include "MeshSequence.h"
+#include "Utils/Geometry.h"
+
+// A GL texture of an image file, shared by the assets that use the file (see TextureFromFile) and deleted
+// with the last of them
+struct SharedTexture {
+    unsigned int id = 0;
+    size_t bytes = 0; // of the internal format the driver chose, with mipmaps
+    ~SharedTexture();
+};
+// From the cache while an asset holds the texture of the same file, else loaded. Any thread with a GL context.
+std::shared_ptr<SharedTexture> TextureFromFile(const std::string &texture_path);
+
+// Optional load-time processing
+struct ModelLoadOptions {
+    bool reorder_triangles = false; // Morton + Tipsify triangle order, see Mesh::ReorderTriangles
+    unsigned int num_lods = 1; // levels of detail including the full mesh, each halves the triangle count
+    bool progressive_bpm = false; // BPM data being computed is drawn per ready triangle, else after the whole level
+    // A chunk of a partitioned mesh (see mesh_partition), in its final triangle order and without LODs. Its BPM
+    // data goes to an on-disk store next to the file, and its CPU mesh data is dropped with the geometry.
+    bool out_of_core = false;
+    // Keeps the CPU state of ModelAsset::UpdateVertices (log ratio layout, record errors) after the precompute,
+    // without it the BPM data can not be edited
+    bool incremental_edits = false;
+};
+
+// Geometry, texture and BPM buffers of one loaded OBJ. Shared by every MeshModel instance of the same
+// file content (see Scene::AddModel), so the parse, upload and BPM precompute happen once per asset.
+class ModelAsset {
+public:
+    std::vector<std::unique_ptr<Mesh>> meshes_;
+    // Levels of detail: lods_[i] is a decimated copy of meshes_ with its own BPM data (LOD i+1)
+    std::vector<std::vector<std::unique_ptr<Mesh>>> lods_;
+    std::vector<float> lod_errors_; // largest decimation error of each LOD, model units
+    std::string directory_;
+    std::string model_name_;
+    size_t content_hash_ = 0;
+
+    geometry::BoundingBox bbox_;
+    unsigned int bbox_VAO_ = 0, bbox_VBO_, bbox_EBO_;
+
+    ModelLoadOptions load_options_;
+
+    ModelAsset(const std::string& path, const ModelLoadOptions& load_options, size_t content_hash);
+    ~ModelAsset();
+    ModelAsset(const ModelAsset&) = delete;
+    ModelAsset& operator=(const ModelAsset&) = delete;
+
+    // Key for deduplication: hash of the OBJ, .mtl and texture contents and the load options
+    static size_t ComputeContentHash(const std::string& path, const ModelLoadOptions& load_options);
+
+    // Getters
+    std::vector<std::unique_ptr<Mesh>>& GetMeshes() { return meshes_; }
+    std::vector<std::unique_ptr<Mesh>>& GetLODMeshes(unsigned int lod); // 0 is the full mesh
+    unsigned int GetNumLODs() const { return static_cast<unsigned int>(lods_.size()) + 1; }
+    unsigned int GetBBoxVAO(); // made on first use, vertex arrays are not shared between GL contexts
+
+    // BPM data on demand: nothing is computed at load, a draw requests the level its texture type needs.
+    // RequestBPMData and RequestRestore return true if the work was not requested before, then the caller has
+    // it done, by PrecomputeStep calls on a loader thread or all at once by ComputeBPMData. PrecomputeStep
+    // restores evicted geometry, or begins or continues the precompute of the first incomplete mesh, LOD 0
+    // first, so one mesh is computed at a time. It returns false when there is nothing left to do.
+    bool RequestBPMData(BPMData level);
+    BPMData GetRequestedBPMData() const { return requested_bpm_data_.load(); }
+    bool PrecomputeStep();
+    void ComputeBPMData();
+    bool HasBPMData(BPMData level) const;
+
+    // Vertex edits of a full-detail mesh by OBJ vertex (see Mesh::UpdateVertices), render thread, of an asset loaded with
+    // incremental_edits. Fails while a PrecomputeStep runs or a precompute of the mesh is unfinished, the caller
+    // tries again on a later frame. The LODs and the bounding box keep the geometry they were made from.
+    bool UpdateVertices(unsigned int mesh_idx, const std::vector<unsigned int>& vertex_ids,
+                        const std::vector<glm::vec3>& positions, const std::vector<glm::vec2>& tex_coords);
+
+    // Deforming playback of the full-detail meshes (see Mesh::BeginDeformation), render thread. BeginDeformation
+    // fails while a PrecomputeStep runs or a precompute is unfinished, EndDeformation while a PrecomputeStep
+    // runs: the caller tries again on a later frame. A deforming asset is drawn at full detail and is not
+    // evicted, PrecomputeStep skips its deforming meshes.
+    bool BeginDeformation();
+    bool EndDeformation();
+    bool IsDeforming() const { return !meshes_.empty() && meshes_[0]->IsDeforming(); }
+    bool UpdateDeformation(); // true when new data was swapped in
+    double GetDeformMilliseconds() const; // over the meshes
+    // While deforming, bbox_ bounds the shown positions, set by the caller for every new frame, and
+    // GetRestBBox is the one of the loaded positions. EndDeformation puts it back.
+    void SetBBox(const glm::vec3& v_min, const glm::vec3& v_max);
+    const geometry::BoundingBox& GetRestBBox() const { return IsDeforming() ? rest_bbox_ : bbox_; }
+    // Frames after this one of an OBJ sequence, played by the renderer through the deformation above. Set on
+    // the render thread for the full-detail mesh, see MeshSequence.
+    std::unique_ptr<MeshSequence> sequence_;
+
+    // Residency (see ResidencyManager), render thread. The Evict functions return the bytes freed, 0 while an
+    // PrecomputeStep runs. Evicted BPM data is uploaded again when a draw requests it. An asset whose geometry
+    // and texture are evicted is not drawn until RequestRestore and the PrecomputeStep that follows.
+    unsigned long long last_drawn_frame_ = 0;
+    void UpdateResidentBytes(); // keeps the last values while a PrecomputeStep runs
+    size_t GetResidentBPMDataBytes() const { return resident_bpm_data_bytes_; }
+    size_t GetResidentGeometryBytes() const { return resident_geometry_bytes_; } // and texture
+    size_t EvictBPMData();
+    size_t EvictGeometry();
+    bool IsResident() const { return resident_.load(std::memory_order_acquire); }
+    bool RequestRestore();
+
+private:
+    void GetModelName(const std::string& path);
+    void LoadModel(const std::string& path);
+    void BuildLODs(const std::vector<unsigned int>& corner_tex_coords); // of meshes_[0], in parse order
+    void SetupBBOX();
+    geometry::BoundingBox rest_bbox_; // see GetRestBBox
+    void Normalize_UV(const glm::vec2& vt_min, float vt_max_delta);
+    void ParseMeshData(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, std::vector<glm::vec3>& face_normals,
+                       glm::vec2& vt_min, float& vt_max_delta, unsigned int& num_ring_faces,
+                       std::vector<unsigned int>* corner_tex_coords = nullptr);
+
+    std::string path_;
+
+    void RestoreGeometry();
+
+    std::atomic<BPMData> requested_bpm_data_{BPMData::NONE};
+    std::mutex precompute_mutex_; // PrecomputeStep may run on several loader threads, evictions skip the asset meanwhile
+    std::string texture_path_;
+    std::shared_ptr<SharedTexture> texture_; // of every mesh and LOD
+    size_t GetTextureBytes() const; // the asset's share of the texture
+    size_t resident_bpm_data_bytes_ = 0, resident_geometry_bytes_ = 0;
+    std::atomic<bool> resident_{true};
+    std::atomic<bool> restore_requested_{false};
+};
@@ -1,10 +1,48 @@
 #pragma once
-#include "Scene/MeshModel.h"
+#include <string>
+#include <vector>
 
+#include <glm/glm.hpp>
+
+#include "Scene/Vertex.h"
+
+// OBJ group of the boundary ring of an out-of-core chunk (see mesh_partition), its faces are the last ones
+constexpr const char* kBoundaryRingGroup = "bpm_boundary_ring";
+
+// num_ring_faces: faces of the kBoundaryRingGroup group, 0 for a file that is not a chunk
+// Vertices are the "v" lines, a vertex gets the "vt" of its last face corner. corner_tex_coords, if given,
+// gets the "vt" index of every face corner (parallel to indices), a vertex with several is on a UV seam.
+// Without require_texture, texture_path is where the texture would be and the file need not exist.
 void ParseObjFile(const std::string& filename, 
                   std::vector<Vertex>& vertices, 
                   std::vector<unsigned int>& indices,
                   std::vector<glm::vec3>& face_normals,
                   std::string& texture_path,
                   glm::vec3& v_min, glm::vec3& v_max,
-                  glm::vec2& vt_min, float& vt_max_delta);
\ No newline at end of file
+                  glm::vec2& vt_min, float& vt_max_delta,
+                  unsigned int& num_ring_faces,
+                  std::vector<unsigned int>* corner_tex_coords = nullptr,
+                  bool require_texture = true);
+// The .mtl file and texture an OBJ refers to, resolved as ParseObjFile does, empty where they are not found
+void GetMaterialFiles(const std::string& obj_path, std::string& mtllib_path, std::string& texture_path);
+// To [0, 1] by the range ParseObjFile returns, before the BPM data is computed
+void NormalizeTexCoords(std::vector<Vertex>& vertices, const glm::vec2& vt_min, float vt_max_delta);
+// An OBJ as the BPM precompute sees it, without GL: triangles in file order, texture coordinates normalized.
+// The texture is not read, texture_path is resolved whether the file exists or not.
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<glm::vec3> face_normals;
+    std::string texture_path;
+    glm::vec3 v_min, v_max;
+    unsigned int num_ring_faces = 0;
+    unsigned int GetNumFaces() const { return static_cast<unsigned int>(indices.size() / 3); }
+};
+void LoadMeshData(const std::string& obj_path, MeshData& mesh); // throws as ParseObjFile
+
+// Positions only ("v" lines), for the frames of a sequence whose topology and texture coordinates are known
+void ParseObjPositions(const std::string& obj_path, std::vector<glm::vec3>& positions);
+
+// Binary positions of a parsed frame: magic, vertex count, then xyz floats
+void ReadPositionsFile(const std::string& path, std::vector<glm::vec3>& positions);
+void WritePositionsFile(const std::string& path, const std::vector<glm::vec3>& positions);
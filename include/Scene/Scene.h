@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <glad/glad.h>
@@ -25,6 +26,9 @@ public:
 	int active_model_idx_;
 	int active_camera_idx_;
 
+	ModelLoadOptions load_options_; // applied to models added from now on
+	std::unordered_map<size_t, std::weak_ptr<ModelAsset>> assets_; // by ModelAsset::content_hash_
+
 	// -------- METHODS -------- //
 	// Constructors
 	Scene();
@@ -33,13 +37,19 @@ public:
     Scene& operator=(const Scene&) = delete;
 
 	// Model //
-	void AddModel(const std::string& path);
+	void AddModel(const std::string& path); // reuses a loaded asset with the same content
+	MeshModel* AddModel(std::shared_ptr<ModelAsset> asset); // e.g. from AssetLoader
+	MeshModel* AddInstance(MeshModel* source); // another placement of the source's asset
 	MeshModel* GetModel(unsigned int idx);
 	MeshModel* GetActiveModel();
 	bool HasModels();
 	std::vector<std::string> GetModelNames();
 	std::vector<std::unique_ptr<MeshModel>>& GetModels();
 	
+	// Changes whenever a camera, a model transformation or a model's rendering flags change, or a model is
+	// added. The renderer redraws on demand by comparing it with the stamp of the last frame.
+	size_t GetChangeStamp() const;
+
 	// Camera // 
 	void SetAspectRatio(float aspect_ratio);
 	void AddCamera();
@@ -0,0 +1,10 @@
+// Vertex.h
+#pragma once
+
+#include <glm/glm.hpp>
+
+struct Vertex {
+    glm::vec3 position_;
+    glm::vec3 normal_;
+    glm::vec2 tex_coords_;
+};
@@ -8,8 +8,24 @@
 extern Scene* scene;
 extern Renderer* renderer;
 
+// Handlers, run on the render thread
 void FramebufferSizeCallback(GLFWwindow* window, int width, int height);
 void KeyboardCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void MousePosCallback(GLFWwindow* window, double x_pos_in, double y_pos_in);
 void ScrollCallback(GLFWwindow* window, double x_offset, double y_offset);
-void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
\ No newline at end of file
+void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+void WindowRefreshCallback(GLFWwindow* window);
+
+// GLFW callbacks, called by the main thread. They post the event to the render thread (see RenderThread),
+// which owns the scene, the renderer and the ImGui context, and passes it to ImGui and then to our handler.
+// Nothing on the render thread queries the window, GLFW allows that on the main thread only.
+void ForwardFramebufferSize(GLFWwindow* window, int width, int height);
+void ForwardWindowSize(GLFWwindow* window, int width, int height);
+void ForwardKey(GLFWwindow* window, int key, int scancode, int action, int mods);
+void ForwardChar(GLFWwindow* window, unsigned int c);
+void ForwardMousePos(GLFWwindow* window, double x_pos_in, double y_pos_in);
+void ForwardScroll(GLFWwindow* window, double x_offset, double y_offset);
+void ForwardMouseButton(GLFWwindow* window, int button, int action, int mods);
+void ForwardWindowFocus(GLFWwindow* window, int focused);
+void ForwardCursorEnter(GLFWwindow* window, int entered);
+void ForwardWindowRefresh(GLFWwindow* window);
@@ -1,6 +1,9 @@
 // UI.h
 #pragma once
 
+#include <chrono>
+#include <random>
+
 #include <imgui.h>
 
 #include "PathConfig.h" // for RESOURCES_DIR
@@ -9,12 +12,15 @@
 class Scene;
 class Renderer;
 class ShaderManager;
+class AssetLoader;
+class MeshModel;
 
 class UI {
 public:
 	Scene* scene_;
 	Renderer* renderer_;
 	ShaderManager& shader_manager_;
+	const AssetLoader* loader_ = nullptr; // models loading in the background, shown in the menu bar
 
 	bool is_model_list_window_open_ = true;
 	bool show_color_picker_models = false;
@@ -22,9 +28,19 @@ public:
 	// window sizes
 	ImVec2 model_list_sizes = ImVec2(300, 80);
 	bool is_model_list_init;
+	std::chrono::steady_clock::time_point last_frame_time_; // for ImGui's DeltaTime
+
+	// vertex edits of models loaded with incremental edits (see ModelAsset::UpdateVertices)
+	int edit_num_vertices_ = 100;
+	float edit_amplitude_ = 0.005f; // of the bounding box, along the vertex normals
+	bool has_edited_ = false;
+	float last_edit_milliseconds_ = -1.0f; // CPU time of the last edit, negative if it was not done
+	std::mt19937 edit_random_;
 
-	UI(Scene* scene, Renderer* renderer, GLFWwindow* window);
+	static void SetupPlatform(GLFWwindow* window); // main thread, before the render thread creates the UI
+	UI(Scene* scene, Renderer* renderer, GLFWwindow* window); // render thread
 	void ShowUI();
 
     void ShowModelListWindow();
+    void DisplaceVertices(MeshModel* model); // random vertices of the full-detail mesh
 };
\ No newline at end of file
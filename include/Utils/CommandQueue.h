@@ -0,0 +1,51 @@
+// CommandQueue.h
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// Bounded lock-free multi-producer multi-consumer queue of commands (Vyukov's ring: every cell has a sequence
+// number telling producers and consumers whose turn it is). Producers never wait for each other or for the
+// consumer, Push fails when the ring is full. Push and Pop take the mutex only to wake up the other side when
+// it sleeps in WaitFor or PushWait, which they see from an atomic count of sleepers.
+class CommandQueue {
+public:
+	using Command = std::function<void()>;
+
+	explicit CommandQueue(size_t capacity = 1024); // rounded up to a power of two
+	CommandQueue(const CommandQueue&) = delete;
+	CommandQueue& operator=(const CommandQueue&) = delete;
+
+	bool Push(Command command);
+	bool Pop(Command& command);
+	bool Empty() const;
+	bool Full() const;
+
+	// Consumer side: sleeps until a command is pushed or the timeout passes
+	void WaitFor(std::chrono::duration<double> timeout);
+	// Producer side: sleeps while the ring is full
+	void PushWait(Command command);
+
+private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		Command command;
+	};
+	std::unique_ptr<Cell[]> cells_;
+	size_t mask_;
+	alignas(64) std::atomic<size_t> enqueue_pos_{0};
+	alignas(64) std::atomic<size_t> dequeue_pos_{0};
+
+	bool TryPush(Command& command); // moves the command only if it is pushed
+
+	std::mutex wait_mutex_;
+	std::condition_variable wait_condition_;  // consumers, a command was pushed
+	std::condition_variable space_condition_; // producers, a cell was freed
+	std::atomic<int> sleeping_consumers_{0};
+	std::atomic<int> sleeping_producers_{0};
+};
@@ -25,6 +25,14 @@ enum class TextureType {
 };
 TextureType& operator++(TextureType& c);
 const char* GetTextureTypeName(TextureType type);
+
+// Matrix exponential used by the BPM blend
+enum class ExpMethod {
+	TAYLOR, // truncated series, EXP_TERMS terms
+	CLOSED_FORM,
+	TYPES_COUNT
+};
+const char* GetExpMethodName(ExpMethod method);
 constexpr const char* DEFAULT_DATA_DIR = "data";
 constexpr const char* DEFAULT_MODEL_NAME = "wolf_head.obj";
 constexpr float PI = glm::pi<float>();
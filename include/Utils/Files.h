@@ -0,0 +1,13 @@
+// Files.h
+#pragma once
+
+#include <string>
+
+namespace files {
+	// Renames from to to, replacing an existing to in one step: a reader of to sees the old file or the new one,
+	// never neither. std::rename does that on POSIX, not on Windows, where it fails if to exists.
+	bool RenameReplacing(const std::string& from, const std::string& to);
+	// A temporary name next to path, unique to this process, thread and call: writers of the same file in
+	// several processes or threads (bpm_precompute jobs, viewers sharing a store) do not write into each other's
+	std::string MakeTempPath(const std::string& path);
+} // namespace files
@@ -0,0 +1,234 @@
+#version 460
+// BPM data of a deforming mesh, recomputed from its current vertex positions (see Mesh::BeginDeformation).
+// One invocation per triangle: the frame and Mobius coefficients of the triangle, the log ratios of its edges
+// and its packed record and flat flag. Topology and texture coordinates do not change, so the neighbors come
+// from a static table instead of the search of neighbors_cs.glsl, and the slots of the log ratios are written
+// once by Mesh::MakeDeformState: the pass writes only what depends on the positions.
+layout(local_size_x = 256) in;
+
+struct Mat2c { vec2 a,b,c,d; };
+
+// same as BPMRecord of bpm_fs.glsl
+struct BPMRecord {
+    vec4 frame_x;
+    vec4 frame_y;
+    Mat2c coeffs;
+    uvec4 log_ratios;
+};
+
+layout(std430, binding = 0) writeonly buffer Transformations {
+    mat4 trans[];
+};
+layout(std430, binding = 1) writeonly buffer MobiusCoefficients {
+    Mat2c mobius[];
+};
+// [0, 3nF) per triangle edge (offset of its mu << 1), [3nF, 3nF + 2) zero mu of boundary edges, both static,
+// then the mu of every triangle edge, see Mesh::AllocateDeformBuffers
+layout(std430, binding = 2) writeonly buffer LogRatios {
+    uint log_ratios[];
+};
+layout(std430, binding = 7) writeonly buffer BPMRecords {
+    BPMRecord records[];
+};
+layout(std430, binding = 9) readonly buffer Vertices {
+    float vertices[]; // Vertex: position, normal, tex coords
+};
+layout(std430, binding = 10) readonly buffer Indices {
+    uint indices[];
+};
+layout(std430, binding = 11) buffer FlatTriangles {
+    uint flat_bits[]; // then the number of flagged triangles, zeroed before the pass
+};
+layout(std430, binding = 17) readonly buffer Adjacency { // ShaderManager::kComputeTableBinding
+    uint third_vertices[]; // per triangle edge ij, jk, ki: the other vertex of the neighbor across it, ~0u on the boundary
+};
+
+uniform uint numTriangles;
+uniform float flatTolerance; // negative before the first classification, no triangle is flagged
+
+const uint kVertexStride = 8u;
+const uint kNoNeighbor = 0xffffffffu;
+
+vec3 Position(uint v) {
+    return vec3(vertices[kVertexStride * v], vertices[kVertexStride * v + 1u], vertices[kVertexStride * v + 2u]);
+}
+
+vec2 TexCoords(uint v) {
+    return vec2(vertices[kVertexStride * v + 6u], vertices[kVertexStride * v + 7u]);
+}
+
+// ------ complex numbers ------ //
+vec2 ComplexMult(vec2 z1, vec2 z2) {
+    return vec2(z1.x * z2.x - z1.y * z2.y, z1.x * z2.y + z1.y * z2.x);
+}
+
+vec2 ComplexDiv(vec2 z1, vec2 z2) {
+    float denom = dot(z2, z2);
+    return vec2((z1.x * z2.x + z1.y * z2.y) / denom, (z1.y * z2.x - z1.x * z2.y) / denom);
+}
+
+vec2 ComplexSqrt(vec2 z) { // principal branch, as std::sqrt
+    float r = length(z);
+    return vec2(sqrt(0.5 * (r + z.x)), (z.y < 0.0 ? -1.0 : 1.0) * sqrt(max(0.5 * (r - z.x), 0.0)));
+}
+
+dvec2 ComplexMult(dvec2 z1, dvec2 z2) {
+    return dvec2(z1.x * z2.x - z1.y * z2.y, z1.x * z2.y + z1.y * z2.x);
+}
+
+dvec2 ComplexDiv(dvec2 z1, dvec2 z2) {
+    double denom = dot(z2, z2);
+    return dvec2((z1.x * z2.x + z1.y * z2.y) / denom, (z1.y * z2.x - z1.x * z2.y) / denom);
+}
+
+dvec2 ComplexSqrt(dvec2 z) {
+    double r = length(z);
+    return dvec2(sqrt(0.5 * (r + z.x)), (z.y < 0.0 ? -1.0 : 1.0) * sqrt(max(0.5 * (r - z.x), 0.0)));
+}
+
+// determinant of the complex 3x3 matrix with rows (r0, r1, r2) and columns x, y, z
+vec2 Determinant(vec2 r0x, vec2 r0y, vec2 r0z, vec2 r1x, vec2 r1y, vec2 r1z, vec2 r2x, vec2 r2y, vec2 r2z) {
+    return ComplexMult(r0x, ComplexMult(r1y, r2z) - ComplexMult(r1z, r2y))
+         - ComplexMult(r0y, ComplexMult(r1x, r2z) - ComplexMult(r1z, r2x))
+         + ComplexMult(r0z, ComplexMult(r1x, r2y) - ComplexMult(r1y, r2x));
+}
+
+dvec2 Determinant(dvec2 r0x, dvec2 r0y, dvec2 r0z, dvec2 r1x, dvec2 r1y, dvec2 r1z, dvec2 r2x, dvec2 r2y, dvec2 r2z) {
+    return ComplexMult(r0x, ComplexMult(r1y, r2z) - ComplexMult(r1z, r2y))
+         - ComplexMult(r0y, ComplexMult(r1x, r2z) - ComplexMult(r1z, r2x))
+         + ComplexMult(r0z, ComplexMult(r1x, r2y) - ComplexMult(r1y, r2x));
+}
+
+// ------ Mobius maps, as BPM/Mobius.cpp ------ //
+// normalized Mobius map taking z to w
+Mat2c ComputeMobiusCoefficients(vec2 z0, vec2 z1, vec2 z2, vec2 w0, vec2 w1, vec2 w2) {
+    vec2 one = vec2(1.0, 0.0);
+    vec2 zw0 = ComplexMult(z0, w0), zw1 = ComplexMult(z1, w1), zw2 = ComplexMult(z2, w2);
+    vec2 a = Determinant(zw0, w0, one, zw1, w1, one, zw2, w2, one);
+    vec2 b = Determinant(zw0, z0, w0, zw1, z1, w1, zw2, z2, w2);
+    vec2 c = Determinant(z0, w0, one, z1, w1, one, z2, w2, one);
+    vec2 d = Determinant(zw0, z0, one, zw1, z1, one, zw2, z2, one);
+    vec2 norm_factor = ComplexSqrt(ComplexMult(a, d) - ComplexMult(b, c));
+    return Mat2c(ComplexDiv(a, norm_factor), ComplexDiv(b, norm_factor), ComplexDiv(c, norm_factor), ComplexDiv(d, norm_factor));
+}
+
+// c p + d of the normalized Mobius map taking z to w, in double precision
+dvec2 MobiusDenominator(dvec2 z0, dvec2 z1, dvec2 z2, dvec2 w0, dvec2 w1, dvec2 w2, dvec2 p) {
+    dvec2 one = dvec2(1.0, 0.0);
+    dvec2 zw0 = ComplexMult(z0, w0), zw1 = ComplexMult(z1, w1), zw2 = ComplexMult(z2, w2);
+    dvec2 a = Determinant(zw0, w0, one, zw1, w1, one, zw2, w2, one);
+    dvec2 b = Determinant(zw0, z0, w0, zw1, z1, w1, zw2, z2, w2);
+    dvec2 c = Determinant(z0, w0, one, z1, w1, one, z2, w2, one);
+    dvec2 d = Determinant(zw0, z0, one, zw1, z1, one, zw2, z2, one);
+    dvec2 norm_factor = ComplexSqrt(ComplexMult(a, d) - ComplexMult(b, c));
+    return ComplexDiv(ComplexMult(c, p) + d, norm_factor);
+}
+
+// mu of the edge (p0, p1) shared with the neighbor (z_nbr, w_nbr), evaluated at p0, see ComputeEdgeLogRatio
+vec2 ComputeEdgeLogRatio(vec2 z0, vec2 z1, vec2 z2, vec2 w0, vec2 w1, vec2 w2,
+                         vec2 z_nbr0, vec2 z_nbr1, vec2 z_nbr2, vec2 w_nbr0, vec2 w_nbr1, vec2 w_nbr2, vec2 p0) {
+    dvec2 p = dvec2(p0);
+    dvec2 lambda = ComplexDiv(MobiusDenominator(dvec2(z0), dvec2(z1), dvec2(z2), dvec2(w0), dvec2(w1), dvec2(w2), p),
+                              MobiusDenominator(dvec2(z_nbr0), dvec2(z_nbr1), dvec2(z_nbr2), dvec2(w_nbr0), dvec2(w_nbr1), dvec2(w_nbr2), p));
+    // same sign choice as Mat2c::LogRatio, whose trace is lambda + 1/lambda
+    if ((lambda + ComplexDiv(dvec2(1.0, 0.0), lambda)).x < 0.0) {
+        lambda = -lambda;
+    }
+    return vec2(log(float(length(lambda))), atan(float(lambda.y), float(lambda.x)));
+}
+
+// ------ flattening, as neighbors_cs.glsl ------ //
+mat4 computeTransformation(vec3 p1, vec3 p2, vec3 p3, bool is_left_vt) {
+    vec3 v1 = normalize(p2 - p1);
+    vec3 n = normalize(cross(v1, p3 - p2));
+    if (is_left_vt) {
+        n = -n;
+    }
+    vec3 v2 = normalize(cross(n, v1));
+    vec3 projectedOrigin = dot(n, p1) * n;
+    mat3 R_t = transpose(mat3(v1, v2, n));
+    mat4 transformation = mat4(R_t);
+    transformation[3] = vec4(-R_t * projectedOrigin, 1.0);
+    return transformation;
+}
+
+vec3 transformPoint3d(vec3 v, mat4 trans) {
+    vec4 transformed_v = trans * vec4(v, 1.0);
+    return transformed_v.xyz / transformed_v.w;
+}
+
+mat4 createRotation3dLineAngle(vec3 center, vec3 v, float theta) {
+    mat3 P = outerProduct(v, v);
+    mat3 Q = transpose(mat3(
+        0, -v.z, v.y,
+        v.z, 0, -v.x,
+        -v.y, v.x, 0));
+    mat3 R = P + (mat3(1.0) - P) * cos(theta) + Q * sin(theta);
+    mat4 result = mat4(R);
+    result[3] = vec4(-R * center + center, 1.0);
+    return result;
+}
+
+vec2 FlattenVertex(vec3 origin, vec3 end, vec3 new_v, bool is_left_vt) {
+    float sgn = is_left_vt ? -1.0 : 1.0;
+    vec3 dir = normalize(end - origin);
+    vec3 v1 = normalize(sgn * cross(dir, vec3(0.0, 0.0, 1.0)));
+    vec3 n = sgn * cross(end - new_v, origin - new_v); // normal of the other triangle
+    float theta = sgn * atan(-dot(n, v1), n.z);
+    return transformPoint3d(new_v, createRotation3dLineAngle(origin, dir, theta)).xy;
+}
+
+void main() {
+    uint trigIdx = gl_GlobalInvocationID.x;
+    if (trigIdx >= numTriangles) return;
+
+    uint idx[3] = uint[3](indices[3u * trigIdx], indices[3u * trigIdx + 1u], indices[3u * trigIdx + 2u]);
+    vec3 p[3];
+    vec2 vt[3];
+    for (int k = 0; k < 3; k++) {
+        p[k] = Position(idx[k]);
+        vt[k] = TexCoords(idx[k]);
+    }
+    vec2 vij_vt = vt[1] - vt[0]; vec2 vik_vt = vt[2] - vt[0];
+    bool is_left_vt = (vij_vt.x * vik_vt.y - vij_vt.y * vik_vt.x) < 0.0;
+
+    mat4 transformation = computeTransformation(p[0], p[1], p[2], is_left_vt);
+    trans[trigIdx] = transformation;
+    vec3 flat_p[3];
+    vec2 z[3];
+    for (int k = 0; k < 3; k++) {
+        flat_p[k] = transformPoint3d(p[k], transformation);
+        z[k] = flat_p[k].xy;
+    }
+    Mat2c coeffs = ComputeMobiusCoefficients(z[0], z[1], z[2], vt[0], vt[1], vt[2]);
+    mobius[trigIdx] = coeffs;
+
+    // edges ij, jk, ki: the neighbor is (end, origin, third) and the ratio is taken at the edge's origin
+    vec2 mu[3] = vec2[3](vec2(0.0), vec2(0.0), vec2(0.0));
+    uint zero_offset = 3u * numTriangles;
+    for (int e = 0; e < 3; e++) {
+        uint slot = 3u * trigIdx + uint(e);
+        uint third = third_vertices[slot];
+        if (third == kNoNeighbor) continue; // its slot points at the zero pair
+        int end = (e + 1) % 3;
+        vec2 z_third = FlattenVertex(flat_p[e], flat_p[end], transformPoint3d(Position(third), transformation), is_left_vt);
+        mu[e] = ComputeEdgeLogRatio(z[0], z[1], z[2], vt[0], vt[1], vt[2],
+                                    z[end], z[e], z_third, vt[end], vt[e], TexCoords(third), z[e]);
+        uint offset = zero_offset + 2u + 2u * slot;
+        log_ratios[offset] = floatBitsToUint(mu[e].x);
+        log_ratios[offset + 1u] = floatBitsToUint(mu[e].y);
+    }
+
+    records[trigIdx] = BPMRecord(vec4(transformation[0][0], transformation[1][0], transformation[2][0], transformation[3][0]),
+                                 vec4(transformation[0][1], transformation[1][1], transformation[2][1], transformation[3][1]),
+                                 coeffs, uvec4(packHalf2x16(mu[0]), packHalf2x16(mu[1]), packHalf2x16(mu[2]), 0u));
+
+    // flags of 32 triangles share a word
+    uint bit = 1u << (trigIdx % 32u);
+    if (max(length(mu[0]), max(length(mu[1]), length(mu[2]))) < flatTolerance) {
+        atomicOr(flat_bits[trigIdx / 32u], bit);
+        atomicAdd(flat_bits[(numTriangles + 31u) / 32u], 1u);
+    } else {
+        atomicAnd(flat_bits[trigIdx / 32u], ~bit);
+    }
+}
@@ -0,0 +1,44 @@
+#version 460
+// Twisted positions of a deforming mesh (see Mesh::SetDeformTwist): the rest positions turn around the vertical
+// axis through twist_center, by twist_angle at twist_height above it and proportionally in between. Normals go
+// through the inverse transpose of the twist's Jacobian, texture coordinates are copied. One invocation per
+// vertex, the deform_bpm pass then reads the result.
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 9) writeonly buffer Vertices {
+    float vertices[]; // Vertex: position, normal, tex coords
+};
+layout(std430, binding = 17) readonly buffer RestVertices { // ShaderManager::kComputeTableBinding
+    float rest_vertices[];
+};
+
+uniform uint num_vertices;
+uniform vec3 twist_center;
+uniform float twist_angle; // radians at twist_height
+uniform float twist_height;
+
+const uint kVertexStride = 8u;
+
+void main() {
+    uint v = gl_GlobalInvocationID.x;
+    if (v >= num_vertices) return;
+    uint base = kVertexStride * v;
+    vec3 p = vec3(rest_vertices[base], rest_vertices[base + 1u], rest_vertices[base + 2u]) - twist_center;
+    vec3 n = vec3(rest_vertices[base + 3u], rest_vertices[base + 4u], rest_vertices[base + 5u]);
+    float k = twist_angle / twist_height; // radians per unit of height
+    float a = k * p.y;
+    float c = cos(a), s = sin(a);
+    vec3 twisted = twist_center + vec3(c * p.x + s * p.z, p.y, -s * p.x + c * p.z);
+    // the xz rotation, and the shear of the angle along y tilts the normal
+    vec3 twisted_normal = vec3(c * n.x + s * n.z, n.y + k * (p.x * n.z - p.z * n.x), -s * n.x + c * n.z);
+    float length2 = dot(twisted_normal, twisted_normal);
+    if (length2 > 0.0) twisted_normal *= inversesqrt(length2); // a zero normal of the OBJ stays zero
+    vertices[base] = twisted.x;
+    vertices[base + 1u] = twisted.y;
+    vertices[base + 2u] = twisted.z;
+    vertices[base + 3u] = twisted_normal.x;
+    vertices[base + 4u] = twisted_normal.y;
+    vertices[base + 5u] = twisted_normal.z;
+    vertices[base + 6u] = rest_vertices[base + 6u];
+    vertices[base + 7u] = rest_vertices[base + 7u];
+}
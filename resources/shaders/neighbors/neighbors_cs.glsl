@@ -1,4 +1,7 @@
 #version 460
+#ifndef NUM_MESH_SLOTS
+#define NUM_MESH_SLOTS 1
+#endif
 
 layout(local_size_x = 256) in;
 
@@ -16,12 +19,23 @@ layout(std430, binding = 0) buffer Transformations0 {
     mat4 trans0[]; 
 };
 
+#if NUM_MESH_SLOTS > 1
 layout(std430, binding = 3) buffer Transformations1 {
     mat4 trans1[]; 
 };
+#endif
+
+layout(std430, binding = 17) readonly buffer Adjacency { // ShaderManager::kComputeTableBinding
+    uint third_vertices[]; // per triangle edge ij, jk, ki: the other vertex of the neighbor across it, ~0u on the boundary
+};
 
 uniform uint ssbo_idx;
-uniform uint numTriangles;
+// chunk of triangles [firstTriangle, endTriangle) of this dispatch, the flat buffer holds the chunk (see Mesh::PrecomputeChunk)
+uniform uint firstTriangle;
+uniform uint endTriangle;
+// DIRECT_MOBIUS needs the frames only, the neighbors are flattened for the log ratios of BPM
+uniform bool findNeighbors;
+uniform bool storeTransformations; // false when the frames are already there (a BPM pass after DIRECT_MOBIUS)
 
 vec2 ComplexSubtract(vec2 z1, vec2 z2) {
     return vec2(z1.x - z2.x, z1.y - z2.y);
@@ -126,19 +140,6 @@ vec2 FlattenVertex(vec3 origin, vec3 end, vec3 new_v, bool is_left_vt) {
     return vec2(new_trans.x, new_trans.y);
 }
 
-uint GetThirdVertexIdx(uint edge, uint vi_idx, uint vj_idx, uint vk_idx){
-    uint third_v_idx;
-    switch (edge) {
-        case 0: // ij
-            third_v_idx = vk_idx; break;
-        case 1: // jk
-            third_v_idx = vi_idx; break;
-        default: // ki
-            third_v_idx = vj_idx; break;
-    }
-    return third_v_idx;
-}
-
 vec2 flattenPoint(vec3 v, mat4 trans) {
     vec3 transformed_v = transformPoint3d(v, trans);
     return vec2(transformed_v.x, transformed_v.y);
@@ -150,17 +151,21 @@ vec2 flattenPoint(vec2 v, mat4 trans) {
 }
 
 void storeTrans(mat4 trans, uint trigIdx) {
+#if NUM_MESH_SLOTS > 1
     switch(ssbo_idx) {
         case 1: trans1[trigIdx] = trans; break;
         default: trans0[trigIdx] = trans;
     }
+#else
+    trans0[trigIdx] = trans;
+#endif
     return;
 }
 
 void FindNeighbors() {
-    uint trigIdx = gl_GlobalInvocationID.x;
+    uint trigIdx = firstTriangle + gl_GlobalInvocationID.x;
 
-    if (trigIdx >= numTriangles) return;
+    if (trigIdx >= endTriangle) return;
 
     uint vi_idx = texelFetch(indicesBuffer, 3 * int(trigIdx)).r;
     uint vj_idx = texelFetch(indicesBuffer, 3 * int(trigIdx) + 1).r;
@@ -179,7 +184,7 @@ void FindNeighbors() {
 
 
     mat4 transformation = computeTransformation(vi, vj, vk, is_left_vt);
-    storeTrans(transformation, trigIdx);
+    if (storeTransformations) storeTrans(transformation, trigIdx);
 
     vi = transformPoint3d(vi, transformation);
     vj = transformPoint3d(vj, transformation);
@@ -196,57 +201,30 @@ void FindNeighbors() {
     vec2 vn_vt = vec2(0.0);
 
     
-    uvec2 edges[3] = {
-        uvec2(min(vi_idx, vj_idx), max(vi_idx, vj_idx)),
-        uvec2(min(vj_idx, vk_idx), max(vj_idx, vk_idx)),
-        uvec2(min(vk_idx, vi_idx), max(vk_idx, vi_idx))
-    };
-    // find neighbors
-    uint numFoundEdges = 0;
-    for (uint oTrigIdx = 0; (oTrigIdx < numTriangles) && (numFoundEdges < 3); ++oTrigIdx) {
-        if (oTrigIdx == trigIdx) continue;
-
-        uint ovi_idx = texelFetch(indicesBuffer, 3 * int(oTrigIdx)).r;
-        uint ovj_idx = texelFetch(indicesBuffer, 3 * int(oTrigIdx) + 1).r;
-        uint ovk_idx = texelFetch(indicesBuffer, 3 * int(oTrigIdx) + 2).r;
-
-        uvec2 otherEdges[3] = {
-            uvec2(min(ovi_idx, ovj_idx), max(ovi_idx, ovj_idx)),
-            uvec2(min(ovj_idx, ovk_idx), max(ovj_idx, ovk_idx)),
-            uvec2(min(ovk_idx, ovi_idx), max(ovk_idx, ovi_idx))
-        };
-
-        int neighborIndex = -1;
-        for (uint edge = 0; (edge < 3) && (neighborIndex==-1); ++edge) 
-        {
-            for (uint otherEdge = 0; otherEdge < 3; ++otherEdge) 
-            {
-                if (edges[edge] == otherEdges[otherEdge]) {
-                    neighborIndex = int(oTrigIdx); numFoundEdges++;
-                    uint third_ov_idx = GetThirdVertexIdx(otherEdge, ovi_idx, ovj_idx, ovk_idx);
-                    vec3 third_ov = texelFetch(verticesBuffer, int(third_ov_idx)).xyz;
-                    vec2 third_ov_vt = texelFetch(vtBuffer, int(third_ov_idx)).xy;
-                    third_ov = transformPoint3d(third_ov, transformation);
-                    switch (edge) {
-                        case 2: // ki_n
-                            vn = FlattenVertex(vk,vi,third_ov,is_left_vt);
-                            vn_vt = third_ov_vt;
-                            break;
-                        case 1: // jk_m
-                            vm = FlattenVertex(vj,vk,third_ov,is_left_vt); 
-                            vm_vt = third_ov_vt;
-                            break;
-                        default: // ij_l
-                            vl = FlattenVertex(vi,vj,third_ov,is_left_vt); 
-                            vl_vt = third_ov_vt;
-                            break;
-                    }                    
-                    break;
-                }
-            }
+    // the neighbors across the edges, from the neighbor table of the mesh (see Mesh::BeginPrecompute)
+    uint numEdges = findNeighbors ? 3u : 0u;
+    for (uint edge = 0; edge < numEdges; ++edge) {
+        uint third_ov_idx = third_vertices[3u * trigIdx + edge];
+        if (third_ov_idx == 0xFFFFFFFFu) continue;
+        vec3 third_ov = texelFetch(verticesBuffer, int(third_ov_idx)).xyz;
+        vec2 third_ov_vt = texelFetch(vtBuffer, int(third_ov_idx)).xy;
+        third_ov = transformPoint3d(third_ov, transformation);
+        switch (edge) {
+            case 2: // ki_n
+                vn = FlattenVertex(vk,vi,third_ov,is_left_vt);
+                vn_vt = third_ov_vt;
+                break;
+            case 1: // jk_m
+                vm = FlattenVertex(vj,vk,third_ov,is_left_vt); 
+                vm_vt = third_ov_vt;
+                break;
+            default: // ij_l
+                vl = FlattenVertex(vi,vj,third_ov,is_left_vt); 
+                vl_vt = third_ov_vt;
+                break;
         }
     }
-    int baseIdx = 6*int(trigIdx);
+    int baseIdx = 6*int(trigIdx - firstTriangle);
     imageStore(flatBuffer, baseIdx + 0, vec4(vi.x, vi.y, vi_vt.x, vi_vt.y));
     imageStore(flatBuffer, baseIdx + 1, vec4(vj.x, vj.y, vj_vt.x, vj_vt.y));
     imageStore(flatBuffer, baseIdx + 2, vec4(vk.x, vk.y, vk_vt.x, vk_vt.y));
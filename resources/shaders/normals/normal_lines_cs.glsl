@@ -0,0 +1,45 @@
+#version 460 core
+// Builds the normal line vertices of a mesh once: a line per face from its centroid, then a line per vertex.
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 9) readonly buffer Vertices {
+    float vertices[]; // Vertex: position, normal, tex coords
+};
+layout(std430, binding = 10) readonly buffer Indices {
+    uint indices[];
+};
+struct LineVertex {
+    vec4 position;
+    vec4 normal; // w: 0 at the start of the line, 1 at its end
+};
+layout(std430, binding = 13) writeonly buffer NormalLines {
+    LineVertex lines[];
+};
+
+uniform uint num_triangles;
+uniform uint num_vertices;
+const uint kVertexStride = 8u;
+
+vec3 GetPosition(uint v) {
+    return vec3(vertices[kVertexStride * v], vertices[kVertexStride * v + 1u], vertices[kVertexStride * v + 2u]);
+}
+
+void main() {
+    uint idx = gl_GlobalInvocationID.x;
+    vec3 position, normal;
+    if (idx < num_triangles) {
+        vec3 v0 = GetPosition(indices[3u * idx]);
+        vec3 v1 = GetPosition(indices[3u * idx + 1u]);
+        vec3 v2 = GetPosition(indices[3u * idx + 2u]);
+        position = (v0 + v1 + v2) / 3.0;
+        normal = normalize(cross(v1 - v0, v2 - v0));
+    } else if (idx < num_triangles + num_vertices) {
+        uint v = idx - num_triangles;
+        position = GetPosition(v);
+        normal = vec3(vertices[kVertexStride * v + 3u], vertices[kVertexStride * v + 4u], vertices[kVertexStride * v + 5u]);
+    } else {
+        return;
+    }
+    lines[2u * idx] = LineVertex(vec4(position, 1.0), vec4(normal, 0.0));
+    lines[2u * idx + 1u] = LineVertex(vec4(position, 1.0), vec4(normal, 1.0));
+}
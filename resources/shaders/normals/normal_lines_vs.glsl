@@ -0,0 +1,33 @@
+#version 460 core
+layout (location = 0) in vec4 aPos;
+layout (location = 1) in vec4 aNormal; // w: 0 at the start of the line, 1 at its end
+
+layout (std140, binding = 0) uniform Matrices {
+    mat4 view;
+    mat4 projection;
+};
+// per instance, computed on the CPU once per draw, see ShaderManager::SetNormalTransformations
+struct NormalTransform {
+    mat4 modelview;
+    mat4 normal_matrix; // inverse transpose of the modelview in the upper 3x3, [3][3]: sign of its determinant
+};
+layout (std430, binding = 14) readonly buffer NormalTransforms {
+    NormalTransform normal_transforms[];
+};
+
+uniform float normal_scale = 1.0;
+uniform uint num_face_vertices; // face lines come first in the line buffer
+
+out vec3 ourColor;
+
+void main()
+{
+    NormalTransform t = normal_transforms[gl_InstanceID];
+    bool is_face = uint(gl_VertexID) < num_face_vertices;
+    vec4 v_eye = t.modelview * vec4(aPos.xyz, 1.0);
+    vec3 normal_eye = normalize(mat3(t.normal_matrix) * aNormal.xyz);
+    if (is_face) normal_eye *= t.normal_matrix[3][3]; // the winding flips with mirroring transforms
+    v_eye.xyz += aNormal.w * normal_scale * normal_eye;
+    gl_Position = projection * v_eye;
+    ourColor = is_face ? vec3(0.0, 1.0, 1.0) : vec3(1.0, 1.0, 0.0);
+}
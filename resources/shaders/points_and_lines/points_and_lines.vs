@@ -1,13 +1,15 @@
 #version 450 core
 
 layout (std140, binding = 0) uniform Matrices {
-    mat4 model;
     mat4 view;
     mat4 projection;
 };
+layout (std430, binding = 6) readonly buffer Instances {
+    mat4 instance_models[]; // model matrix per gl_InstanceID
+};
 
 layout(location = 0) in vec3 aPos;
 
 void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * instance_models[gl_InstanceID] * vec4(aPos, 1.0);
 }
\ No newline at end of file
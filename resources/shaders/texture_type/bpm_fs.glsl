@@ -1,14 +1,170 @@
 #version 460 core
+// Compile-time variant, defines are injected by ShaderManager
+#ifndef TEXTURE_TYPE
+#define TEXTURE_TYPE 2 // 0: Linear | 1: Direct Mobius | 2: BPM
+#endif
+#ifndef EXP_METHOD
+#define EXP_METHOD 0 // 0: Taylor series | 1: closed form
+#endif
+#ifndef EXP_TERMS
+#define EXP_TERMS 10
+#endif
+#ifndef NUM_MESH_SLOTS
+#define NUM_MESH_SLOTS 1
+#endif
+#ifndef PACKED_RECORDS
+#define PACKED_RECORDS 0 // 1: read the interleaved per-triangle BPM records
+#endif
+#ifndef ADAPTIVE_BPM
+#define ADAPTIVE_BPM 0 // 1: triangles flagged flat skip the blend and the exp
+#endif
+#ifndef PROGRESSIVE_BPM
+#define PROGRESSIVE_BPM 0 // 1: triangles whose BPM data is not computed yet are textured linearly
+#endif
+#ifndef WIREFRAME
+#define WIREFRAME 0 // 1: blend the triangle edges over the texture
+#endif
+#ifndef POINTS
+#define POINTS 0 // 1: blend vertex markers over the texture
+#endif
+#ifndef OVERLAY_ONLY
+#define OVERLAY_ONLY 0 // 1: only the wireframe / vertex markers, for models drawn without fill
+#endif
+#ifndef VISIBILITY_RESOLVE
+#define VISIBILITY_RESOLVE 0 // 1: full-screen pass, fs_in is rebuilt from the visibility buffer
+#endif
+
 // input
+#if VISIBILITY_RESOLVE
+#ifndef RESOLVE_SLOTS
+#define RESOLVE_SLOTS 1 // meshes of one resolve pass
+#endif
+#ifndef RESOLVE_BINDING
+#define RESOLVE_BINDING 18
+#endif
+struct FragmentInput {
+    vec3 v_pos_local;
+    vec2 tex_coords;
+    vec2 tex_coords_dx; // screen space derivatives of the linear texture coordinates
+    vec2 tex_coords_dy;
+    vec3 trig_verts_pos_local[3];
+    uint triangle_id;
+};
+FragmentInput fs_in;
+
+layout (std140, binding = 0) uniform Matrices {
+    mat4 view;
+    mat4 projection;
+};
+layout (std430, binding = 6) readonly buffer Instances {
+    mat4 instance_models[]; // of every visibility draw of the frame
+};
+layout(binding = 1) uniform usampler2D visibility_ids; // (triangle id, instance << 16 | draw id + 1)
+layout(binding = 2) uniform sampler2D visibility_barycentrics;
+layout(binding = 3) uniform sampler2D visibility_depth;
+layout(binding = 4) uniform sampler2D resolve_textures[RESOLVE_SLOTS];
+uniform uint resolve_draw_ids[RESOLVE_SLOTS];        // draw id + 1 of the mesh in each slot, 0 for none
+uniform uint resolve_first_instances[RESOLVE_SLOTS]; // of its draw, in instance_models
+uint resolve_slot; // of the pixel's mesh
+
+// Per-mesh buffers as arrays of blocks, buffer kind k of slot s at RESOLVE_BINDING + k * RESOLVE_SLOTS + s (see
+// Mesh::BindResolveBuffers). A block array takes dynamically uniform indices only, so the slot is found by a loop.
+#define RESOLVE_FETCH_FUNCTION(type, name) \
+    type Fetch_##name(uint idx) { \
+        for (int s = 0; s < RESOLVE_SLOTS; s++) { \
+            if (uint(s) == resolve_slot) return resolve_##name[s].name[idx]; \
+        } \
+        return resolve_##name[0].name[idx]; \
+    }
+layout(std430, binding = RESOLVE_BINDING) readonly buffer ResolveVertices {
+    float vertices[]; // Vertex: position, normal, tex coords
+} resolve_vertices[RESOLVE_SLOTS];
+layout(std430, binding = RESOLVE_BINDING + RESOLVE_SLOTS) readonly buffer ResolveIndices {
+    uint indices[];
+} resolve_indices[RESOLVE_SLOTS];
+RESOLVE_FETCH_FUNCTION(float, vertices)
+RESOLVE_FETCH_FUNCTION(uint, indices)
+const uint kVertexStride = 8u;
+
+vec4 ResolveTexture(vec2 tex_coords) {
+    for (int s = 0; s < RESOLVE_SLOTS; s++) {
+        if (uint(s) == resolve_slot) return textureGrad(resolve_textures[s], tex_coords, fs_in.tex_coords_dx, fs_in.tex_coords_dy);
+    }
+    return vec4(0.0);
+}
+
+// Screen space derivatives of the perspective correct barycentrics of the triangle with clip positions c, at the
+// pixel. The resolve's neighbor pixels may be of other triangles, so they are computed from the triangle itself.
+void BarycentricDerivatives(vec4 c[3], vec2 ndc, out vec3 ddx, out vec3 ddy) {
+    vec3 inv_w = 1.0 / vec3(c[0].w, c[1].w, c[2].w);
+    vec2 p0 = c[0].xy * inv_w.x, p1 = c[1].xy * inv_w.y, p2 = c[2].xy * inv_w.z;
+    float inv_det = 1.0 / determinant(mat2(p2 - p1, p0 - p1));
+    // of the barycentrics over w, per NDC unit
+    vec3 dx = vec3(p1.y - p2.y, p2.y - p0.y, p0.y - p1.y) * inv_det * inv_w;
+    vec3 dy = vec3(p2.x - p1.x, p0.x - p2.x, p1.x - p0.x) * inv_det * inv_w;
+    vec2 delta = ndc - p0;
+    float interp_inv_w = inv_w.x + delta.x * (dx.x + dx.y + dx.z) + delta.y * (dy.x + dy.y + dy.z);
+    vec3 barycentric = (vec3(inv_w.x, 0.0, 0.0) + delta.x * dx + delta.y * dy) / interp_inv_w;
+    vec2 pixel_ndc = 2.0 / vec2(textureSize(visibility_ids, 0));
+    dx *= pixel_ndc.x;
+    dy *= pixel_ndc.y;
+    ddx = (barycentric * interp_inv_w + dx) / (interp_inv_w + dx.x + dx.y + dx.z) - barycentric;
+    ddy = (barycentric * interp_inv_w + dy) / (interp_inv_w + dy.x + dy.y + dy.z) - barycentric;
+}
+
+bool LoadFragmentInput() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    uvec2 id = texelFetch(visibility_ids, pixel, 0).xy;
+    uint draw = id.y & 0xFFFFu;
+    if (draw == 0u) return false;
+    resolve_slot = uint(RESOLVE_SLOTS);
+    for (int s = 0; s < RESOLVE_SLOTS; s++) {
+        if (resolve_draw_ids[s] == draw) resolve_slot = uint(s);
+    }
+    if (resolve_slot == uint(RESOLVE_SLOTS)) return false; // shaded by another pass
+    mat4 mvp = projection * view * instance_models[resolve_first_instances[resolve_slot] + (id.y >> 16)];
+    vec2 b12 = texelFetch(visibility_barycentrics, pixel, 0).xy;
+    vec3 barycentric = vec3(1.0 - b12.x - b12.y, b12);
+    fs_in.triangle_id = id.x;
+    fs_in.v_pos_local = vec3(0.0);
+    fs_in.tex_coords = vec2(0.0);
+    vec2 tex_coords[3];
+    vec4 clip[3];
+    for (uint i = 0u; i < 3u; i++) {
+        uint v = kVertexStride * Fetch_indices(3u * id.x + i);
+        vec3 position = vec3(Fetch_vertices(v), Fetch_vertices(v + 1u), Fetch_vertices(v + 2u));
+        tex_coords[i] = vec2(Fetch_vertices(v + 6u), Fetch_vertices(v + 7u));
+        clip[i] = mvp * vec4(position, 1.0);
+        fs_in.trig_verts_pos_local[i] = position;
+        fs_in.v_pos_local += barycentric[i] * position;
+        fs_in.tex_coords += barycentric[i] * tex_coords[i];
+    }
+    vec3 ddx, ddy;
+    BarycentricDerivatives(clip, 2.0 * gl_FragCoord.xy / vec2(textureSize(visibility_ids, 0)) - 1.0, ddx, ddy);
+    fs_in.tex_coords_dx = ddx.x * tex_coords[0] + ddx.y * tex_coords[1] + ddx.z * tex_coords[2];
+    fs_in.tex_coords_dy = ddy.x * tex_coords[0] + ddy.y * tex_coords[1] + ddy.z * tex_coords[2];
+    gl_FragDepth = texelFetch(visibility_depth, pixel, 0).r; // later passes depth test against the scene
+    return true;
+}
+#else
 in Block2 {
+#if TEXTURE_TYPE != 0
     vec3 v_pos_local;
+#endif
     vec2 tex_coords;
+#if TEXTURE_TYPE == 2
     flat vec3 trig_verts_pos_local[3];
+#endif
+#if TEXTURE_TYPE != 0
     flat uint triangle_id;
+#endif
+#if WIREFRAME || POINTS
+    noperspective vec3 overlay_barycentric;
+#endif
 } fs_in;
+#endif // VISIBILITY_RESOLVE
 
 // Texture
-uniform int texture_type; // 0: Linear | 1: Trivial_PCM | 2: BPM
 uniform sampler2D texture_diffuse0;
 float eps = 1e-5;
 
@@ -16,18 +172,78 @@ float eps = 1e-5;
 struct Mat2c { vec2 a,b,c,d; };
 Mat2c identity2c() { return Mat2c(vec2(1.0,0.0), vec2(0.0,0.0), vec2(0.0,0.0), vec2(1.0,0.0)); }
 
+#if TEXTURE_TYPE != 0
 uniform uint ssbo_idx;
+#if PACKED_RECORDS
+// Everything a fragment needs from its triangle in one 80 byte record, see Mesh::NeighborsComputeShader
+struct BPMRecord {
+    vec4 frame_x; // first two rows of the flattening transform
+    vec4 frame_y;
+    Mat2c coeffs;
+    uvec4 log_ratios; // packHalf2x16 mu of edges ij, jk, ki
+};
+#endif
+#if VISIBILITY_RESOLVE
+#if PACKED_RECORDS
+layout(std430, binding = RESOLVE_BINDING + 5 * RESOLVE_SLOTS) readonly buffer ResolveRecords {
+    BPMRecord records[];
+} resolve_records[RESOLVE_SLOTS];
+RESOLVE_FETCH_FUNCTION(BPMRecord, records)
+#else
+layout(std430, binding = RESOLVE_BINDING + 2 * RESOLVE_SLOTS) readonly buffer ResolveTransformations {
+    mat4 trans[];
+} resolve_trans[RESOLVE_SLOTS];
+layout(std430, binding = RESOLVE_BINDING + 3 * RESOLVE_SLOTS) readonly buffer ResolveMobiusCoeffs {
+    Mat2c mobius_coeffs[];
+} resolve_mobius_coeffs[RESOLVE_SLOTS];
+RESOLVE_FETCH_FUNCTION(mat4, trans)
+RESOLVE_FETCH_FUNCTION(Mat2c, mobius_coeffs)
+#if TEXTURE_TYPE == 2
+layout(std430, binding = RESOLVE_BINDING + 4 * RESOLVE_SLOTS) readonly buffer ResolveLogMobiusRatios {
+    uint log_mobius_ratios[];
+} resolve_log_mobius_ratios[RESOLVE_SLOTS];
+RESOLVE_FETCH_FUNCTION(uint, log_mobius_ratios)
+#endif
+#endif // PACKED_RECORDS
+#if TEXTURE_TYPE == 2 && ADAPTIVE_BPM
+layout(std430, binding = RESOLVE_BINDING + 6 * RESOLVE_SLOTS) readonly buffer ResolveFlatTriangles {
+    uint flat_triangles[];
+} resolve_flat_triangles[RESOLVE_SLOTS];
+RESOLVE_FETCH_FUNCTION(uint, flat_triangles)
+#endif
+#if PROGRESSIVE_BPM
+layout(std430, binding = RESOLVE_BINDING + 7 * RESOLVE_SLOTS) readonly buffer ResolveReadyTriangles {
+    uint ready_triangles[];
+} resolve_ready_triangles[RESOLVE_SLOTS];
+RESOLVE_FETCH_FUNCTION(uint, ready_triangles)
+#endif
+// read from the slot of the pixel's mesh
+#define SLOT_FETCH(arr, idx) Fetch_##arr(idx)
+#else
+#if PACKED_RECORDS
+layout(std430, binding = 7) readonly buffer BPMRecords0 {
+    BPMRecord records0[];
+};
+#if NUM_MESH_SLOTS > 1
+layout(std430, binding = 8) readonly buffer BPMRecords1 {
+    BPMRecord records1[];
+};
+#endif
+#else
 layout(std430, binding = 0) buffer Transformations0 {
     mat4 trans0[]; 
 };
 layout(std430, binding = 1) buffer MobiusCoeffs0 {
      Mat2c mobius_coeffs0[]; 
 };
-
+#if TEXTURE_TYPE == 2
+// per triangle edge refs followed by one mu per edge, see Mesh::NeighborsComputeShader
 layout(std430, binding = 2) buffer LogMobiusRatios0 {
-    Mat2c log_mobius_ratios0[]; 
+    uint log_mobius_ratios0[]; 
 };
+#endif
 
+#if NUM_MESH_SLOTS > 1
 layout(std430, binding = 3) buffer Transformations1 {
     mat4 trans1[]; 
 };
@@ -35,10 +251,46 @@ layout(std430, binding = 3) buffer Transformations1 {
 layout(std430, binding = 4) buffer MobiusCoeffs1 {
      Mat2c mobius_coeffs1[]; 
 };
-
+#if TEXTURE_TYPE == 2
 layout(std430, binding = 5) buffer LogMobiusRatios1 {
-    Mat2c log_mobius_ratios1[]; 
+    uint log_mobius_ratios1[]; 
+};
+#endif
+#endif
+#endif // PACKED_RECORDS
+
+#if TEXTURE_TYPE == 2 && ADAPTIVE_BPM
+// one bit per triangle, set when all its edge log ratios are below the tolerance, see Mesh::ClassifyTriangles
+layout(std430, binding = 11) readonly buffer FlatTriangles0 {
+    uint flat_triangles0[];
 };
+#if NUM_MESH_SLOTS > 1
+layout(std430, binding = 12) readonly buffer FlatTriangles1 {
+    uint flat_triangles1[];
+};
+#endif
+#endif
+
+#if PROGRESSIVE_BPM
+// one bit per triangle, set when its BPM data is uploaded, see Mesh::PrecomputeChunk
+layout(std430, binding = 15) readonly buffer ReadyTriangles0 {
+    uint ready_triangles0[];
+};
+#if NUM_MESH_SLOTS > 1
+layout(std430, binding = 16) readonly buffer ReadyTriangles1 {
+    uint ready_triangles1[];
+};
+#endif
+#endif
+
+#if NUM_MESH_SLOTS > 1
+// read from the SSBO slot of the bound mesh
+#define SLOT_FETCH(arr, idx) ((ssbo_idx == 1u) ? arr##1[idx] : arr##0[idx])
+#else
+#define SLOT_FETCH(arr, idx) (arr##0[idx])
+#endif
+#endif // VISIBILITY_RESOLVE
+#endif // TEXTURE_TYPE != 0
 
 
 float PointToEdgeDistance(vec2 z, vec2 z1, vec2 z2) {
@@ -245,20 +497,50 @@ vec2 MobiusTransform(Mat2c coeff, vec2 z) {
     return ComplexDivide(numerator, denominator);
 }
 
-Mat2c getLogMobiusRatio(uint trig_idx, uint edge_idx) {
-    Mat2c log_mobius_ratio;
-    switch (ssbo_idx) {
-        case 1:  log_mobius_ratio = log_mobius_ratios1[3*trig_idx + edge_idx];
-        default: log_mobius_ratio = log_mobius_ratios0[3*trig_idx + edge_idx];
-    }
-    return log_mobius_ratio;
+#if TEXTURE_TYPE == 2
+// The log ratio of an edge fixes its endpoints p0, p1, so it is rebuilt from one complex number mu:
+// L = mu / (p1 - p0) * [[p0 + p1, -2 p0 p1], [2, -(p0 + p1)]]
+vec2 getEdgeMu(uint trig_idx, uint edge_idx) {
+#if PACKED_RECORDS
+    return unpackHalf2x16(SLOT_FETCH(records, trig_idx).log_ratios[edge_idx]);
+#else
+    uint ref = SLOT_FETCH(log_mobius_ratios, 3*trig_idx + edge_idx);
+    uint offset = ref >> 1;
+    vec2 mu = vec2(uintBitsToFloat(SLOT_FETCH(log_mobius_ratios, offset)),
+                   uintBitsToFloat(SLOT_FETCH(log_mobius_ratios, offset + 1)));
+    return ((ref & 1u) != 0u) ? -mu : mu;
+#endif
 }
 
+Mat2c getLogMobiusRatio(uint trig_idx, uint edge_idx, vec2 p0, vec2 p1) {
+    vec2 mu = getEdgeMu(trig_idx, edge_idx);
+    Mat2c log_ratio = Mat2c(vec2(0.0), vec2(0.0), vec2(0.0), vec2(0.0));
+    if (mu == vec2(0.0)) return log_ratio; // boundary edge
+    vec2 s = ComplexDivide(mu, p1 - p0);
+    log_ratio.a = ComplexMult(s, p0 + p1);
+    log_ratio.b = -2.0 * ComplexMult(s, ComplexMult(p0, p1));
+    log_ratio.c = 2.0 * s;
+    log_ratio.d = -log_ratio.a;
+    return log_ratio;
+}
+
+#if PROGRESSIVE_BPM
+bool isReadyTriangle(uint trig_idx) {
+    return (SLOT_FETCH(ready_triangles, trig_idx >> 5) & (1u << (trig_idx & 31u))) != 0u;
+}
+#endif
+
+#if ADAPTIVE_BPM
+bool isFlatTriangle(uint trig_idx) {
+    return (SLOT_FETCH(flat_triangles, trig_idx >> 5) & (1u << (trig_idx & 31u))) != 0u;
+}
+#endif
+
 Mat2c BlendedLogRatio(vec2 z, vec2 zi, vec2 zj, vec2 zk) {
     vec3 edge_barycentric_coords = EdgeBarycentricCoords(z, zi, zj, zk);
-    Mat2c log_Eij = getLogMobiusRatio(fs_in.triangle_id, 0);
-    Mat2c log_Ejk = getLogMobiusRatio(fs_in.triangle_id, 1);
-    Mat2c log_Eki = getLogMobiusRatio(fs_in.triangle_id, 2);
+    Mat2c log_Eij = getLogMobiusRatio(fs_in.triangle_id, 0, zi, zj);
+    Mat2c log_Ejk = getLogMobiusRatio(fs_in.triangle_id, 1, zj, zk);
+    Mat2c log_Eki = getLogMobiusRatio(fs_in.triangle_id, 2, zk, zi);
 
     log_Eij = ComplexMatrixScalarMult(log_Eij, edge_barycentric_coords.x);
     log_Ejk = ComplexMatrixScalarMult(log_Ejk, edge_barycentric_coords.y);
@@ -266,59 +548,119 @@ Mat2c BlendedLogRatio(vec2 z, vec2 zi, vec2 zj, vec2 zk) {
     Mat2c sum = ComplexMatrixAdd(ComplexMatrixAdd(log_Eij, log_Ejk), log_Eki);
     return sum;
 }
+#endif
 
+#if TEXTURE_TYPE != 0
+#if PACKED_RECORDS
 Mat2c getCoeff(uint trig_idx) {
-    Mat2c coeff;
-    switch (ssbo_idx) {
-        case 1:  coeff = mobius_coeffs1[trig_idx];
-        default: coeff = mobius_coeffs0[trig_idx];
-    return coeff;
-    }
+    return SLOT_FETCH(records, trig_idx).coeffs;
 }
 
 mat4 getTrans(uint trig_idx) {
-    mat4 trans;
-    switch (ssbo_idx) {
-        case 1:  trans = trans1[trig_idx];
-        default: trans = trans0[trig_idx];
-    return trans;
-    }
+    BPMRecord record = SLOT_FETCH(records, trig_idx);
+    return transpose(mat4(record.frame_x, record.frame_y, vec4(0.0), vec4(0.0, 0.0, 0.0, 1.0)));
+}
+#else
+Mat2c getCoeff(uint trig_idx) {
+    return SLOT_FETCH(mobius_coeffs, trig_idx);
 }
 
+mat4 getTrans(uint trig_idx) {
+    return SLOT_FETCH(trans, trig_idx);
+}
+#endif
+#endif
+
+#if WIREFRAME || POINTS
+const vec3 kOverlayColor = vec3(0.0);
+const float kWireframeHalfWidth = 1.5; // pixels
+const float kPointHalfSize = 1.5;
+
+// Coverage of the wireframe / vertex markers. The barycentric coordinate of a vertex over the length of its
+// screen space gradient is the distance in pixels to the opposite edge.
+float OverlayCoverage() {
+    vec3 b = fs_in.overlay_barycentric;
+    vec3 dx = dFdx(b), dy = dFdy(b);
+    vec3 d = b / max(sqrt(dx * dx + dy * dy), vec3(1e-6));
+    float coverage = 0.0;
+#if WIREFRAME
+    float edge_distance = min(d.x, min(d.y, d.z));
+    coverage = 1.0 - smoothstep(kWireframeHalfWidth - 0.5, kWireframeHalfWidth + 0.5, edge_distance);
+#endif
+#if POINTS
+    // near a vertex both edges through it are near
+    float vertex_distance = min(max(d.y, d.z), min(max(d.z, d.x), max(d.x, d.y)));
+    coverage = max(coverage, 1.0 - smoothstep(kPointHalfSize - 0.5, kPointHalfSize + 0.5, vertex_distance));
+#endif
+    return coverage;
+}
+#endif
+
 out vec4 FragColor;
 
 void main() {
-    vec2 tex_coords = vec2(0.0);
-    if (texture_type == 0) { // Linear
-        tex_coords = fs_in.tex_coords;
-    } 
-    else if (texture_type == 1) // 1: Trivial PCM
-    { 
+#if VISIBILITY_RESOLVE
+    if (!LoadFragmentInput()) discard;
+#endif
+#if WIREFRAME || POINTS
+    float overlay = OverlayCoverage(); // before any branch, it takes derivatives
+#endif
+#if OVERLAY_ONLY
+    if (overlay < 0.5) discard;
+    FragColor = vec4(kOverlayColor, 1.0);
+    return;
+#endif
+#if TEXTURE_TYPE == 0 // Linear
+    vec2 tex_coords = fs_in.tex_coords;
+#else
+    vec2 tex_coords = fs_in.tex_coords; // linear until the triangle's BPM data is ready
+#if PROGRESSIVE_BPM
+    if (isReadyTriangle(fs_in.triangle_id))
+#endif
+    {
+#if TEXTURE_TYPE == 1 // Direct Mobius
         mat4 trans = getTrans(fs_in.triangle_id);
         vec2 v_pos_tr = flattenPoint(fs_in.v_pos_local, trans);
         Mat2c coeff = getCoeff(fs_in.triangle_id);
         tex_coords = MobiusTransform(coeff, v_pos_tr);
-    } 
-    else if (texture_type == 2) // 2: BPM
-    { 
+#else // BPM
         // transform
         mat4 trans = getTrans(fs_in.triangle_id);
         vec2 v_pos_tr = flattenPoint(fs_in.v_pos_local, trans);
-        vec2 vi_tr = flattenPoint(fs_in.trig_verts_pos_local[0], trans);
-        vec2 vj_tr = flattenPoint(fs_in.trig_verts_pos_local[1], trans);
-        vec2 vk_tr = flattenPoint(fs_in.trig_verts_pos_local[2], trans);
-        Mat2c blended_log_ratio = BlendedLogRatio(v_pos_tr, vi_tr, vj_tr, vk_tr);
-        
-        blended_log_ratio = ComplexMatrixScalarMult(blended_log_ratio, 0.5);
-        blended_log_ratio = ComplexMatrixExp(blended_log_ratio,10);
-        // blended_log_ratio = ComplexMatrixExp(blended_log_ratio);
-        // Compute Mz
         Mat2c coeff = getCoeff(fs_in.triangle_id);
-        Mat2c Mz = ComplexMatrixMultiply(coeff, blended_log_ratio); // ORDER MATTERS!
-        // Compute BPM coords
-        tex_coords = MobiusTransform(Mz, v_pos_tr);
+#if ADAPTIVE_BPM
+        if (isFlatTriangle(fs_in.triangle_id)) {
+            tex_coords = MobiusTransform(coeff, v_pos_tr); // the blend is the triangle's own Mobius map
+        } else
+#endif
+        {
+            vec2 vi_tr = flattenPoint(fs_in.trig_verts_pos_local[0], trans);
+            vec2 vj_tr = flattenPoint(fs_in.trig_verts_pos_local[1], trans);
+            vec2 vk_tr = flattenPoint(fs_in.trig_verts_pos_local[2], trans);
+            Mat2c blended_log_ratio = BlendedLogRatio(v_pos_tr, vi_tr, vj_tr, vk_tr);
+            
+            blended_log_ratio = ComplexMatrixScalarMult(blended_log_ratio, 0.5);
+#if EXP_METHOD == 1
+            blended_log_ratio = ComplexMatrixExp(blended_log_ratio);
+#else
+            blended_log_ratio = ComplexMatrixExp(blended_log_ratio, uint(EXP_TERMS));
+#endif
+            // Compute Mz
+            Mat2c Mz = ComplexMatrixMultiply(coeff, blended_log_ratio); // ORDER MATTERS!
+            // Compute BPM coords
+            tex_coords = MobiusTransform(Mz, v_pos_tr);
+        }
+#endif
     }
+#endif
+#if VISIBILITY_RESOLVE
+    vec3 texture_color = ResolveTexture(tex_coords).rgb;
+#else
     vec3 texture_color = texture(texture_diffuse0, tex_coords).rgb;
+#endif
+#if WIREFRAME || POINTS
+    texture_color = mix(texture_color, kOverlayColor, overlay);
+#endif
     FragColor = vec4(texture_color, 1.0);
     return;
 }
@@ -1,41 +1,90 @@
 #version 460 core
+#ifndef TEXTURE_TYPE
+#define TEXTURE_TYPE 2 // 0: Linear (only with an overlay) | 1: Direct Mobius | 2: BPM
+#endif
+#ifndef WIREFRAME
+#define WIREFRAME 0
+#endif
+#ifndef POINTS
+#define POINTS 0
+#endif
+#ifndef VISIBILITY_PASS
+#define VISIBILITY_PASS 0 // 1: only triangle id and barycentrics, for the visibility buffer
+#endif
 
 layout(triangles) in;
 layout(triangle_strip, max_vertices = 3) out;
+// fill and overlay draws of the same triangle must have the same depth, whichever program draws them
+invariant gl_Position;
 
 layout (std140, binding = 0) uniform Matrices {
-    mat4 model;
     mat4 view;
     mat4 projection;
 };
-mat4 modelview = view * model;
-mat4 mvp = projection * modelview;
+layout (std430, binding = 6) readonly buffer Instances {
+    mat4 instance_models[]; // model matrix per gl_InstanceID
+};
 
 in Block {
     vec3 v_pos_local;
     vec2 tex_coords;
-    flat uint triangle_id;
+    flat uint first_triangle;
+    flat uint instance;
 } gs_in[];
 
+#if VISIBILITY_PASS
+out Block2 {
+    vec2 barycentric; // of vertices 1 and 2, perspective correct
+    flat uint triangle_id;
+    flat uint instance; // the resolve rebuilds the triangle's clip positions for the texture derivatives
+} gs_out;
+#else
 out Block2 {
+#if TEXTURE_TYPE != 0
     vec3 v_pos_local;
+#endif
     vec2 tex_coords;
+#if TEXTURE_TYPE == 2
     flat vec3 trig_verts_pos_local[3];
+#endif
+#if TEXTURE_TYPE != 0
     flat uint triangle_id;
+#endif
+#if WIREFRAME || POINTS
+    noperspective vec3 overlay_barycentric; // screen space, for the wireframe and vertex overlay
+#endif
 } gs_out;
+#endif
 
 void main() {
+    mat4 model = instance_models[gs_in[0].instance];
     // Pass through the vertex position
-    gs_out.triangle_id = gs_in[0].triangle_id;
+#if TEXTURE_TYPE != 0 || VISIBILITY_PASS
+    gs_out.triangle_id = gs_in[0].first_triangle + uint(gl_PrimitiveIDIn); // index into the mesh's element buffer / 3
+#endif
+#if VISIBILITY_PASS
+    gs_out.instance = gs_in[0].instance;
+#endif
+#if TEXTURE_TYPE == 2 && !VISIBILITY_PASS
     for (int i = 0; i < 3; i++) {
         gs_out.trig_verts_pos_local[i] = gs_in[i].v_pos_local;
     }
+#endif
 
     // Emit the vertices of the triangle
     for (int i = 0; i < 3; i++) {
+#if VISIBILITY_PASS
+        gs_out.barycentric = vec2(i == 1 ? 1.0 : 0.0, i == 2 ? 1.0 : 0.0);
+#else
+#if TEXTURE_TYPE != 0
         gs_out.v_pos_local = gs_in[i].v_pos_local;
+#endif
         gs_out.tex_coords = gs_in[i].tex_coords;
-        gl_Position = mvp * vec4(gs_in[i].v_pos_local, 1.0);
+#if WIREFRAME || POINTS
+        gs_out.overlay_barycentric = vec3(i == 0 ? 1.0 : 0.0, i == 1 ? 1.0 : 0.0, i == 2 ? 1.0 : 0.0);
+#endif
+#endif
+        gl_Position = projection * view * model * vec4(gs_in[i].v_pos_local, 1.0); // as bpm_vs.glsl
         EmitVertex();
     }
     EndPrimitive();
@@ -1,18 +1,51 @@
 #version 460 core
+#ifndef TEXTURE_TYPE
+#define TEXTURE_TYPE 2 // 0: Linear | 1: Direct Mobius | 2: BPM
+#endif
+#ifndef WIREFRAME
+#define WIREFRAME 0
+#endif
+#ifndef POINTS
+#define POINTS 0
+#endif
+// Linear without an overlay has no geometry stage
+#define NO_GEOMETRY_STAGE (TEXTURE_TYPE == 0 && !WIREFRAME && !POINTS)
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoords;
-layout(location = 3) in float aTriangleID;
 
+#if NO_GEOMETRY_STAGE
+// the same depth as the geometry stage's overlay draws of these triangles (bpm_gs.glsl), they test GL_LEQUAL
+invariant gl_Position;
+// feed the fragment shader directly
+layout (std140, binding = 0) uniform Matrices {
+    mat4 view;
+    mat4 projection;
+};
+layout (std430, binding = 6) readonly buffer Instances {
+    mat4 instance_models[]; // model matrix per gl_InstanceID
+};
+
+out Block2 {
+    vec2 tex_coords;
+} vs_out;
+#else
 out Block {
     vec3 v_pos_local;
     vec2 tex_coords;
-    flat uint triangle_id;
+    flat uint first_triangle; // meshlet draws start at gl_BaseInstance, primitive ids restart per draw
+    flat uint instance;
 } vs_out;
+#endif
     
 void main() {
-    vs_out.v_pos_local = aPos;
     vs_out.tex_coords = aTexCoords;
-    vs_out.triangle_id = uint(aTriangleID);
+#if NO_GEOMETRY_STAGE
+    gl_Position = projection * view * instance_models[gl_InstanceID] * vec4(aPos, 1.0);
+#else
+    vs_out.v_pos_local = aPos;
+    vs_out.first_triangle = uint(gl_BaseInstance);
+    vs_out.instance = uint(gl_InstanceID);
     gl_Position = vec4(aPos, 1.0);
-}
\ No newline at end of file
+#endif
+}
@@ -5,7 +5,6 @@ layout (location = 1) in vec3 aColor;
 out vec3 ourColor;
 
 layout (std140, binding = 0) uniform Matrices {
-    mat4 model;
     mat4 view;
     mat4 projection;
 };
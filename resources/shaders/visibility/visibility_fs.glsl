@@ -0,0 +1,18 @@
+#version 460 core
+// First pass of the visibility buffer: which triangle covers the pixel, and where in it
+
+in Block2 {
+    vec2 barycentric;
+    flat uint triangle_id;
+    flat uint instance;
+} fs_in;
+
+uniform uint draw_id; // index of the mesh in this frame's visibility draws
+
+layout(location = 0) out uvec2 visibility_id; // (triangle id, instance << 16 | draw id + 1), 0 is background
+layout(location = 1) out vec2 visibility_barycentric;
+
+void main() {
+    visibility_id = uvec2(fs_in.triangle_id, (fs_in.instance << 16) | (draw_id + 1u));
+    visibility_barycentric = fs_in.barycentric;
+}
@@ -113,3 +113,73 @@ cvec ApplyMobius(const Matrix2c& mobius, const cvec& z) {
     Complex result = ApplyMobius(mobius, z_complex);
     return cvec(result.real(), result.imag());
 }
+
+namespace {
+    using ComplexD = std::complex<double>;
+
+    // the (c, d) row of the normalized Mobius map taking z to w, in double precision
+    std::array<ComplexD, 2> MobiusDenominatorD(const std::array<Complex, 3>& z, const std::array<Complex, 3>& w) {
+        Eigen::Matrix3cd matA, matB, matC, matD;
+        ComplexD z0(z[0]), z1(z[1]), z2(z[2]), w0(w[0]), w1(w[1]), w2(w[2]), one(1, 0);
+        matA << z0 * w0, w0, one,
+                z1 * w1, w1, one,
+                z2 * w2, w2, one;
+        matB << z0 * w0, z0, w0,
+                z1 * w1, z1, w1,
+                z2 * w2, z2, w2;
+        matC << z0, w0, one,
+                z1, w1, one,
+                z2, w2, one;
+        matD << z0 * w0, z0, one,
+                z1 * w1, z1, one,
+                z2 * w2, z2, one;
+        ComplexD a = matA.determinant(), b = matB.determinant(), c = matC.determinant(), d = matD.determinant();
+        ComplexD norm_factor = std::sqrt(a * d - b * c);
+        return {c / norm_factor, d / norm_factor};
+    }
+
+    float PointToEdgeDistance(const Complex& z, const Complex& z1, const Complex& z2) {
+        Complex e = z1 - z2, w = z - z2;
+        return std::abs(e.real() * w.imag() - e.imag() * w.real()) / std::abs(e);
+    }
+} // namespace
+
+Complex ComputeEdgeLogRatio(const std::array<Complex, 3>& z, const std::array<Complex, 3>& w,
+                            const std::array<Complex, 3>& z_nbr, const std::array<Complex, 3>& w_nbr, const Complex& p0) {
+    // M (p0, 1)^T = (c p0 + d) (w0, 1)^T, so the eigenvalue of M^-1 * M_nbr at the fixed point p0 is
+    // (c_nbr p0 + d_nbr) / (c p0 + d). Both determinants are 1, its reciprocal is the eigenvalue at p1.
+    std::array<ComplexD, 2> cd = MobiusDenominatorD(z, w);
+    std::array<ComplexD, 2> cd_nbr = MobiusDenominatorD(z_nbr, w_nbr);
+    ComplexD p(p0);
+    ComplexD lambda = (cd[0] * p + cd[1]) / (cd_nbr[0] * p + cd_nbr[1]);
+    // same sign choice as Mat2c::LogRatio, whose trace is lambda + 1/lambda
+    if ((lambda + 1.0 / lambda).real() < 0.0) {
+        lambda = -lambda;
+    }
+    return Complex(std::log(lambda));
+}
+
+Mat2c EdgeLogRatioMatrix(const Complex& mu, const Complex& p0, const Complex& p1) {
+    Complex s = mu / (p1 - p0);
+    Complex a = s * (p0 + p1);
+    Complex b = -2.0f * s * p0 * p1;
+    Complex c = 2.0f * s;
+    return Mat2c(cvec(a.real(), a.imag()), cvec(b.real(), b.imag()), cvec(c.real(), c.imag()), cvec(-a.real(), -a.imag()));
+}
+
+Complex EvaluateBPM(const Mat2c& coeffs, const std::array<Complex, 3>& mu, const std::array<Complex, 3>& p, const Complex& z) {
+    // edge barycentric coordinates, z is assumed to be inside the triangle and off its edges
+    float r_ij = PointToEdgeDistance(z, p[0], p[1]);
+    float r_jk = PointToEdgeDistance(z, p[1], p[2]);
+    float r_ki = PointToEdgeDistance(z, p[2], p[0]);
+    vec3 gamma(r_jk * r_ki, r_ki * r_ij, r_ij * r_jk);
+    gamma /= gamma.x + gamma.y + gamma.z;
+
+    Matrix2c blended_log_ratio = Matrix2c::Zero();
+    for (int e = 0; e < 3; ++e) {
+        if (mu[e] == Complex(0.0f)) continue;
+        blended_log_ratio += EdgeLogRatioMatrix(mu[e], p[e], p[(e + 1) % 3]).ToEigenMatrix() * Complex(gamma[e]);
+    }
+    Matrix2c mz = coeffs.ToEigenMatrix() * (blended_log_ratio * Complex(0.5f)).exp();
+    return ApplyMobius(mz, z);
+}
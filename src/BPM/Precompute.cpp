@@ -0,0 +1,409 @@
+#include "BPM/Precompute.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <glm/gtc/packing.hpp>
+
+#include "Utils/Files.h"
+
+// ---------------------- PER TRIANGLE ---------------------- //
+TriangleBPM ComputeTriangleBPM(const glm::vec4* flat, bool log_ratios) {
+    Complex vi    = Complex(flat[0].x, flat[0].y);
+    Complex vi_vt = Complex(flat[0].z, flat[0].w);
+    Complex vj    = Complex(flat[1].x, flat[1].y);
+    Complex vj_vt = Complex(flat[1].z, flat[1].w);
+    Complex vk    = Complex(flat[2].x, flat[2].y);
+    Complex vk_vt = Complex(flat[2].z, flat[2].w);
+    Complex vl    = Complex(flat[3].x, flat[3].y);
+    Complex vl_vt = Complex(flat[3].z, flat[3].w);
+    Complex vm    = Complex(flat[4].x, flat[4].y);
+    Complex vm_vt = Complex(flat[4].z, flat[4].w);
+    Complex vn    = Complex(flat[5].x, flat[5].y);
+    Complex vn_vt = Complex(flat[5].z, flat[5].w);
+
+    TriangleBPM bpm;
+    bpm.p = {vi, vj, vk};
+    bpm.coeffs = ComputeMobiusCoefficients({vi, vj, vk}, {vi_vt, vj_vt, vk_vt});
+    if (!log_ratios) return bpm; // DIRECT_MOBIUS needs the coefficients only
+
+    float tolerance = 1e-6;
+    bpm.has_neighbor = {std::abs(vl - vi) > tolerance, std::abs(vm - vi) > tolerance, std::abs(vn - vi) > tolerance};
+    if (bpm.has_neighbor[0]) bpm.mu[0] = ComputeEdgeLogRatio({vi, vj, vk}, {vi_vt, vj_vt, vk_vt}, {vj, vi, vl}, {vj_vt, vi_vt, vl_vt}, vi);
+    if (bpm.has_neighbor[1]) bpm.mu[1] = ComputeEdgeLogRatio({vi, vj, vk}, {vi_vt, vj_vt, vk_vt}, {vk, vj, vm}, {vk_vt, vj_vt, vm_vt}, vj);
+    if (bpm.has_neighbor[2]) bpm.mu[2] = ComputeEdgeLogRatio({vi, vj, vk}, {vi_vt, vj_vt, vk_vt}, {vi, vk, vn}, {vi_vt, vk_vt, vn_vt}, vk);
+    return bpm;
+}
+
+// centroid and points near the edge midpoints
+static std::array<Complex, 4> ErrorSamples(const TriangleBPM& bpm) {
+    const Complex& vi = bpm.p[0]; const Complex& vj = bpm.p[1]; const Complex& vk = bpm.p[2];
+    return {(vi + vj + vk) / 3.0f, 0.98f * 0.5f * (vi + vj) + 0.02f * vk,
+            0.98f * 0.5f * (vj + vk) + 0.02f * vi, 0.98f * 0.5f * (vk + vi) + 0.02f * vj};
+}
+
+BPMRecord MakeBPMRecord(const glm::mat4& frame, const TriangleBPM& bpm, float& max_uv_error, double& sum_uv_error) {
+    BPMRecord record;
+    record.frame_x = glm::vec4(frame[0][0], frame[1][0], frame[2][0], frame[3][0]);
+    record.frame_y = glm::vec4(frame[0][1], frame[1][1], frame[2][1], frame[3][1]);
+    record.coeffs = bpm.coeffs;
+    std::array<Complex, 3> mu_half;
+    for (int e = 0; e < 3; e++) {
+        record.log_ratios[e] = glm::packHalf2x16(glm::vec2(bpm.mu[e].real(), bpm.mu[e].imag()));
+        glm::vec2 unpacked = glm::unpackHalf2x16(record.log_ratios[e]);
+        mu_half[e] = Complex(unpacked.x, unpacked.y);
+    }
+    record.log_ratios[3] = 0u;
+    for (const Complex& z : ErrorSamples(bpm)) {
+        float uv_error = std::abs(EvaluateBPM(bpm.coeffs, mu_half, bpm.p, z) - EvaluateBPM(bpm.coeffs, bpm.mu, bpm.p, z));
+        if (!std::isfinite(uv_error)) continue; // degenerate triangle
+        max_uv_error = std::max(max_uv_error, uv_error);
+        sum_uv_error += uv_error;
+    }
+    return record;
+}
+
+float ComputeFlatUVError(const TriangleBPM& bpm) {
+    const std::array<Complex, 3> no_mu = {Complex(0.0f), Complex(0.0f), Complex(0.0f)};
+    float flat_uv_error = 0.0f;
+    for (const Complex& z : ErrorSamples(bpm)) {
+        float uv_error = std::abs(EvaluateBPM(bpm.coeffs, no_mu, bpm.p, z) - EvaluateBPM(bpm.coeffs, bpm.mu, bpm.p, z));
+        if (std::isfinite(uv_error)) flat_uv_error = std::max(flat_uv_error, uv_error);
+    }
+    return flat_uv_error;
+}
+
+// ---------------------- FLATTENING ---------------------- //
+// CPU versions of neighbors_cs.glsl
+static glm::vec3 TransformPoint(const glm::mat4& transformation, const glm::vec3& v) {
+    glm::vec4 transformed = transformation * glm::vec4(v, 1.0f);
+    return glm::vec3(transformed) / transformed.w;
+}
+
+static glm::mat4 ComputeTriangleFrame(const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, bool is_left_vt) {
+    glm::vec3 v1 = glm::normalize(p2 - p1);
+    glm::vec3 n = glm::normalize(glm::cross(v1, p3 - p2));
+    if (is_left_vt) n = -n;
+    glm::vec3 v2 = glm::normalize(glm::cross(n, v1));
+    glm::vec3 projected_origin = glm::dot(n, p1) * n;
+    glm::mat3 R_t = glm::transpose(glm::mat3(v1, v2, n));
+    glm::mat4 transformation = glm::mat4(R_t);
+    transformation[3] = glm::vec4(-R_t * projected_origin, 1.0f);
+    return transformation;
+}
+
+static glm::mat4 CreateRotation3dLineAngle(const glm::vec3& center, const glm::vec3& v, float theta) {
+    glm::mat3 P = glm::outerProduct(v, v);
+    glm::mat3 Q = glm::transpose(glm::mat3(0.0f, -v.z, v.y, v.z, 0.0f, -v.x, -v.y, v.x, 0.0f)); // cross product matrix
+    glm::mat3 R = P + (glm::mat3(1.0f) - P) * std::cos(theta) + Q * std::sin(theta);
+    glm::mat4 result = glm::mat4(R);
+    result[3] = glm::vec4(-R * center + center, 1.0f);
+    return result;
+}
+
+// the third vertex of the neighbor across the edge origin-end, rotated around the edge into the triangle's plane
+static glm::vec2 FlattenVertex(const glm::vec3& origin, const glm::vec3& end, const glm::vec3& new_v, bool is_left_vt) {
+    float sgn = is_left_vt ? -1.0f : 1.0f;
+    glm::vec3 dir = glm::normalize(end - origin);
+    glm::vec3 v1 = glm::normalize(sgn * glm::cross(dir, glm::vec3(0.0f, 0.0f, 1.0f)));
+    glm::vec3 n = sgn * glm::cross(end - new_v, origin - new_v); // normal of the other triangle
+    float theta = sgn * std::atan2(-glm::dot(n, v1), n.z);
+    return glm::vec2(TransformPoint(CreateRotation3dLineAngle(origin, dir, theta), new_v));
+}
+
+unsigned int ThirdVertex(const unsigned int* triangle, unsigned int a, unsigned int b) {
+    if (triangle[0] != a && triangle[0] != b) return triangle[0];
+    return (triangle[1] != a && triangle[1] != b) ? triangle[1] : triangle[2];
+}
+
+void FlattenTriangle(const Vertex* vertices, const unsigned int* indices, unsigned int face, const int neighbors[3],
+                     glm::mat4& frame, glm::vec4 flat[6]) {
+    const unsigned int* idx = &indices[3 * face];
+    glm::vec3 p[3];
+    glm::vec2 vt[3];
+    for (int k = 0; k < 3; k++) {
+        p[k] = vertices[idx[k]].position_;
+        vt[k] = vertices[idx[k]].tex_coords_;
+    }
+    glm::vec2 vij_vt = vt[1] - vt[0], vik_vt = vt[2] - vt[0];
+    bool is_left_vt = (vij_vt.x * vik_vt.y - vij_vt.y * vik_vt.x) < 0.0f;
+    frame = ComputeTriangleFrame(p[0], p[1], p[2], is_left_vt);
+    for (int k = 0; k < 3; k++) {
+        p[k] = TransformPoint(frame, p[k]);
+        flat[k] = glm::vec4(p[k].x, p[k].y, vt[k].x, vt[k].y);
+    }
+    for (int e = 0; e < 3; e++) {
+        flat[3 + e] = glm::vec4(p[0].x, p[0].y, 0.0f, 0.0f); // no neighbor
+        if (neighbors[e] < 0) continue;
+        unsigned int third = ThirdVertex(&indices[3 * neighbors[e]], idx[e], idx[(e + 1) % 3]);
+        glm::vec3 third_p = TransformPoint(frame, vertices[third].position_);
+        glm::vec2 flattened = FlattenVertex(p[e], p[(e + 1) % 3], third_p, is_left_vt);
+        flat[3 + e] = glm::vec4(flattened, vertices[third].tex_coords_);
+    }
+}
+
+std::vector<int> ComputeEdgeAdjacency(const std::vector<unsigned int>& indices, size_t num_vertices) {
+    // vertex -> triangles (CSR), in triangle order
+    std::vector<unsigned int> offsets(num_vertices + 1, 0u);
+    for (unsigned int v : indices) offsets[v + 1]++;
+    for (size_t v = 0; v < num_vertices; v++) offsets[v + 1] += offsets[v];
+    std::vector<unsigned int> faces(indices.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    unsigned int num_faces = static_cast<unsigned int>(indices.size() / 3);
+    for (unsigned int f = 0; f < num_faces; f++) {
+        for (int k = 0; k < 3; k++) {
+            faces[fill[indices[3 * f + k]]++] = f;
+        }
+    }
+    std::vector<int> adjacency(3 * static_cast<size_t>(num_faces), -1);
+    for (unsigned int f = 0; f < num_faces; f++) {
+        for (int e = 0; e < 3; e++) {
+            unsigned int a = indices[3 * f + e], b = indices[3 * f + (e + 1) % 3];
+            for (unsigned int i = offsets[a]; i < offsets[a + 1]; i++) {
+                unsigned int other = faces[i];
+                if (other == f) continue;
+                const unsigned int* o = &indices[3 * other];
+                if (o[0] == b || o[1] == b || o[2] == b) {
+                    adjacency[3 * f + e] = static_cast<int>(other);
+                    break;
+                }
+            }
+        }
+    }
+    return adjacency;
+}
+
+// ---------------------- LOG RATIO LAYOUT ---------------------- //
+LogRatioLayout::LogRatioLayout(unsigned int num_faces) {
+    // until the end there is room for one pair per triangle edge
+    uint32_t zero_offset = 3 * num_faces;
+    data_.assign(3 * static_cast<size_t>(num_faces) + 2, zero_offset << 1);
+    data_[3 * static_cast<size_t>(num_faces)] = data_[3 * static_cast<size_t>(num_faces) + 1] = 0u;
+}
+
+void LogRatioLayout::Set(size_t slot, unsigned int a, unsigned int b, Complex mu) {
+    uint64_t key = (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+    float tolerance = 1e-4f * std::max(1.0f, std::abs(mu));
+    std::vector<std::pair<uint32_t, Complex>>& entries = edge_entries_[key];
+    for (const auto& [offset, stored] : entries) {
+        // the other side may be a different branch of the log, then it gets its own entry
+        if (std::abs(stored - mu) < tolerance) { data_[slot] = offset << 1; num_shared_++; return; }
+        if (std::abs(stored + mu) < tolerance) { data_[slot] = (offset << 1) | 1u; num_shared_++; return; }
+    }
+    uint32_t offset = static_cast<uint32_t>(data_.size());
+    float re = mu.real(), im = mu.imag();
+    uint32_t bits[2];
+    std::memcpy(bits, &re, sizeof(float));
+    std::memcpy(bits + 1, &im, sizeof(float));
+    data_.push_back(bits[0]);
+    data_.push_back(bits[1]);
+    entries.emplace_back(offset, mu);
+    data_[slot] = offset << 1;
+}
+
+Complex GetEdgeLogRatio(const uint32_t* log_ratios, size_t slot) {
+    uint32_t ref = log_ratios[slot];
+    float re, im;
+    std::memcpy(&re, &log_ratios[ref >> 1], sizeof(float));
+    std::memcpy(&im, &log_ratios[(ref >> 1) + 1], sizeof(float));
+    return (ref & 1u) ? -Complex(re, im) : Complex(re, im);
+}
+
+// ---------------------- INCREMENTAL UPDATES ---------------------- //
+void RecomputeTriangles(const Vertex* vertices, const unsigned int* indices, const std::vector<unsigned int>& faces,
+                        const std::vector<int>& neighbors, bool log_ratios, std::vector<glm::mat4>& frames,
+                        std::vector<TriangleBPM>& bpms) {
+    frames.resize(faces.size());
+    bpms.resize(faces.size());
+    for (size_t r = 0; r < faces.size(); r++) {
+        glm::vec4 flat[6];
+        FlattenTriangle(vertices, indices, faces[r], &neighbors[3 * r], frames[r], flat);
+        bpms[r] = ComputeTriangleBPM(flat, log_ratios);
+    }
+}
+
+// An edge is done once, from the first of its two triangles, with the pairs it has: one for both sides when they
+// match up to the sign (see LogRatioLayout), else one each.
+void UpdateEdgeLogRatios(std::vector<uint32_t>& log_ratios, std::vector<uint32_t>& free_pairs, uint32_t num_faces,
+                         const std::vector<unsigned int>& changed_faces, const std::vector<unsigned int>& faces,
+                         const std::vector<int>& neighbors, const std::vector<TriangleBPM>& bpms, std::vector<uint32_t>& changed) {
+    uint32_t zero_offset = 3 * num_faces;
+    auto write_pair = [&](uint32_t offset, Complex mu) {
+        float re = mu.real(), im = mu.imag();
+        std::memcpy(&log_ratios[offset], &re, sizeof(float));
+        std::memcpy(&log_ratios[offset + 1], &im, sizeof(float));
+        changed.push_back(offset);
+        changed.push_back(offset + 1);
+    };
+    auto is_changed = [&changed_faces](int face) {
+        return face >= 0 && std::binary_search(changed_faces.begin(), changed_faces.end(), static_cast<unsigned int>(face));
+    };
+    for (size_t r = 0; r < faces.size(); r++) {
+        unsigned int face = faces[r];
+        for (int e = 0; e < 3; e++) {
+            int other = neighbors[3 * r + e];
+            if (!is_changed(static_cast<int>(face)) && !is_changed(other)) continue;
+            // the other side, when the two triangles are each other's neighbor across the edge
+            size_t other_r = faces.size();
+            int other_e = -1;
+            if (other >= 0) {
+                auto it = std::lower_bound(faces.begin(), faces.end(), static_cast<unsigned int>(other));
+                if (it != faces.end() && *it == static_cast<unsigned int>(other)) other_r = static_cast<size_t>(it - faces.begin());
+            }
+            for (int k = 0; k < 3 && other_r < faces.size(); k++) {
+                if (neighbors[3 * other_r + k] == static_cast<int>(face)) other_e = k;
+            }
+            if (other_e >= 0 && static_cast<unsigned int>(other) < face) continue; // done from the other side
+
+            size_t slots[2] = {3 * static_cast<size_t>(face) + e, other_e >= 0 ? 3 * static_cast<size_t>(other) + other_e : 0};
+            const TriangleBPM* sides[2] = {&bpms[r], other_e >= 0 ? &bpms[other_r] : nullptr};
+            int edges[2] = {e, other_e};
+            int num_sides = other_e >= 0 ? 2 : 1;
+            uint32_t pairs[2];
+            int num_pairs = 0, num_used = 0;
+            for (int s = 0; s < num_sides; s++) {
+                uint32_t offset = log_ratios[slots[s]] >> 1;
+                if (offset != zero_offset && (num_pairs == 0 || pairs[0] != offset)) pairs[num_pairs++] = offset;
+            }
+            // a pair of the edge, else a free one, else one more at the end
+            auto take_pair = [&]() {
+                if (num_used < num_pairs) return pairs[num_used++];
+                if (!free_pairs.empty()) {
+                    uint32_t offset = free_pairs.back();
+                    free_pairs.pop_back();
+                    return offset;
+                }
+                log_ratios.resize(log_ratios.size() + 2);
+                return static_cast<uint32_t>(log_ratios.size() - 2);
+            };
+            uint32_t first_offset = zero_offset;
+            for (int s = 0; s < num_sides; s++) {
+                const Complex& mu = sides[s]->mu[edges[s]];
+                changed.push_back(static_cast<uint32_t>(slots[s]));
+                if (!sides[s]->has_neighbor[edges[s]]) {
+                    log_ratios[slots[s]] = zero_offset << 1;
+                    continue;
+                }
+                if (s == 1 && first_offset != zero_offset) {
+                    Complex stored = sides[0]->mu[edges[0]];
+                    float tolerance = 1e-4f * std::max(1.0f, std::abs(mu));
+                    if (std::abs(stored - mu) < tolerance) { log_ratios[slots[s]] = first_offset << 1; continue; }
+                    if (std::abs(stored + mu) < tolerance) { log_ratios[slots[s]] = (first_offset << 1) | 1u; continue; }
+                }
+                uint32_t offset = take_pair();
+                write_pair(offset, mu);
+                log_ratios[slots[s]] = offset << 1;
+                if (s == 0) first_offset = offset;
+            }
+            // a single side may share its pair with a triangle that is not its neighbor, it is not given away
+            if (num_sides == 2) free_pairs.insert(free_pairs.end(), pairs + num_used, pairs + num_pairs);
+        }
+    }
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+}
+
+// ---------------------- STORE ---------------------- //
+namespace {
+    constexpr char kBPMStoreMagic[8] = {'B', 'P', 'M', 'S', 'T', 'O', 'R', 'E'};
+    constexpr uint32_t kBPMStoreVersion = 1;
+
+    struct BPMStoreHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t level;
+        uint64_t key;
+        uint32_t num_faces;
+        float record_max_uv_error;
+    };
+
+    template <typename T>
+    void WriteSection(std::ofstream& file, const std::vector<T>& data) {
+        uint64_t bytes = data.size() * sizeof(T);
+        file.write(reinterpret_cast<const char*>(&bytes), sizeof(bytes));
+        file.write(reinterpret_cast<const char*>(data.data()), bytes);
+    }
+
+    template <typename T>
+    bool ReadSection(std::ifstream& file, std::vector<T>& data) {
+        uint64_t bytes = 0;
+        if (!file.read(reinterpret_cast<char*>(&bytes), sizeof(bytes)) || bytes % sizeof(T) != 0) return false;
+        data.resize(bytes / sizeof(T));
+        return static_cast<bool>(file.read(reinterpret_cast<char*>(data.data()), bytes));
+    }
+} // namespace
+
+bool WriteBPMStoreFile(const std::string& path, const BPMStoreData& data) {
+    std::string temp_path = files::MakeTempPath(path);
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        BPMStoreHeader header{};
+        std::memcpy(header.magic, kBPMStoreMagic, sizeof(header.magic));
+        header.version = kBPMStoreVersion;
+        header.level = static_cast<uint32_t>(data.level);
+        header.key = data.key;
+        header.num_faces = data.num_faces;
+        header.record_max_uv_error = data.record_max_uv_error;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        WriteSection(file, data.trans);
+        WriteSection(file, data.mobius);
+        WriteSection(file, data.log_ratios);
+        WriteSection(file, data.records);
+        WriteSection(file, data.max_log_ratio);
+        WriteSection(file, data.flat_uv_error);
+        if (!file) {
+            std::cerr << "ERROR::BPM_STORE::WRITE_FAILED: " << temp_path << std::endl;
+            std::remove(temp_path.c_str());
+            return false;
+        }
+    }
+    if (!files::RenameReplacing(temp_path, path)) {
+        std::remove(temp_path.c_str());
+        std::cerr << "ERROR::BPM_STORE::RENAME_FAILED: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool ReadHeader(std::ifstream& file, BPMStoreData& data) {
+    BPMStoreHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, kBPMStoreMagic, sizeof(header.magic)) != 0 ||
+        header.version != kBPMStoreVersion || header.level > static_cast<uint32_t>(BPMData::FULL)) {
+        return false;
+    }
+    data.level = static_cast<BPMData>(header.level);
+    data.key = header.key;
+    data.num_faces = header.num_faces;
+    data.record_max_uv_error = header.record_max_uv_error;
+    return true;
+}
+
+bool ReadBPMStoreHeader(const std::string& path, BPMStoreData& data) {
+    std::ifstream file(path, std::ios::binary);
+    return file.is_open() && ReadHeader(file, data);
+}
+
+bool ReadBPMStoreFile(const std::string& path, uint64_t key, uint32_t num_faces, BPMStoreData& data, bool header_only) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open() || !ReadHeader(file, data) || data.key != key || data.num_faces != num_faces) return false;
+    if (header_only) return true;
+    return ReadSection(file, data.trans) && ReadSection(file, data.mobius) && ReadSection(file, data.log_ratios) &&
+           ReadSection(file, data.records) && ReadSection(file, data.max_log_ratio) && ReadSection(file, data.flat_uv_error);
+}
+
+uint64_t ComputeFileKey(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    uint64_t hash = 14695981039346656037ull;
+    std::vector<char> buffer(1 << 20);
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        for (std::streamsize i = 0; i < file.gcount(); i++) {
+            hash = (hash ^ static_cast<unsigned char>(buffer[i])) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
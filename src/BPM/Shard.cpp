@@ -0,0 +1,213 @@
+#include "BPM/Shard.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "Utils/Files.h"
+
+namespace {
+    constexpr char kAdjacencyMagic[8] = {'B', 'P', 'M', 'A', 'D', 'J', '0', '1'};
+    constexpr char kShardMagic[8] = {'B', 'P', 'M', 'S', 'H', 'R', 'D', '1'};
+
+    struct ShardHeader {
+        char magic[8];
+        uint64_t key;
+        uint32_t num_faces;
+        uint32_t first, end;
+        float record_max_uv_error;
+    };
+
+    template <typename T>
+    void WriteArray(std::ofstream& file, const std::vector<T>& data) {
+        file.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(T));
+    }
+
+    template <typename T>
+    bool ReadArray(std::ifstream& file, std::vector<T>& data, size_t count) {
+        data.resize(count);
+        return static_cast<bool>(file.read(reinterpret_cast<char*>(data.data()), count * sizeof(T)));
+    }
+
+    // write(file) to a temporary file next to path, then renamed
+    template <typename Write>
+    bool WriteFileAtomically(const std::string& path, Write write) {
+        std::string temp_path = files::MakeTempPath(path);
+        {
+            std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+            write(file);
+            if (!file) {
+                std::cerr << "ERROR::BPM_SHARD::WRITE_FAILED: " << temp_path << std::endl;
+                std::remove(temp_path.c_str());
+                return false;
+            }
+        }
+        if (!files::RenameReplacing(temp_path, path)) {
+            std::remove(temp_path.c_str());
+            std::cerr << "ERROR::BPM_SHARD::RENAME_FAILED: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+} // namespace
+
+void GetShardRange(uint32_t num_faces, unsigned int shard, unsigned int num_shards, uint32_t& first, uint32_t& end) {
+    uint64_t base = num_faces / num_shards, extra = num_faces % num_shards;
+    first = static_cast<uint32_t>(shard * base + std::min<uint64_t>(shard, extra));
+    end = static_cast<uint32_t>(first + base + (shard < extra ? 1 : 0));
+}
+
+std::string GetShardPath(const std::string& obj_path, unsigned int shard, unsigned int num_shards) {
+    return obj_path + ".shard-" + std::to_string(shard) + "-of-" + std::to_string(num_shards);
+}
+
+void ComputeShard(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const std::vector<int>& adjacency,
+                  uint64_t key, unsigned int shard, unsigned int num_shards, unsigned int num_threads, BPMShard& result) {
+    result.key = key;
+    result.num_faces = static_cast<uint32_t>(indices.size() / 3);
+    GetShardRange(result.num_faces, shard, num_shards, result.first, result.end);
+    size_t count = result.end - result.first;
+    result.frames.resize(count);
+    result.coeffs.resize(count);
+    result.mu.resize(count);
+    result.neighbor_bits.resize(count);
+    result.records.resize(count);
+    result.max_log_ratio.resize(count);
+    result.flat_uv_error.resize(count);
+
+    // every triangle is independent, the threads only share the max of the record error
+    num_threads = std::max(1u, std::min<unsigned int>(num_threads, static_cast<unsigned int>((count + 1023) / 1024)));
+    std::vector<float> max_uv_errors(num_threads, 0.0f);
+    auto compute_range = [&](unsigned int thread) {
+        uint32_t first, end;
+        GetShardRange(static_cast<uint32_t>(count), thread, num_threads, first, end);
+        double sum_uv_error = 0.0;
+        for (uint32_t i = first; i < end; i++) {
+            unsigned int face = result.first + i;
+            glm::vec4 flat[6];
+            FlattenTriangle(vertices.data(), indices.data(), face, &adjacency[3 * face], result.frames[i], flat);
+            TriangleBPM bpm = ComputeTriangleBPM(flat, true);
+            result.coeffs[i] = bpm.coeffs;
+            result.mu[i] = bpm.mu;
+            result.neighbor_bits[i] = static_cast<uint8_t>(bpm.has_neighbor[0] | (bpm.has_neighbor[1] << 1) | (bpm.has_neighbor[2] << 2));
+            result.records[i] = MakeBPMRecord(result.frames[i], bpm, max_uv_errors[thread], sum_uv_error);
+            result.max_log_ratio[i] = std::max(std::abs(bpm.mu[0]), std::max(std::abs(bpm.mu[1]), std::abs(bpm.mu[2])));
+            result.flat_uv_error[i] = ComputeFlatUVError(bpm);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int thread = 1; thread < num_threads; thread++) {
+        threads.emplace_back(compute_range, thread);
+    }
+    compute_range(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    result.record_max_uv_error = *std::max_element(max_uv_errors.begin(), max_uv_errors.end());
+}
+
+// ---------------------- FILES ---------------------- //
+bool WriteAdjacencyFile(const std::string& path, uint64_t key, const std::vector<int>& adjacency) {
+    return WriteFileAtomically(path, [&](std::ofstream& file) {
+        uint32_t num_faces = static_cast<uint32_t>(adjacency.size() / 3);
+        file.write(kAdjacencyMagic, sizeof(kAdjacencyMagic));
+        file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+        file.write(reinterpret_cast<const char*>(&num_faces), sizeof(num_faces));
+        WriteArray(file, adjacency);
+    });
+}
+
+bool ReadAdjacencyFile(const std::string& path, uint64_t key, uint32_t num_faces, std::vector<int>& adjacency) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[8];
+    uint64_t file_key = 0;
+    uint32_t file_faces = 0;
+    if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, kAdjacencyMagic, sizeof(magic)) != 0 ||
+        !file.read(reinterpret_cast<char*>(&file_key), sizeof(file_key)) || !file.read(reinterpret_cast<char*>(&file_faces), sizeof(file_faces)) ||
+        file_key != key || file_faces != num_faces) {
+        return false;
+    }
+    if (!ReadArray(file, adjacency, 3 * static_cast<size_t>(num_faces))) return false;
+    return std::all_of(adjacency.begin(), adjacency.end(), [num_faces](int face) { return face < static_cast<int64_t>(num_faces); });
+}
+
+bool WriteShardFile(const std::string& path, const BPMShard& shard) {
+    return WriteFileAtomically(path, [&](std::ofstream& file) {
+        ShardHeader header{};
+        std::memcpy(header.magic, kShardMagic, sizeof(header.magic));
+        header.key = shard.key;
+        header.num_faces = shard.num_faces;
+        header.first = shard.first;
+        header.end = shard.end;
+        header.record_max_uv_error = shard.record_max_uv_error;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        WriteArray(file, shard.frames);
+        WriteArray(file, shard.coeffs);
+        WriteArray(file, shard.mu);
+        WriteArray(file, shard.neighbor_bits);
+        WriteArray(file, shard.records);
+        WriteArray(file, shard.max_log_ratio);
+        WriteArray(file, shard.flat_uv_error);
+    });
+}
+
+bool ReadShardFile(const std::string& path, uint64_t key, uint32_t num_faces, BPMShard& shard) {
+    std::ifstream file(path, std::ios::binary);
+    ShardHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, kShardMagic, sizeof(header.magic)) != 0 ||
+        header.key != key || header.num_faces != num_faces || header.first > header.end || header.end > num_faces) {
+        return false;
+    }
+    shard.key = header.key;
+    shard.num_faces = header.num_faces;
+    shard.first = header.first;
+    shard.end = header.end;
+    shard.record_max_uv_error = header.record_max_uv_error;
+    size_t count = header.end - header.first;
+    return ReadArray(file, shard.frames, count) && ReadArray(file, shard.coeffs, count) && ReadArray(file, shard.mu, count) &&
+           ReadArray(file, shard.neighbor_bits, count) && ReadArray(file, shard.records, count) &&
+           ReadArray(file, shard.max_log_ratio, count) && ReadArray(file, shard.flat_uv_error, count);
+}
+
+// ---------------------- MERGE ---------------------- //
+ShardMerger::ShardMerger(const std::vector<unsigned int>& indices, uint64_t key)
+    : indices_(indices), log_ratios_(static_cast<unsigned int>(indices.size() / 3)) {
+    store_.level = BPMData::FULL;
+    store_.key = key;
+    store_.num_faces = static_cast<uint32_t>(indices.size() / 3);
+}
+
+bool ShardMerger::Add(const BPMShard& shard) {
+    if (shard.key != store_.key || shard.num_faces != store_.num_faces || shard.first != end_) return false;
+    auto append_bytes = [](std::vector<char>& bytes, const auto& data) {
+        const char* begin = reinterpret_cast<const char*>(data.data());
+        bytes.insert(bytes.end(), begin, begin + data.size() * sizeof(data[0]));
+    };
+    append_bytes(store_.trans, shard.frames);
+    append_bytes(store_.mobius, shard.coeffs);
+    append_bytes(store_.records, shard.records);
+    store_.max_log_ratio.insert(store_.max_log_ratio.end(), shard.max_log_ratio.begin(), shard.max_log_ratio.end());
+    store_.flat_uv_error.insert(store_.flat_uv_error.end(), shard.flat_uv_error.begin(), shard.flat_uv_error.end());
+    store_.record_max_uv_error = std::max(store_.record_max_uv_error, shard.record_max_uv_error);
+    // the same calls, in the same order, as Mesh::PrecomputeChunk
+    for (uint32_t face = shard.first; face < shard.end; face++) {
+        const unsigned int* idx = &indices_[3 * face];
+        for (int e = 0; e < 3; e++) {
+            if (shard.neighbor_bits[face - shard.first] & (1u << e)) {
+                log_ratios_.Set(3 * face + e, idx[e], idx[(e + 1) % 3], shard.mu[face - shard.first][e]);
+            }
+        }
+    }
+    end_ = shard.end;
+    return true;
+}
+
+bool ShardMerger::Finish(BPMStoreData& store) {
+    if (end_ != store_.num_faces) return false;
+    store_.log_ratios = std::move(log_ratios_.data_);
+    store = std::move(store_);
+    return true;
+}
@@ -13,4 +13,12 @@ const char* GetTextureTypeName(TextureType type) {
         case TextureType::BPM: return "BPM";
         default: return "Unknown";
     }
-}
\ No newline at end of file
+}
+
+const char* GetExpMethodName(ExpMethod method) {
+    switch (method) {
+        case ExpMethod::TAYLOR: return "Taylor Series";
+        case ExpMethod::CLOSED_FORM: return "Closed Form";
+        default: return "Unknown";
+    }
+}
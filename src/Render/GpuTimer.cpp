@@ -0,0 +1,39 @@
+// GpuTimer.cpp
+#include "Render/GpuTimer.h"
+
+GpuQuery::~GpuQuery() {
+	if (initialized_) {
+		glDeleteQueries(kNumQueries, queries_);
+	}
+}
+
+void GpuQuery::Begin() {
+	if (!initialized_) {
+		glGenQueries(kNumQueries, queries_);
+		initialized_ = true;
+	}
+	// collect the oldest query before reusing it, skip this frame if the GPU has not finished it
+	if (pending_[current_]) {
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(queries_[current_], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) return;
+		glGetQueryObjectui64v(queries_[current_], GL_QUERY_RESULT, &last_result_);
+		OnResult(last_result_);
+		pending_[current_] = false;
+	}
+	glBeginQuery(target_, queries_[current_]);
+	active_ = true;
+}
+
+void GpuQuery::End() {
+	if (!active_) return;
+	glEndQuery(target_);
+	active_ = false;
+	pending_[current_] = true;
+	current_ = (current_ + 1) % kNumQueries;
+}
+
+void GpuTimer::OnResult(GLuint64 elapsed_ns) {
+	last_ms_ = static_cast<double>(elapsed_ns) * 1e-6;
+	smoothed_ms_ = (smoothed_ms_ == 0.0) ? last_ms_ : 0.9 * smoothed_ms_ + 0.1 * last_ms_;
+}
@@ -0,0 +1,32 @@
+// RenderThread.cpp
+#include "Render/RenderThread.h"
+
+void RenderThread::Start(std::function<void()> body) {
+	glfwMakeContextCurrent(nullptr); // a context is current on one thread at a time
+	thread_ = std::thread([this, body = std::move(body)] {
+		glfwMakeContextCurrent(window_);
+		body();
+		glfwMakeContextCurrent(nullptr);
+	});
+}
+
+void RenderThread::Stop() {
+	if (!thread_.joinable()) return;
+	stopping_ = true;
+	Post([] {}); // wakes up WaitForCommands
+	thread_.join();
+}
+
+void RenderThread::Post(CommandQueue::Command command) {
+	commands_.PushWait(std::move(command));
+}
+
+size_t RenderThread::RunCommands() {
+	size_t num_commands = 0;
+	CommandQueue::Command command;
+	while (num_commands < kMaxCommandsPerFrame && commands_.Pop(command)) {
+		command();
+		++num_commands;
+	}
+	return num_commands;
+}
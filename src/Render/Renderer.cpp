@@ -1,66 +1,280 @@
 // Renderer.cpp
 #include "Render/Renderer.h" 
 
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <tuple>
 #include <vector>
+#include <glm/gtc/constants.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "Utils/Constants.h" // for SCR_WIDTH, SCR_HEIGHT
 #include "PathConfig.h"
+#include "Scene/MeshOptimizer.h"
 
 
 void DrawAxes(Shader& shader); // forward declaration
 
 Renderer::Renderer(Scene* scene) : shader_manager_(ShaderManager::GetInstance()) {
   scene_ = scene;
-  shader_manager_.SetupShaders(this);
+  shader_manager_.SetupShaders();
 }
 
-void Renderer::DrawModel(MeshModel* model) {
-  shader_manager_.SetModelTransformation(model->GetModelTransform());
-  if (model->draw_fill_) {
-    Shader& texture_type_shader = shader_manager_.GetShader("texture_type");
-    texture_type_shader.use();
+Renderer::~Renderer() {
+  ReleaseSceneTarget();
+  ReleaseVisibilityBuffer();
+}
+
+void Renderer::CullModel(MeshModel* model) {
+  Camera* camera = scene_->GetActiveCamera();
+  glm::mat4 model_transform = model->GetModelTransform();
+  glm::mat4 mvp = camera->GetProjectionTransform() * camera->GetViewTransform() * model_transform;
+  glm::vec3 eye_local = glm::vec3(glm::inverse(model_transform) * glm::vec4(camera->eye_, 1.0f));
+  // cone culling needs a view point, skip it for orthographic projection
+  bool cull_backfacing = is_backface_culling_ && camera->IsPerspectiveProjection();
+  for (auto& mesh : model->GetDrawnMeshes()) {
+    if (meshlet_culling_) {
+      mesh->CullMeshlets(mvp, eye_local, cull_backfacing);
+    } else {
+      mesh->ResetCulling();
+    }
+    num_drawn_meshlets_ += mesh->num_visible_meshlets_;
+    num_total_meshlets_ += static_cast<unsigned int>(mesh->meshlets_.size());
+    num_drawn_faces_ += mesh->num_visible_faces_;
+  }
+}
+
+// projected bounding sphere radius, relative to half the viewport height
+float Renderer::ScreenCoverage(MeshModel* model) {
+  Camera* camera = scene_->GetActiveCamera();
+  glm::mat4 model_transform = model->GetModelTransform();
+  float scale = std::max(glm::length(glm::vec3(model_transform[0])),
+                         std::max(glm::length(glm::vec3(model_transform[1])), glm::length(glm::vec3(model_transform[2]))));
+  float radius = 0.5f * glm::length(model->GetBBox().size_) * scale;
+  glm::vec3 center = glm::vec3(model_transform * glm::vec4(model->GetBBox().center_, 1.0f));
+  if (camera->IsPerspectiveProjection()) {
+    float distance = std::max(glm::length(center - camera->eye_) - radius, camera->GetZNear());
+    return radius / (distance * std::tan(0.5f * camera->GetFovy()));
+  }
+  return radius / camera->top_;
+}
+
+void Renderer::SelectLOD(MeshModel* model) {
+  if (model->GetAsset()->IsDeforming()) { // the LODs keep the rest positions
+    model->lod_ = 0;
+    return;
+  }
+  unsigned int num_lods = model->GetNumLODs();
+  if (model->forced_lod_ >= 0) {
+    model->lod_ = std::min(static_cast<unsigned int>(model->forced_lod_), num_lods - 1);
+    return;
+  }
+  if (num_lods == 1) return;
+  float coverage = ScreenCoverage(model);
+  // continuous level, kept within [lod - h, lod + 1 + h) of the current one
+  float level = std::log2(lod_full_detail_coverage_ / std::max(coverage, 1e-6f));
+  float current = static_cast<float>(model->lod_);
+  if (level < current - kLODHysteresis || level >= current + 1.0f + kLODHysteresis) {
+    model->lod_ = static_cast<unsigned int>(std::clamp(std::floor(level), 0.0f, static_cast<float>(num_lods - 1)));
+  }
+}
+
+void Renderer::SelectTextureType(MeshModel* model) {
+  if (!auto_texture_type_) {
+    model->texture_type_ = texture_type_;
+    return;
+  }
+  // average screen area of a front-facing triangle: the projected bounding disk over half the triangles
+  unsigned int num_faces = 0;
+  for (auto& mesh : model->GetDrawnMeshes()) num_faces += mesh->GetNumDrawnFaces();
+  float radius_pixels = ScreenCoverage(model) * 0.5f * static_cast<float>(render_height_);
+  float triangle_pixels = glm::pi<float>() * radius_pixels * radius_pixels / std::max(0.5f * num_faces, 1.0f);
+  model->triangle_pixels_ = triangle_pixels;
+  // levels in log2 pixels: LINEAR below the Mobius threshold, BPM from the BPM threshold. Hysteresis is in
+  // the same units, the current type is kept within [low - h, high + h) of its range.
+  float level = std::log2(std::max(triangle_pixels, 1e-6f));
+  float mobius_level = std::log2(mobius_min_triangle_pixels_);
+  float bpm_level = std::log2(std::max(bpm_min_triangle_pixels_, mobius_min_triangle_pixels_));
+  float low = -FLT_MAX, high = FLT_MAX;
+  switch (model->texture_type_) {
+    case TextureType::LINEAR: high = mobius_level; break;
+    case TextureType::DIRECT_MOBIUS: low = mobius_level; high = bpm_level; break;
+    default: low = bpm_level; break;
+  }
+  if (level >= low - kTextureTypeHysteresis && level < high + kTextureTypeHysteresis) return;
+  if (level >= bpm_level) {
+    model->texture_type_ = TextureType::BPM;
+  } else if (level >= mobius_level) {
+    model->texture_type_ = TextureType::DIRECT_MOBIUS;
+  } else {
+    model->texture_type_ = TextureType::LINEAR;
+  }
+}
+
+void Renderer::ComputeBPMData(MeshModel* model) {
+  if (compute_bpm_data_) {
+    compute_bpm_data_(model->asset_);
+  } else {
+    model->GetAsset()->ComputeBPMData();
+  }
+}
+
+TextureType Renderer::GetDrawnTextureType(MeshModel* model, bool& progressive) {
+  progressive = false;
+  BPMData needed = Mesh::GetRequiredBPMData(model->texture_type_);
+  if (needed == BPMData::NONE) return model->texture_type_;
+  if (model->GetAsset()->RequestBPMData(needed)) {
+    ComputeBPMData(model);
+  }
+  bool complete = true, started = true;
+  for (auto& mesh : model->GetDrawnMeshes()) {
+    complete = complete && mesh->HasBPMData(needed);
+    started = started && (mesh->HasBPMData(needed) || mesh->IsComputingBPMData(needed));
+  }
+  if (complete) return model->texture_type_;
+  // a level being computed is drawn linear where it is not ready yet, or as the best complete level
+  if (started && model->GetAsset()->load_options_.progressive_bpm) {
+    progressive = true;
+    return model->texture_type_;
+  }
+  TextureType texture_type = model->texture_type_;
+  while (texture_type != TextureType::LINEAR) {
+    texture_type = static_cast<TextureType>(static_cast<int>(texture_type) - 1);
+    BPMData level = Mesh::GetRequiredBPMData(texture_type);
+    auto& meshes = model->GetDrawnMeshes();
+    if (std::all_of(meshes.begin(), meshes.end(), [level](const std::unique_ptr<Mesh>& mesh) { return mesh->HasBPMData(level); })) break;
+  }
+  return texture_type;
+}
+
+// model matrices of the instances with a rendering flag set
+static std::vector<glm::mat4> GetInstanceTransforms(const std::vector<MeshModel*>& instances, bool MeshModel::* flag) {
+  std::vector<glm::mat4> transforms;
+  for (MeshModel* instance : instances) {
+    if (instance->*flag) transforms.push_back(instance->GetModelTransform());
+  }
+  return transforms;
+}
+
+// true if at least one instance is filled and every filled one has the flag
+static bool AllFilledInstancesHave(const std::vector<MeshModel*>& instances, bool MeshModel::* flag) {
+  bool any_filled = false;
+  for (MeshModel* instance : instances) {
+    if (!instance->draw_fill_) continue;
+    if (!(instance->*flag)) return false;
+    any_filled = true;
+  }
+  return any_filled;
+}
+
+bool Renderer::IsInFrustum(MeshModel* model) {
+  Camera* camera = scene_->GetActiveCamera();
+  glm::vec4 planes[6];
+  mesh_optimizer::ExtractFrustumPlanes(camera->GetProjectionTransform() * camera->GetViewTransform() * model->GetModelTransform(), planes);
+  const geometry::BoundingBox& bbox = model->GetBBox();
+  return mesh_optimizer::IsSphereInFrustum(bbox.center_, 0.5f * glm::length(bbox.size_), planes);
+}
+
+void Renderer::CullInstances(std::vector<MeshModel*>& instances) {
+  Camera* camera = scene_->GetActiveCamera();
+  glm::mat4 view_projection = camera->GetProjectionTransform() * camera->GetViewTransform();
+  const geometry::BoundingBox& bbox = instances[0]->GetBBox();
+  float radius = 0.5f * glm::length(bbox.size_);
+  instances.erase(std::remove_if(instances.begin(), instances.end(), [&](MeshModel* instance) {
+    glm::vec4 planes[6];
+    mesh_optimizer::ExtractFrustumPlanes(view_projection * instance->GetModelTransform(), planes);
+    return !mesh_optimizer::IsSphereInFrustum(bbox.center_, radius, planes);
+  }), instances.end());
+  if (instances.empty()) return; // every instance is out of view
+  for (auto& mesh : instances[0]->GetDrawnMeshes()) {
+    mesh->ResetCulling();
+    num_drawn_meshlets_ += static_cast<unsigned int>(instances.size() * mesh->meshlets_.size());
+    num_total_meshlets_ += static_cast<unsigned int>(instances.size() * mesh->meshlets_.size());
+    num_drawn_faces_ += static_cast<unsigned int>(instances.size()) * mesh->GetNumDrawnFaces();
+  }
+}
+
+void Renderer::DrawInstances(std::vector<MeshModel*>& instances, DrawPass pass) {
+  if (pass != DrawPass::OVERLAYS) {
+    if (instances.size() == 1) {
+      CullModel(instances[0]);
+    } else {
+      CullInstances(instances);
+    }
+  }
+  if (instances.empty()) return;
+  MeshModel* model = instances[0]; // all instances share the asset and LOD
+  // The fill shader blends the wireframe / vertex markers from barycentrics when every filled instance has
+  // them. Other instances get them from an overlay-only draw of the same triangles.
+  bool fill_wireframe = (pass == DrawPass::ALL) && AllFilledInstancesHave(instances, &MeshModel::draw_wireframe_);
+  bool fill_points = (pass == DrawPass::ALL) && AllFilledInstancesHave(instances, &MeshModel::draw_points_);
+  std::vector<glm::mat4> transforms = GetInstanceTransforms(instances, &MeshModel::draw_fill_);
+  if (!transforms.empty() && pass != DrawPass::OVERLAYS) {
+    bool progressive = false;
+    TextureType texture_type = GetDrawnTextureType(model, progressive);
+    shader_manager_.SetModelTransformations(transforms);
+    unsigned int first_instance = static_cast<unsigned int>(visibility_instances_.size());
+    if (pass == DrawPass::VISIBILITY) visibility_instances_.insert(visibility_instances_.end(), transforms.begin(), transforms.end());
+    Shader& fill_shader = (pass == DrawPass::VISIBILITY)
+        ? shader_manager_.GetShader("visibility", {{"TEXTURE_TYPE", "1"}, {"VISIBILITY_PASS", "1"}})
+        : GetTextureTypeShader(texture_type, false, fill_wireframe, fill_points, progressive);
+    fill_shader.use();
     
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    for (auto& mesh : model->meshes_) {
+    bool adaptive = adaptive_bpm_ && texture_type == TextureType::BPM && !progressive;
+    for (auto& mesh : model->GetDrawnMeshes()) {
+      if (adaptive) {
+        if (mesh->classified_tolerance_ != flat_log_ratio_tolerance_) mesh->ClassifyTriangles(flat_log_ratio_tolerance_);
+        num_adaptive_flat_faces_ += static_cast<unsigned int>(transforms.size()) * mesh->num_flat_faces_;
+        num_adaptive_faces_ += static_cast<unsigned int>(transforms.size()) * mesh->num_faces_;
+      }
+      mesh->SetPackedRecords(packed_bpm_records_);
       mesh->BindDataBuffers();
-      mesh->BindTextures(texture_type_shader);
-      glDrawArrays(GL_TRIANGLES, 0, static_cast<unsigned int>(mesh->indices_.size())); glBindVertexArray(0);
+      if (pass == DrawPass::VISIBILITY) {
+        if (visibility_meshes_.size() == kMaxVisibilityDraws) continue;
+        fill_shader.setUInt("draw_id", static_cast<unsigned int>(visibility_meshes_.size()));
+        visibility_meshes_.push_back({mesh.get(), texture_type, progressive, first_instance});
+      } else {
+        mesh->BindTextures(fill_shader);
+      }
+      mesh->Draw(static_cast<GLsizei>(transforms.size()));
     }
-    texture_type_shader.disable();
+    fill_shader.disable();
   }
-  if (model->draw_wireframe_) {
-    Shader& points_and_lines = shader_manager_.GetShader("points_and_lines");
-    points_and_lines.use();
-    GLfloat original_line_width; glGetFloatv(GL_LINE_WIDTH, &original_line_width);
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); glLineWidth(3.0f);
-    for (auto& mesh : model->meshes_) {
-      mesh->BindDataBuffers();
-      glDrawArrays(GL_TRIANGLES, 0, static_cast<unsigned int>(mesh->indices_.size())); glBindVertexArray(0);
-    }
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); glLineWidth(original_line_width);
-    points_and_lines.disable();
+  if (pass == DrawPass::VISIBILITY) return;
+  std::vector<MeshModel*> wireframe_instances, points_instances;
+  for (MeshModel* instance : instances) {
+    if (instance->draw_wireframe_ && !(fill_wireframe && instance->draw_fill_)) wireframe_instances.push_back(instance);
+    if (instance->draw_points_ && !(fill_points && instance->draw_fill_)) points_instances.push_back(instance);
   }
-  if (model->draw_points_) {
-    Shader& points_and_lines = shader_manager_.GetShader("points_and_lines");
-    points_and_lines.use();
-    glPolygonMode(GL_FRONT_AND_BACK, GL_POINT); glPointSize(3.0f);
-    for (auto& mesh: model->meshes_) {
+  for (bool wireframe : {true, false}) {
+    transforms = GetInstanceTransforms(wireframe ? wireframe_instances : points_instances, wireframe ? &MeshModel::draw_wireframe_ : &MeshModel::draw_points_);
+    if (transforms.empty()) continue;
+    shader_manager_.SetModelTransformations(transforms);
+    Shader& overlay_shader = GetOverlayShader(wireframe, !wireframe);
+    overlay_shader.use();
+    glDepthFunc(GL_LEQUAL); // on top of the fill of the same triangles
+    for (auto& mesh : model->GetDrawnMeshes()) {
       mesh->BindDataBuffers();
-      glDrawArrays(GL_TRIANGLES, 0, static_cast<unsigned int>(mesh->indices_.size())); glBindVertexArray(0);
-    } 
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    points_and_lines.disable();
+      mesh->Draw(static_cast<GLsizei>(transforms.size()));
+    }
+    glDepthFunc(GL_LESS);
+    overlay_shader.disable();
   }
 
-  if (model->draw_bbox_) {
+  transforms = GetInstanceTransforms(instances, &MeshModel::draw_bbox_);
+  if (!transforms.empty()) {
+    shader_manager_.SetModelTransformations(transforms);
     Shader& points_and_lines_shader = shader_manager_.GetShader("points_and_lines");
     points_and_lines_shader.use();
     points_and_lines_shader.setVec3("color", cg::BBOX_COLOR); 
-    glBindVertexArray(model->bbox_VAO_);
+    glBindVertexArray(model->GetAsset()->GetBBoxVAO());
     GLfloat original_line_width; glGetFloatv(GL_LINE_WIDTH, &original_line_width);
     glLineWidth(7.0f);
-    glDrawElements(GL_LINES, model->bbox_.indices_.size(), GL_UNSIGNED_INT, 0);
+    glDrawElementsInstanced(GL_LINES, model->GetBBox().indices_.size(), GL_UNSIGNED_INT, 0, static_cast<GLsizei>(transforms.size()));
     glBindVertexArray(0);
     glLineWidth(original_line_width);
     points_and_lines_shader.setVec3("color", glm::vec3(0.0f)); 
@@ -68,13 +282,13 @@ void Renderer::DrawModel(MeshModel* model) {
   }
 
     // Draw Normals
-  if ((draw_face_normals_ || draw_vertex_normals_) && (model->draw_normals_)) {
-    Shader& normals_shader = shader_manager_.GetShader("normals_shader");
+  transforms = GetInstanceTransforms(instances, &MeshModel::draw_normals_);
+  if ((draw_face_normals_ || draw_vertex_normals_) && !transforms.empty()) {
+    shader_manager_.SetNormalTransformations(scene_->GetActiveCamera()->GetViewTransform(), transforms);
+    Shader& normals_shader = GetNormalsShader();
     normals_shader.use();
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    for (auto& mesh : model->meshes_) {
-      mesh->BindDataBuffers();
-      glDrawArrays(GL_TRIANGLES, 0, static_cast<unsigned int>(mesh->indices_.size())); glBindVertexArray(0);    
+    for (auto& mesh : model->GetDrawnMeshes()) {
+      mesh->DrawNormalLines(normals_shader, draw_face_normals_, draw_vertex_normals_, static_cast<GLsizei>(transforms.size()));
     }
     normals_shader.disable();
   }
@@ -82,18 +296,80 @@ void Renderer::DrawModel(MeshModel* model) {
 }
 
 void Renderer::Draw() {
+  UpdateDeformations();
+  LoadChunksInView();
+  // the scene goes to the default framebuffer, or to the lower left render_width_ x render_height_ of the
+  // scene target which is upscaled to the window at the end
+  GLuint scene_fbo = 0;
+  render_width_ = width_;
+  render_height_ = height_;
+  if (!dynamic_resolution_) ReleaseSceneTarget(); // switched off
+  if (!visibility_buffer_) ReleaseVisibilityBuffer();
+  if (dynamic_resolution_) {
+    SetupSceneTarget();
+    scene_fbo = scene_fbo_;
+    render_width_ = std::max(1u, static_cast<unsigned int>(std::lround(resolution_scale_ * width_)));
+    render_height_ = std::max(1u, static_cast<unsigned int>(std::lround(resolution_scale_ * height_)));
+    glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
+    glViewport(0, 0, render_width_, render_height_);
+  }
   DrawSetup();
+  frame_timer_.Begin();
+  fragment_query_.Begin();
+  num_drawn_meshlets_ = 0; num_total_meshlets_ = 0; num_drawn_faces_ = 0;
+  num_adaptive_flat_faces_ = 0; num_adaptive_faces_ = 0;
   // Set uniforms
   shader_manager_.SetCameraUniforms(scene_); 
 
   
-  // Draw Models
+  // Draw Models: one instanced batch per asset, LOD and texture type, in scene order
+  std::vector<std::pair<std::tuple<ModelAsset*, unsigned int, TextureType>, std::vector<MeshModel*>>> batches;
   auto& models = scene_->GetModels();
+  for (int i = 0; i < static_cast<int>(TextureType::TYPES_COUNT); ++i) num_texture_type_models_[i] = 0;
   for (auto& model : models) {
-    if (model->should_draw_) {
-      DrawModel(model.get());
+    if (!model->should_draw_) continue;
+    ModelAsset* asset = model->GetAsset();
+    // chunks of a partitioned mesh out of view are skipped before they count as drawn, the residency manager evicts them
+    if (asset->load_options_.out_of_core && !IsInFrustum(model.get())) continue;
+    asset->last_drawn_frame_ = num_frames_drawn_;
+    if (!asset->IsResident()) {
+      if (asset->RequestRestore()) ComputeBPMData(model.get());
+      continue;
     }
+    SelectLOD(model.get());
+    SelectTextureType(model.get());
+    num_texture_type_models_[static_cast<int>(model->texture_type_)]++;
+    std::tuple<ModelAsset*, unsigned int, TextureType> key(model->GetAsset(), model->lod_, model->texture_type_);
+    auto batch = std::find_if(batches.begin(), batches.end(), [&key](const auto& b) { return b.first == key; });
+    if (batch == batches.end()) {
+      batches.push_back({key, {}});
+      batch = batches.end() - 1;
+    }
+    batch->second.push_back(model.get());
   }
+  if (visibility_buffer_) {
+    // every fill first, so that the resolve shades each pixel once, then the overlays on top
+    SetupVisibilityBuffer();
+    glBindFramebuffer(GL_FRAMEBUFFER, visibility_fbo_);
+    GLuint background[4] = {0, 0, 0, 0};
+    glClearBufferuiv(GL_COLOR, 0, background);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    visibility_meshes_.clear();
+    visibility_instances_.clear();
+    for (auto& batch : batches) {
+      DrawInstances(batch.second, DrawPass::VISIBILITY);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
+    ResolveVisibilityBuffer();
+    for (auto& batch : batches) {
+      DrawInstances(batch.second, DrawPass::OVERLAYS);
+    }
+  } else {
+    for (auto& batch : batches) {
+      DrawInstances(batch.second);
+    }
+  }
+  num_batches_ = static_cast<unsigned int>(batches.size());
 
 
   // Draw Axes
@@ -101,6 +377,296 @@ void Renderer::Draw() {
       Shader& vertex_color_shader = shader_manager_.GetShader("vertex_color");
       DrawAxes(vertex_color_shader);
   }
+  fragment_query_.End();
+  frame_timer_.End();
+  layout_milliseconds_[packed_bpm_records_ ? 1 : 0] = frame_timer_.GetSmoothedMilliseconds();
+  if (texture_type_ == TextureType::BPM) {
+    adaptive_milliseconds_[adaptive_bpm_ ? 1 : 0] = frame_timer_.GetSmoothedMilliseconds();
+  }
+  if (dynamic_resolution_) {
+    // upscale to the window, the UI is drawn after this at the window resolution
+    glBlitNamedFramebuffer(scene_fbo_, 0, 0, 0, render_width_, render_height_, 0, 0, width_, height_, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, width_, height_);
+    UpdateResolutionScale();
+  }
+  residency_.Update(scene_, num_frames_drawn_);
+  num_frames_drawn_++;
+  last_scene_stamp_ = scene_->GetChangeStamp();
+  int frames = redraw_frames_.load();
+  if (frames > 0) redraw_frames_.compare_exchange_strong(frames, frames - 1); // unless a new request came in
+}
+
+void Renderer::RequestRedraw() {
+  redraw_frames_ = kRedrawFrames;
+}
+
+bool Renderer::NeedsRedraw() const {
+  return !render_on_demand_ || deform_models_ || num_playing_sequences_ > 0 || !pending_deform_benchmarks_.empty() ||
+         redraw_frames_ > 0 || scene_->GetChangeStamp() != last_scene_stamp_;
+}
+
+void Renderer::LoadChunksInView() {
+  if (pending_chunks_.empty() || !load_chunk_) return;
+  Camera* camera = scene_->GetActiveCamera();
+  glm::mat4 view_projection = camera->GetProjectionTransform() * camera->GetViewTransform();
+  pending_chunks_.erase(std::remove_if(pending_chunks_.begin(), pending_chunks_.end(), [&](const PendingChunk& chunk) {
+    glm::mat4 model_transform = glm::translate(glm::mat4(1.0f), chunk.translation) * glm::scale(glm::mat4(1.0f), glm::vec3(chunk.scale));
+    glm::vec4 planes[6];
+    mesh_optimizer::ExtractFrustumPlanes(view_projection * model_transform, planes);
+    if (!mesh_optimizer::IsSphereInFrustum(0.5f * (chunk.v_min + chunk.v_max), 0.5f * glm::length(chunk.v_max - chunk.v_min), planes)) return false;
+    load_chunk_(chunk);
+    return true;
+  }), pending_chunks_.end());
+}
+
+// ---------------------- DEFORMATION ---------------------- //
+void Renderer::UpdateDeformations() {
+  CollectDeformBenchmarks();
+  static const auto start = std::chrono::steady_clock::now();
+  float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+  float angle = deform_twist_ * std::sin(glm::two_pi<float>() * seconds / std::max(deform_period_seconds_, 0.1f));
+  if (play_sequences_) sequence_seconds_ += seconds - last_deform_seconds_;
+  last_deform_seconds_ = seconds;
+  num_deforming_assets_ = 0;
+  deform_milliseconds_ = 0.0;
+  num_playing_sequences_ = 0;
+  sequence_stalls_ = 0;
+  sequence_read_milliseconds_ = 0.0;
+  std::vector<ModelAsset*> assets; // instances share theirs
+  for (auto& model : scene_->GetModels()) {
+    ModelAsset* asset = model->GetAsset();
+    if (std::find(assets.begin(), assets.end(), asset) != assets.end()) continue;
+    assets.push_back(asset);
+    MeshSequence* sequence = (play_sequences_ && asset->sequence_ && asset->sequence_->GetNumFrames() > 1) ? asset->sequence_.get() : nullptr;
+    if (!deform_models_ && !sequence) {
+      if (asset->IsDeforming() && !asset->EndDeformation()) RequestRedraw(); // a PrecomputeStep runs, next frame
+      continue;
+    }
+    // positions, normals and bounds of the sequence's shown frame
+    auto show_frame = [asset, sequence] {
+      asset->GetMeshes()[0]->SetDeformedPositions(sequence->GetPositions(), sequence->GetNormals());
+      asset->SetBBox(sequence->GetMin(), sequence->GetMax());
+    };
+    if (!asset->IsDeforming()) {
+      if (!asset->BeginDeformation()) continue; // busy or evicted, tried again next frame
+      if (sequence && !sequence->GetPositions().empty()) show_frame(); // from the rest positions to the shown frame
+    }
+    if (sequence) {
+      // the frame that is due, frames the prefetch did not read in time are dropped
+      size_t frame = static_cast<size_t>(sequence_seconds_ * std::max(sequence_fps_, 1.0f)) % sequence->GetNumFrames();
+      if (frame != sequence->GetShownFrame() && sequence->AcquireFrame(frame)) show_frame();
+      num_playing_sequences_++;
+      sequence_stalls_ += sequence->GetNumStalls();
+      sequence_read_milliseconds_ += sequence->GetReadMilliseconds();
+    } else {
+      // twist around the vertical axis through the bounding box center, proportional to the height
+      const geometry::BoundingBox& bbox = asset->GetRestBBox();
+      float height = std::max(bbox.size_.y, 1e-6f);
+      for (auto& mesh : asset->GetMeshes()) {
+        mesh->SetDeformTwist(angle, bbox.center_, height);
+      }
+      // the positions are on the GPU only: the circle the box turns in, which holds every twisted vertex
+      float radius = 0.5f * glm::length(glm::vec2(bbox.size_.x, bbox.size_.z));
+      glm::vec3 v_min = bbox.min_, v_max = bbox.max_;
+      if (angle != 0.0f) {
+        v_min = glm::vec3(bbox.center_.x - radius, bbox.min_.y, bbox.center_.z - radius);
+        v_max = glm::vec3(bbox.center_.x + radius, bbox.max_.y, bbox.center_.z + radius);
+      }
+      if (v_min != asset->bbox_.min_ || v_max != asset->bbox_.max_) asset->SetBBox(v_min, v_max);
+    }
+    asset->UpdateDeformation();
+    num_deforming_assets_++;
+    deform_milliseconds_ += asset->GetDeformMilliseconds();
+  }
+}
+
+void Renderer::BenchmarkDeformation(std::shared_ptr<ModelAsset> asset) {
+  for (unsigned int lod = 0; lod < asset->GetNumLODs(); ++lod) {
+    for (auto& mesh : asset->GetLODMeshes(lod)) {
+      if (mesh->BeginDeformationBenchmark(kDeformBenchmarkRepetitions)) pending_deform_benchmarks_.push_back({asset, mesh.get(), lod});
+    }
+  }
+}
+
+// the timer queries of BenchmarkDeformation, polled once per frame
+void Renderer::CollectDeformBenchmarks() {
+  auto done = [this](const PendingDeformBenchmark& pending) {
+    double milliseconds = pending.mesh->GetDeformationBenchmark();
+    if (milliseconds < 0.0) return false;
+    if (milliseconds == 0.0) return true;
+    deform_benchmark_.push_back({pending.mesh->num_faces_, milliseconds});
+    std::cout << "Deformation recompute: " << pending.asset->model_name_ << " LOD " << pending.lod << ", " << pending.mesh->num_faces_
+              << " triangles: " << milliseconds << " ms (" << 1e6 * milliseconds / pending.mesh->num_faces_ << " ns/triangle)" << std::endl;
+    return true;
+  };
+  size_t num_pending = pending_deform_benchmarks_.size();
+  pending_deform_benchmarks_.erase(std::remove_if(pending_deform_benchmarks_.begin(), pending_deform_benchmarks_.end(), done),
+                                   pending_deform_benchmarks_.end());
+  if (pending_deform_benchmarks_.size() == num_pending) return;
+  std::sort(deform_benchmark_.begin(), deform_benchmark_.end());
+  if (pending_deform_benchmarks_.empty() && !deform_benchmark_.empty()) {
+    double milliseconds = EstimateDeformMilliseconds(kDeformTargetTriangles);
+    std::cout << "Deformation recompute of " << kDeformTargetTriangles << " triangles: " << milliseconds << " ms estimated, "
+              << (milliseconds <= target_frame_milliseconds_ ? "within" : "over") << " the frame time of "
+              << target_frame_milliseconds_ << " ms" << std::endl;
+  }
+}
+
+double Renderer::EstimateDeformMilliseconds(unsigned int num_triangles) const {
+  if (deform_benchmark_.empty()) return 0.0;
+  const auto& [num_faces, milliseconds] = deform_benchmark_.back();
+  return milliseconds * num_triangles / num_faces;
+}
+
+// Fragment cost is about proportional to the pixel count, i.e. to the square of the scale. The timer
+// results are a few frames old, so the scale moves a fraction of the way per frame.
+void Renderer::UpdateResolutionScale() {
+  double milliseconds = frame_timer_.GetMilliseconds();
+  if (milliseconds <= 0.0) return;
+  double ratio = target_frame_milliseconds_ / milliseconds;
+  if (std::abs(ratio - 1.0) < kResolutionDeadband) return;
+  float step = static_cast<float>(std::pow(ratio, 0.5 * kResolutionGain));
+  float scale = std::clamp(resolution_scale_ * step, kMinResolutionScale, 1.0f);
+  if (scale != resolution_scale_) redraw_frames_ = kRedrawFrames; // keep adapting while idle
+  resolution_scale_ = scale;
+}
+
+void Renderer::SetupSceneTarget() {
+  if (scene_fbo_ != 0 && scene_target_width_ == width_ && scene_target_height_ == height_) return;
+  if (scene_fbo_ == 0) {
+    glGenFramebuffers(1, &scene_fbo_);
+  } else { // resized
+    GLuint textures[2] = {scene_color_, scene_depth_};
+    glDeleteTextures(2, textures);
+  }
+  // allocated at the window size, the scale only changes the rendered region
+  scene_target_width_ = width_;
+  scene_target_height_ = height_;
+  glCreateTextures(GL_TEXTURE_2D, 1, &scene_color_);
+  glTextureStorage2D(scene_color_, 1, GL_RGBA8, scene_target_width_, scene_target_height_);
+  glCreateTextures(GL_TEXTURE_2D, 1, &scene_depth_);
+  glTextureStorage2D(scene_depth_, 1, GL_DEPTH_COMPONENT32F, scene_target_width_, scene_target_height_);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, scene_color_, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, scene_depth_, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cerr << "ERROR::RENDERER::SCENE_TARGET_INCOMPLETE" << std::endl;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Renderer::ReleaseSceneTarget() {
+  if (scene_fbo_ == 0) return;
+  GLuint textures[2] = {scene_color_, scene_depth_};
+  glDeleteTextures(2, textures);
+  glDeleteFramebuffers(1, &scene_fbo_);
+  scene_fbo_ = scene_color_ = scene_depth_ = 0;
+  scene_target_width_ = scene_target_height_ = 0;
+}
+
+void Renderer::SetupVisibilityBuffer() {
+  if (visibility_fbo_ != 0 && visibility_width_ == width_ && visibility_height_ == height_) return;
+  if (visibility_fbo_ == 0) {
+    glGenFramebuffers(1, &visibility_fbo_);
+    glGenVertexArrays(1, &fullscreen_vao_);
+    glGetIntegerv(GL_MAX_FRAGMENT_SHADER_STORAGE_BLOCKS, &max_fragment_storage_blocks_);
+    glGetIntegerv(GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS, &max_storage_bindings_);
+    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &max_texture_units_);
+  } else { // resized
+    GLuint textures[3] = {visibility_ids_, visibility_barycentrics_, visibility_depth_};
+    glDeleteTextures(3, textures);
+  }
+  visibility_width_ = width_;
+  visibility_height_ = height_;
+  auto create_texture = [this](GLenum internal_format) {
+    GLuint texture;
+    glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+    glTextureStorage2D(texture, 1, internal_format, visibility_width_, visibility_height_);
+    glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    return texture;
+  };
+  visibility_ids_ = create_texture(GL_RG32UI);
+  visibility_barycentrics_ = create_texture(GL_RG32F);
+  visibility_depth_ = create_texture(GL_DEPTH_COMPONENT32F);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, visibility_fbo_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, visibility_ids_, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, visibility_barycentrics_, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, visibility_depth_, 0);
+  GLenum draw_buffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, draw_buffers);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cerr << "ERROR::RENDERER::VISIBILITY_BUFFER_INCOMPLETE" << std::endl;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Renderer::ReleaseVisibilityBuffer() {
+  if (visibility_fbo_ == 0) return;
+  GLuint textures[3] = {visibility_ids_, visibility_barycentrics_, visibility_depth_};
+  glDeleteTextures(3, textures);
+  glDeleteFramebuffers(1, &visibility_fbo_);
+  glDeleteVertexArrays(1, &fullscreen_vao_);
+  visibility_fbo_ = visibility_ids_ = visibility_barycentrics_ = visibility_depth_ = fullscreen_vao_ = 0;
+  visibility_width_ = visibility_height_ = 0;
+}
+
+// One full-screen draw per group of up to GetResolveSlots meshes of the same program, usually one in all. The meshes
+// are bound to the slots of the pass and each pixel reads the data of the slot with its draw id.
+void Renderer::ResolveVisibilityBuffer() {
+  num_resolve_passes_ = 0;
+  if (visibility_meshes_.empty()) return;
+  glBindTextureUnit(1, visibility_ids_);
+  glBindTextureUnit(2, visibility_barycentrics_);
+  glBindTextureUnit(3, visibility_depth_);
+  shader_manager_.SetModelTransformations(visibility_instances_);
+  glDepthFunc(GL_ALWAYS); // the resolve writes the visibility depth
+  glBindVertexArray(fullscreen_vao_);
+  std::vector<bool> resolved(visibility_meshes_.size(), false);
+  for (size_t first = 0; first < visibility_meshes_.size(); ++first) {
+    if (resolved[first]) continue;
+    TextureType texture_type = visibility_meshes_[first].texture_type;
+    bool progressive = visibility_meshes_[first].progressive;
+    unsigned int num_slots = GetResolveSlots(texture_type, progressive);
+    Shader& resolve_shader = GetTextureTypeShader(texture_type, true, false, false, progressive);
+    resolve_shader.use();
+    unsigned int slot = 0;
+    for (size_t draw_id = first; draw_id < visibility_meshes_.size() && slot < num_slots; ++draw_id) {
+      const VisibilityDraw& draw = visibility_meshes_[draw_id];
+      if (resolved[draw_id] || draw.texture_type != texture_type || draw.progressive != progressive) continue;
+      draw.mesh->BindResolveBuffers(slot, num_slots);
+      resolve_shader.setUInt("resolve_draw_ids[" + std::to_string(slot) + "]", static_cast<unsigned int>(draw_id + 1));
+      resolve_shader.setUInt("resolve_first_instances[" + std::to_string(slot) + "]", draw.first_instance);
+      resolved[draw_id] = true;
+      slot++;
+    }
+    for (; slot < num_slots; ++slot) {
+      resolve_shader.setUInt("resolve_draw_ids[" + std::to_string(slot) + "]", 0u);
+    }
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    resolve_shader.disable();
+    num_resolve_passes_++;
+  }
+  glBindVertexArray(0);
+  glDepthFunc(GL_LESS);
+}
+
+// Every mesh of a resolve pass takes a storage block per buffer the program reads (see bpm_fs.glsl) and a texture unit
+unsigned int Renderer::GetResolveSlots(TextureType texture_type, bool progressive) const {
+  unsigned int blocks_per_mesh = 2; // vertices, indices
+  if (texture_type != TextureType::LINEAR) {
+    blocks_per_mesh += packed_bpm_records_ ? 1 : (texture_type == TextureType::BPM ? 3 : 2);
+    if (progressive) blocks_per_mesh++;
+    if (texture_type == TextureType::BPM && adaptive_bpm_ && !progressive) blocks_per_mesh++;
+  }
+  int slots = std::min({static_cast<int>(kMaxResolveSlots),
+                        (max_fragment_storage_blocks_ - 1) / static_cast<int>(blocks_per_mesh), // and the instances
+                        (max_storage_bindings_ - static_cast<int>(ShaderManager::kResolveBinding)) / static_cast<int>(ShaderManager::kResolveBufferKinds),
+                        max_texture_units_ - static_cast<int>(ShaderManager::kResolveTextureUnit)});
+  return static_cast<unsigned int>(std::max(slots, 1));
 }
 
 void Renderer::DrawSetup() {
@@ -116,12 +682,49 @@ void Renderer::DrawSetup() {
     glDisable(GL_CULL_FACE);
 }
 
-void Renderer::HandleWindowReshape(int new_width, int new_height) { width_ = new_width; height_ = new_height; }
+void Renderer::HandleWindowReshape(int new_width, int new_height) { width_ = new_width; height_ = new_height; RequestRedraw(); }
 
 
 void Renderer::SetTextureType(TextureType texture_type) {
     texture_type_ = texture_type;
-    shader_manager_.SetTextureType(texture_type);
+}
+
+void Renderer::SetExpMethod(ExpMethod exp_method) {
+    exp_method_ = exp_method;
+}
+
+// Texture type, exp method, data layout and mesh slots are compiled into the program, switching is a program switch
+Shader& Renderer::GetTextureTypeShader(TextureType texture_type, bool visibility_resolve, bool wireframe, bool points, bool progressive) {
+  ShaderDefines defines = shader_manager_.GetMeshSlotDefines();
+  defines["TEXTURE_TYPE"] = std::to_string(static_cast<int>(texture_type));
+  if (visibility_resolve) {
+    defines["VISIBILITY_RESOLVE"] = "1";
+    defines["RESOLVE_SLOTS"] = std::to_string(GetResolveSlots(texture_type, progressive));
+    defines["RESOLVE_BINDING"] = std::to_string(ShaderManager::kResolveBinding);
+  }
+  if (wireframe) defines["WIREFRAME"] = "1";
+  if (points) defines["POINTS"] = "1";
+  if (texture_type == TextureType::LINEAR && !visibility_resolve && !wireframe && !points) {
+    return shader_manager_.GetShader("texture_type_linear", defines);
+  }
+  defines["PACKED_RECORDS"] = packed_bpm_records_ ? "1" : "0";
+  if (progressive) defines["PROGRESSIVE_BPM"] = "1";
+  if (texture_type == TextureType::BPM) {
+    defines["EXP_METHOD"] = std::to_string(static_cast<int>(exp_method_));
+    defines["EXP_TERMS"] = std::to_string(kExpTaylorTerms);
+    defines["ADAPTIVE_BPM"] = (adaptive_bpm_ && !progressive) ? "1" : "0"; // flat flags are classified once the data is complete
+  }
+  return shader_manager_.GetShader(visibility_resolve ? "visibility_resolve" : "texture_type", defines);
+}
+
+// Linear texture type program without the texture, the overlay needs the geometry stage for barycentrics
+Shader& Renderer::GetOverlayShader(bool wireframe, bool points) {
+  return shader_manager_.GetShader("texture_type", {{"TEXTURE_TYPE", "0"}, {"OVERLAY_ONLY", "1"},
+                                                    {"WIREFRAME", wireframe ? "1" : "0"}, {"POINTS", points ? "1" : "0"}});
+}
+
+Shader& Renderer::GetNormalsShader() {
+  return shader_manager_.GetShader("normal_lines");
 }
 
 void DrawAxes(Shader& shader) {
@@ -152,15 +755,12 @@ void DrawAxes(Shader& shader) {
 
 void Renderer::ToggleDrawVertexNormals() {
   draw_vertex_normals_ = !draw_vertex_normals_;
-	shader_manager_.SetDrawVertexNormals(draw_vertex_normals_);
 }
 
 void Renderer::ToggleDrawFaceNormals() {
   draw_face_normals_ = !draw_face_normals_;
-  shader_manager_.SetDrawFaceNormals(draw_face_normals_);
 }
 
 void Renderer::SwitchTextureType() {
   texture_type_ = (texture_type_ == TextureType::LINEAR) ? TextureType::BPM : TextureType::LINEAR;
-  shader_manager_.SetTextureType(texture_type_);
 }
\ No newline at end of file
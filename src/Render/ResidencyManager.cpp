@@ -0,0 +1,49 @@
+// ResidencyManager.cpp
+#include "Render/ResidencyManager.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "Scene/Scene.h"
+
+void ResidencyManager::Update(Scene* scene, unsigned long long frame) {
+	std::vector<ModelAsset*> assets; // each once
+	for (auto& model : scene->GetModels()) {
+		ModelAsset* asset = model->GetAsset();
+		if (std::find(assets.begin(), assets.end(), asset) == assets.end()) assets.push_back(asset);
+	}
+	num_assets_ = static_cast<unsigned int>(assets.size());
+	num_evicted_assets_ = 0;
+	resident_bytes_ = 0;
+	for (ModelAsset* asset : assets) {
+		asset->UpdateResidentBytes();
+		resident_bytes_ += asset->GetResidentBPMDataBytes() + asset->GetResidentGeometryBytes();
+		if (!asset->IsResident()) num_evicted_assets_++;
+	}
+	for (ModelAsset* asset : assets) {
+		if (!asset->load_options_.out_of_core || asset->last_drawn_frame_ + min_idle_frames_ > frame) continue;
+		bool was_resident = asset->IsResident();
+		size_t bytes = asset->EvictBPMData() + asset->EvictGeometry(); // the BPM data is in its store
+		if (bytes == 0) continue;
+		resident_bytes_ -= std::min(bytes, resident_bytes_);
+		if (was_resident && !asset->IsResident()) num_evicted_assets_++;
+		num_evictions_++;
+	}
+	if (budget_bytes_ == 0 || resident_bytes_ <= budget_bytes_) return;
+
+	// least recently drawn first
+	std::sort(assets.begin(), assets.end(), [](const ModelAsset* a, const ModelAsset* b) { return a->last_drawn_frame_ < b->last_drawn_frame_; });
+	for (ModelAsset* asset : assets) {
+		if (resident_bytes_ <= budget_bytes_ || asset->last_drawn_frame_ + min_idle_frames_ > frame) break;
+		size_t bytes = 0;
+		bool geometry_first = asset->GetResidentGeometryBytes() > asset->GetResidentBPMDataBytes();
+		for (bool geometry : {geometry_first, !geometry_first}) {
+			if (resident_bytes_ - bytes <= budget_bytes_) break;
+			bytes += geometry ? asset->EvictGeometry() : asset->EvictBPMData();
+		}
+		if (bytes == 0) continue; // being updated, or nothing left
+		resident_bytes_ -= std::min(bytes, resident_bytes_);
+		if (!asset->IsResident()) num_evicted_assets_++;
+		num_evictions_++;
+	}
+}
@@ -1,14 +1,23 @@
 #include "Render/Shader.h"
 
+#include "Utils/Files.h"
+
 
 unsigned int compileShaderProgram(const std::vector<std::string>& shaderPaths, const std::vector<GLenum>& shaderTypes, const std::string& shader_name) {
+    std::vector<std::string> shaderSources;
+    shaderSources.reserve(shaderPaths.size());
+    for (const auto& shaderPath : shaderPaths) {
+        shaderSources.push_back(readShaderFile(shaderPath));
+    }
+    return compileShaderProgramFromSources(shaderSources, shaderTypes, shader_name);
+}
+
+unsigned int compileShaderProgramFromSources(const std::vector<std::string>& shaderSources, const std::vector<GLenum>& shaderTypes, const std::string& shader_name, bool retrievable_binary) {
     unsigned int programID = glCreateProgram();
-    std::vector<unsigned int> shaderIDs;
-    shaderIDs.reserve(shaderPaths.size());
+    std::vector<unsigned int> shaderIDs(shaderSources.size());
     // Compile each shader
-    for (size_t i = 0; i < shaderPaths.size(); ++i) {
-        std::string shaderCode = readShaderFile(shaderPaths[i]);
-        const char* shaderSource = shaderCode.c_str();
+    for (size_t i = 0; i < shaderSources.size(); ++i) {
+        const char* shaderSource = shaderSources[i].c_str();
         shaderIDs[i] = glCreateShader(shaderTypes[i]);
         glShaderSource(shaderIDs[i], 1, &shaderSource, nullptr);
         glCompileShader(shaderIDs[i]);
@@ -19,16 +28,87 @@ unsigned int compileShaderProgram(const std::vector<std::string>& shaderPaths, c
     }
 
     // Link the program
+    if (retrievable_binary) {
+        glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(programID);
     checkCompileErrors(programID, GL_LINK_STATUS, shader_name);
 
     // Delete shaders as they're linked into our program now and no longer necessary
-    for (size_t i = 0; i < shaderPaths.size(); ++i){
+    for (size_t i = 0; i < shaderIDs.size(); ++i){
         glDeleteShader(shaderIDs[i]);
     }
     return programID;
 }
 
+// ---- Program binary cache ---- //
+// file layout: [GLenum binary_format][GLint binary_length][binary]
+unsigned int loadProgramBinary(const std::string& binaryPath) {
+    std::ifstream binaryFile(binaryPath, std::ios::binary);
+    if (!binaryFile.is_open()) {
+        return 0;
+    }
+    GLenum binaryFormat = 0;
+    GLint binaryLength = 0;
+    binaryFile.read(reinterpret_cast<char*>(&binaryFormat), sizeof(binaryFormat));
+    binaryFile.read(reinterpret_cast<char*>(&binaryLength), sizeof(binaryLength));
+    if (!binaryFile || binaryLength <= 0) {
+        return 0;
+    }
+    std::vector<char> binary(binaryLength);
+    binaryFile.read(binary.data(), binaryLength);
+    if (!binaryFile) {
+        return 0;
+    }
+
+    unsigned int programID = glCreateProgram();
+    glProgramBinary(programID, binaryFormat, binary.data(), binaryLength);
+    GLint success;
+    glGetProgramiv(programID, GL_LINK_STATUS, &success);
+    if (!success) {
+        // driver rejected the binary (e.g. after a driver update), caller recompiles from source
+        glDeleteProgram(programID);
+        return 0;
+    }
+    return programID;
+}
+
+bool saveProgramBinary(GLuint programID, const std::string& binaryPath) {
+    GLint binaryLength = 0;
+    glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+    if (binaryLength <= 0) {
+        return false;
+    }
+    std::vector<char> binary(binaryLength);
+    GLenum binaryFormat = 0;
+    glGetProgramBinary(programID, binaryLength, nullptr, &binaryFormat, binary.data());
+
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(binaryPath).parent_path(), ec);
+    // written next to the final name and renamed: another viewer, or the next run after a crash, never loads a
+    // partial binary
+    std::string tempPath = files::MakeTempPath(binaryPath);
+    {
+        std::ofstream binaryFile(tempPath, std::ios::binary | std::ios::trunc);
+        if (!binaryFile.is_open()) {
+            return false;
+        }
+        binaryFile.write(reinterpret_cast<const char*>(&binaryFormat), sizeof(binaryFormat));
+        binaryFile.write(reinterpret_cast<const char*>(&binaryLength), sizeof(binaryLength));
+        binaryFile.write(binary.data(), binaryLength);
+        if (!binaryFile) {
+            binaryFile.close();
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+    }
+    if (!files::RenameReplacing(tempPath, binaryPath)) {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
+
 std::string getShaderTypeName(GLenum type) {
     switch (type)
     {
@@ -101,3 +181,38 @@ std::string extractShaderName(const std::string& shaderPath) {
     }
 }
 
+
+std::string injectShaderDefines(const std::string& shaderCode, const ShaderDefines& defines) {
+    if (defines.empty()) {
+        return shaderCode;
+    }
+    std::string define_lines;
+    for (const auto& [name, value] : defines) {
+        define_lines += "#define " + name + " " + value + "\n";
+    }
+    // #version must stay the first statement
+    size_t version_pos = shaderCode.find("#version");
+    if (version_pos == std::string::npos) {
+        return define_lines + shaderCode;
+    }
+    size_t line_end = shaderCode.find('\n', version_pos);
+    if (line_end == std::string::npos) {
+        return shaderCode + "\n" + define_lines;
+    }
+    std::string result = shaderCode;
+    result.insert(line_end + 1, define_lines);
+    return result;
+}
+
+std::string getShaderVariantName(const std::string& shader_name, const ShaderDefines& defines) {
+    // e.g. texture_type[EXP_METHOD=0,NUM_MESH_SLOTS=1,TEXTURE_TYPE=2]
+    if (defines.empty()) {
+        return shader_name;
+    }
+    std::string variant_name = shader_name + "[";
+    for (auto it = defines.begin(); it != defines.end(); ++it) {
+        if (it != defines.begin()) variant_name += ",";
+        variant_name += it->first + "=" + it->second;
+    }
+    return variant_name + "]";
+}
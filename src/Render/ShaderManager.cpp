@@ -1,6 +1,9 @@
 #include "Render/ShaderManager.h"
 
 #include <vector>
+#include <chrono>
+#include <functional>
+#include <iomanip>
 
 #include <glm/gtc/type_ptr.hpp>
 
@@ -11,24 +14,44 @@
 
 // ------- CONSTRUCTORS ------- //
 
-void ShaderManager::SetupShaders(Renderer* renderer) {
-    shaders_["points_and_lines"] = Shader({std::string(RESOURCES_DIR) + "/shaders/points_and_lines/points_and_lines.vs", std::string(RESOURCES_DIR) + "/shaders/points_and_lines/points_and_lines.fs"}, {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER}); // used for bbox
-    shaders_["normals_shader"] = Shader({std::string(RESOURCES_DIR) + "/shaders/normals/normals.vs", std::string(RESOURCES_DIR) + "/shaders/normals/normals.fs", std::string(RESOURCES_DIR) + "/shaders/normals/normals.gs"}, {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER});
-    shaders_["vertex_color"] = Shader({std::string(RESOURCES_DIR) + "/shaders/vertex_color/vertex_color.vs", std::string(RESOURCES_DIR) + "/shaders/vertex_color/vertex_color.fs"}, {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER});
-    shaders_["texture_type"] = Shader({std::string(RESOURCES_DIR) + "/shaders/texture_type/bpm_vs.glsl", std::string(RESOURCES_DIR) + "/shaders/texture_type/bpm_fs.glsl", std::string(RESOURCES_DIR) + "/shaders/texture_type/bpm_gs.glsl"}, {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER});
-    shaders_["neighbors"] = Shader({std::string(RESOURCES_DIR) + "/shaders/neighbors/neighbors_cs.glsl"}, {GL_COMPUTE_SHADER});
+void ShaderManager::SetupShaders() {
+    // programs are compiled lazily, on first GetShader()
+    RegisterShader("points_and_lines", {std::string(RESOURCES_DIR) + "/shaders/points_and_lines/points_and_lines.vs", std::string(RESOURCES_DIR) + "/shaders/points_and_lines/points_and_lines.fs"}, {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER}); // used for bbox
+    RegisterShader("normal_lines", {std::string(RESOURCES_DIR) + "/shaders/normals/normal_lines_vs.glsl", std::string(RESOURCES_DIR) + "/shaders/normals/normals.fs"}, {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER});
+    RegisterShader("normal_lines_build", {std::string(RESOURCES_DIR) + "/shaders/normals/normal_lines_cs.glsl"}, {GL_COMPUTE_SHADER});
+    RegisterShader("vertex_color", {std::string(RESOURCES_DIR) + "/shaders/vertex_color/vertex_color.vs", std::string(RESOURCES_DIR) + "/shaders/vertex_color/vertex_color.fs"}, {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER});
+    RegisterShader("texture_type", {std::string(RESOURCES_DIR) + "/shaders/texture_type/bpm_vs.glsl", std::string(RESOURCES_DIR) + "/shaders/texture_type/bpm_fs.glsl", std::string(RESOURCES_DIR) + "/shaders/texture_type/bpm_gs.glsl"}, {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER});
+    RegisterShader("texture_type_linear", {std::string(RESOURCES_DIR) + "/shaders/texture_type/bpm_vs.glsl", std::string(RESOURCES_DIR) + "/shaders/texture_type/bpm_fs.glsl"}, {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER}); // TEXTURE_TYPE=0, no geometry stage
+    RegisterShader("visibility", {std::string(RESOURCES_DIR) + "/shaders/texture_type/bpm_vs.glsl", std::string(RESOURCES_DIR) + "/shaders/visibility/visibility_fs.glsl", std::string(RESOURCES_DIR) + "/shaders/texture_type/bpm_gs.glsl"}, {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER}); // VISIBILITY_PASS=1
+    RegisterShader("visibility_resolve", {std::string(RESOURCES_DIR) + "/shaders/visibility/fullscreen_vs.glsl", std::string(RESOURCES_DIR) + "/shaders/texture_type/bpm_fs.glsl"}, {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER}); // VISIBILITY_RESOLVE=1
+    RegisterShader("neighbors", {std::string(RESOURCES_DIR) + "/shaders/neighbors/neighbors_cs.glsl"}, {GL_COMPUTE_SHADER});
+    RegisterShader("deform_bpm", {std::string(RESOURCES_DIR) + "/shaders/neighbors/deform_bpm_cs.glsl"}, {GL_COMPUTE_SHADER});
+    RegisterShader("deform_twist", {std::string(RESOURCES_DIR) + "/shaders/neighbors/deform_twist_cs.glsl"}, {GL_COMPUTE_SHADER});
+
+    // program binary cache is keyed by driver, binaries are not portable across drivers
+    GLint num_binary_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_binary_formats);
+    binary_cache_enabled_ = (num_binary_formats > 0);
+    driver_string_.clear();
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        const GLubyte* value = glGetString(name);
+        if (value) {
+            driver_string_ += reinterpret_cast<const char*>(value);
+        }
+        driver_string_ += "|";
+    }
 
     // setup UBO_matrices_
     glGenBuffers(1, &UBO_matrices_);
     glBindBuffer(GL_UNIFORM_BUFFER, UBO_matrices_);
-    glBufferData(GL_UNIFORM_BUFFER, 3 * sizeof(glm::mat4), nullptr, GL_STATIC_DRAW);
+    glBufferData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4), nullptr, GL_STATIC_DRAW);
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
     glBindBufferBase(GL_UNIFORM_BUFFER, 0, UBO_matrices_);  // Bind the UBO to binding point 0
 
-    SetTextureType(renderer->texture_type_);
-    SetDrawVertexNormals(renderer->draw_vertex_normals_);
-    SetDrawFaceNormals(renderer->draw_face_normals_);
-
+    // per-instance model matrices
+    glGenBuffers(1, &SSBO_instances_);
+    SetModelTransformation(glm::mat4(1.0f));
+    glGenBuffers(1, &SSBO_normal_transforms_);
     
 
 }
@@ -38,52 +61,150 @@ void ShaderManager::SetupShaders(Renderer* renderer) {
 void ShaderManager::SetCameraUniforms(Scene* scene) {
     Camera* camera = scene->GetActiveCamera();
     glBindBuffer(GL_UNIFORM_BUFFER, UBO_matrices_);
-    glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(camera->GetViewTransform()));
-    glBufferSubData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(camera->GetProjectionTransform()));
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(camera->GetViewTransform()));
+    glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(camera->GetProjectionTransform()));
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
-void ShaderManager::SetTextureType(TextureType texture_type) {
-    Shader& shader = shaders_["texture_type"];
-    shader.use();
-    shader.setInt("texture_type", static_cast<int>(texture_type));
-    shader.disable();
+void ShaderManager::SetModelTransformations(const std::vector<glm::mat4>& model_transforms) {
+    // orphan the previous contents, draws that still read them keep their copy
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, SSBO_instances_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, model_transforms.size() * sizeof(glm::mat4), model_transforms.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kInstancesBinding, SSBO_instances_);
 }
 
-void ShaderManager::SetDrawVertexNormals(bool draw_vertex_normals) {
-    Shader& normals_shader = shaders_["normals_shader"];
-	normals_shader.use();
-	normals_shader.setInt("draw_vertex_normals", draw_vertex_normals);
-	normals_shader.disable();
+void ShaderManager::SetNormalTransformations(const glm::mat4& view, const std::vector<glm::mat4>& model_transforms) {
+    // modelview and normal matrix per instance, so the normal lines need no matrix inverse per vertex
+    std::vector<glm::mat4> normal_transforms;
+    normal_transforms.reserve(2 * model_transforms.size());
+    for (const glm::mat4& model : model_transforms) {
+        glm::mat4 modelview = view * model;
+        glm::mat3 upper = glm::mat3(modelview);
+        glm::mat4 normal_matrix = glm::mat4(glm::transpose(glm::inverse(upper)));
+        normal_matrix[3][3] = (glm::determinant(upper) < 0.0f) ? -1.0f : 1.0f;
+        normal_transforms.push_back(modelview);
+        normal_transforms.push_back(normal_matrix);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, SSBO_normal_transforms_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, normal_transforms.size() * sizeof(glm::mat4), normal_transforms.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kNormalTransformsBinding, SSBO_normal_transforms_);
 }
 
-void ShaderManager::SetDrawFaceNormals(bool draw_face_normals) {
-    Shader& normals_shader = shaders_["normals_shader"];
-	normals_shader.use();
-	normals_shader.setInt("draw_face_normals", draw_face_normals);
-	normals_shader.disable();
+void ShaderManager::SetNormalScale(float normal_scale) {
+    normal_scale_ = normal_scale;
+    for (Shader* shader : GetLoadedVariants("normal_lines")) {
+        shader->use();
+        shader->setFloat("normal_scale", normal_scale);
+        shader->disable();
+    }
 }
 
-void ShaderManager::SetModelTransformation(const glm::mat4& model_transform) {
-    glBindBuffer(GL_UNIFORM_BUFFER, UBO_matrices_);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(model_transform));
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+// ------- GETTERS ------- //
+
+Shader& ShaderManager::GetShader(std::string shader_name) {
+    return GetShader(shader_name, ShaderDefines{});
 }
 
+Shader& ShaderManager::GetShader(const std::string& shader_name, const ShaderDefines& defines) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    auto it = shaders_.find(getShaderVariantName(shader_name, defines));
+    if (it != shaders_.end()) {
+        return it->second;
+    }
+    return LoadShader(shader_name, defines);
+}
 
-void ShaderManager::SetNormalScale(float normal_scale) {
-    Shader& shader = shaders_["normals_shader"];
-    shader.use();
-    shader.setFloat("normal_scale", normal_scale);
-    shader.disable();
+bool ShaderManager::IsShaderLoaded(const std::string& variant_name) const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return shaders_.find(variant_name) != shaders_.end();
 }
 
-Shader& ShaderManager::GetShader(std::string shader_name) {
-    return shaders_[shader_name];
+std::vector<Shader*> ShaderManager::GetLoadedVariants(const std::string& shader_name) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    std::vector<Shader*> variants;
+    for (auto& [variant_name, shader] : shaders_) {
+        if (variant_name == shader_name || variant_name.rfind(shader_name + "[", 0) == 0) {
+            variants.push_back(&shader);
+        }
+    }
+    return variants;
+}
+
+ShaderDefines ShaderManager::GetMeshSlotDefines() const {
+    return {{"NUM_MESH_SLOTS", std::to_string(num_mesh_slots_)}};
+}
+
+// ------- LOADING ------- //
+
+void ShaderManager::RegisterShader(const std::string& shader_name, const std::vector<std::string>& shaderPaths, const std::vector<GLenum>& shaderTypes) {
+    if (shaderPaths.size() != shaderTypes.size()) { std::cerr << "ERROR::SHADER::PATHS_AND_TYPES_SIZE_MISMATCH" << std::endl; return; }
+    if (shaderPaths.size() < 1) { std::cerr << "ERROR::SHADER::NO_SHADER_PATHS_PROVIDED" << std::endl; return;  }
+    shader_sources_[shader_name] = ShaderSource{shaderPaths, shaderTypes};
+}
+
+Shader& ShaderManager::LoadShader(const std::string& shader_name, const ShaderDefines& defines) {
+    std::string variant_name = getShaderVariantName(shader_name, defines);
+    auto source_it = shader_sources_.find(shader_name);
+    if (source_it == shader_sources_.end()) {
+        std::cerr << "ERROR::SHADER::NOT_REGISTERED: " << shader_name << std::endl;
+        return shaders_[variant_name];
+    }
+    const ShaderSource& source = source_it->second;
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::string> shaderSources;
+    shaderSources.reserve(source.paths.size());
+    for (const auto& path : source.paths) {
+        shaderSources.push_back(injectShaderDefines(readShaderFile(path), defines));
+    }
+    std::string program_name = extractShaderName(source.paths[0]);
+
+    // try the binary cache first, fall back to compiling from source
+    std::string cache_path = GetProgramCachePath(shader_name, shaderSources, source.types);
+    GLuint program = binary_cache_enabled_ ? loadProgramBinary(cache_path) : 0;
+    bool from_cache = (program != 0);
+    if (!from_cache) {
+        program = compileShaderProgramFromSources(shaderSources, source.types, program_name, binary_cache_enabled_);
+        if (binary_cache_enabled_ && !saveProgramBinary(program, cache_path)) {
+            std::cout << "ShaderManager: could not write program binary " << cache_path << std::endl;
+        }
+    }
+    Shader& shader = shaders_[variant_name];
+    shader = Shader(program, program_name);
+    ApplyShaderState(shader_name, shader);
+
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    shader_load_ms_ += elapsed_ms;
+    from_cache ? ++num_cached_programs_ : ++num_compiled_programs_;
+    std::cout << "ShaderManager: " << variant_name << (from_cache ? " loaded from binary cache" : " compiled from source")
+              << " in " << std::fixed << std::setprecision(2) << elapsed_ms << " ms" << std::defaultfloat << std::endl;
+    return shader;
+}
+
+void ShaderManager::ApplyShaderState(const std::string& shader_name, Shader& shader) {
+    if (shader_name == "normal_lines") {
+        shader.use();
+        shader.setFloat("normal_scale", normal_scale_);
+        shader.disable();
+    }
+}
+
+std::string ShaderManager::GetProgramCachePath(const std::string& shader_name, const std::vector<std::string>& shaderSources, const std::vector<GLenum>& shaderTypes) const {
+    // key: hash of driver string and all stage sources
+    std::string key = driver_string_;
+    for (size_t i = 0; i < shaderSources.size(); ++i) {
+        key += std::to_string(shaderTypes[i]) + ":" + shaderSources[i];
+    }
+    std::stringstream file_name;
+    file_name << shader_name << "_" << std::hex << std::hash<std::string>{}(key) << ".bin";
+    return (std::filesystem::path(SHADER_CACHE_DIR) / file_name.str()).string();
 }
 
 GLuint ShaderManager::AssignSSBOIndex() {
-  return ssbo_idx_++;
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  return ssbo_idx_++ % num_mesh_slots_;
 }  
 // Link shader program
 GLuint ShaderManager::linkShaderProgram(GLuint shader) {
@@ -0,0 +1,130 @@
+// AssetLoader.cpp
+#include "Scene/AssetLoader.h"
+
+#include <exception>
+#include <iostream>
+
+AssetLoader::AssetLoader(GLFWwindow* shared_window, unsigned int num_workers) {
+	// window creation is main thread only, the contexts are made current by the workers
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	for (unsigned int i = 0; i < num_workers; ++i) {
+		GLFWwindow* context = glfwCreateWindow(1, 1, "loader", NULL, shared_window);
+		if (context == NULL) {
+			std::cerr << "ERROR::ASSET_LOADER::CONTEXT_CREATION_FAILED" << std::endl;
+			break;
+		}
+		contexts_.push_back(context);
+	}
+	glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+	for (GLFWwindow* context : contexts_) {
+		workers_.emplace_back(&AssetLoader::WorkerLoop, this, context);
+	}
+}
+
+AssetLoader::~AssetLoader() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	jobs_condition_.notify_all();
+	for (std::thread& worker : workers_) {
+		worker.join();
+	}
+	for (GLFWwindow* context : contexts_) {
+		glfwDestroyWindow(context);
+	}
+}
+
+void AssetLoader::Load(const std::string& path, const ModelLoadOptions& load_options, OnLoaded on_loaded) {
+	if (workers_.empty()) {
+		std::cerr << "ERROR::ASSET_LOADER::NO_WORKERS: " << path << std::endl;
+		return;
+	}
+	num_pending_++;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		jobs_.push_back(Job{path, load_options, std::move(on_loaded), nullptr, nullptr});
+	}
+	jobs_condition_.notify_one();
+}
+
+void AssetLoader::Update(std::shared_ptr<ModelAsset> asset, OnLoaded on_progress) {
+	if (workers_.empty()) {
+		std::cerr << "ERROR::ASSET_LOADER::NO_WORKERS: " << asset->model_name_ << std::endl;
+		return;
+	}
+	num_pending_updates_++;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		jobs_.push_back(Job{"", ModelLoadOptions(), nullptr, std::move(asset), std::move(on_progress)});
+	}
+	jobs_condition_.notify_one();
+}
+
+void AssetLoader::WorkerLoop(GLFWwindow* context) {
+	glfwMakeContextCurrent(context);
+	while (true) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			jobs_condition_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+			if (stopping_) break; // queued loads are dropped
+			job = std::move(jobs_.front());
+			jobs_.pop_front();
+		}
+		if (job.asset) {
+			// the asset is drawn meanwhile, its triangles switch to the requested texture type as the chunks land
+			try {
+				while (!IsStopping() && job.asset->PrecomputeStep()) {
+					job.on_progress(job.asset);
+				}
+			} catch (const std::exception& e) {
+				std::cerr << "ERROR::ASSET_LOADER::UPDATE_FAILED: " << job.asset->model_name_ << ": " << e.what() << std::endl;
+			}
+			job.on_progress(std::move(job.asset));
+			num_pending_updates_--;
+			continue;
+		}
+		std::shared_ptr<ModelAsset> asset = LoadAsset(job);
+		if (asset) job.on_loaded(asset);
+		num_pending_--;
+	}
+	glfwMakeContextCurrent(NULL);
+}
+
+bool AssetLoader::IsStopping() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stopping_;
+}
+
+std::shared_ptr<ModelAsset> AssetLoader::LoadAsset(const Job& job) {
+	size_t content_hash = ModelAsset::ComputeContentHash(job.path, job.load_options);
+	std::promise<std::shared_ptr<ModelAsset>> promise;
+	std::shared_future<std::shared_ptr<ModelAsset>> loading;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = loading_.find(content_hash);
+		if (it != loading_.end()) {
+			loading = it->second;
+		} else {
+			loading_[content_hash] = promise.get_future().share();
+		}
+	}
+	if (loading.valid()) { // another worker has it
+		return loading.get();
+	}
+
+	std::shared_ptr<ModelAsset> asset;
+	try {
+		asset = std::make_shared<ModelAsset>(job.path, job.load_options, content_hash);
+		// the uploads must be complete before another context uses the objects
+		glFinish();
+	} catch (const std::exception& e) {
+		std::cerr << "ERROR::ASSET_LOADER::LOAD_FAILED: " << job.path << ": " << e.what() << std::endl;
+		asset = nullptr; // the workers waiting for the same file fail too
+	}
+	promise.set_value(asset);
+	std::lock_guard<std::mutex> lock(mutex_);
+	loading_.erase(content_hash);
+	return asset;
+}
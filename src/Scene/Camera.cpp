@@ -36,6 +36,7 @@ glm::mat4 Camera::LookAt(const glm::vec3& eye, const glm::vec3& at, const glm::v
 	up_ = up;
 	// Compute translation matrix 
 	view_transform_ = glm::lookAt(eye, at, up);
+	version_++;
 	return view_transform_;
 }
 
@@ -44,6 +45,7 @@ void Camera::UpdateProjection() {
 		projection_ = glm::perspective(fovy_, aspect_, z_near_, z_far_);
 	else
 		projection_ = glm::ortho(-right_, right_, -top_, top_, z_near_, z_far_);
+	version_++;
 }
 
 void Camera::SetAspect(float aspect) {
@@ -1,87 +1,409 @@
 #include "Scene/Mesh.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
 #include <limits>
+#include <mutex>
+#include <utility>
 
 #include <unsupported/Eigen/MatrixFunctions>
 
-#include "Scene/MeshModel.h"
+#include "Scene/ModelAsset.h"
+#include "Render/GpuTimer.h"
 #include "Render/Shader.h"
 #include "Render/ShaderManager.h"
 #include "BPM/Mobius.h"
+#include "Scene/MeshOptimizer.h"
+
+struct Mesh::PrecomputeState {
+  // inputs of the neighbors compute shader
+  GLuint indicesBO = 0, indicesTBO = 0, verticesBO = 0, verticesTBO = 0, vtBO = 0, vtTBO = 0;
+  GLuint thirdVerticesBO = 0; // neighbor table of BPMData::FULL, see ComputeThirdVertices
+  GLuint flattenedBO = 0, flattenedTBO = 0; // output, one chunk
+  unsigned int flattened_capacity = 0;
+  unsigned int num_computed_faces = 0; // the triangles before it are computed, and published once ready_fence_ is done
+  // log ratio layout of the whole mesh, see BeginPrecompute
+  LogRatioLayout log_ratios;
+  size_t num_uploaded_ratios = 0;
+  bool records = false; // packed records are made as well
+  std::vector<GLuint> ready_bits;
+  double sum_uv_error = 0.0;
+
+  ~PrecomputeState() {
+    glDeleteBuffers(1, &indicesBO);
+    glDeleteTextures(1, &indicesTBO);
+    glDeleteBuffers(1, &verticesBO);
+    glDeleteTextures(1, &verticesTBO);
+    glDeleteBuffers(1, &vtBO);
+    glDeleteTextures(1, &vtTBO);
+    glDeleteBuffers(1, &thirdVerticesBO);
+    glDeleteBuffers(1, &flattenedBO);
+    glDeleteTextures(1, &flattenedTBO);
+  }
+};
+
+struct Mesh::EvictedBPMData { // of a level in the BPM store, read on restore
+  BPMData level = BPMData::NONE;
+  std::vector<char> trans, mobius, ratios, records; // buffer contents, ratios and records for BPMData::FULL
+};
+
+struct Mesh::DeformBuffers {
+  GLuint VAO = 0, VBO = 0, trans = 0, mobius = 0, ratios = 0, records = 0, flat = 0;
+};
+
+struct Mesh::DeformState {
+  GLuint adjacencyBO = 0; // per triangle edge, the other vertex of the neighbor across it
+  DeformBuffers back;     // written by the pass in flight, the drawn set is the mesh's own buffers
+  std::vector<Vertex> vertices; // with the latest positions of SetDeformedPositions
+  bool has_new_positions = false;
+  // SetDeformTwist: the deform_twist pass writes the positions from restVBO instead
+  bool twist = false;
+  float twist_angle = 0.0f, twist_height = 1.0f;
+  glm::vec3 twist_center = glm::vec3(0.0f);
+  GLuint restVBO = 0;
+  GLsync fence = nullptr; // of the pass in flight
+  GpuTimer timer;
+
+  ~DeformState() {
+    glDeleteBuffers(1, &adjacencyBO);
+    glDeleteVertexArrays(1, &back.VAO);
+    for (GLuint* buffer : {&back.VBO, &back.trans, &back.mobius, &back.ratios, &back.records, &back.flat, &restVBO}) {
+      glDeleteBuffers(1, buffer);
+    }
+    if (fence != nullptr) glDeleteSync(fence);
+  }
+};
+
+struct Mesh::DeformBenchmark {
+  std::unique_ptr<DeformState> state;
+  GLuint query = 0;
+  int repetitions = 0;
+
+  ~DeformBenchmark() {
+    glDeleteQueries(1, &query);
+  }
+};
 
 // ---------------------- SETUP ---------------------- //
 Mesh::Mesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices,
-           unsigned int texture_id, std::vector<glm::vec3>& face_normals, MeshModel* parent)
+           unsigned int texture_id, std::vector<glm::vec3>& face_normals, ModelAsset* parent)
     : vertices_(vertices),
       indices_(indices),
       texture_id_(texture_id),
       face_normals_(face_normals),
-      parent_mesh_model_(parent),
+      parent_asset_(parent),
       shader_manager_(ShaderManager::GetInstance()) 
       {
         num_faces_ = indices.size() / 3;
         ssbo_idx_ = shader_manager_.AssignSSBOIndex();
+        acmr_ = mesh_optimizer::ComputeACMR(indices_, vertices_.size());
+        acmr_before_reorder_ = acmr_;
   }
 
 Mesh::~Mesh() {
   glDeleteVertexArrays(1, &VAO);
   glDeleteBuffers(1, &VBO);
+  glDeleteBuffers(1, &EBO);
+  glDeleteBuffers(1, &indirectBO);
   glDeleteBuffers(1, &mobiusSSBO);
   glDeleteBuffers(1, &ratiosSSBO);
   glDeleteBuffers(1, &transSSBO);
+  glDeleteBuffers(1, &recordsSSBO);
+  glDeleteBuffers(1, &flatSSBO);
+  glDeleteBuffers(1, &readySSBO);
+  glDeleteBuffers(1, &final_ratiosSSBO_);
+  glDeleteBuffers(1, &normalLinesVBO);
+  glDeleteVertexArrays(1, &normalLinesVAO);
+  if (ready_fence_) glDeleteSync(ready_fence_);
 }
 
 // ---------------------- BUFFERS ---------------------- //
 void Mesh::InitBuffers() {
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
+  UploadGeometry();
 
-  glBindVertexArray(VAO);
+  // meshlets over the final triangle order, without the boundary ring
+  std::vector<glm::vec3> positions(vertices_.size());
+  for (size_t i = 0; i < vertices_.size(); i++) {
+    positions[i] = vertices_[i].position_;
+  }
+  if (num_ring_faces_ > 0) {
+    std::vector<unsigned int> drawn_indices(indices_.begin(), indices_.begin() + 3 * static_cast<size_t>(GetNumDrawnFaces()));
+    meshlets_ = mesh_optimizer::BuildMeshlets(positions, drawn_indices, face_normals_);
+  } else {
+    meshlets_ = mesh_optimizer::BuildMeshlets(positions, indices_, face_normals_);
+  }
+  num_visible_meshlets_ = static_cast<unsigned int>(meshlets_.size());
+  num_visible_faces_ = GetNumDrawnFaces();
+  draw_commands_.reserve(meshlets_.size());
+  glGenBuffers(1, &indirectBO);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBO);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, meshlets_.size() * sizeof(DrawElementsCommand), nullptr, GL_STREAM_DRAW);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
 
-  // Create a combined buffer for vertices and triangle IDs
-  std::vector<float> combined_data;
-  for (size_t i = 0; i < indices_.size(); ++i) {
-    unsigned int vertex_index = indices_[i];
-    const Vertex& vertex = vertices_[vertex_index];
+void Mesh::UploadGeometry() {
+  glGenBuffers(1, &VBO);
+  glGenBuffers(1, &EBO);
 
-    combined_data.push_back(vertex.position_.x);
-    combined_data.push_back(vertex.position_.y);
-    combined_data.push_back(vertex.position_.z);
-    combined_data.push_back(vertex.normal_.x);
-    combined_data.push_back(vertex.normal_.y);
-    combined_data.push_back(vertex.normal_.z);
-    combined_data.push_back(vertex.tex_coords_.x);
-    combined_data.push_back(vertex.tex_coords_.y);
-    combined_data.push_back( static_cast<float>(i / 3)); 
-  }
+  // Indexed vertices, so that the post-transform cache is used. Triangle IDs come from gl_PrimitiveID.
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(Vertex), vertices_.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_.size() * sizeof(unsigned int), indices_.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
 
+// Vertex arrays are not shared between GL contexts, so the VAO is made by the drawing context on first use.
+void Mesh::SetupVertexArray() {
+  glGenVertexArrays(1, &VAO);
+  glBindVertexArray(VAO);
   glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, combined_data.size() * sizeof(float), combined_data.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 
   // vertex Positions
   glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position_));
   // vertex normals
   glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)(3 * sizeof(float)));
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal_));
   // vertex texture coords
   glEnableVertexAttribArray(2);
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)(6 * sizeof(float)));
-  // vertex triangle ID
-  glEnableVertexAttribArray(3);
-  glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, 9 * sizeof(float),
-                        (void*)(8 * sizeof(float)));
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tex_coords_));
 
   glBindVertexArray(0);
 }
 
+void Mesh::Draw(GLsizei instance_count) {
+  if (use_draw_commands_ && instance_count == 1) {
+    if (!draw_commands_.empty()) {
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBO);
+      glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, static_cast<GLsizei>(draw_commands_.size()), 0);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+  } else {
+    glDrawElementsInstanced(GL_TRIANGLES, 3 * static_cast<GLsizei>(GetNumDrawnFaces()), GL_UNSIGNED_INT, 0, instance_count);
+  }
+  glBindVertexArray(0);
+}
+
+void Mesh::BuildNormalLines() {
+  // line vertex: position, normal (w: 0 at the start, 1 at the end)
+  GLsizeiptr line_vertex_size = 2 * sizeof(glm::vec4);
+  GLsizeiptr num_line_vertices = 2 * (static_cast<GLsizeiptr>(num_faces_) + static_cast<GLsizeiptr>(vertices_.size()));
+  glGenVertexArrays(1, &normalLinesVAO);
+  glGenBuffers(1, &normalLinesVBO);
+  glBindVertexArray(normalLinesVAO);
+  glBindBuffer(GL_ARRAY_BUFFER, normalLinesVBO);
+  glBufferData(GL_ARRAY_BUFFER, num_line_vertices * line_vertex_size, nullptr, GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, line_vertex_size, (void*)0);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, line_vertex_size, (void*)sizeof(glm::vec4));
+  glBindVertexArray(0);
+
+  Shader& build_shader = shader_manager_.GetShader("normal_lines_build");
+  build_shader.use();
+  build_shader.setUInt("num_triangles", num_faces_);
+  build_shader.setUInt("num_vertices", static_cast<unsigned int>(vertices_.size()));
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShaderManager::kResolveVerticesBinding, VBO);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShaderManager::kResolveIndicesBinding, EBO);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShaderManager::kNormalLinesBinding, normalLinesVBO);
+  GLuint num_lines = num_faces_ + static_cast<GLuint>(vertices_.size());
+  glDispatchCompute((num_lines + 255) / 256, 1, 1);
+  glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+  build_shader.disable();
+}
+
+void Mesh::DrawNormalLines(Shader& shader, bool face_normals, bool vertex_normals, GLsizei instance_count) {
+  if (!face_normals && !vertex_normals) return;
+  if (normalLinesVAO == 0) {
+    BuildNormalLines();
+    shader.use();
+  }
+  GLint num_face_vertices = 2 * static_cast<GLint>(num_faces_);
+  GLsizei num_vertex_vertices = 2 * static_cast<GLsizei>(vertices_.size());
+  shader.setUInt("num_face_vertices", static_cast<unsigned int>(num_face_vertices));
+  glBindVertexArray(normalLinesVAO);
+  GLint first = face_normals ? 0 : num_face_vertices;
+  GLsizei count = (face_normals ? num_face_vertices : 0) + (vertex_normals ? num_vertex_vertices : 0);
+  glDrawArraysInstanced(GL_LINES, first, count, instance_count);
+  glBindVertexArray(0);
+}
+
+void Mesh::CullMeshlets(const glm::mat4& model_view_projection, const glm::vec3& eye_local, bool cull_backfacing) {
+  if (deform_) { // the bounds are of the rest positions
+    ResetCulling();
+    return;
+  }
+  glm::vec4 planes[6];
+  mesh_optimizer::ExtractFrustumPlanes(model_view_projection, planes);
+  draw_commands_.clear();
+  num_visible_meshlets_ = 0;
+  num_visible_faces_ = 0;
+  for (const mesh_optimizer::Meshlet& meshlet : meshlets_) {
+    if (!mesh_optimizer::IsMeshletInFrustum(meshlet, planes)) continue;
+    if (cull_backfacing && mesh_optimizer::IsMeshletBackfacing(meshlet, eye_local)) continue;
+    num_visible_meshlets_++;
+    num_visible_faces_ += meshlet.triangle_count;
+    // meshlets are contiguous, so neighboring visible meshlets merge into one draw
+    if (!draw_commands_.empty() && draw_commands_.back().base_instance + draw_commands_.back().count / 3 == meshlet.first_triangle) {
+      draw_commands_.back().count += 3 * meshlet.triangle_count;
+      continue;
+    }
+    draw_commands_.push_back({3 * meshlet.triangle_count, 1, 3 * meshlet.first_triangle, 0, meshlet.first_triangle});
+  }
+  if (!draw_commands_.empty()) {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBO);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, draw_commands_.size() * sizeof(DrawElementsCommand), draw_commands_.data());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  }
+  use_draw_commands_ = true;
+}
+
+void Mesh::ResetCulling() {
+  use_draw_commands_ = false;
+  num_visible_meshlets_ = static_cast<unsigned int>(meshlets_.size());
+  num_visible_faces_ = GetNumDrawnFaces();
+}
+
+void Mesh::ReorderTriangles() {
+  std::vector<glm::vec3> positions(vertices_.size());
+  for (size_t i = 0; i < vertices_.size(); i++) {
+    positions[i] = vertices_[i].position_;
+  }
+  acmr_before_reorder_ = mesh_optimizer::ComputeACMR(indices_, vertices_.size());
+
+  // spatially coherent order first, Tipsify keeps it on dead ends
+  std::vector<unsigned int> order = mesh_optimizer::MortonTriangleOrder(positions, indices_);
+  mesh_optimizer::PermuteTriangles(indices_, order, 3);
+  mesh_optimizer::PermuteTriangles(face_normals_, order);
+  order = mesh_optimizer::TipsifyTriangleOrder(indices_, vertices_.size());
+  mesh_optimizer::PermuteTriangles(indices_, order, 3);
+  mesh_optimizer::PermuteTriangles(face_normals_, order);
+
+  // vertex fetch locality
+  std::vector<unsigned int> vertex_order = mesh_optimizer::FirstUseVertexOrder(indices_, vertices_.size());
+  std::vector<Vertex> reordered_vertices; reordered_vertices.reserve(vertices_.size());
+  for (unsigned int old_idx : vertex_order) {
+    reordered_vertices.push_back(vertices_[old_idx]);
+  }
+  vertices_.swap(reordered_vertices);
+  source_vertices_ = std::move(vertex_order);
+
+  acmr_ = mesh_optimizer::ComputeACMR(indices_, vertices_.size());
+  std::cout << "Reordered triangles of " << parent_asset_->model_name_ << ": ACMR " << acmr_before_reorder_
+            << " -> " << acmr_ << " (FIFO cache of " << mesh_optimizer::kVertexCacheSize << ")" << std::endl;
+}
+
 void Mesh::BindDataBuffers() {
+  if (VAO == 0) {
+    SetupVertexArray();
+  }
   glBindVertexArray(VAO);
+  // bpm_data_ first: the precompute writes final_ratiosSSBO_ and the level's statistics before it publishes the
+  // level, so they may be read once it is acquired and not before
+  if (HasBPMData(BPMData::FULL) && final_ratiosSSBO_ != 0) {
+    // the precompute is done and no longer writes them. The ready flags stay, a draw may still have chosen
+    // the progressive program before the last chunk was published.
+    glDeleteBuffers(1, &ratiosSSBO);
+    ratiosSSBO = final_ratiosSSBO_;
+    final_ratiosSSBO_ = 0;
+  }
   GLuint trans_port  = ssbo_idx_ * shader_manager_.ssbo_per_mesh_ + 0;
   GLuint mobius_port = ssbo_idx_ * shader_manager_.ssbo_per_mesh_ + 1;
   GLuint ratios_port = ssbo_idx_ * shader_manager_.ssbo_per_mesh_ + 2;
   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, trans_port, transSSBO);
   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, mobius_port, mobiusSSBO);
   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ratios_port, ratiosSSBO);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShaderManager::kRecordsBinding + ssbo_idx_, recordsSSBO);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShaderManager::kFlatTrianglesBinding + ssbo_idx_, flatSSBO);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShaderManager::kReadyTrianglesBinding + ssbo_idx_, readySSBO);
+}
+
+void Mesh::ClassifyTriangles(float tolerance) {
+  if (deform_) { // the deform_bpm pass flags and counts the triangles with this tolerance from its next run
+    classified_tolerance_ = tolerance;
+    flat_max_uv_error_ = 0.0f; // not measured
+    return;
+  }
+  if (!HasBPMData(BPMData::FULL)) return; // max_log_ratio_ is being computed
+  // a triangle whose edge log ratios are all below the tolerance is textured by its own Mobius map,
+  // the blend of the three edge ratios is then within exp(tolerance) of the identity
+  flat_bits_.assign((num_faces_ + 31) / 32, 0u);
+  num_flat_faces_ = 0;
+  flat_max_uv_error_ = 0.0f;
+  for (size_t f = 0; f < max_log_ratio_.size(); f++) {
+    if (max_log_ratio_[f] >= tolerance) continue;
+    flat_bits_[f / 32] |= 1u << (f % 32);
+    num_flat_faces_++;
+    flat_max_uv_error_ = std::max(flat_max_uv_error_, flat_uv_error_[f]);
+  }
+  if (flatSSBO == 0) glGenBuffers(1, &flatSSBO);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, flatSSBO);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, flat_bits_.size() * sizeof(GLuint), flat_bits_.data(), GL_DYNAMIC_DRAW);
+  classified_tolerance_ = tolerance;
+}
+
+void Mesh::SetPackedRecords(bool packed) {
+  packed_records_.store(packed, std::memory_order_release);
+  // a precompute in flight makes them or not as it began, this thread owns the buffers of a complete level
+  if (deform_ || !HasBPMData(BPMData::FULL)) return;
+  if (!packed && recordsSSBO != 0) {
+    glDeleteBuffers(1, &recordsSSBO);
+    recordsSSBO = 0;
+    std::vector<float>().swap(record_uv_error_);
+  } else if (packed && recordsSSBO == 0) {
+    BuildRecords();
+  }
+}
+
+// Reads the split buffers back once, when the packed layout is chosen after the precompute
+void Mesh::BuildRecords() {
+  if (final_ratiosSSBO_ != 0) { // not swapped in yet
+    glDeleteBuffers(1, &ratiosSSBO);
+    ratiosSSBO = final_ratiosSSBO_;
+    final_ratiosSSBO_ = 0;
+  }
+  size_t nF = num_faces_;
+  std::vector<glm::mat4> frames(nF);
+  std::vector<Mat2c> coeffs(nF);
+  std::vector<GLuint> ratios(ratios_bytes_ / sizeof(GLuint));
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, transSSBO);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, nF * sizeof(glm::mat4), frames.data());
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, mobiusSSBO);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, nF * sizeof(Mat2c), coeffs.data());
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, ratiosSSBO);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, ratios_bytes_, ratios.data());
+
+  std::vector<BPMRecord> records(nF);
+  record_max_uv_error_ = 0.0f;
+  record_uv_error_.assign(IsEditable() ? nF : 0, 0.0f);
+  double sum_uv_error = 0.0;
+  for (size_t f = 0; f < nF; f++) {
+    TriangleBPM bpm;
+    bpm.coeffs = coeffs[f];
+    for (int k = 0; k < 3; k++) {
+      glm::vec4 p = frames[f] * glm::vec4(vertices_[indices_[3 * f + k]].position_, 1.0f); // flattened, as by the neighbors pass
+      bpm.p[k] = Complex(p.x, p.y);
+      bpm.mu[k] = GetEdgeLogRatio(ratios.data(), 3 * f + k);
+    }
+    float uv_error = 0.0f;
+    records[f] = MakeBPMRecord(frames[f], bpm, uv_error, sum_uv_error);
+    record_max_uv_error_ = std::max(record_max_uv_error_, uv_error);
+    if (!record_uv_error_.empty()) record_uv_error_[f] = uv_error;
+  }
+  glGenBuffers(1, &recordsSSBO);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, recordsSSBO);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, nF * sizeof(BPMRecord), records.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  packed_bytes_per_triangle_ = static_cast<float>(sizeof(BPMRecord));
 }
 
 void Mesh::BindTextures(Shader& shader) {
@@ -92,33 +414,65 @@ void Mesh::BindTextures(Shader& shader) {
   glBindTexture(GL_TEXTURE_2D, texture_id_);
   shader.setUInt("ssbo_idx", ssbo_idx_);
 
+}
+
+// buffer kind k at kResolveBinding + k * num_slots + slot, in the order of the resolve's block arrays (bpm_fs.glsl)
+void Mesh::BindResolveBuffers(unsigned int slot, unsigned int num_slots) const {
+  GLuint buffers[ShaderManager::kResolveBufferKinds] = {VBO, EBO, transSSBO, mobiusSSBO, ratiosSSBO, recordsSSBO, flatSSBO, readySSBO};
+  for (GLuint kind = 0; kind < ShaderManager::kResolveBufferKinds; kind++) {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShaderManager::kResolveBinding + kind * num_slots + slot, buffers[kind]);
+  }
+  glBindTextureUnit(ShaderManager::kResolveTextureUnit + slot, texture_id_);
 }  // ---------------------- SETUP ---------------------- //
 
 // ---------------------- FIND NEIGHBORS ---------------------- //
 using flattenedType = glm::vec4;
-void Mesh::NeighborsComputeShader() {
-  std::cout << "Computing Mobius Coefficients and Log Ratios for Mesh: " << parent_mesh_model_->model_name_ << std::endl;
-  Shader& neighbors_shader = shader_manager_.GetShader("neighbors");
-  neighbors_shader.use();
-  // set neighbors shader uniforms
-  unsigned int nF = static_cast<int>(indices_.size() / 3);
-  neighbors_shader.setUInt("numTriangles", nF);
-  neighbors_shader.setUInt("ssbo_idx", ssbo_idx_);
 
-  GLuint trans_port  = ssbo_idx_ * shader_manager_.ssbo_per_mesh_ + 0; 
-  GLuint mobius_port = ssbo_idx_ * shader_manager_.ssbo_per_mesh_ + 1;
-  GLuint ratios_port = ssbo_idx_ * shader_manager_.ssbo_per_mesh_ + 2;
+BPMData Mesh::GetRequiredBPMData(TextureType texture_type) {
+  switch (texture_type) {
+    case TextureType::LINEAR: return BPMData::NONE;
+    case TextureType::DIRECT_MOBIUS: return BPMData::MOBIUS;
+    default: return BPMData::FULL;
+  }
+}
+
+void Mesh::ComputeBPMData(BPMData level) {
+  while (!HasBPMData(level)) {
+    if (!IsPrecomputing()) BeginPrecompute(level); // else a lower level is finished first
+    PrecomputeChunk(num_faces_);
+  }
+}
+
+// A triangle reads its neighbors from the neighbor table, a chunk costs the same at both levels
+unsigned int Mesh::GetPrecomputeChunkSize() const {
+  return kPrecomputeChunkSize;
+}
+
+void Mesh::BeginPrecompute(BPMData level) {
+  if (num_faces_ == 0) {
+    precompute_level_.store(level, std::memory_order_release);
+    bpm_data_.store(level, std::memory_order_release);
+    return;
+  }
+  if (evicted_) {
+    RestoreBPMData();
+    if (HasBPMData(level)) return;
+  }
+  bool full = (level == BPMData::FULL);
+  std::cout << (full ? "Computing Mobius Coefficients and Log Ratios for Mesh: " : "Computing Mobius Coefficients for Mesh: ")
+            << parent_asset_->model_name_ << std::endl;
+  precompute_ = std::make_unique<PrecomputeState>();
+  PrecomputeState& state = *precompute_;
+  unsigned int nF = static_cast<int>(indices_.size() / 3);
 
   // --- INDICES TBO --- //
-  GLuint indicesBO;
-  glGenBuffers(1, &indicesBO);
-  glBindBuffer(GL_TEXTURE_BUFFER, indicesBO);  // size 3*nF
+  glGenBuffers(1, &state.indicesBO);
+  glBindBuffer(GL_TEXTURE_BUFFER, state.indicesBO);  // size 3*nF
   glBufferData(GL_TEXTURE_BUFFER, indices_.size() * sizeof(unsigned int), indices_.data(), GL_STATIC_DRAW);
 
-  GLuint indicesTBO;
-  glGenTextures(1, &indicesTBO);
-  glBindTexture(GL_TEXTURE_BUFFER, indicesTBO);
-  glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, indicesBO);
+  glGenTextures(1, &state.indicesTBO);
+  glBindTexture(GL_TEXTURE_BUFFER, state.indicesTBO);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, state.indicesBO);
 
   // --- VERTICES TBO --- //
   std::vector<glm::vec3> verts_pos(vertices_.size());
@@ -126,15 +480,13 @@ void Mesh::NeighborsComputeShader() {
     verts_pos[i] = vertices_[i].position_;
   }
 
-  GLuint verticesBO;
-  glGenBuffers(1, &verticesBO);
-  glBindBuffer(GL_TEXTURE_BUFFER, verticesBO);
+  glGenBuffers(1, &state.verticesBO);
+  glBindBuffer(GL_TEXTURE_BUFFER, state.verticesBO);
   glBufferData(GL_TEXTURE_BUFFER, verts_pos.size() * sizeof(glm::vec3), verts_pos.data(), GL_STATIC_DRAW);
 
-  GLuint verticesTBO;
-  glGenTextures(1, &verticesTBO);
-  glBindTexture(GL_TEXTURE_BUFFER, verticesTBO);
-  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, verticesBO);
+  glGenTextures(1, &state.verticesTBO);
+  glBindTexture(GL_TEXTURE_BUFFER, state.verticesTBO);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, state.verticesBO);
 
   // --- VT TBO --- //
   std::vector<glm::vec2> vt(vertices_.size());
@@ -142,138 +494,973 @@ void Mesh::NeighborsComputeShader() {
     vt[i] = vertices_[i].tex_coords_;
   }
 
-  GLuint vtBO;
-  glGenBuffers(1, &vtBO);
-  glBindBuffer(GL_TEXTURE_BUFFER, vtBO);
+  glGenBuffers(1, &state.vtBO);
+  glBindBuffer(GL_TEXTURE_BUFFER, state.vtBO);
   glBufferData(GL_TEXTURE_BUFFER, vt.size() * sizeof(glm::vec2), vt.data(), GL_STATIC_DRAW);
 
-  GLuint vtTBO;
-  glGenTextures(1, &vtTBO);
-  glBindTexture(GL_TEXTURE_BUFFER, vtTBO);
-  glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, vtBO);
+  glGenTextures(1, &state.vtTBO);
+  glBindTexture(GL_TEXTURE_BUFFER, state.vtTBO);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, state.vtBO);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+  // --- BPM buffers of the level, filled chunk by chunk --- //
+  if (transSSBO == 0) {
+    glGenBuffers(1, &transSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, transSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, nF * sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &mobiusSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mobiusSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, nF * sizeof(Mat2c), nullptr, GL_STATIC_DRAW);
+  }
+
+  if (full) {
+    // --- NEIGHBOR TABLE --- //
+    // made once on the CPU in O(nF) from the vertex -> triangles table, the neighbors pass indexes it
+    std::vector<GLuint> third_vertices = ComputeThirdVertices();
+    glGenBuffers(1, &state.thirdVerticesBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, state.thirdVerticesBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, third_vertices.size() * sizeof(GLuint), third_vertices.data(), GL_STATIC_DRAW);
+
+    // Log ratios, see LogRatioLayout. The number of pairs is known at the end, until then the buffer has room
+    // for one per triangle edge.
+    state.log_ratios = LogRatioLayout(nF);
+    glGenBuffers(1, &ratiosSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ratiosSSBO);
+    ratios_bytes_ = (9 * static_cast<size_t>(nF) + 2) * sizeof(GLuint);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, ratios_bytes_, nullptr, GL_STATIC_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 3 * nF * sizeof(GLuint), 2 * sizeof(GLuint), &state.log_ratios.data_[3 * nF]);
+    state.num_uploaded_ratios = state.log_ratios.data_.size();
+
+    state.records = packed_records_.load(std::memory_order_acquire);
+    if (state.records) {
+      glGenBuffers(1, &recordsSSBO);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, recordsSSBO);
+      glBufferData(GL_SHADER_STORAGE_BUFFER, nF * sizeof(BPMRecord), nullptr, GL_STATIC_DRAW);
+    }
+
+    record_max_uv_error_ = 0.0f;
+    record_uv_error_.assign(IsEditable() && state.records ? nF : 0, 0.0f);
+    max_log_ratio_.assign(nF, 0.0f);
+    flat_uv_error_.assign(nF, 0.0f);
+  }
+
+  state.ready_bits.assign((nF + 31) / 32, 0u);
+  if (readySSBO == 0) {
+    glGenBuffers(1, &readySSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, readySSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, state.ready_bits.size() * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, readySSBO);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, state.ready_bits.size() * sizeof(GLuint), state.ready_bits.data());
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  num_ready_faces_.store(0, std::memory_order_release);
+  // the cleared ready bits must reach the GPU before a draw picks the progressive program for this level
+  glFinish();
+  precompute_level_.store(level, std::memory_order_release);
+}
+
+unsigned int Mesh::PrecomputeChunk(unsigned int max_triangles) {
+  // the chunk before is published once the GPU is done with it, waited for only when nothing is left to compute
+  PublishReadyFaces(!precompute_);
+  if (!precompute_) return 0;
+  PrecomputeState& state = *precompute_;
+  unsigned int nF = num_faces_;
+  unsigned int first = state.num_computed_faces;
+  unsigned int end = std::min(nF, first + max_triangles);
+  unsigned int count = end - first;
+  if (count == 0) return 0;
+  bool full = (GetPrecomputeLevel() == BPMData::FULL);
+  bool has_mobius = HasBPMData(BPMData::MOBIUS); // a BPM pass after DIRECT_MOBIUS leaves the drawn buffers as they are
 
   // --- FLATTENED TBO --- //
-  // each vec4 is (vi.x, vi.y, vi_vt.x, vi_vt.y) where vi is after flattening
-  unsigned int numFlatVectors = 6 * nF;
-  GLuint flattenedBO;
-  glGenBuffers(1, &flattenedBO);
-  glBindBuffer(GL_TEXTURE_BUFFER, flattenedBO);
-  glBufferData(GL_TEXTURE_BUFFER, numFlatVectors * sizeof(flattenedType), nullptr, GL_DYNAMIC_DRAW);
-
-  GLuint flattenedTBO;
-  glGenTextures(1, &flattenedTBO);
-  glBindTexture(GL_TEXTURE_BUFFER, flattenedTBO);
-  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, flattenedBO);
-
-  // --- transSSBO --- //
-  glGenBuffers(1, &transSSBO);
-  glBindBuffer(GL_SHADER_STORAGE_BUFFER, transSSBO);
-  glBufferData(GL_SHADER_STORAGE_BUFFER, nF * sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
+  // each vec4 is (vi.x, vi.y, vi_vt.x, vi_vt.y) where vi is after flattening, for the triangles of the chunk
+  unsigned int numFlatVectors = 6 * count;
+  if (state.flattened_capacity < count) {
+    glDeleteTextures(1, &state.flattenedTBO);
+    glDeleteBuffers(1, &state.flattenedBO);
+    glGenBuffers(1, &state.flattenedBO);
+    glBindBuffer(GL_TEXTURE_BUFFER, state.flattenedBO);
+    glBufferData(GL_TEXTURE_BUFFER, numFlatVectors * sizeof(flattenedType), nullptr, GL_DYNAMIC_DRAW);
+    glGenTextures(1, &state.flattenedTBO);
+    glBindTexture(GL_TEXTURE_BUFFER, state.flattenedTBO);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, state.flattenedBO);
+    state.flattened_capacity = count;
+  }
+
+  Shader& neighbors_shader = shader_manager_.GetShader("neighbors", shader_manager_.GetMeshSlotDefines());
+  std::unique_lock<std::mutex> program_lock(shader_manager_.shared_program_mutex_);
+  neighbors_shader.use();
+  // set neighbors shader uniforms
+  neighbors_shader.setUInt("firstTriangle", first);
+  neighbors_shader.setUInt("endTriangle", end);
+  neighbors_shader.setBool("findNeighbors", full);
+  neighbors_shader.setBool("storeTransformations", !has_mobius);
+  neighbors_shader.setUInt("ssbo_idx", ssbo_idx_);
+
+  GLuint trans_port = ssbo_idx_ * shader_manager_.ssbo_per_mesh_ + 0;
   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, trans_port, transSSBO);
+  // not read without findNeighbors, any buffer is bound then
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShaderManager::kComputeTableBinding, full ? state.thirdVerticesBO : state.indicesBO);
 
   //  -- BIND TEXTURES -- //
   glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_BUFFER, indicesTBO);
+  glBindTexture(GL_TEXTURE_BUFFER, state.indicesTBO);
   neighbors_shader.setInt("indicesBuffer", 0);
 
   glActiveTexture(GL_TEXTURE1);
-  glBindTexture(GL_TEXTURE_BUFFER, verticesTBO);
+  glBindTexture(GL_TEXTURE_BUFFER, state.verticesTBO);
   neighbors_shader.setInt("verticesBuffer", 1);
 
   glActiveTexture(GL_TEXTURE2);
-  glBindTexture(GL_TEXTURE_BUFFER, vtTBO);
+  glBindTexture(GL_TEXTURE_BUFFER, state.vtTBO);
   neighbors_shader.setInt("vtBuffer", 2);
 
   // use the flat buffer as image
-  glBindImageTexture(3, flattenedTBO, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+  glBindImageTexture(3, state.flattenedTBO, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
   neighbors_shader.setUInt("flatBuffer", 3);
 
   ////// ------------- DISPATCH COMPUTE ------------- //////
-  glDispatchCompute((nF + 255) / 256, 1, 1);
+  glDispatchCompute((count + 255) / 256, 1, 1);
   glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+  glFlush();
+  program_lock.unlock();
 
   // Unbind the texture
-  glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+  glBindImageTexture(3, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  neighbors_shader.disable();
 
   ////// ------------- READ RESULTS ------------- //////
   // - COMPUTE MOBIUS TRANSFORMS - //
-  std::vector<Mat2c>  mobius_coeffs; mobius_coeffs.reserve(nF); // vector size #faces
-  std::vector<Mat2c> mobius_log_ratios(3*nF, Mat2c(0.0f)); // vector size 3#faces
-  
+  std::vector<Mat2c>  mobius_coeffs; mobius_coeffs.reserve(count); // vector size #faces of the chunk
+  std::vector<GLuint>& log_ratios = state.log_ratios.data_;
+
+  // packed records, see MakeBPMRecord
+  bool make_records = full && state.records;
+  std::vector<BPMRecord> records(make_records ? count : 0);
+  std::vector<glm::mat4> frames(make_records ? count : 0);
+  if (make_records) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, transSSBO);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(glm::mat4), count * sizeof(glm::mat4), frames.data());
+  }
+
   // read the flattened buffer
-  glBindBuffer(GL_TEXTURE_BUFFER, flattenedBO);
+  glBindBuffer(GL_TEXTURE_BUFFER, state.flattenedBO);
   flattenedType* flattenedData = (flattenedType*)glMapBufferRange(GL_TEXTURE_BUFFER, 0, numFlatVectors * sizeof(flattenedType), GL_MAP_READ_BIT);
   // compute mobius coefficients and log ratios
-  for (size_t trigIdx = 0; trigIdx < nF; trigIdx++) 
+  for (size_t trigIdx = first; trigIdx < end; trigIdx++)
   {
-    // compute mobius transforms
-    size_t baseIdx = 6 * trigIdx;    
-    Complex vi    = Complex(flattenedData[baseIdx + 0].x, flattenedData[baseIdx + 0].y);
-    Complex vi_vt = Complex(flattenedData[baseIdx + 0].z, flattenedData[baseIdx + 0].w);
-    Complex vj    = Complex(flattenedData[baseIdx + 1].x, flattenedData[baseIdx + 1].y);
-    Complex vj_vt = Complex(flattenedData[baseIdx + 1].z, flattenedData[baseIdx + 1].w);
-    Complex vk    = Complex(flattenedData[baseIdx + 2].x, flattenedData[baseIdx + 2].y);
-    Complex vk_vt = Complex(flattenedData[baseIdx + 2].z, flattenedData[baseIdx + 2].w);
-    Complex vl    = Complex(flattenedData[baseIdx + 3].x, flattenedData[baseIdx + 3].y);
-    Complex vl_vt = Complex(flattenedData[baseIdx + 3].z, flattenedData[baseIdx + 3].w);
-    Complex vm    = Complex(flattenedData[baseIdx + 4].x, flattenedData[baseIdx + 4].y);
-    Complex vm_vt = Complex(flattenedData[baseIdx + 4].z, flattenedData[baseIdx + 4].w);
-    Complex vn    = Complex(flattenedData[baseIdx + 5].x, flattenedData[baseIdx + 5].y);
-    Complex vn_vt = Complex(flattenedData[baseIdx + 5].z, flattenedData[baseIdx + 5].w);
-    vec3 vi3 (flattenedData[baseIdx + 0]); vec3 vj3 (flattenedData[baseIdx + 1]); vec3 vk3 (flattenedData[baseIdx + 2]);
-    vec3 vl3 (flattenedData[baseIdx + 3]); vec3 vm3 (flattenedData[baseIdx + 4]); vec3 vn3 (flattenedData[baseIdx + 5]);
-
-
-    Mat2c mobius_coeffs_ijk = ComputeMobiusCoefficients({vi, vj, vk}, {vi_vt, vj_vt, vk_vt});
-    mobius_coeffs.emplace_back(mobius_coeffs_ijk); 
-
-    
-    // compute log ratios 
-    float tolerance = 1e-6;
-    if (std::abs(vl - vi) > tolerance) {
-        Matrix2c mobius_coeffs_jil = ComputeMobiusCoefficients_Eigen({vj, vi, vl}, {vj_vt, vi_vt, vl_vt});
-        Mat2c log_jil = mobius_coeffs_ijk.LogRatio(mobius_coeffs_jil);
-        mobius_log_ratios[3*trigIdx + 0] = log_jil;
+    TriangleBPM bpm = ComputeTriangleBPM(&flattenedData[6 * (trigIdx - first)], full);
+    mobius_coeffs.emplace_back(bpm.coeffs);
+    if (!full) continue;
+
+    // - LOG RATIOS - //
+    unsigned int i = indices_[3 * trigIdx], j = indices_[3 * trigIdx + 1], k = indices_[3 * trigIdx + 2];
+    if (bpm.has_neighbor[0]) state.log_ratios.Set(3*trigIdx + 0, i, j, bpm.mu[0]);
+    if (bpm.has_neighbor[1]) state.log_ratios.Set(3*trigIdx + 1, j, k, bpm.mu[1]);
+    if (bpm.has_neighbor[2]) state.log_ratios.Set(3*trigIdx + 2, k, i, bpm.mu[2]);
+
+    // - PACKED RECORD - //
+    if (make_records) {
+      float uv_error = 0.0f;
+      records[trigIdx - first] = MakeBPMRecord(frames[trigIdx - first], bpm, uv_error, state.sum_uv_error);
+      record_max_uv_error_ = std::max(record_max_uv_error_, uv_error);
+      if (!record_uv_error_.empty()) record_uv_error_[trigIdx] = uv_error;
+    }
+
+    // - ADAPTIVE EVALUATION - //
+    // |mu| is the eigenvalue magnitude of the edge's log ratio, independent of the triangle frame
+    max_log_ratio_[trigIdx] = std::max(std::abs(bpm.mu[0]), std::max(std::abs(bpm.mu[1]), std::abs(bpm.mu[2])));
+    flat_uv_error_[trigIdx] = ComputeFlatUVError(bpm);
+  }
+  glUnmapBuffer(GL_TEXTURE_BUFFER);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  // --- UPLOAD THE CHUNK --- //
+  if (!has_mobius) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mobiusSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(Mat2c), count * sizeof(Mat2c), mobius_coeffs.data());
+  }
+  if (make_records) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, recordsSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(BPMRecord), count * sizeof(BPMRecord), records.data());
+  }
+  if (full) {
+    // the edge slots of the chunk and the mu pairs it added, pairs of earlier chunks are already there
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ratiosSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 3 * first * sizeof(GLuint), 3 * count * sizeof(GLuint), &log_ratios[3 * first]);
+    if (log_ratios.size() > state.num_uploaded_ratios) {
+      glBufferSubData(GL_SHADER_STORAGE_BUFFER, state.num_uploaded_ratios * sizeof(GLuint), (log_ratios.size() - state.num_uploaded_ratios) * sizeof(GLuint),
+                      &log_ratios[state.num_uploaded_ratios]);
+      state.num_uploaded_ratios = log_ratios.size();
+    }
+  }
+  for (unsigned int f = first; f < end; f++) {
+    state.ready_bits[f / 32] |= 1u << (f % 32);
+  }
+  size_t first_word = first / 32, end_word = (end + 31) / 32;
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, readySSBO);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, first_word * sizeof(GLuint), (end_word - first_word) * sizeof(GLuint), &state.ready_bits[first_word]);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  state.num_computed_faces = end;
+  if (end == nF) {
+    FinishPrecompute();
+  }
+  // other contexts draw with the chunk once the fence is signaled. A pending fence of the chunk before is
+  // replaced, the new one is signaled after it.
+  if (ready_fence_) glDeleteSync(ready_fence_);
+  ready_fence_ = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  fenced_faces_ = end;
+  glFlush();
+  return count;
+}
+
+void Mesh::PublishReadyFaces(bool wait) {
+  if (!ready_fence_) return;
+  GLenum status;
+  do {
+    status = glClientWaitSync(ready_fence_, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000ull : 0); // ns
+  } while (wait && status == GL_TIMEOUT_EXPIRED);
+  if (status == GL_TIMEOUT_EXPIRED) return;
+  glDeleteSync(ready_fence_);
+  ready_fence_ = nullptr;
+  num_ready_faces_.store(fenced_faces_, std::memory_order_release);
+  if (fenced_faces_ == num_faces_) {
+    bpm_data_.store(GetPrecomputeLevel(), std::memory_order_release);
+  }
+}
+
+void Mesh::FinishPrecompute() {
+  unsigned int nF = num_faces_;
+  if (GetPrecomputeLevel() == BPMData::MOBIUS) {
+    std::cout << "Mobius data: " << (nF * (sizeof(glm::mat4) + sizeof(Mat2c))) / 1024.0f << " KB, log ratios are computed when BPM is used" << std::endl;
+    precompute_.reset();
+    if (!bpm_store_path_.empty()) WriteBPMStore();
+    return;
+  }
+  PrecomputeState& state = *precompute_;
+  const std::vector<GLuint>& log_ratios = state.log_ratios.data_;
+  // --- Write the compacted Mobius Ratios SSBO --- //
+  glGenBuffers(1, &final_ratiosSSBO_);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, final_ratiosSSBO_);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, log_ratios.size() * sizeof(GLuint), log_ratios.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  ratios_bytes_ = log_ratios.size() * sizeof(GLuint);
+  split_bytes_per_triangle_ = sizeof(glm::mat4) + sizeof(Mat2c) + static_cast<float>(log_ratios.size() * sizeof(GLuint)) / nF;
+  packed_bytes_per_triangle_ = static_cast<float>(sizeof(BPMRecord));
+
+  size_t num_entries = (log_ratios.size() - 3 * nF) / 2 - 1;
+  std::cout << "Log ratios: " << num_entries << " edge entries (" << state.log_ratios.num_shared_ << " shared), "
+            << (3 * nF * sizeof(Mat2c)) / 1024.0f << " KB -> " << (log_ratios.size() * sizeof(GLuint)) / 1024.0f << " KB" << std::endl;
+  if (state.records) {
+    GLint texture_width = 0;
+    glGetTextureLevelParameteriv(texture_id_, 0, GL_TEXTURE_WIDTH, &texture_width);
+    std::cout << "BPM records: " << split_bytes_per_triangle_ << " B/triangle in 3 buffers -> " << packed_bytes_per_triangle_
+              << " B/triangle packed, fp16 log ratio UV error max " << record_max_uv_error_ << " (" << record_max_uv_error_ * texture_width
+              << " texels), mean " << state.sum_uv_error / (4.0 * nF) << std::endl;
+  }
+
+  // Cleanup, the layout stays for UpdateVertices if the mesh is editable
+  log_ratios_ = std::move(state.log_ratios.data_);
+  free_ratio_pairs_.clear();
+  precompute_.reset();
+  if (!bpm_store_path_.empty()) WriteBPMStore();
+  if (!IsEditable()) std::vector<GLuint>().swap(log_ratios_);
+}
+
+// ---------------------- RESIDENCY ---------------------- //
+// copy of a buffer's contents on the CPU
+static std::vector<char> ReadBuffer(GLuint buffer, size_t size) {
+  std::vector<char> data(size);
+  glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+  glGetBufferSubData(GL_COPY_READ_BUFFER, 0, size, data.data());
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  return data;
+}
+
+static GLuint UploadBuffer(const std::vector<char>& data) {
+  GLuint buffer = 0;
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, data.size(), data.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  return buffer;
+}
+
+size_t Mesh::GetBPMDataBytes() const {
+  size_t nF = num_faces_;
+  size_t bit_bytes = (nF + 31) / 32 * sizeof(GLuint);
+  size_t bytes = 0;
+  if (transSSBO != 0) bytes += nF * (sizeof(glm::mat4) + sizeof(Mat2c));
+  if (ratiosSSBO != 0) bytes += ratios_bytes_;
+  if (recordsSSBO != 0) bytes += nF * sizeof(BPMRecord);
+  if (flatSSBO != 0) bytes += bit_bytes;
+  if (readySSBO != 0) bytes += bit_bytes;
+  if (deform_) { // the second set and the adjacency
+    bytes += nF * (sizeof(glm::mat4) + sizeof(Mat2c) + sizeof(BPMRecord)) + ratios_bytes_ + bit_bytes;
+    bytes += vertices_.size() * sizeof(Vertex) + 3 * nF * sizeof(GLuint);
+    if (deform_->restVBO != 0) bytes += vertices_.size() * sizeof(Vertex);
+  }
+  return bytes;
+}
+
+size_t Mesh::GetGeometryBytes() const {
+  if (VBO == 0) return 0;
+  size_t bytes = vertices_.size() * sizeof(Vertex) + indices_.size() * sizeof(unsigned int);
+  if (normalLinesVBO != 0) bytes += 2 * (num_faces_ + vertices_.size()) * 2 * sizeof(glm::vec4);
+  return bytes;
+}
+
+size_t Mesh::EvictBPMData() {
+  if (IsPrecomputing() || deform_ || GetBPMData() == BPMData::NONE) return 0;
+  size_t bytes = GetBPMDataBytes();
+  if (final_ratiosSSBO_ != 0) { // not swapped in yet
+    glDeleteBuffers(1, &ratiosSSBO);
+    ratiosSSBO = final_ratiosSSBO_;
+    final_ratiosSSBO_ = 0;
+  }
+  // no read back, which would stall on the GPU: the level is read again from the store, or else computed again
+  if (bpm_store_level_ >= GetBPMData()) {
+    evicted_ = std::make_unique<EvictedBPMData>();
+    evicted_->level = GetBPMData();
+  }
+  std::vector<GLuint>().swap(log_ratios_);
+  std::vector<GLuint>().swap(free_ratio_pairs_);
+  std::vector<float>().swap(record_uv_error_);
+  std::vector<float>().swap(max_log_ratio_);
+  std::vector<float>().swap(flat_uv_error_);
+  // the flat flags are classified again from max_log_ratio_, the ready flags are made by the next precompute
+  for (GLuint* buffer : {&transSSBO, &mobiusSSBO, &ratiosSSBO, &recordsSSBO, &flatSSBO, &readySSBO}) {
+    glDeleteBuffers(1, buffer);
+    *buffer = 0;
+  }
+  classified_tolerance_ = -1.0f;
+  bpm_data_.store(BPMData::NONE, std::memory_order_release);
+  precompute_level_.store(BPMData::NONE, std::memory_order_release);
+  return bytes;
+}
+
+bool Mesh::RestoreBPMData() {
+  if (!ReadBPMStore(*evicted_)) {
+    evicted_.reset();
+    bpm_store_level_ = BPMData::NONE; // written again by the precompute
+    return false;
+  }
+  transSSBO = UploadBuffer(evicted_->trans);
+  mobiusSSBO = UploadBuffer(evicted_->mobius);
+  if (evicted_->level == BPMData::FULL) {
+    ratiosSSBO = UploadBuffer(evicted_->ratios);
+    if (packed_records_.load(std::memory_order_acquire) && !evicted_->records.empty()) recordsSSBO = UploadBuffer(evicted_->records);
+  }
+  BPMData level = evicted_->level;
+  evicted_.reset();
+  if (level == BPMData::FULL && packed_records_.load(std::memory_order_acquire) && recordsSSBO == 0) BuildRecords();
+  // other contexts draw with the buffers as soon as the level is published
+  glFinish();
+  precompute_level_.store(level, std::memory_order_release);
+  bpm_data_.store(level, std::memory_order_release);
+  return true;
+}
+
+size_t Mesh::EvictGeometry() {
+  if (deform_) return 0;
+  size_t bytes = GetGeometryBytes();
+  glDeleteVertexArrays(1, &VAO);
+  glDeleteVertexArrays(1, &normalLinesVAO);
+  for (GLuint* buffer : {&VBO, &EBO, &normalLinesVBO}) {
+    glDeleteBuffers(1, buffer);
+    *buffer = 0;
+  }
+  VAO = 0;
+  normalLinesVAO = 0;
+  return bytes;
+}
+
+void Mesh::ReleaseMeshData() {
+  if (VBO != 0 || deform_ || IsPrecomputing()) return;
+  std::vector<Vertex>().swap(vertices_);
+  std::vector<unsigned int>().swap(indices_);
+  std::vector<glm::vec3>().swap(face_normals_);
+  std::vector<unsigned int>().swap(vertex_face_offsets_);
+  std::vector<unsigned int>().swap(vertex_faces_);
+  std::vector<unsigned int>().swap(source_copy_offsets_);
+  std::vector<unsigned int>().swap(source_copies_);
+}
+
+void Mesh::OpenBPMStore(const std::string& path, size_t key) {
+  bpm_store_path_ = path;
+  bpm_store_key_ = key;
+  bpm_store_level_ = BPMData::NONE;
+  BPMStoreData header;
+  if (!ReadBPMStoreFile(path, key, num_faces_, header, true) || evicted_ || GetBPMData() != BPMData::NONE) return;
+  bpm_store_level_ = header.level;
+  if (bpm_store_level_ == BPMData::NONE) return;
+  evicted_ = std::make_unique<EvictedBPMData>();
+  evicted_->level = bpm_store_level_;
+}
+
+void Mesh::WriteBPMStore() {
+  size_t nF = num_faces_;
+  BPMStoreData data;
+  data.level = GetPrecomputeLevel();
+  data.key = bpm_store_key_;
+  data.num_faces = num_faces_;
+  data.record_max_uv_error = record_max_uv_error_;
+  data.trans = ReadBuffer(transSSBO, nF * sizeof(glm::mat4));
+  data.mobius = ReadBuffer(mobiusSSBO, nF * sizeof(Mat2c));
+  if (data.level == BPMData::FULL) {
+    if (recordsSSBO != 0) data.records = ReadBuffer(recordsSSBO, nF * sizeof(BPMRecord)); // else built from the rest on load
+    data.log_ratios = log_ratios_;
+    data.max_log_ratio = max_log_ratio_;
+    data.flat_uv_error = flat_uv_error_;
+  }
+  if (WriteBPMStoreFile(bpm_store_path_, data)) bpm_store_level_ = data.level;
+}
+
+bool Mesh::ReadBPMStore(EvictedBPMData& evicted) {
+  BPMStoreData data;
+  if (!ReadBPMStoreFile(bpm_store_path_, bpm_store_key_, num_faces_, data) || data.level < evicted.level) {
+    std::cerr << "ERROR::MESH::BPM_STORE::READ_FAILED: " << bpm_store_path_ << std::endl;
+    return false;
+  }
+  evicted.trans = std::move(data.trans);
+  evicted.mobius = std::move(data.mobius);
+  if (evicted.level == BPMData::FULL) {
+    ratios_bytes_ = data.log_ratios.size() * sizeof(GLuint);
+    evicted.ratios.resize(ratios_bytes_);
+    std::memcpy(evicted.ratios.data(), data.log_ratios.data(), ratios_bytes_);
+    evicted.records = std::move(data.records);
+    if (IsEditable()) {
+      log_ratios_ = std::move(data.log_ratios);
+      free_ratio_pairs_.clear();
+      evicted.records.clear(); // built again, with the record errors per triangle
     }
-    
-    if (std::abs(vm - vi) > tolerance) {        
-        Matrix2c mobius_coeffs_kjm = ComputeMobiusCoefficients_Eigen({vk, vj, vm}, {vk_vt, vj_vt, vm_vt});
-        Mat2c log_kjm = mobius_coeffs_ijk.LogRatio(mobius_coeffs_kjm);
-        mobius_log_ratios[3*trigIdx + 1] = log_kjm;
+    max_log_ratio_ = std::move(data.max_log_ratio);
+    flat_uv_error_ = std::move(data.flat_uv_error);
+    record_max_uv_error_ = data.record_max_uv_error;
+    split_bytes_per_triangle_ = sizeof(glm::mat4) + sizeof(Mat2c) + static_cast<float>(ratios_bytes_) / std::max(num_faces_, 1u);
+    packed_bytes_per_triangle_ = static_cast<float>(sizeof(BPMRecord));
+  } else {
+    evicted.records.clear();
+  }
+  return true;
+}
+
+// ---------------------- INCREMENTAL UPDATES ---------------------- //
+// calls upload(first id, position of first in ids, count) for every run of consecutive ids, ids are sorted
+template <typename Upload>
+static void ForEachRun(const std::vector<unsigned int>& ids, Upload upload) {
+  size_t begin = 0;
+  for (size_t i = 1; i <= ids.size(); i++) {
+    if (i < ids.size() && ids[i] == ids[i - 1] + 1) continue;
+    upload(ids[begin], begin, i - begin);
+    begin = i;
+  }
+}
+
+bool Mesh::IsEditable() const {
+  return parent_asset_ != nullptr && parent_asset_->load_options_.incremental_edits;
+}
+
+void Mesh::BuildVertexFaces() {
+  vertex_face_offsets_.assign(vertices_.size() + 1, 0u);
+  for (unsigned int v : indices_) vertex_face_offsets_[v + 1]++;
+  for (size_t v = 0; v < vertices_.size(); v++) vertex_face_offsets_[v + 1] += vertex_face_offsets_[v];
+  vertex_faces_.resize(indices_.size());
+  std::vector<unsigned int> fill(vertex_face_offsets_.begin(), vertex_face_offsets_.end() - 1);
+  for (unsigned int f = 0; f < num_faces_; f++) {
+    for (int k = 0; k < 3; k++) {
+      vertex_faces_[fill[indices_[3 * f + k]]++] = f;
     }
-    if (std::abs(vn - vi) > tolerance) {
-        Matrix2c mobius_coeffs_ikn = ComputeMobiusCoefficients_Eigen({vi, vk, vn}, {vi_vt, vk_vt, vn_vt});
-        Mat2c log_ikn = mobius_coeffs_ijk.LogRatio(mobius_coeffs_ikn);
-        mobius_log_ratios[3*trigIdx + 2] = log_ikn;
+  }
+}
+
+// source_vertices_ inverted, in vertex order per OBJ vertex. Without a reorder each vertex is its own.
+void Mesh::BuildSourceCopies() {
+  auto source_of = [this](size_t v) { return source_vertices_.empty() ? static_cast<unsigned int>(v) : source_vertices_[v]; };
+  unsigned int num_sources = 0;
+  for (size_t v = 0; v < vertices_.size(); v++) num_sources = std::max(num_sources, source_of(v) + 1);
+  source_copy_offsets_.assign(static_cast<size_t>(num_sources) + 1, 0u);
+  for (size_t v = 0; v < vertices_.size(); v++) source_copy_offsets_[source_of(v) + 1]++;
+  for (unsigned int s = 0; s < num_sources; s++) source_copy_offsets_[s + 1] += source_copy_offsets_[s];
+  source_copies_.resize(vertices_.size());
+  std::vector<unsigned int> fill(source_copy_offsets_.begin(), source_copy_offsets_.end() - 1);
+  for (size_t v = 0; v < vertices_.size(); v++) source_copies_[fill[source_of(v)]++] = static_cast<unsigned int>(v);
+}
+
+// Neighbor table of the neighbors and deform_bpm passes. The vertex -> triangles table is only needed here,
+// unless UpdateVertices built it before.
+std::vector<GLuint> Mesh::ComputeThirdVertices() {
+  bool had_vertex_faces = !vertex_face_offsets_.empty();
+  if (!had_vertex_faces) BuildVertexFaces();
+  std::vector<GLuint> third_vertices(3 * static_cast<size_t>(num_faces_), ~0u);
+  for (unsigned int f = 0; f < num_faces_; f++) {
+    for (int e = 0; e < 3; e++) {
+      int other = GetEdgeNeighbor(f, e);
+      if (other >= 0) third_vertices[3 * f + e] = ThirdVertex(&indices_[3 * other], indices_[3 * f + e], indices_[3 * f + (e + 1) % 3]);
     }
-    volatile int dummy = 0;
   }
-  glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
-  glUnmapBuffer(GL_TEXTURE_BUFFER);
+  if (!had_vertex_faces) {
+    std::vector<unsigned int>().swap(vertex_face_offsets_);
+    std::vector<unsigned int>().swap(vertex_faces_);
+  }
+  return third_vertices;
+}
 
-  // --- Write Mobius Coeffs SSBO --- //
-  glGenBuffers(1, &mobiusSSBO);
+// the first other triangle with both vertices of the edge (ij, jk, ki), -1 on the boundary
+int Mesh::GetEdgeNeighbor(unsigned int face, int edge) const {
+  unsigned int a = indices_[3 * face + edge], b = indices_[3 * face + (edge + 1) % 3];
+  for (unsigned int i = vertex_face_offsets_[a]; i < vertex_face_offsets_[a + 1]; i++) {
+    unsigned int other = vertex_faces_[i];
+    if (other == face) continue;
+    const unsigned int* o = &indices_[3 * other];
+    if (o[0] == b || o[1] == b || o[2] == b) return static_cast<int>(other);
+  }
+  return -1;
+}
+
+bool Mesh::UpdateVertices(const std::vector<unsigned int>& vertex_ids, const std::vector<glm::vec3>& positions,
+                          const std::vector<glm::vec2>& tex_coords) {
+  bool update_positions = !positions.empty(), update_tex_coords = !tex_coords.empty();
+  if ((update_positions && positions.size() != vertex_ids.size()) || (update_tex_coords && tex_coords.size() != vertex_ids.size())) {
+    std::cerr << "ERROR::MESH::UPDATE_VERTICES::SIZE_MISMATCH: " << parent_asset_->model_name_ << std::endl;
+    return false;
+  }
+  if (source_copy_offsets_.empty()) BuildSourceCopies();
+  for (unsigned int v : vertex_ids) {
+    if (v + 1 >= source_copy_offsets_.size()) {
+      std::cerr << "ERROR::MESH::UPDATE_VERTICES::INVALID_VERTEX: " << v << " of " << parent_asset_->model_name_ << std::endl;
+      return false;
+    }
+  }
+  if (IsPrecomputing() || deform_) {
+    std::cerr << (deform_ ? "ERROR::MESH::UPDATE_VERTICES::DEFORMING: " : "ERROR::MESH::UPDATE_VERTICES::PRECOMPUTING: ")
+              << parent_asset_->model_name_ << std::endl;
+    return false;
+  }
+  if (!IsEditable()) {
+    std::cerr << "ERROR::MESH::UPDATE_VERTICES::NOT_EDITABLE: " << parent_asset_->model_name_ << ", load it with incremental edits" << std::endl;
+    return false;
+  }
+
+  // --- VERTICES --- //
+  std::vector<unsigned int> changed;
+  for (size_t i = 0; i < vertex_ids.size(); i++) {
+    for (unsigned int c = source_copy_offsets_[vertex_ids[i]]; c < source_copy_offsets_[vertex_ids[i] + 1]; c++) {
+      Vertex& vertex = vertices_[source_copies_[c]];
+      if (update_positions) vertex.position_ = positions[i];
+      if (update_tex_coords) vertex.tex_coords_ = tex_coords[i];
+      changed.push_back(source_copies_[c]);
+    }
+  }
+  std::sort(changed.begin(), changed.end());
+  changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+  if (VBO != 0) { // evicted geometry is uploaded from vertices_ when it is restored
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    ForEachRun(changed, [this](unsigned int first, size_t, size_t count) {
+      glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(Vertex), count * sizeof(Vertex), &vertices_[first]);
+    });
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  // --- AFFECTED TRIANGLES --- //
+  if (vertex_face_offsets_.empty()) BuildVertexFaces();
+  std::vector<unsigned int> faces;
+  for (unsigned int v : changed) {
+    faces.insert(faces.end(), vertex_faces_.begin() + vertex_face_offsets_[v], vertex_faces_.begin() + vertex_face_offsets_[v + 1]);
+  }
+  std::sort(faces.begin(), faces.end());
+  faces.erase(std::unique(faces.begin(), faces.end()), faces.end());
+
+  if (update_positions) {
+    std::vector<size_t> changed_meshlets;
+    for (unsigned int f : faces) {
+      face_normals_[f] = geometry::ComputeFaceNormal(vertices_[indices_[3 * f]].position_, vertices_[indices_[3 * f + 1]].position_,
+                                                     vertices_[indices_[3 * f + 2]].position_);
+      auto meshlet = std::upper_bound(meshlets_.begin(), meshlets_.end(), f,
+                                      [](unsigned int face, const mesh_optimizer::Meshlet& m) { return face < m.first_triangle; });
+      if (meshlet != meshlets_.begin()) changed_meshlets.push_back(static_cast<size_t>(meshlet - meshlets_.begin()) - 1);
+    }
+    changed_meshlets.erase(std::unique(changed_meshlets.begin(), changed_meshlets.end()), changed_meshlets.end());
+    for (size_t m : changed_meshlets) {
+      mesh_optimizer::ComputeMeshletBounds(meshlets_[m], [this](unsigned int v) { return vertices_[v].position_; }, indices_, face_normals_);
+    }
+    // built again on the next draw that shows them
+    glDeleteVertexArrays(1, &normalLinesVAO);
+    glDeleteBuffers(1, &normalLinesVBO);
+    normalLinesVAO = 0;
+    normalLinesVBO = 0;
+  }
+
+  // --- BPM DATA --- //
+  evicted_.reset(); // stale, the next request computes it again
+  if (bpm_store_level_ != BPMData::NONE) { // as is the store
+    bpm_store_level_ = BPMData::NONE;
+    std::remove(bpm_store_path_.c_str());
+  }
+  BPMData level = GetBPMData();
+  if (level == BPMData::NONE || faces.empty()) return true;
+  bool full = (level == BPMData::FULL);
+  if (final_ratiosSSBO_ != 0) {
+    glDeleteBuffers(1, &ratiosSSBO);
+    ratiosSSBO = final_ratiosSSBO_;
+    final_ratiosSSBO_ = 0;
+  }
+  // a log ratio depends on the triangles on both sides of its edge
+  std::vector<unsigned int> recomputed(faces);
+  if (full) {
+    for (unsigned int f : faces) {
+      for (int e = 0; e < 3; e++) {
+        int other = GetEdgeNeighbor(f, e);
+        if (other >= 0) recomputed.push_back(static_cast<unsigned int>(other));
+      }
+    }
+    std::sort(recomputed.begin(), recomputed.end());
+    recomputed.erase(std::unique(recomputed.begin(), recomputed.end()), recomputed.end());
+  }
+  std::vector<int> neighbors(3 * recomputed.size(), -1);
+  if (full) {
+    for (size_t r = 0; r < recomputed.size(); r++) {
+      for (int e = 0; e < 3; e++) neighbors[3 * r + e] = GetEdgeNeighbor(recomputed[r], e);
+    }
+  }
+  std::vector<glm::mat4> frames;
+  std::vector<TriangleBPM> bpms;
+  RecomputeTriangles(vertices_.data(), indices_.data(), recomputed, neighbors, full, frames, bpms);
+  std::vector<Mat2c> mobius_coeffs(recomputed.size());
+  for (size_t r = 0; r < recomputed.size(); r++) mobius_coeffs[r] = bpms[r].coeffs;
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, transSSBO);
+  ForEachRun(recomputed, [&frames](unsigned int first, size_t r, size_t count) {
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(glm::mat4), count * sizeof(glm::mat4), &frames[r]);
+  });
   glBindBuffer(GL_SHADER_STORAGE_BUFFER, mobiusSSBO);
-  glBufferData(GL_SHADER_STORAGE_BUFFER, mobius_coeffs.size() * sizeof(Mat2c),
-               mobius_coeffs.data(), GL_STATIC_DRAW);
-  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, mobius_port, mobiusSSBO);
+  ForEachRun(recomputed, [&mobius_coeffs](unsigned int first, size_t r, size_t count) {
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(Mat2c), count * sizeof(Mat2c), &mobius_coeffs[r]);
+  });
+  if (!full) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return true;
+  }
 
-  // --- Write Mobius Ratios SSBO --- //
-  glGenBuffers(1, &ratiosSSBO);
+  // - LOG RATIOS - //
+  // pairs of the edge, or freed by other edits, are reused: the layout grows only when both are used up
+  std::vector<GLuint> changed_ratios; // uints of the layout, with the pairs appended
+  UpdateEdgeLogRatios(log_ratios_, free_ratio_pairs_, num_faces_, faces, recomputed, neighbors, bpms, changed_ratios);
   glBindBuffer(GL_SHADER_STORAGE_BUFFER, ratiosSSBO);
-  glBufferData(GL_SHADER_STORAGE_BUFFER, mobius_log_ratios.size() * sizeof(Mat2c), mobius_log_ratios.data(), GL_DYNAMIC_DRAW);
-  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ratios_port, ratiosSSBO);
+  if (log_ratios_.size() * sizeof(GLuint) > ratios_bytes_) { // past the buffer, the next one has room for more pairs
+    ratios_bytes_ = (log_ratios_.size() + log_ratios_.size() / 16) * sizeof(GLuint);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, ratios_bytes_, nullptr, GL_STATIC_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, log_ratios_.size() * sizeof(GLuint), log_ratios_.data());
+  } else {
+    ForEachRun(changed_ratios, [this](unsigned int first, size_t, size_t count) {
+      glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(GLuint), count * sizeof(GLuint), &log_ratios_[first]);
+    });
+  }
 
-  // Cleanup
-  glDeleteBuffers(1, &indicesBO);
-  glDeleteBuffers(1, &indicesTBO);
-  glDeleteBuffers(1, &verticesBO);
-  glDeleteBuffers(1, &verticesTBO);
-  glDeleteBuffers(1, &vtBO);
-  glDeleteBuffers(1, &vtTBO);
-  glDeleteBuffers(1, &flattenedBO);
-  glDeleteBuffers(1, &flattenedTBO);
-  glBindTexture(GL_TEXTURE_BUFFER, 0);
-  neighbors_shader.disable();
-  glUnmapBuffer(GL_SHADER_STORAGE_BUFFER); glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  // - PACKED RECORDS AND ADAPTIVE EVALUATION - //
+  // the largest record error may have been one of the recomputed triangles, then the others are searched again
+  std::vector<BPMRecord> records(recomputed.size());
+  double sum_uv_error = 0.0;
+  bool replaced_max_uv_error = false;
+  for (size_t r = 0; r < recomputed.size(); r++) {
+    unsigned int f = recomputed[r];
+    const TriangleBPM& bpm = bpms[r];
+    if (recordsSSBO != 0) {
+      float uv_error = 0.0f;
+      records[r] = MakeBPMRecord(frames[r], bpm, uv_error, sum_uv_error);
+      replaced_max_uv_error = replaced_max_uv_error || record_uv_error_[f] >= record_max_uv_error_;
+      record_uv_error_[f] = uv_error;
+      record_max_uv_error_ = std::max(record_max_uv_error_, uv_error);
+    }
+    max_log_ratio_[f] = std::max(std::abs(bpm.mu[0]), std::max(std::abs(bpm.mu[1]), std::abs(bpm.mu[2])));
+    flat_uv_error_[f] = ComputeFlatUVError(bpm);
+  }
+  if (recordsSSBO != 0) {
+    if (replaced_max_uv_error) record_max_uv_error_ = *std::max_element(record_uv_error_.begin(), record_uv_error_.end());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, recordsSSBO);
+    ForEachRun(recomputed, [&records](unsigned int first, size_t r, size_t count) {
+      glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(BPMRecord), count * sizeof(BPMRecord), &records[r]);
+    });
+  }
+  if (flatSSBO != 0 && classified_tolerance_ >= 0.0f) {
+    // flat_max_uv_error_ stays an upper bound until the next ClassifyTriangles
+    std::vector<unsigned int> changed_words;
+    for (unsigned int f : recomputed) {
+      bool flat = max_log_ratio_[f] < classified_tolerance_;
+      GLuint bit = 1u << (f % 32);
+      if (flat) flat_max_uv_error_ = std::max(flat_max_uv_error_, flat_uv_error_[f]);
+      if (flat == ((flat_bits_[f / 32] & bit) != 0)) continue;
+      flat_bits_[f / 32] ^= bit;
+      num_flat_faces_ = flat ? num_flat_faces_ + 1 : num_flat_faces_ - 1;
+      changed_words.push_back(f / 32);
+    }
+    changed_words.erase(std::unique(changed_words.begin(), changed_words.end()), changed_words.end());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, flatSSBO);
+    ForEachRun(changed_words, [this](unsigned int first, size_t, size_t count) {
+      glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(GLuint), count * sizeof(GLuint), &flat_bits_[first]);
+    });
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  return true;
+}
+
+// ---------------------- DEFORMATION ---------------------- //
+std::unique_ptr<Mesh::DeformState> Mesh::MakeDeformState() {
+  auto state = std::make_unique<DeformState>();
+  std::vector<GLuint> third_vertices = ComputeThirdVertices();
+  glGenBuffers(1, &state->adjacencyBO);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, state->adjacencyBO);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, third_vertices.size() * sizeof(GLuint), third_vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  // the slots depend on the topology only, the pass writes the pairs
+  std::vector<GLuint> slots(3 * static_cast<size_t>(num_faces_) + 2, 0u);
+  GLuint zero_offset = 3 * num_faces_;
+  for (GLuint slot = 0; slot < zero_offset; slot++) {
+    slots[slot] = (third_vertices[slot] == ~0u ? zero_offset : zero_offset + 2 + 2 * slot) << 1;
+  }
+
+  // the positions of every frame are written to the same storage, see UpdateDeformation
+  glGenBuffers(1, &state->back.VBO);
+  glBindBuffer(GL_ARRAY_BUFFER, state->back.VBO);
+  glBufferStorage(GL_ARRAY_BUFFER, vertices_.size() * sizeof(Vertex), vertices_.data(), GL_DYNAMIC_STORAGE_BIT);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  AllocateDeformBuffers(state->back);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, state->back.ratios);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, slots.size() * sizeof(GLuint), slots.data());
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  state->vertices = vertices_;
+  return state;
+}
+
+// BPM buffers of the deform_bpm pass. The log ratios have a pair per triangle edge, the two sides of an edge
+// are not matched up as in BeginPrecompute: [0, 3nF) slots, [3nF, 3nF + 2) zero pair, 3nF + 2 + 2 * slot pairs.
+// The slots and the zero pair are written once, by MakeDeformState. The flat flags are followed by the number
+// of flagged triangles.
+void Mesh::AllocateDeformBuffers(DeformBuffers& buffers) const {
+  size_t nF = num_faces_;
+  auto allocate = [](GLuint& buffer, size_t size, const void* data) {
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, GL_DYNAMIC_DRAW);
+  };
+  allocate(buffers.trans, nF * sizeof(glm::mat4), nullptr);
+  allocate(buffers.mobius, nF * sizeof(Mat2c), nullptr);
+  allocate(buffers.records, nF * sizeof(BPMRecord), nullptr);
+  allocate(buffers.ratios, (9 * nF + 2) * sizeof(GLuint), nullptr);
+  std::vector<GLuint> flat_bits((nF + 31) / 32 + 1, 0u);
+  allocate(buffers.flat, flat_bits.size() * sizeof(GLuint), flat_bits.data());
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void Mesh::DispatchDeformation(const DeformBuffers& buffers, GLuint adjacency) {
+  const GLuint zero = 0u;
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers.flat);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, (num_faces_ + 31) / 32 * sizeof(GLuint), sizeof(GLuint), &zero);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  Shader& deform_shader = shader_manager_.GetShader("deform_bpm");
+  deform_shader.use();
+  deform_shader.setUInt("numTriangles", num_faces_);
+  deform_shader.setFloat("flatTolerance", classified_tolerance_);
+  // mesh slot 0 and the shared bindings, every draw binds its own buffers again
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers.trans);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffers.mobius);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, buffers.ratios);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShaderManager::kRecordsBinding, buffers.records);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShaderManager::kResolveVerticesBinding, buffers.VBO);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShaderManager::kResolveIndicesBinding, EBO);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShaderManager::kFlatTrianglesBinding, buffers.flat);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShaderManager::kComputeTableBinding, adjacency);
+  glDispatchCompute((num_faces_ + 255) / 256, 1, 1);
+  deform_shader.disable();
+}
+
+bool Mesh::BeginDeformation() {
+  if (deform_) return true;
+  if (IsPrecomputing() || VBO == 0 || num_faces_ == 0) {
+    std::cerr << (IsPrecomputing() ? "ERROR::MESH::BEGIN_DEFORMATION::PRECOMPUTING: " : "ERROR::MESH::BEGIN_DEFORMATION::NO_GEOMETRY: ")
+              << parent_asset_->model_name_ << std::endl;
+    return false;
+  }
+  // the BPM data of the rest positions goes, the pass has a layout of its own
+  evicted_.reset();
+  for (GLuint* buffer : {&transSSBO, &mobiusSSBO, &ratiosSSBO, &recordsSSBO, &flatSSBO, &readySSBO, &final_ratiosSSBO_}) {
+    glDeleteBuffers(1, buffer);
+    *buffer = 0;
+  }
+  log_ratios_.clear();
+  free_ratio_pairs_.clear();
+  record_uv_error_.clear();
+  flat_bits_.clear();
+  num_flat_faces_ = 0;
+
+  deform_ = MakeDeformState();
+  DeformBuffers front;
+  AllocateDeformBuffers(front);
+  glBindBuffer(GL_COPY_READ_BUFFER, deform_->back.ratios);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, front.ratios);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (3 * static_cast<GLsizeiptr>(num_faces_) + 2) * sizeof(GLuint));
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  front.VBO = VBO;
+  transSSBO = front.trans;
+  mobiusSSBO = front.mobius;
+  ratiosSSBO = front.ratios;
+  recordsSSBO = front.records;
+  flatSSBO = front.flat;
+  ratios_bytes_ = (9 * static_cast<size_t>(num_faces_) + 2) * sizeof(GLuint);
+  DispatchDeformation(front, deform_->adjacencyBO);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+  precompute_level_.store(BPMData::FULL, std::memory_order_release);
+  bpm_data_.store(BPMData::FULL, std::memory_order_release);
+  std::cout << "Deforming " << parent_asset_->model_name_ << ": BPM data of " << num_faces_ << " triangles recomputed on the GPU, "
+            << GetBPMDataBytes() / 1024.0f << " KB in two sets" << std::endl;
+  return true;
+}
+
+void Mesh::EndDeformation() {
+  if (!deform_) return;
+  deform_.reset(); // GL keeps the storage until the pass in flight is done
+  // the drawn VBO may be the immutable one of MakeDeformState, it gets the rest positions back in place
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, vertices_.size() * sizeof(Vertex), vertices_.data());
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  for (GLuint* buffer : {&transSSBO, &mobiusSSBO, &ratiosSSBO, &recordsSSBO, &flatSSBO}) {
+    glDeleteBuffers(1, buffer);
+    *buffer = 0;
+  }
+  ratios_bytes_ = 0;
+  glDeleteVertexArrays(1, &normalLinesVAO);
+  glDeleteBuffers(1, &normalLinesVBO);
+  normalLinesVAO = 0;
+  normalLinesVBO = 0;
+  classified_tolerance_ = -1.0f;
+  precompute_level_.store(BPMData::NONE, std::memory_order_release);
+  bpm_data_.store(BPMData::NONE, std::memory_order_release);
+}
+
+void Mesh::SetDeformedPositions(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals) {
+  if (!deform_) return;
+  if (positions.size() != vertices_.size() || (!normals.empty() && normals.size() != vertices_.size())) {
+    std::cerr << "ERROR::MESH::SET_DEFORMED_POSITIONS::SIZE_MISMATCH: " << positions.size() << " positions and " << normals.size()
+              << " normals for " << vertices_.size() << " vertices of " << parent_asset_->model_name_ << std::endl;
+    return;
+  }
+  for (size_t v = 0; v < positions.size(); v++) {
+    deform_->vertices[v].position_ = positions[v];
+  }
+  for (size_t v = 0; v < normals.size(); v++) {
+    deform_->vertices[v].normal_ = normals[v];
+  }
+  deform_->twist = false;
+  deform_->has_new_positions = true;
+}
+
+void Mesh::SetDeformTwist(float angle, const glm::vec3& center, float height) {
+  if (!deform_) return;
+  DeformState& state = *deform_;
+  if (state.restVBO == 0) {
+    glGenBuffers(1, &state.restVBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, state.restVBO);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, vertices_.size() * sizeof(Vertex), vertices_.data(), 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  }
+  state.twist = true;
+  state.twist_angle = angle;
+  state.twist_center = center;
+  state.twist_height = std::max(height, 1e-6f);
+  state.has_new_positions = true;
+}
+
+bool Mesh::UpdateDeformation() {
+  if (!deform_) return false;
+  DeformState& state = *deform_;
+  bool swapped = false;
+  if (state.fence != nullptr) {
+    // the drawn set stays until the pass is done, the latest positions wait for the next one
+    if (glClientWaitSync(state.fence, 0, 0) == GL_TIMEOUT_EXPIRED) return false;
+    glDeleteSync(state.fence);
+    state.fence = nullptr;
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    // the pass is done, so the count of the flags it set is there without a wait
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, state.back.flat);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, (num_faces_ + 31) / 32 * sizeof(GLuint), sizeof(GLuint), &num_flat_faces_);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    std::swap(VAO, state.back.VAO);
+    std::swap(VBO, state.back.VBO);
+    std::swap(transSSBO, state.back.trans);
+    std::swap(mobiusSSBO, state.back.mobius);
+    std::swap(ratiosSSBO, state.back.ratios);
+    std::swap(recordsSSBO, state.back.records);
+    std::swap(flatSSBO, state.back.flat);
+    // built again from the new positions when they are drawn
+    glDeleteVertexArrays(1, &normalLinesVAO);
+    glDeleteBuffers(1, &normalLinesVBO);
+    normalLinesVAO = 0;
+    normalLinesVBO = 0;
+    swapped = true;
+  }
+  if (state.has_new_positions) {
+    // the back set was drawn before the last swap, GL orders the writes after those frames
+    if (state.twist) {
+      Shader& twist_shader = shader_manager_.GetShader("deform_twist");
+      twist_shader.use();
+      twist_shader.setUInt("num_vertices", static_cast<unsigned int>(vertices_.size()));
+      twist_shader.setVec3("twist_center", state.twist_center);
+      twist_shader.setFloat("twist_angle", state.twist_angle);
+      twist_shader.setFloat("twist_height", state.twist_height);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShaderManager::kResolveVerticesBinding, state.back.VBO);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShaderManager::kComputeTableBinding, state.restVBO);
+      glDispatchCompute((static_cast<GLuint>(vertices_.size()) + 255) / 256, 1, 1);
+      twist_shader.disable();
+      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    } else {
+      glBindBuffer(GL_ARRAY_BUFFER, state.back.VBO);
+      glBufferSubData(GL_ARRAY_BUFFER, 0, state.vertices.size() * sizeof(Vertex), state.vertices.data());
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    state.timer.Begin();
+    DispatchDeformation(state.back, state.adjacencyBO);
+    state.timer.End();
+    state.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    state.has_new_positions = false;
+  }
+  return swapped;
+}
+
+double Mesh::GetDeformMilliseconds() const {
+  return deform_ ? deform_->timer.GetSmoothedMilliseconds() : 0.0;
+}
+
+bool Mesh::BeginDeformationBenchmark(int repetitions) {
+  if (num_faces_ == 0 || EBO == 0 || repetitions <= 0 || deform_benchmark_) return false;
+  deform_benchmark_ = std::make_unique<DeformBenchmark>();
+  DeformBenchmark& benchmark = *deform_benchmark_;
+  benchmark.state = MakeDeformState();
+  benchmark.repetitions = repetitions;
+  DispatchDeformation(benchmark.state->back, benchmark.state->adjacencyBO); // the program is made outside of the measurement
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+  glGenQueries(1, &benchmark.query);
+  glBeginQuery(GL_TIME_ELAPSED, benchmark.query);
+  for (int i = 0; i < repetitions; i++) {
+    DispatchDeformation(benchmark.state->back, benchmark.state->adjacencyBO);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT); // one pass at a time, as per frame
+  }
+  glEndQuery(GL_TIME_ELAPSED);
+  return true;
+}
+
+double Mesh::GetDeformationBenchmark() {
+  if (!deform_benchmark_) return 0.0;
+  GLuint available = GL_FALSE;
+  glGetQueryObjectuiv(deform_benchmark_->query, GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available) return -1.0;
+  GLuint64 elapsed_ns = 0;
+  glGetQueryObjectui64v(deform_benchmark_->query, GL_QUERY_RESULT, &elapsed_ns);
+  double milliseconds = static_cast<double>(elapsed_ns) / 1e6 / deform_benchmark_->repetitions;
+  deform_benchmark_.reset(); // and its buffers
+  return milliseconds;
 }
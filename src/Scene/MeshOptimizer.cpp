@@ -0,0 +1,227 @@
+// MeshOptimizer.cpp
+#include "Scene/MeshOptimizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <numeric>
+#include <unordered_set>
+
+namespace {
+	// spread the lower 10 bits of v so that there are two zero bits between each bit
+	uint32_t ExpandBits(uint32_t v) {
+		v &= 0x3ff;
+		v = (v | (v << 16)) & 0x030000ff;
+		v = (v | (v << 8)) & 0x0300f00f;
+		v = (v | (v << 4)) & 0x030c30c3;
+		v = (v | (v << 2)) & 0x09249249;
+		return v;
+	}
+} // namespace
+
+uint32_t mesh_optimizer::MortonCode(const glm::vec3& p) {
+	glm::vec3 q = glm::clamp(p * 1024.0f, glm::vec3(0.0f), glm::vec3(1023.0f));
+	return (ExpandBits(static_cast<uint32_t>(q.x)) << 2) | (ExpandBits(static_cast<uint32_t>(q.y)) << 1) | ExpandBits(static_cast<uint32_t>(q.z));
+}
+
+std::vector<unsigned int> mesh_optimizer::MortonTriangleOrder(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices) {
+	size_t num_faces = indices.size() / 3;
+	std::vector<glm::vec3> centroids(num_faces);
+	glm::vec3 c_min(FLT_MAX), c_max(-FLT_MAX);
+	for (size_t f = 0; f < num_faces; ++f) {
+		centroids[f] = (positions[indices[3 * f]] + positions[indices[3 * f + 1]] + positions[indices[3 * f + 2]]) / 3.0f;
+		c_min = glm::min(c_min, centroids[f]);
+		c_max = glm::max(c_max, centroids[f]);
+	}
+	glm::vec3 extent = glm::max(c_max - c_min, glm::vec3(1e-12f));
+	float largest_extent = std::max(extent.x, std::max(extent.y, extent.z)); // keep the grid cubic
+
+	std::vector<uint32_t> codes(num_faces);
+	for (size_t f = 0; f < num_faces; ++f) {
+		codes[f] = mesh_optimizer::MortonCode((centroids[f] - c_min) / largest_extent);
+	}
+	std::vector<unsigned int> order(num_faces);
+	std::iota(order.begin(), order.end(), 0u);
+	std::stable_sort(order.begin(), order.end(), [&codes](unsigned int a, unsigned int b) { return codes[a] < codes[b]; });
+	return order;
+}
+
+std::vector<unsigned int> mesh_optimizer::TipsifyTriangleOrder(const std::vector<unsigned int>& indices, size_t num_vertices, unsigned int cache_size) {
+	size_t num_faces = indices.size() / 3;
+	// vertex -> triangles adjacency (CSR), triangles kept in input order
+	std::vector<unsigned int> live(num_vertices, 0);
+	for (unsigned int v : indices) live[v]++;
+	std::vector<unsigned int> offsets(num_vertices + 1, 0);
+	for (size_t v = 0; v < num_vertices; ++v) offsets[v + 1] = offsets[v] + live[v];
+	std::vector<unsigned int> vertex_faces(indices.size());
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t f = 0; f < num_faces; ++f) {
+		for (int k = 0; k < 3; ++k) {
+			vertex_faces[fill[indices[3 * f + k]]++] = static_cast<unsigned int>(f);
+		}
+	}
+
+	std::vector<int> cache_time(num_vertices, 0);
+	std::vector<bool> emitted(num_faces, false);
+	std::vector<unsigned int> dead_end; // recently referenced vertices
+	std::vector<unsigned int> order; order.reserve(num_faces);
+	int time_stamp = static_cast<int>(cache_size) + 1;
+	size_t face_cursor = 0; // restart point in input order
+
+	auto skip_dead_end = [&]() -> long long {
+		while (!dead_end.empty()) {
+			unsigned int d = dead_end.back(); dead_end.pop_back();
+			if (live[d] > 0) return d;
+		}
+		while (face_cursor < num_faces) {
+			if (!emitted[face_cursor]) return indices[3 * face_cursor];
+			++face_cursor;
+		}
+		return -1;
+	};
+
+	long long fanning = num_faces > 0 ? static_cast<long long>(indices[0]) : -1;
+	std::vector<unsigned int> candidates;
+	while (fanning >= 0) {
+		candidates.clear();
+		unsigned int v_fan = static_cast<unsigned int>(fanning);
+		for (unsigned int i = offsets[v_fan]; i < offsets[v_fan + 1]; ++i) {
+			unsigned int f = vertex_faces[i];
+			if (emitted[f]) continue;
+			for (int k = 0; k < 3; ++k) {
+				unsigned int v = indices[3 * f + k];
+				dead_end.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time_stamp - cache_time[v] > static_cast<int>(cache_size)) {
+					cache_time[v] = time_stamp++;
+				}
+			}
+			emitted[f] = true;
+			order.push_back(f);
+		}
+		// next fanning vertex: the candidate that stays longest in cache and is still used
+		long long best = -1;
+		int best_priority = -1;
+		for (unsigned int v : candidates) {
+			if (live[v] == 0) continue;
+			int priority = 0;
+			if (time_stamp - cache_time[v] + 2 * static_cast<int>(live[v]) <= static_cast<int>(cache_size)) {
+				priority = time_stamp - cache_time[v];
+			}
+			if (priority > best_priority) {
+				best_priority = priority;
+				best = v;
+			}
+		}
+		fanning = (best >= 0) ? best : skip_dead_end();
+	}
+	return order;
+}
+
+float mesh_optimizer::ComputeACMR(const std::vector<unsigned int>& indices, size_t num_vertices, unsigned int cache_size) {
+	size_t num_faces = indices.size() / 3;
+	if (num_faces == 0) return 0.0f;
+	std::vector<bool> in_cache(num_vertices, false);
+	std::deque<unsigned int> fifo;
+	size_t misses = 0;
+	for (unsigned int v : indices) {
+		if (in_cache[v]) continue;
+		misses++;
+		fifo.push_back(v);
+		in_cache[v] = true;
+		if (fifo.size() > cache_size) {
+			in_cache[fifo.front()] = false;
+			fifo.pop_front();
+		}
+	}
+	return static_cast<float>(misses) / static_cast<float>(num_faces);
+}
+
+std::vector<unsigned int> mesh_optimizer::FirstUseVertexOrder(std::vector<unsigned int>& indices, size_t num_vertices) {
+	constexpr unsigned int kUnassigned = ~0u;
+	std::vector<unsigned int> new_index(num_vertices, kUnassigned);
+	std::vector<unsigned int> order; order.reserve(num_vertices);
+	for (unsigned int& v : indices) {
+		if (new_index[v] == kUnassigned) {
+			new_index[v] = static_cast<unsigned int>(order.size());
+			order.push_back(v);
+		}
+		v = new_index[v];
+	}
+	// unreferenced vertices go last
+	for (size_t v = 0; v < num_vertices; ++v) {
+		if (new_index[v] == kUnassigned) {
+			order.push_back(static_cast<unsigned int>(v));
+		}
+	}
+	return order;
+}
+
+// ---------------------- MESHLETS ---------------------- //
+std::vector<mesh_optimizer::Meshlet> mesh_optimizer::BuildMeshlets(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+                                                                   const std::vector<glm::vec3>& face_normals) {
+	std::vector<Meshlet> meshlets;
+	size_t num_faces = indices.size() / 3;
+	std::unordered_set<unsigned int> meshlet_vertices;
+
+	auto finish_meshlet = [&](unsigned int first, unsigned int count) {
+		Meshlet meshlet{first, count, glm::vec3(0.0f), 0.0f, glm::vec3(0.0f), 1.0f};
+		ComputeMeshletBounds(meshlet, [&positions](unsigned int v) { return positions[v]; }, indices, face_normals);
+		meshlets.push_back(meshlet);
+	};
+
+	unsigned int first = 0;
+	for (size_t f = 0; f < num_faces; ++f) {
+		unsigned int new_vertices = 0;
+		for (int k = 0; k < 3; ++k) {
+			if (meshlet_vertices.count(indices[3 * f + k]) == 0) new_vertices++;
+		}
+		unsigned int count = static_cast<unsigned int>(f) - first;
+		if (count == kMaxMeshletTriangles || meshlet_vertices.size() + new_vertices > kMaxMeshletVertices) {
+			finish_meshlet(first, count);
+			first = static_cast<unsigned int>(f);
+			meshlet_vertices.clear();
+		}
+		for (int k = 0; k < 3; ++k) meshlet_vertices.insert(indices[3 * f + k]);
+	}
+	if (num_faces > first) {
+		finish_meshlet(first, static_cast<unsigned int>(num_faces) - first);
+	}
+	return meshlets;
+}
+
+void mesh_optimizer::ExtractFrustumPlanes(const glm::mat4& mvp, glm::vec4 planes[6]) {
+	// Gribb-Hartmann, glm is column major: row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+	glm::vec4 row0(mvp[0][0], mvp[1][0], mvp[2][0], mvp[3][0]);
+	glm::vec4 row1(mvp[0][1], mvp[1][1], mvp[2][1], mvp[3][1]);
+	glm::vec4 row2(mvp[0][2], mvp[1][2], mvp[2][2], mvp[3][2]);
+	glm::vec4 row3(mvp[0][3], mvp[1][3], mvp[2][3], mvp[3][3]);
+	planes[0] = row3 + row0; // left
+	planes[1] = row3 - row0; // right
+	planes[2] = row3 + row1; // bottom
+	planes[3] = row3 - row1; // top
+	planes[4] = row3 + row2; // near
+	planes[5] = row3 - row2; // far
+	for (int i = 0; i < 6; ++i) {
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+bool mesh_optimizer::IsSphereInFrustum(const glm::vec3& center, float radius, const glm::vec4 planes[6]) {
+	for (int i = 0; i < 6; ++i) {
+		if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius) return false;
+	}
+	return true;
+}
+
+bool mesh_optimizer::IsMeshletInFrustum(const Meshlet& meshlet, const glm::vec4 planes[6]) {
+	return IsSphereInFrustum(meshlet.center, meshlet.radius, planes);
+}
+
+bool mesh_optimizer::IsMeshletBackfacing(const Meshlet& meshlet, const glm::vec3& eye) {
+	glm::vec3 view = meshlet.center - eye;
+	return glm::dot(view, meshlet.cone_axis) >= meshlet.cone_cutoff * glm::length(view) + meshlet.radius;
+}
@@ -0,0 +1,698 @@
+// MeshPartition.cpp
+#include "Scene/MeshPartition.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <unordered_map>
+
+#include "Scene/MeshOptimizer.h"
+#include "Scene/Parser.h"
+#include "Utils/Files.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+	constexpr uint32_t kNone = ~0u;
+	constexpr int kCellBits = 6; // Morton cells per axis 2^6, chunks are ranges of the 2^18 cells
+	constexpr size_t kNumCells = size_t(1) << (3 * kCellBits);
+	constexpr size_t kRecordsPerRead = 1 << 16;
+	constexpr size_t kBucketFlushBytes = 1 << 18;
+	constexpr uint32_t kVerticesPerBucket = 1u << 20; // positions of a vertex bucket in memory, 12 MB
+	constexpr uint32_t kFacesPerBucket = 1u << 19;    // corner positions of a face bucket in memory, 18 MB
+	constexpr int kManifestFormat = 2;                // with the chunk bounds
+
+	// a face of the OBJ, indices 0-based, kNone where the corner has no vt / vn
+	struct FaceRecord {
+		uint32_t index; // in the OBJ, the order the parser assigns the per-vertex attributes in
+		uint32_t v[3], vt[3], vn[3];
+	};
+	// joins of the faces with the vertex attributes, through buckets of vertices and of faces
+	struct CornerRecord {
+		uint32_t vertex, face, corner;
+	};
+	struct CornerPosition {
+		uint32_t face, corner;
+		glm::vec3 position;
+	};
+	struct VertexChunk {
+		uint32_t vertex, chunk, face;
+	};
+	struct FaceChunk {
+		uint32_t face, chunk;
+	};
+
+	// The OBJ without its faces and vertex attributes, which are in the temporary files
+	struct ObjData {
+		uint32_t num_positions = 0, num_tex_coords = 0, num_normals = 0;
+		glm::vec3 v_min = glm::vec3(FLT_MAX), v_max = glm::vec3(-FLT_MAX);
+		glm::vec2 vt_min = glm::vec2(FLT_MAX), vt_max = glm::vec2(std::numeric_limits<float>::min()); // as the parser has them
+		std::string mtllib_path, mtl_name;
+		uint32_t num_faces = 0;
+	};
+
+	// Files of a partition in the chunk directory, removed when it is done. Named with files::MakeTempPath, so two
+	// partitions of the same OBJ do not share them
+	struct TempFiles {
+		std::string faces, positions, tex_coords, normals, cells;
+		std::vector<std::string> paths;
+		explicit TempFiles(const fs::path& directory) {
+			faces = Add(directory / "faces");
+			positions = Add(directory / "positions");
+			tex_coords = Add(directory / "tex_coords");
+			normals = Add(directory / "normals");
+			cells = Add(directory / "cells");
+		}
+		~TempFiles() {
+			std::error_code error;
+			for (const std::string& path : paths) fs::remove(path, error);
+		}
+		std::string Add(const fs::path& path) {
+			paths.push_back(files::MakeTempPath(path.string()));
+			return paths.back();
+		}
+	};
+
+	// write(file) to a temporary file next to path, then renamed, so a reader never sees a partly written chunk or manifest
+	template <typename Write>
+	bool WriteFileAtomically(const std::string& path, std::ios::openmode mode, Write write) {
+		std::string temp_path = files::MakeTempPath(path);
+		{
+			std::ofstream file(temp_path, mode | std::ios::trunc);
+			write(file);
+			if (!file) {
+				std::remove(temp_path.c_str());
+				return false;
+			}
+		}
+		if (!files::RenameReplacing(temp_path, path)) {
+			std::remove(temp_path.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// Binary records of a temporary file, kRecordsPerRead at a time, from the record first on
+	template <typename Record>
+	class RecordReader {
+	public:
+		explicit RecordReader(const std::string& path, uint64_t first = 0) : file_(path, std::ios::binary), buffer_(kRecordsPerRead) {
+			if (first > 0) file_.seekg(first * sizeof(Record));
+		}
+		bool Next(Record& record) {
+			if (next_ == count_) {
+				if (!file_) return false;
+				file_.read(reinterpret_cast<char*>(buffer_.data()), buffer_.size() * sizeof(Record));
+				count_ = static_cast<size_t>(file_.gcount()) / sizeof(Record);
+				next_ = 0;
+				if (count_ == 0) return false;
+			}
+			record = buffer_[next_++];
+			return true;
+		}
+		bool AtEnd() const { return next_ == count_ && file_.eof(); } // false after an open or read error
+	private:
+		std::ifstream file_;
+		std::vector<Record> buffer_;
+		size_t next_ = 0, count_ = 0;
+	};
+
+	template <typename Record>
+	class RecordWriter {
+	public:
+		explicit RecordWriter(const std::string& path) : file_(path, std::ios::binary | std::ios::trunc) { buffer_.reserve(kRecordsPerRead); }
+		void Append(const Record& record) {
+			buffer_.push_back(record);
+			if (buffer_.size() == kRecordsPerRead) Flush();
+		}
+		bool Finish() {
+			Flush();
+			file_.flush();
+			return static_cast<bool>(file_);
+		}
+	private:
+		void Flush() {
+			file_.write(reinterpret_cast<const char*>(buffer_.data()), buffer_.size() * sizeof(Record));
+			buffer_.clear();
+		}
+		std::ofstream file_;
+		std::vector<Record> buffer_;
+	};
+
+	// returns false on a read error
+	template <typename Record, typename Visit>
+	bool ForEachRecord(const std::string& path, Visit visit) {
+		RecordReader<Record> reader(path);
+		Record record;
+		while (reader.Next(record)) visit(record);
+		return reader.AtEnd();
+	}
+
+	template <typename Visit>
+	bool ForEachFace(const std::string& path, Visit visit) {
+		return ForEachRecord<FaceRecord>(path, visit);
+	}
+
+	// count records from the record first on, or all of them
+	template <typename Record>
+	bool ReadRecords(const std::string& path, std::vector<Record>& records, uint64_t first = 0, size_t count = SIZE_MAX) {
+		records.clear();
+		RecordReader<Record> reader(path, first);
+		Record record;
+		while (records.size() < count && reader.Next(record)) records.push_back(record);
+		return records.size() == count || reader.AtEnd();
+	}
+
+	// The records of a chunk's sorted, distinct ids, from a file of records by id
+	template <typename Record>
+	class GatheredRecords {
+	public:
+		bool Gather(const std::string& path, std::vector<uint32_t> ids) {
+			ids_ = std::move(ids);
+			records_.resize(ids_.size());
+			std::ifstream file(path, std::ios::binary);
+			uint64_t position = ~0ull; // of the next record the file reads
+			for (size_t i = 0; i < ids_.size() && file; ++i) {
+				if (ids_[i] != position) file.seekg(ids_[i] * sizeof(Record));
+				file.read(reinterpret_cast<char*>(&records_[i]), sizeof(Record));
+				position = uint64_t(ids_[i]) + 1;
+			}
+			return static_cast<bool>(file);
+		}
+		const Record& operator[](uint32_t id) const { return records_[std::lower_bound(ids_.begin(), ids_.end(), id) - ids_.begin()]; }
+	private:
+		std::vector<uint32_t> ids_;
+		std::vector<Record> records_;
+	};
+
+	std::vector<uint32_t> SortedDistinct(std::vector<uint32_t> ids) {
+		std::sort(ids.begin(), ids.end());
+		ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+		return ids;
+	}
+
+	// records appended to one file per bucket, through a buffer per bucket so that few files are open
+	template <typename Record>
+	class BucketWriter {
+	public:
+		BucketWriter(std::vector<std::string> paths) : paths_(std::move(paths)), buffers_(paths_.size()) {
+			for (const std::string& path : paths_) std::ofstream(path, std::ios::binary | std::ios::trunc);
+		}
+		void Append(uint32_t bucket, const Record& record) {
+			std::vector<Record>& buffer = buffers_[bucket];
+			buffer.push_back(record);
+			if (buffer.size() * sizeof(Record) >= kBucketFlushBytes) Flush(bucket);
+		}
+		bool Finish() {
+			for (uint32_t bucket = 0; bucket < buffers_.size(); ++bucket) Flush(bucket);
+			return ok_;
+		}
+	private:
+		void Flush(uint32_t bucket) {
+			std::vector<Record>& buffer = buffers_[bucket];
+			if (buffer.empty()) return;
+			std::ofstream file(paths_[bucket], std::ios::binary | std::ios::app);
+			file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(Record));
+			ok_ = ok_ && static_cast<bool>(file);
+			buffer.clear();
+		}
+		std::vector<std::string> paths_;
+		std::vector<std::vector<Record>> buffers_;
+		bool ok_ = true;
+	};
+
+	// corner "v", "v/vt", "v//vn" or "v/vt/vn"
+	const char* ParseCorner(const char* cursor, uint32_t& v, uint32_t& vt, uint32_t& vn) {
+		char* next = nullptr;
+		v = static_cast<uint32_t>(std::strtoul(cursor, &next, 10)) - 1;
+		vt = vn = kNone;
+		if (*next == '/') {
+			if (next[1] != '/') vt = static_cast<uint32_t>(std::strtoul(next + 1, &next, 10)) - 1;
+			else ++next;
+			if (*next == '/') vn = static_cast<uint32_t>(std::strtoul(next + 1, &next, 10)) - 1;
+		}
+		return next;
+	}
+
+	// The faces and the vertex attributes to their temporary files, the rest of the OBJ into obj
+	bool ReadObj(const std::string& obj_path, const TempFiles& temp, ObjData& obj) {
+		std::ifstream obj_file(obj_path);
+		if (!obj_file.is_open()) {
+			std::cerr << "ERROR::MESH_PARTITION::OPEN_FAILED: " << obj_path << std::endl;
+			return false;
+		}
+		RecordWriter<FaceRecord> faces(temp.faces);
+		RecordWriter<glm::vec3> positions(temp.positions), normals(temp.normals);
+		RecordWriter<glm::vec2> tex_coords(temp.tex_coords);
+		std::string line;
+		while (std::getline(obj_file, line)) {
+			const char* cursor = line.c_str();
+			char* next = nullptr;
+			if (line.compare(0, 2, "v ") == 0 || line.compare(0, 2, "v\t") == 0) {
+				glm::vec3 p;
+				p.x = std::strtof(cursor + 2, &next);
+				p.y = std::strtof(next, &next);
+				p.z = std::strtof(next, &next);
+				positions.Append(p);
+				obj.num_positions++;
+				obj.v_min = glm::min(obj.v_min, p);
+				obj.v_max = glm::max(obj.v_max, p);
+			} else if (line.compare(0, 3, "vt ") == 0) {
+				glm::vec2 t;
+				t.x = std::strtof(cursor + 3, &next);
+				t.y = std::strtof(next, &next);
+				tex_coords.Append(t);
+				obj.num_tex_coords++;
+				obj.vt_min = glm::min(obj.vt_min, t);
+				obj.vt_max = glm::max(obj.vt_max, t);
+			} else if (line.compare(0, 3, "vn ") == 0) {
+				glm::vec3 n;
+				n.x = std::strtof(cursor + 3, &next);
+				n.y = std::strtof(next, &next);
+				n.z = std::strtof(next, &next);
+				normals.Append(n);
+				obj.num_normals++;
+			} else if (line.compare(0, 2, "f ") == 0) {
+				FaceRecord face;
+				face.index = obj.num_faces++;
+				cursor += 2;
+				for (int k = 0; k < 3; ++k) cursor = ParseCorner(cursor, face.v[k], face.vt[k], face.vn[k]); // triangles, as the parser
+				faces.Append(face);
+			} else if (line.compare(0, 7, "mtllib ") == 0) {
+				std::istringstream(line.substr(7)) >> obj.mtllib_path;
+			} else if (line.compare(0, 7, "usemtl ") == 0) {
+				std::istringstream(line.substr(7)) >> obj.mtl_name;
+			}
+		}
+		bool faces_ok = faces.Finish();
+		bool attributes_ok = positions.Finish() && tex_coords.Finish() && normals.Finish();
+		if (!faces_ok || !attributes_ok) {
+			std::cerr << "ERROR::MESH_PARTITION::WRITE_FAILED: " << (faces_ok ? temp.positions : temp.faces) << std::endl;
+			return false;
+		}
+		if (obj.mtllib_path.empty() || obj.mtl_name.empty() || obj.num_faces == 0) {
+			std::cerr << "ERROR::MESH_PARTITION::INVALID_OBJ: no faces or material in " << obj_path << std::endl;
+			return false;
+		}
+		// the chunks are in another directory, the material file is referenced by its absolute path
+		fs::path mtllib(obj.mtllib_path);
+		if (!fs::exists(mtllib)) mtllib = fs::path(obj_path).parent_path() / mtllib;
+		obj.mtllib_path = fs::absolute(mtllib).string();
+		return true;
+	}
+
+	bool IsValidFace(const FaceRecord& face, const ObjData& obj) {
+		return face.v[0] < obj.num_positions && face.v[1] < obj.num_positions && face.v[2] < obj.num_positions;
+	}
+
+	uint32_t FaceCell(const glm::vec3 corners[3], const ObjData& obj, float largest_extent) {
+		glm::vec3 centroid = (corners[0] + corners[1] + corners[2]) / 3.0f;
+		return mesh_optimizer::MortonCode((centroid - obj.v_min) / largest_extent) >> (30 - 3 * kCellBits);
+	}
+
+	void AppendFloat(std::string& text, float value) {
+		char buffer[32];
+		int length = std::snprintf(buffer, sizeof(buffer), " %.9g", value);
+		text.append(buffer, length);
+	}
+
+	// One chunk OBJ: its vertices in first-use order, a texture coordinate per vertex (the one of its last face
+	// in the OBJ, as the parser assigns them), the owned triangles in Morton + Tipsify order, then the ring. The
+	// attributes of its vertices are read from the temporary files, and the bounds of the owned triangles go to chunk.
+	bool WriteChunk(mesh_partition::Chunk& chunk, const ObjData& obj, const TempFiles& temp, std::vector<FaceRecord>& owned,
+	                std::vector<FaceRecord>& ring, const std::string& source_name) {
+		std::unordered_map<uint32_t, uint32_t> local_vertex;
+		std::vector<uint32_t> global_vertex;
+		auto local_indices = [&](const std::vector<FaceRecord>& faces) {
+			std::vector<unsigned int> indices;
+			indices.reserve(3 * faces.size());
+			for (const FaceRecord& face : faces) {
+				for (int k = 0; k < 3; ++k) {
+					auto inserted = local_vertex.emplace(face.v[k], static_cast<uint32_t>(global_vertex.size()));
+					if (inserted.second) global_vertex.push_back(face.v[k]);
+					indices.push_back(inserted.first->second);
+				}
+			}
+			return indices;
+		};
+		std::vector<unsigned int> owned_indices = local_indices(owned);
+		size_t num_owned_vertices = global_vertex.size();
+		std::vector<unsigned int> ring_indices = local_indices(ring);
+		size_t num_vertices = global_vertex.size();
+
+		GatheredRecords<glm::vec3> obj_positions;
+		if (!obj_positions.Gather(temp.positions, SortedDistinct(global_vertex))) return false;
+		std::vector<glm::vec3> positions(num_vertices);
+		for (size_t v = 0; v < num_vertices; ++v) positions[v] = obj_positions[global_vertex[v]];
+		chunk.v_min = glm::vec3(FLT_MAX);
+		chunk.v_max = glm::vec3(-FLT_MAX);
+		for (size_t v = 0; v < num_owned_vertices; ++v) {
+			chunk.v_min = glm::min(chunk.v_min, positions[v]);
+			chunk.v_max = glm::max(chunk.v_max, positions[v]);
+		}
+		std::vector<uint32_t> vertex_vt(num_vertices, kNone), vertex_vn(num_vertices, kNone);
+		std::vector<const FaceRecord*> in_obj_order;
+		in_obj_order.reserve(owned.size() + ring.size());
+		for (const FaceRecord& face : owned) in_obj_order.push_back(&face);
+		for (const FaceRecord& face : ring) in_obj_order.push_back(&face);
+		std::sort(in_obj_order.begin(), in_obj_order.end(), [](const FaceRecord* a, const FaceRecord* b) { return a->index < b->index; });
+		for (const FaceRecord* face : in_obj_order) {
+			for (int k = 0; k < 3; ++k) {
+				uint32_t v = local_vertex[face->v[k]];
+				if (face->vt[k] < obj.num_tex_coords) vertex_vt[v] = face->vt[k];
+				if (face->vn[k] < obj.num_normals) vertex_vn[v] = face->vn[k];
+			}
+		}
+		GatheredRecords<glm::vec2> obj_tex_coords;
+		GatheredRecords<glm::vec3> obj_normals;
+		auto used = [](std::vector<uint32_t> ids) {
+			ids.erase(std::remove(ids.begin(), ids.end(), kNone), ids.end());
+			return SortedDistinct(std::move(ids));
+		};
+		if (!obj_tex_coords.Gather(temp.tex_coords, used(vertex_vt)) || !obj_normals.Gather(temp.normals, used(vertex_vn))) return false;
+
+		// triangle order of ModelAsset's --reorder, done here since a chunk keeps the order of its file
+		std::vector<unsigned int> order = mesh_optimizer::MortonTriangleOrder(positions, owned_indices);
+		mesh_optimizer::PermuteTriangles(owned_indices, order, 3);
+		order = mesh_optimizer::TipsifyTriangleOrder(owned_indices, num_vertices);
+		mesh_optimizer::PermuteTriangles(owned_indices, order, 3);
+		std::vector<unsigned int> indices(owned_indices);
+		indices.insert(indices.end(), ring_indices.begin(), ring_indices.end());
+		std::vector<unsigned int> vertex_order = mesh_optimizer::FirstUseVertexOrder(indices, num_vertices);
+
+		bool has_normals = obj.num_normals > 0;
+		std::string text;
+		text += "# chunk of " + source_name + ": " + std::to_string(owned.size()) + " triangles and a boundary ring of " +
+		        std::to_string(ring.size()) + ", see mesh_partition\n";
+		text += "mtllib " + obj.mtllib_path + "\nusemtl " + obj.mtl_name + "\n";
+		for (unsigned int v : vertex_order) {
+			text += "v";
+			for (int a = 0; a < 3; ++a) AppendFloat(text, positions[v][a]);
+			text += "\n";
+		}
+		for (unsigned int v : vertex_order) {
+			glm::vec2 t = vertex_vt[v] != kNone ? obj_tex_coords[vertex_vt[v]] : glm::vec2(0.0f);
+			text += "vt";
+			AppendFloat(text, t.x);
+			AppendFloat(text, t.y);
+			text += "\n";
+		}
+		if (obj.num_tex_coords > 0) {
+			// unreferenced, they give the chunk the texture coordinate range of the whole mesh, which the loader normalizes by
+			float vt_max_delta = std::max(obj.vt_max.x - obj.vt_min.x, obj.vt_max.y - obj.vt_min.y);
+			text += "vt";
+			AppendFloat(text, obj.vt_min.x);
+			AppendFloat(text, obj.vt_min.y);
+			text += "\nvt";
+			AppendFloat(text, obj.vt_min.x + vt_max_delta);
+			AppendFloat(text, obj.vt_min.y + vt_max_delta);
+			text += "\n";
+		}
+		if (has_normals) {
+			for (unsigned int v : vertex_order) {
+				glm::vec3 n = vertex_vn[v] != kNone ? obj_normals[vertex_vn[v]] : glm::vec3(0.0f);
+				text += "vn";
+				for (int a = 0; a < 3; ++a) AppendFloat(text, n[a]);
+				text += "\n";
+			}
+		}
+		for (size_t f = 0; f < indices.size() / 3; ++f) {
+			if (f == owned.size()) text += std::string("g ") + kBoundaryRingGroup + "\n";
+			text += "f";
+			for (int k = 0; k < 3; ++k) {
+				std::string corner = std::to_string(indices[3 * f + k] + 1);
+				text += " " + corner + "/" + corner;
+				if (has_normals) text += "/" + corner;
+			}
+			text += "\n";
+		}
+		return WriteFileAtomically(chunk.path, std::ios::binary, [&](std::ofstream& file) { file.write(text.data(), text.size()); });
+	}
+
+	bool WriteManifest(const std::string& manifest_path, const mesh_partition::Manifest& manifest) {
+		return WriteFileAtomically(manifest_path, std::ios::out, [&](std::ofstream& file) {
+			file.precision(9);
+			file << "# BPM chunks, see mesh_partition\n";
+			file << "format " << kManifestFormat << "\n";
+			file << "chunk_triangles " << manifest.max_chunk_triangles << "\n";
+			file << "bbox " << manifest.v_min.x << " " << manifest.v_min.y << " " << manifest.v_min.z << " "
+			     << manifest.v_max.x << " " << manifest.v_max.y << " " << manifest.v_max.z << "\n";
+			for (const mesh_partition::Chunk& chunk : manifest.chunks) {
+				file << "chunk " << chunk.num_faces << " " << chunk.num_ring_faces << " " << chunk.v_min.x << " " << chunk.v_min.y << " "
+				     << chunk.v_min.z << " " << chunk.v_max.x << " " << chunk.v_max.y << " " << chunk.v_max.z << " "
+				     << fs::path(chunk.path).filename().string() << "\n";
+			}
+			file << "source " << manifest.source_path << "\n";
+		});
+	}
+} // namespace
+
+bool mesh_partition::PartitionObjFile(const std::string& obj_path, const std::string& manifest_path, unsigned int max_chunk_triangles,
+                                      Manifest& manifest) {
+	fs::path directory = fs::path(manifest_path).parent_path();
+	std::error_code error;
+	fs::create_directories(directory, error);
+	TempFiles temp(directory);
+	std::string source_name = fs::path(obj_path).filename().string();
+	max_chunk_triangles = std::max(max_chunk_triangles, 1u);
+
+	// --- 1. faces and vertex attributes to disk --- //
+	ObjData obj;
+	if (!ReadObj(obj_path, temp, obj)) return false;
+	glm::vec3 extent = glm::max(obj.v_max - obj.v_min, glm::vec3(1e-12f));
+	float largest_extent = std::max(extent.x, std::max(extent.y, extent.z)); // cubic cells
+	uint32_t num_vertex_buckets = std::max(1u, (obj.num_positions + kVerticesPerBucket - 1) / kVerticesPerBucket);
+	uint32_t num_face_buckets = (obj.num_faces + kFacesPerBucket - 1) / kFacesPerBucket;
+	std::vector<std::string> vertex_paths, face_paths;
+	for (uint32_t b = 0; b < num_vertex_buckets; ++b) vertex_paths.push_back(temp.Add(directory / ("vertices_" + std::to_string(b))));
+	for (uint32_t b = 0; b < num_face_buckets; ++b) face_paths.push_back(temp.Add(directory / ("faces_" + std::to_string(b))));
+	auto read_failed = [](const std::string& path) {
+		std::cerr << "ERROR::MESH_PARTITION::READ_FAILED: " << path << std::endl;
+		return false;
+	};
+
+	// --- 2. the Morton cell of every face: its corners meet their positions by vertex bucket, then their face by face bucket --- //
+	std::vector<uint32_t> histogram(kNumCells, 0);
+	{
+		BucketWriter<CornerRecord> corners(vertex_paths);
+		bool read_ok = ForEachFace(temp.faces, [&](const FaceRecord& face) {
+			if (!IsValidFace(face, obj)) return;
+			for (uint32_t k = 0; k < 3; ++k) corners.Append(face.v[k] / kVerticesPerBucket, {face.v[k], face.index, k});
+		});
+		if (!read_ok) return read_failed(temp.faces);
+		if (!corners.Finish()) return read_failed(vertex_paths[0]);
+	}
+	{
+		BucketWriter<CornerPosition> corner_positions(face_paths);
+		std::vector<glm::vec3> positions;
+		for (uint32_t b = 0; b < num_vertex_buckets; ++b) {
+			uint32_t first = b * kVerticesPerBucket;
+			if (!ReadRecords(temp.positions, positions, first, std::min(kVerticesPerBucket, obj.num_positions - first))) return read_failed(temp.positions);
+			bool read_ok = ForEachRecord<CornerRecord>(vertex_paths[b], [&](const CornerRecord& corner) {
+				corner_positions.Append(corner.face / kFacesPerBucket, {corner.face, corner.corner, positions[corner.vertex - first]});
+			});
+			if (!read_ok) return read_failed(vertex_paths[b]);
+		}
+		if (!corner_positions.Finish()) return read_failed(face_paths[0]);
+	}
+	{
+		RecordWriter<uint32_t> cells(temp.cells); // per face in OBJ order, kNone for the invalid ones
+		std::vector<glm::vec3> corners;
+		std::vector<uint8_t> num_corners;
+		for (uint32_t b = 0; b < num_face_buckets; ++b) {
+			uint32_t first = b * kFacesPerBucket;
+			uint32_t count = std::min(kFacesPerBucket, obj.num_faces - first);
+			corners.assign(3 * size_t(count), glm::vec3(0.0f));
+			num_corners.assign(count, 0);
+			bool read_ok = ForEachRecord<CornerPosition>(face_paths[b], [&](const CornerPosition& corner) {
+				corners[3 * size_t(corner.face - first) + corner.corner] = corner.position;
+				num_corners[corner.face - first]++;
+			});
+			if (!read_ok) return read_failed(face_paths[b]);
+			for (uint32_t f = 0; f < count; ++f) {
+				uint32_t cell = num_corners[f] == 3 ? FaceCell(&corners[3 * size_t(f)], obj, largest_extent) : kNone;
+				if (cell != kNone) histogram[cell]++;
+				cells.Append(cell);
+			}
+		}
+		if (!cells.Finish()) return read_failed(temp.cells);
+	}
+
+	// --- 3. chunks: ranges of Morton cells of about max_chunk_triangles triangles --- //
+	std::vector<uint32_t> cell_chunk(kNumCells, 0);
+	{
+		uint32_t chunk = 0;
+		uint64_t count = 0;
+		for (size_t cell = 0; cell < kNumCells; ++cell) {
+			if (count > 0 && count + histogram[cell] > max_chunk_triangles) {
+				chunk++;
+				count = 0;
+			}
+			cell_chunk[cell] = chunk;
+			count += histogram[cell];
+		}
+		manifest.chunks.assign(chunk + 1, Chunk());
+	}
+	uint32_t num_chunks = static_cast<uint32_t>(manifest.chunks.size());
+	std::string stem = fs::path(obj_path).stem().string();
+	std::vector<std::string> owned_paths, ring_paths;
+	for (uint32_t c = 0; c < num_chunks; ++c) {
+		char name[32];
+		std::snprintf(name, sizeof(name), "_chunk_%04u", c);
+		manifest.chunks[c].path = (directory / (stem + name + ".obj")).string();
+		owned_paths.push_back(temp.Add(directory / (stem + name + ".owned")));
+		ring_paths.push_back(temp.Add(directory / (stem + name + ".ring")));
+	}
+
+	// --- 4. faces into their chunk's bucket, their corners with the chunk by vertex bucket --- //
+	{
+		BucketWriter<FaceRecord> owned_writer(owned_paths);
+		BucketWriter<VertexChunk> vertex_chunks(vertex_paths);
+		RecordReader<uint32_t> cells(temp.cells);
+		bool cells_ok = true;
+		bool read_ok = ForEachFace(temp.faces, [&](const FaceRecord& face) {
+			uint32_t cell = kNone;
+			cells_ok = cells.Next(cell) && cells_ok;
+			if (cell == kNone) return;
+			uint32_t chunk = cell_chunk[cell];
+			owned_writer.Append(chunk, face);
+			manifest.chunks[chunk].num_faces++;
+			for (uint32_t v : face.v) vertex_chunks.Append(v / kVerticesPerBucket, {v, chunk, face.index});
+		});
+		if (!read_ok || !cells_ok) return read_failed(read_ok ? temp.cells : temp.faces);
+		if (!owned_writer.Finish() || !vertex_chunks.Finish()) return read_failed(vertex_paths[0]);
+	}
+
+	// --- 5. a face at a vertex of several chunks goes to the ring of the others there, (face, chunk) pairs by face bucket --- //
+	{
+		BucketWriter<FaceChunk> ring_pairs(face_paths);
+		std::vector<VertexChunk> records;
+		std::vector<uint32_t> chunks;
+		for (uint32_t b = 0; b < num_vertex_buckets; ++b) {
+			if (!ReadRecords(vertex_paths[b], records)) return read_failed(vertex_paths[b]);
+			std::sort(records.begin(), records.end(), [](const VertexChunk& a, const VertexChunk& b) {
+				return a.vertex != b.vertex ? a.vertex < b.vertex : a.chunk < b.chunk;
+			});
+			for (size_t begin = 0, end = 0; begin < records.size(); begin = end) {
+				chunks.clear();
+				for (end = begin; end < records.size() && records[end].vertex == records[begin].vertex; ++end) {
+					if (chunks.empty() || chunks.back() != records[end].chunk) chunks.push_back(records[end].chunk);
+				}
+				if (chunks.size() < 2) continue;
+				for (size_t r = begin; r < end; ++r) {
+					for (uint32_t other : chunks) {
+						if (other != records[r].chunk) ring_pairs.Append(records[r].face / kFacesPerBucket, {records[r].face, other});
+					}
+				}
+			}
+		}
+		if (!ring_pairs.Finish()) return read_failed(face_paths[0]);
+	}
+	{
+		BucketWriter<FaceRecord> ring_writer(ring_paths);
+		std::vector<FaceChunk> pairs;
+		for (uint32_t b = 0; b < num_face_buckets; ++b) {
+			if (!ReadRecords(face_paths[b], pairs)) return read_failed(face_paths[b]);
+			std::sort(pairs.begin(), pairs.end(), [](const FaceChunk& a, const FaceChunk& b) {
+				return a.face != b.face ? a.face < b.face : a.chunk < b.chunk;
+			});
+			pairs.erase(std::unique(pairs.begin(), pairs.end(), [](const FaceChunk& a, const FaceChunk& b) {
+				return a.face == b.face && a.chunk == b.chunk;
+			}), pairs.end());
+			// the faces file is in OBJ order, the pairs' faces are read in one pass over the bucket's range
+			RecordReader<FaceRecord> faces(temp.faces, uint64_t(b) * kFacesPerBucket);
+			FaceRecord face;
+			face.index = kNone;
+			for (const FaceChunk& pair : pairs) {
+				while (face.index != pair.face) {
+					if (!faces.Next(face)) return read_failed(temp.faces);
+				}
+				ring_writer.Append(pair.chunk, face);
+				manifest.chunks[pair.chunk].num_ring_faces++;
+			}
+		}
+		if (!ring_writer.Finish()) return read_failed(ring_paths[0]);
+	}
+
+	// --- 6. one chunk in memory at a time --- //
+	bool write_ok = true;
+	for (uint32_t c = 0; c < num_chunks && write_ok; ++c) {
+		std::vector<FaceRecord> owned, ring;
+		if (!ReadRecords(owned_paths[c], owned) || !ReadRecords(ring_paths[c], ring)) return read_failed(owned_paths[c]);
+		if (owned.empty()) continue;
+		write_ok = WriteChunk(manifest.chunks[c], obj, temp, owned, ring, source_name);
+		if (!write_ok) std::cerr << "ERROR::MESH_PARTITION::WRITE_FAILED: " << manifest.chunks[c].path << std::endl;
+	}
+	if (!write_ok) return false;
+	manifest.chunks.erase(std::remove_if(manifest.chunks.begin(), manifest.chunks.end(), [](const Chunk& chunk) { return chunk.num_faces == 0; }),
+	                      manifest.chunks.end());
+	manifest.source_path = obj_path;
+	manifest.max_chunk_triangles = max_chunk_triangles;
+	manifest.v_min = obj.v_min;
+	manifest.v_max = obj.v_max;
+	if (!WriteManifest(manifest_path, manifest)) {
+		std::cerr << "ERROR::MESH_PARTITION::WRITE_FAILED: " << manifest_path << std::endl;
+		return false;
+	}
+	std::cout << "Partitioned " << source_name << ": " << obj.num_faces << " triangles into " << manifest.chunks.size() << " chunks" << std::endl;
+	return true;
+}
+
+bool mesh_partition::ReadManifest(const std::string& manifest_path, Manifest& manifest) {
+	std::ifstream file(manifest_path);
+	if (!file.is_open()) return false;
+	manifest = Manifest();
+	fs::path directory = fs::path(manifest_path).parent_path();
+	int format = 1;
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream iss(line);
+		std::string token;
+		iss >> token;
+		if (token == "format") {
+			iss >> format;
+		} else if (token == "chunk_triangles") {
+			iss >> manifest.max_chunk_triangles;
+		} else if (token == "bbox") {
+			iss >> manifest.v_min.x >> manifest.v_min.y >> manifest.v_min.z >> manifest.v_max.x >> manifest.v_max.y >> manifest.v_max.z;
+		} else if (token == "chunk") {
+			Chunk chunk;
+			std::string name;
+			iss >> chunk.num_faces >> chunk.num_ring_faces >> chunk.v_min.x >> chunk.v_min.y >> chunk.v_min.z
+			    >> chunk.v_max.x >> chunk.v_max.y >> chunk.v_max.z >> std::ws;
+			std::getline(iss, name);
+			chunk.path = (directory / name).string();
+			manifest.chunks.push_back(chunk);
+		} else if (token == "source") {
+			std::getline(iss >> std::ws, manifest.source_path);
+		}
+	}
+	if (format != kManifestFormat) {
+		std::cerr << "ERROR::MESH_PARTITION::OLD_MANIFEST: format " << format << " of " << manifest_path << ", partition the OBJ again" << std::endl;
+		return false;
+	}
+	if (manifest.chunks.empty()) {
+		std::cerr << "ERROR::MESH_PARTITION::INVALID_MANIFEST: " << manifest_path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool mesh_partition::LoadOrPartition(const std::string& obj_path, unsigned int max_chunk_triangles, Manifest& manifest) {
+	fs::path path(obj_path);
+	std::string stem = path.stem().string();
+	std::string manifest_path = (path.parent_path() / (stem + "_chunks") / (stem + kManifestExtension)).string();
+	std::error_code error;
+	auto manifest_time = fs::last_write_time(manifest_path, error);
+	bool is_current = !error && manifest_time >= fs::last_write_time(obj_path, error) && !error;
+	if (is_current && ReadManifest(manifest_path, manifest) && manifest.max_chunk_triangles == max_chunk_triangles) return true;
+	return PartitionObjFile(obj_path, manifest_path, max_chunk_triangles, manifest);
+}
@@ -0,0 +1,207 @@
+// MeshSequence.cpp
+#include "Scene/MeshSequence.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include "Scene/Mesh.h"
+#include "Scene/Parser.h"
+
+namespace fs = std::filesystem;
+
+std::vector<std::string> MeshSequence::FindFrames(const std::string& first_frame_path) {
+	std::vector<std::string> frame_paths{first_frame_path};
+	fs::path path(first_frame_path);
+	std::string stem = path.stem().string();
+	size_t digits_begin = stem.size();
+	while (digits_begin > 0 && std::isdigit(static_cast<unsigned char>(stem[digits_begin - 1]))) digits_begin--;
+	if (digits_begin == stem.size()) return frame_paths;
+
+	std::string prefix = stem.substr(0, digits_begin);
+	size_t width = stem.size() - digits_begin; // zero padded
+	unsigned long long number = 0;
+	if (std::from_chars(stem.data() + digits_begin, stem.data() + stem.size(), number).ec != std::errc()) { // more digits than fit, not a frame number
+		std::cerr << "ERROR::MESH_SEQUENCE::FIND_FRAMES::INVALID_NUMBER: " << first_frame_path << std::endl;
+		return frame_paths;
+	}
+	while (true) {
+		std::ostringstream name;
+		name << prefix << std::setw(static_cast<int>(width)) << std::setfill('0') << ++number << path.extension().string();
+		fs::path frame_path = path.parent_path() / name.str();
+		if (!fs::exists(frame_path)) break;
+		frame_paths.push_back(frame_path.string());
+	}
+	return frame_paths;
+}
+
+MeshSequence::MeshSequence(std::vector<std::string> frame_paths, const Mesh& mesh, bool write_positions_files,
+                           unsigned int num_workers)
+	: frame_paths_(std::move(frame_paths)), num_vertices_(mesh.vertices_.size()), source_vertices_(mesh.source_vertices_),
+	  indices_(mesh.indices_), write_positions_files_(write_positions_files), slots_(std::min(kRingSize, frame_paths_.size())) {
+	if (frame_paths_.size() < 2) return; // nothing to play
+	// frame 0 is the loaded mesh, shown until the first AcquireFrame
+	v_min_ = glm::vec3(FLT_MAX);
+	v_max_ = glm::vec3(-FLT_MAX);
+	for (const auto& vertex : mesh.vertices_) {
+		v_min_ = glm::min(v_min_, vertex.position_);
+		v_max_ = glm::max(v_max_, vertex.position_);
+	}
+	for (unsigned int i = 0; i < num_workers; ++i) {
+		workers_.emplace_back(&MeshSequence::WorkerLoop, this);
+	}
+}
+
+MeshSequence::~MeshSequence() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	condition_.notify_all();
+	for (std::thread& worker : workers_) {
+		worker.join();
+	}
+}
+
+bool MeshSequence::AcquireFrame(size_t frame) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (window_begin_ != frame) {
+		window_begin_ = frame;
+		condition_.notify_all(); // slots outside the new window are free
+	}
+	for (Slot& slot : slots_) {
+		if (slot.frame != frame || (slot.state != SlotState::READY && slot.state != SlotState::FAILED)) continue;
+		bool is_read = slot.state == SlotState::READY;
+		if (is_read) { // the slot keeps the old allocations for the next frame
+			positions_.swap(slot.data.positions);
+			normals_.swap(slot.data.normals);
+			v_min_ = slot.data.v_min;
+			v_max_ = slot.data.v_max;
+		}
+		slot.state = SlotState::EMPTY;
+		shown_frame_ = frame;
+		condition_.notify_one();
+		return is_read;
+	}
+	num_stalls_++;
+	return false;
+}
+
+size_t MeshSequence::GetNumReadyFrames() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return std::count_if(slots_.begin(), slots_.end(), [this](const Slot& slot) {
+		return slot.state == SlotState::READY && IsInWindow(slot.frame);
+	});
+}
+
+bool MeshSequence::IsInWindow(size_t frame) const {
+	size_t num_frames = frame_paths_.size();
+	return (frame + num_frames - window_begin_ % num_frames) % num_frames < slots_.size();
+}
+
+MeshSequence::Slot* MeshSequence::ClaimSlot(size_t& frame) {
+	for (size_t i = 0; i < slots_.size(); ++i) {
+		size_t candidate = (window_begin_ + i) % frame_paths_.size();
+		bool has_slot = std::any_of(slots_.begin(), slots_.end(), [candidate](const Slot& slot) {
+			return slot.state != SlotState::EMPTY && slot.frame == candidate;
+		});
+		if (has_slot) continue;
+		for (Slot& slot : slots_) {
+			if (slot.state == SlotState::READING) continue;
+			if (slot.state != SlotState::EMPTY && IsInWindow(slot.frame)) continue;
+			slot.frame = candidate;
+			slot.state = SlotState::READING;
+			frame = candidate;
+			return &slot;
+		}
+		return nullptr; // every slot is being read or holds a frame of the window
+	}
+	return nullptr;
+}
+
+void MeshSequence::Frame::Swap(Frame& other) {
+	positions.swap(other.positions);
+	normals.swap(other.normals);
+	std::swap(v_min, other.v_min);
+	std::swap(v_max, other.v_max);
+}
+
+void MeshSequence::WorkerLoop() {
+	std::vector<glm::vec3> read;
+	Frame data;
+	while (true) {
+		size_t frame = 0;
+		Slot* slot = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			condition_.wait(lock, [&] { return stopping_ || (slot = ClaimSlot(frame)) != nullptr; });
+			if (stopping_) return;
+			data.Swap(slot->data); // reuses the allocations of the frame it held before
+		}
+		bool read_ok = true;
+		try {
+			ReadFrame(frame, read, data);
+		} catch (const std::exception& e) {
+			std::cerr << "ERROR::MESH_SEQUENCE::READ_FAILED: " << e.what() << std::endl;
+			read_ok = false;
+		}
+		std::lock_guard<std::mutex> lock(mutex_);
+		slot->data.Swap(data);
+		slot->state = read_ok ? SlotState::READY : SlotState::FAILED;
+	}
+}
+
+void MeshSequence::ReadFrame(size_t frame, std::vector<glm::vec3>& read, Frame& data) {
+	auto begin = std::chrono::steady_clock::now();
+	const std::string& obj_path = frame_paths_[frame];
+	std::string positions_path = obj_path + kPositionsExtension;
+	std::error_code error;
+	auto positions_time = fs::last_write_time(positions_path, error);
+	bool has_positions_file = !error && positions_time >= fs::last_write_time(obj_path, error) && !error;
+	if (has_positions_file) {
+		ReadPositionsFile(positions_path, read);
+	} else {
+		ParseObjPositions(obj_path, read);
+		if (write_positions_files_ && read.size() == num_vertices_) WritePositionsFile(positions_path, read);
+	}
+	if (read.size() != num_vertices_) {
+		throw std::runtime_error(std::to_string(read.size()) + " vertices in " + obj_path + ", the sequence has " + std::to_string(num_vertices_));
+	}
+	std::vector<glm::vec3>& positions = data.positions;
+	if (source_vertices_.empty()) {
+		positions.swap(read);
+	} else {
+		positions.resize(num_vertices_);
+		for (size_t v = 0; v < num_vertices_; v++) {
+			positions[v] = read[source_vertices_[v]];
+		}
+	}
+	data.v_min = glm::vec3(FLT_MAX);
+	data.v_max = glm::vec3(-FLT_MAX);
+	for (const glm::vec3& position : positions) {
+		data.v_min = glm::min(data.v_min, position);
+		data.v_max = glm::max(data.v_max, position);
+	}
+	// the cross product of two edges is the face normal weighted by twice the area
+	data.normals.assign(num_vertices_, glm::vec3(0.0f));
+	for (size_t i = 0; i + 2 < indices_.size(); i += 3) {
+		const glm::vec3& p0 = positions[indices_[i]];
+		glm::vec3 normal = glm::cross(positions[indices_[i + 1]] - p0, positions[indices_[i + 2]] - p0);
+		for (size_t k = 0; k < 3; k++) {
+			data.normals[indices_[i + k]] += normal;
+		}
+	}
+	for (glm::vec3& normal : data.normals) {
+		float length = glm::length(normal);
+		if (length > 0.0f) normal /= length;
+	}
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	read_milliseconds_ = 0.9 * read_milliseconds_.load() + 0.1 * milliseconds;
+}
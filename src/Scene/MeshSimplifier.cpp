@@ -0,0 +1,223 @@
+// MeshSimplifier.cpp
+#include "Scene/MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+	// symmetric 4x4 plane quadric, upper triangle
+	struct Quadric {
+		double a[10] = {};
+
+		static Quadric FromPlane(const glm::dvec3& n, double d, double weight) {
+			Quadric q;
+			double p[4] = {n.x, n.y, n.z, d};
+			int k = 0;
+			for (int i = 0; i < 4; ++i) {
+				for (int j = i; j < 4; ++j) {
+					q.a[k++] = weight * p[i] * p[j];
+				}
+			}
+			return q;
+		}
+		Quadric& operator+=(const Quadric& other) {
+			for (int k = 0; k < 10; ++k) a[k] += other.a[k];
+			return *this;
+		}
+		double Evaluate(const glm::vec3& v) const {
+			double x = v.x, y = v.y, z = v.z;
+			return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+			     + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+			     + a[7] * z * z + 2 * a[8] * z
+			     + a[9];
+		}
+	};
+
+	struct Collapse {
+		double cost;
+		unsigned int from, to;
+		unsigned int from_version, to_version;
+		bool operator>(const Collapse& other) const { return cost > other.cost; }
+	};
+
+	uint64_t EdgeKey(unsigned int a, unsigned int b) {
+		return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+	}
+
+	float SignedUVArea(const glm::vec2& a, const glm::vec2& b, const glm::vec2& c) {
+		glm::vec2 ab = b - a, ac = c - a;
+		return 0.5f * (ab.x * ac.y - ab.y * ac.x);
+	}
+
+	// how far a UV-to-surface area ratio is from the mesh average, >= 1
+	float StretchDeviation(float uv_area, float area, float mean_ratio) {
+		if (area <= 0.0f || uv_area <= 0.0f) return INFINITY;
+		float ratio = (uv_area / area) / mean_ratio;
+		return std::max(ratio, 1.0f / ratio);
+	}
+} // namespace
+
+mesh_simplifier::SimplifiedMesh mesh_simplifier::Simplify(const std::vector<glm::vec3>& positions, const std::vector<glm::vec2>& tex_coords,
+                                                          const std::vector<unsigned int>& indices, const std::vector<unsigned int>& corner_tex_coords,
+                                                          const SimplifyOptions& options) {
+	size_t num_vertices = positions.size();
+	size_t num_faces = indices.size() / 3;
+	std::vector<unsigned int> faces(indices); // updated in place by collapses
+	std::vector<bool> face_alive(num_faces, true);
+	std::vector<bool> vertex_alive(num_vertices, true);
+	std::vector<unsigned int> version(num_vertices, 0);
+	std::vector<std::vector<unsigned int>> vertex_faces(num_vertices);
+	std::vector<Quadric> quadrics(num_vertices);
+
+	auto face_normal = [&](unsigned int f) {
+		return glm::cross(positions[faces[3 * f + 1]] - positions[faces[3 * f]], positions[faces[3 * f + 2]] - positions[faces[3 * f]]);
+	};
+
+	// quadrics, adjacency and the mean UV stretch of the input
+	double uv_area_sum = 0.0, area_sum = 0.0;
+	std::unordered_map<uint64_t, int> edge_faces;
+	for (unsigned int f = 0; f < num_faces; ++f) {
+		glm::vec3 n = face_normal(f);
+		float double_area = glm::length(n);
+		for (int k = 0; k < 3; ++k) {
+			vertex_faces[faces[3 * f + k]].push_back(f);
+			edge_faces[EdgeKey(faces[3 * f + k], faces[3 * f + (k + 1) % 3])]++;
+		}
+		area_sum += 0.5 * double_area;
+		uv_area_sum += std::abs(SignedUVArea(tex_coords[faces[3 * f]], tex_coords[faces[3 * f + 1]], tex_coords[faces[3 * f + 2]]));
+		if (double_area <= 0.0f) continue;
+		glm::dvec3 unit_n = glm::dvec3(n) / static_cast<double>(double_area);
+		double d = -glm::dot(unit_n, glm::dvec3(positions[faces[3 * f]]));
+		Quadric q = Quadric::FromPlane(unit_n, d, 0.5 * double_area);
+		for (int k = 0; k < 3; ++k) quadrics[faces[3 * f + k]] += q;
+	}
+	float mean_uv_ratio = (area_sum > 0.0 && uv_area_sum > 0.0) ? static_cast<float>(uv_area_sum / area_sum) : 1.0f;
+
+	// seams and boundaries are not collapsed
+	std::vector<bool> locked(num_vertices, false);
+	for (const auto& [key, count] : edge_faces) {
+		if (count != 2) {
+			locked[static_cast<unsigned int>(key >> 32)] = true;
+			locked[static_cast<unsigned int>(key & 0xffffffffu)] = true;
+		}
+	}
+	if (corner_tex_coords.size() == indices.size()) {
+		constexpr unsigned int kNoTexCoord = ~0u;
+		std::vector<unsigned int> vertex_tex_coord(num_vertices, kNoTexCoord);
+		for (size_t i = 0; i < indices.size(); ++i) {
+			unsigned int& first = vertex_tex_coord[indices[i]];
+			if (first == kNoTexCoord) first = corner_tex_coords[i];
+			else if (first != corner_tex_coords[i]) locked[indices[i]] = true;
+		}
+	}
+
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+	auto push_collapse = [&](unsigned int from, unsigned int to) {
+		if (locked[from]) return;
+		Quadric q = quadrics[from];
+		q += quadrics[to];
+		heap.push({std::max(0.0, q.Evaluate(positions[to])), from, to, version[from], version[to]});
+	};
+	auto neighbors = [&](unsigned int v) {
+		std::vector<unsigned int> result;
+		for (unsigned int f : vertex_faces[v]) {
+			for (int k = 0; k < 3; ++k) {
+				if (faces[3 * f + k] != v) result.push_back(faces[3 * f + k]);
+			}
+		}
+		std::sort(result.begin(), result.end());
+		result.erase(std::unique(result.begin(), result.end()), result.end());
+		return result;
+	};
+	for (unsigned int v = 0; v < num_vertices; ++v) {
+		for (unsigned int w : neighbors(v)) push_collapse(v, w);
+	}
+
+	// moving "from" onto "to" must keep the mesh manifold, not fold triangles and not stretch the UVs
+	auto is_valid_collapse = [&](unsigned int from, unsigned int to) {
+		std::vector<unsigned int> from_neighbors = neighbors(from);
+		if (!std::binary_search(from_neighbors.begin(), from_neighbors.end(), to)) return false;
+		std::vector<unsigned int> to_neighbors = neighbors(to);
+		std::vector<unsigned int> common;
+		std::set_intersection(from_neighbors.begin(), from_neighbors.end(), to_neighbors.begin(), to_neighbors.end(), std::back_inserter(common));
+		if (common.size() != 2) return false; // link condition of an interior edge
+		for (unsigned int f : vertex_faces[from]) {
+			unsigned int a = faces[3 * f], b = faces[3 * f + 1], c = faces[3 * f + 2];
+			if (a == to || b == to || c == to) continue; // removed by the collapse
+			glm::vec3 old_n = face_normal(f);
+			unsigned int na = (a == from) ? to : a, nb = (b == from) ? to : b, nc = (c == from) ? to : c;
+			glm::vec3 new_n = glm::cross(positions[nb] - positions[na], positions[nc] - positions[na]);
+			float new_len = glm::length(new_n), old_len = glm::length(old_n);
+			if (new_len <= 0.0f) return false;
+			if (old_len > 0.0f && glm::dot(new_n, old_n) < options.min_normal_dot * new_len * old_len) return false;
+			// UVs: same orientation and bounded stretch
+			float old_uv = SignedUVArea(tex_coords[a], tex_coords[b], tex_coords[c]);
+			float new_uv = SignedUVArea(tex_coords[na], tex_coords[nb], tex_coords[nc]);
+			if (new_uv * old_uv <= 0.0f) return false;
+			float old_dev = StretchDeviation(std::abs(old_uv), 0.5f * old_len, mean_uv_ratio);
+			float new_dev = StretchDeviation(std::abs(new_uv), 0.5f * new_len, mean_uv_ratio);
+			if (new_dev > std::max(options.max_uv_stretch, old_dev)) return false;
+		}
+		return true;
+	};
+
+	SimplifiedMesh result;
+	size_t target_faces = static_cast<size_t>(options.target_ratio * static_cast<float>(num_faces));
+	size_t live_faces = num_faces;
+	while (live_faces > target_faces && !heap.empty()) {
+		Collapse collapse = heap.top(); heap.pop();
+		unsigned int from = collapse.from, to = collapse.to;
+		if (!vertex_alive[from] || !vertex_alive[to]) continue;
+		if (collapse.from_version != version[from] || collapse.to_version != version[to]) continue; // stale
+		if (!is_valid_collapse(from, to)) continue;
+
+		for (unsigned int f : vertex_faces[from]) {
+			unsigned int* face = &faces[3 * f];
+			if (face[0] == to || face[1] == to || face[2] == to) {
+				face_alive[f] = false;
+				live_faces--;
+				for (int k = 0; k < 3; ++k) {
+					if (face[k] == from) continue;
+					auto& adjacent = vertex_faces[face[k]];
+					adjacent.erase(std::remove(adjacent.begin(), adjacent.end(), f), adjacent.end());
+				}
+				continue;
+			}
+			for (int k = 0; k < 3; ++k) {
+				if (face[k] == from) face[k] = to;
+			}
+			vertex_faces[to].push_back(f);
+		}
+		vertex_faces[from].clear();
+		vertex_alive[from] = false;
+		quadrics[to] += quadrics[from];
+		result.max_error = std::max(result.max_error, static_cast<float>(std::sqrt(collapse.cost)));
+
+		// every queued collapse onto or from "to" is now stale
+		version[to]++;
+		for (unsigned int w : neighbors(to)) {
+			push_collapse(to, w);
+			push_collapse(w, to);
+		}
+	}
+
+	// compact, vertices in order of first use
+	constexpr unsigned int kUnassigned = ~0u;
+	std::vector<unsigned int> new_index(num_vertices, kUnassigned);
+	result.indices.reserve(3 * live_faces);
+	for (unsigned int f = 0; f < num_faces; ++f) {
+		if (!face_alive[f]) continue;
+		for (int k = 0; k < 3; ++k) {
+			unsigned int v = faces[3 * f + k];
+			if (new_index[v] == kUnassigned) {
+				new_index[v] = static_cast<unsigned int>(result.vertex_order.size());
+				result.vertex_order.push_back(v);
+			}
+			result.indices.push_back(new_index[v]);
+		}
+	}
+	return result;
+}
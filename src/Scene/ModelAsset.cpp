@@ -0,0 +1,432 @@
+// ModelAsset.cpp
+#include "Scene/ModelAsset.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+#include <stb_image.h>
+#include <glm/glm.hpp>
+
+#include "Scene/Parser.h"
+#include "Scene/MeshSimplifier.h"
+
+ModelAsset::ModelAsset(const std::string& path, const ModelLoadOptions& load_options, size_t content_hash)
+    : content_hash_(content_hash), load_options_(load_options) {
+  LoadModel(path);
+}
+
+ModelAsset::~ModelAsset() {
+  glDeleteVertexArrays(1, &bbox_VAO_);
+  glDeleteBuffers(1, &bbox_VBO_);
+  glDeleteBuffers(1, &bbox_EBO_);
+}
+
+size_t ModelAsset::ComputeContentHash(const std::string& path, const ModelLoadOptions& load_options) {
+  std::string mtllib_path, texture_path;
+  GetMaterialFiles(path, mtllib_path, texture_path);
+  // the files are hashed as they are read, a large OBJ is not held in memory
+  std::stringstream key;
+  key << ComputeFileKey(path) << "|" << ComputeFileKey(mtllib_path) << "|" << ComputeFileKey(texture_path)
+      << "|" << load_options.reorder_triangles << "|" << load_options.num_lods << "|" << load_options.out_of_core
+      << "|" << load_options.incremental_edits;
+  return std::hash<std::string>{}(key.str());
+}
+
+std::vector<std::unique_ptr<Mesh>>& ModelAsset::GetLODMeshes(unsigned int lod) {
+  return (lod == 0 || lods_.empty()) ? meshes_ : lods_[std::min<size_t>(lod, lods_.size()) - 1];
+}
+
+void ModelAsset::GetModelName(const std::string& path) {
+  size_t last_slash_idx = path.find_last_of("\\/");
+  if (std::string::npos != last_slash_idx) {
+    directory_ = path.substr(0, last_slash_idx);
+    model_name_ = path.substr(last_slash_idx + 1, path.size() - 5 - last_slash_idx);
+  } else {
+    model_name_ = path.substr(0, path.size() - 4);
+  }
+}
+
+void ModelAsset::ParseMeshData(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, std::vector<glm::vec3>& face_normals,
+                               glm::vec2& vt_min, float& vt_max_delta, unsigned int& num_ring_faces,
+                               std::vector<unsigned int>* corner_tex_coords) {
+  std::string texture_path;
+  glm::vec3 v_min, v_max;
+  ParseObjFile(path_, vertices, indices, face_normals, texture_path, v_min, v_max, vt_min, vt_max_delta, num_ring_faces, corner_tex_coords);
+  texture_path_ = texture_path;
+  bbox_.min_ = v_min;
+  bbox_.max_ = v_max;
+}
+
+void ModelAsset::LoadModel(const std::string& path) {
+  GetModelName(path);
+  path_ = path;
+  // init variables
+  std::vector<Vertex> vertices;
+  std::vector<unsigned int> indices;
+  std::vector<glm::vec3> face_normals;
+  glm::vec2 vt_min;
+  float vt_max_delta;
+  unsigned int num_ring_faces = 0;
+  std::vector<unsigned int> corner_tex_coords; // UV seams of the LODs
+
+  ParseMeshData(vertices, indices, face_normals, vt_min, vt_max_delta, num_ring_faces, &corner_tex_coords);
+
+  // create texture
+  texture_ = TextureFromFile(texture_path_);
+  meshes_.push_back(std::make_unique<Mesh>(vertices, indices, texture_->id, face_normals, this));
+  meshes_[0]->num_ring_faces_ = num_ring_faces;
+  
+  
+  SetupBBOX();
+  Normalize_UV(vt_min, vt_max_delta);
+  // a chunk keeps the triangle order of its file, with the boundary ring last, so that it can be parsed again
+  bool is_chunk = load_options_.out_of_core || num_ring_faces > 0;
+  if (!is_chunk) BuildLODs(corner_tex_coords);
+  for (unsigned int lod = 0; lod < GetNumLODs(); ++lod) {
+    for (auto& mesh : GetLODMeshes(lod)) {
+      if (load_options_.reorder_triangles && !is_chunk) {
+        mesh->ReorderTriangles();
+      }
+      mesh->InitBuffers(); // the BPM data is made when a texture type first needs it, see RequestBPMData
+    }
+  }
+  // a store of the parse order, written by bpm_precompute or by the precompute of an earlier run of a chunk
+  bool has_store = !load_options_.reorder_triangles && std::filesystem::exists(path + kBPMStoreExtension);
+  if (load_options_.out_of_core || has_store) {
+    meshes_[0]->OpenBPMStore(path + kBPMStoreExtension, ComputeFileKey(path));
+  }
+}
+
+bool ModelAsset::RequestBPMData(BPMData level) {
+  BPMData requested = requested_bpm_data_.load();
+  while (requested < level) {
+    if (requested_bpm_data_.compare_exchange_weak(requested, level)) return true;
+  }
+  return false;
+}
+
+bool ModelAsset::RequestRestore() {
+  return !IsResident() && !restore_requested_.exchange(true);
+}
+
+bool ModelAsset::PrecomputeStep() {
+  std::lock_guard<std::mutex> lock(precompute_mutex_);
+  if (restore_requested_.load() && !IsResident()) {
+    RestoreGeometry();
+    return true;
+  }
+  if (load_options_.out_of_core && !IsResident()) return false; // the mesh data comes back with the geometry
+  BPMData requested = requested_bpm_data_.load();
+  // one mesh at a time, full detail first: only its intermediate buffers exist, and the next mesh begins when
+  // it is done. The others are drawn without the level until their turn.
+  for (unsigned int lod = 0; lod < GetNumLODs(); ++lod) {
+    for (auto& mesh : GetLODMeshes(lod)) {
+      if (mesh->IsDeforming()) continue; // its BPM data comes from the deform pass until EndDeformation
+      if (mesh->IsPrecomputing()) {
+        mesh->PrecomputeChunk(mesh->GetPrecomputeChunkSize());
+        return true; // a lower level that finished is followed by the requested one on the next step
+      }
+      if (!mesh->HasBPMData(requested)) {
+        mesh->BeginPrecompute(requested);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void ModelAsset::ComputeBPMData() {
+  while (PrecomputeStep()) {}
+}
+
+bool ModelAsset::HasBPMData(BPMData level) const {
+  auto all_have = [level](const std::vector<std::unique_ptr<Mesh>>& meshes) {
+    return std::all_of(meshes.begin(), meshes.end(), [level](const std::unique_ptr<Mesh>& mesh) { return mesh->HasBPMData(level); });
+  };
+  return all_have(meshes_) && std::all_of(lods_.begin(), lods_.end(), all_have);
+}
+
+bool ModelAsset::UpdateVertices(unsigned int mesh_idx, const std::vector<unsigned int>& vertex_ids,
+                                const std::vector<glm::vec3>& positions, const std::vector<glm::vec2>& tex_coords) {
+  if (mesh_idx >= meshes_.size()) {
+    std::cerr << "ERROR::MODEL_ASSET::UPDATE_VERTICES::INVALID_MESH: " << mesh_idx << " of " << model_name_ << std::endl;
+    return false;
+  }
+  std::unique_lock<std::mutex> lock(precompute_mutex_, std::try_to_lock);
+  if (!lock) return false; // a loader thread is in PrecomputeStep, the render thread does not wait for it
+  return meshes_[mesh_idx]->UpdateVertices(vertex_ids, positions, tex_coords);
+}
+
+// ---------------------- DEFORMATION ---------------------- //
+bool ModelAsset::BeginDeformation() {
+  std::unique_lock<std::mutex> lock(precompute_mutex_, std::try_to_lock);
+  if (!lock || !IsResident()) return false;
+  if (std::any_of(meshes_.begin(), meshes_.end(), [](const std::unique_ptr<Mesh>& mesh) { return mesh->IsPrecomputing(); })) return false;
+  for (auto& mesh : meshes_) {
+    if (!mesh->BeginDeformation()) {
+      for (auto& begun : meshes_) begun->EndDeformation();
+      return false;
+    }
+  }
+  rest_bbox_ = bbox_;
+  return true;
+}
+
+bool ModelAsset::EndDeformation() {
+  std::unique_lock<std::mutex> lock(precompute_mutex_, std::try_to_lock);
+  if (!lock) return false;
+  for (auto& mesh : meshes_) {
+    mesh->EndDeformation();
+  }
+  SetBBox(rest_bbox_.min_, rest_bbox_.max_);
+  // the next draw requests the level it needs
+  requested_bpm_data_.store(BPMData::NONE);
+  return true;
+}
+
+bool ModelAsset::UpdateDeformation() {
+  bool swapped = false;
+  for (auto& mesh : meshes_) {
+    swapped = mesh->UpdateDeformation() || swapped;
+  }
+  return swapped;
+}
+
+double ModelAsset::GetDeformMilliseconds() const {
+  double milliseconds = 0.0;
+  for (const auto& mesh : meshes_) {
+    milliseconds += mesh->GetDeformMilliseconds();
+  }
+  return milliseconds;
+}
+
+// ---------------------- RESIDENCY ---------------------- //
+void ModelAsset::UpdateResidentBytes() {
+  std::unique_lock<std::mutex> lock(precompute_mutex_, std::try_to_lock);
+  if (!lock) return;
+  resident_bpm_data_bytes_ = 0;
+  resident_geometry_bytes_ = IsResident() ? GetTextureBytes() : 0;
+  for (unsigned int lod = 0; lod < GetNumLODs(); ++lod) {
+    for (auto& mesh : GetLODMeshes(lod)) {
+      resident_bpm_data_bytes_ += mesh->GetBPMDataBytes();
+      resident_geometry_bytes_ += mesh->GetGeometryBytes();
+    }
+  }
+}
+
+size_t ModelAsset::EvictBPMData() {
+  std::unique_lock<std::mutex> lock(precompute_mutex_, std::try_to_lock);
+  if (!lock || IsDeforming()) return 0;
+  size_t bytes = 0;
+  for (unsigned int lod = 0; lod < GetNumLODs(); ++lod) {
+    for (auto& mesh : GetLODMeshes(lod)) {
+      bytes += mesh->EvictBPMData();
+    }
+  }
+  // the next draw that needs it requests it again, then PrecomputeStep uploads the copies
+  requested_bpm_data_.store(BPMData::NONE);
+  resident_bpm_data_bytes_ -= std::min(bytes, resident_bpm_data_bytes_);
+  return bytes;
+}
+
+size_t ModelAsset::EvictGeometry() {
+  std::unique_lock<std::mutex> lock(precompute_mutex_, std::try_to_lock);
+  if (!lock || !IsResident() || IsDeforming()) return 0;
+  resident_.store(false, std::memory_order_release);
+  size_t bytes = GetTextureBytes();
+  texture_.reset(); // deleted with the last asset of the image
+  for (unsigned int lod = 0; lod < GetNumLODs(); ++lod) {
+    for (auto& mesh : GetLODMeshes(lod)) {
+      mesh->texture_id_ = 0;
+      bytes += mesh->EvictGeometry();
+      if (load_options_.out_of_core) mesh->ReleaseMeshData();
+    }
+  }
+  resident_geometry_bytes_ = 0;
+  return bytes;
+}
+
+void ModelAsset::RestoreGeometry() {
+  if (load_options_.out_of_core && meshes_[0]->vertices_.empty()) {
+    Mesh& mesh = *meshes_[0];
+    glm::vec2 vt_min;
+    float vt_max_delta;
+    unsigned int num_ring_faces = 0;
+    ParseMeshData(mesh.vertices_, mesh.indices_, mesh.face_normals_, vt_min, vt_max_delta, num_ring_faces);
+    Normalize_UV(vt_min, vt_max_delta);
+  }
+  texture_ = TextureFromFile(texture_path_);
+  for (unsigned int lod = 0; lod < GetNumLODs(); ++lod) {
+    for (auto& mesh : GetLODMeshes(lod)) {
+      mesh->texture_id_ = texture_->id;
+      mesh->UploadGeometry();
+    }
+  }
+  // the render thread draws the asset as soon as it is resident
+  glFinish();
+  restore_requested_.store(false);
+  resident_.store(true, std::memory_order_release);
+}
+
+void ModelAsset::BuildLODs(const std::vector<unsigned int>& corner_tex_coords) {
+  float target_ratio = 1.0f;
+  for (unsigned int lod = 1; lod < load_options_.num_lods; ++lod) {
+    target_ratio *= 0.5f;
+    mesh_simplifier::SimplifyOptions options;
+    options.target_ratio = target_ratio;
+    std::vector<std::unique_ptr<Mesh>> lod_meshes;
+    float lod_error = 0.0f;
+    for (auto& mesh : meshes_) {
+      std::vector<glm::vec3> positions(mesh->vertices_.size());
+      std::vector<glm::vec2> tex_coords(mesh->vertices_.size());
+      for (size_t i = 0; i < mesh->vertices_.size(); i++) {
+        positions[i] = mesh->vertices_[i].position_;
+        tex_coords[i] = mesh->vertices_[i].tex_coords_;
+      }
+      mesh_simplifier::SimplifiedMesh simplified = mesh_simplifier::Simplify(positions, tex_coords, mesh->indices_, corner_tex_coords, options);
+      std::vector<Vertex> vertices; vertices.reserve(simplified.vertex_order.size());
+      for (unsigned int old_idx : simplified.vertex_order) {
+        vertices.push_back(mesh->vertices_[old_idx]);
+      }
+      std::vector<glm::vec3> face_normals; face_normals.reserve(simplified.indices.size() / 3);
+      for (size_t f = 0; f < simplified.indices.size() / 3; ++f) {
+        face_normals.push_back(geometry::ComputeFaceNormal(vertices[simplified.indices[3 * f]].position_,
+                                                           vertices[simplified.indices[3 * f + 1]].position_,
+                                                           vertices[simplified.indices[3 * f + 2]].position_));
+      }
+      lod_error = std::max(lod_error, simplified.max_error);
+      std::cout << "LOD " << lod << " of " << model_name_ << ": " << mesh->num_faces_ << " -> " << simplified.indices.size() / 3
+                << " triangles, error " << simplified.max_error << std::endl;
+      lod_meshes.push_back(std::make_unique<Mesh>(vertices, simplified.indices, mesh->texture_id_, face_normals, this));
+    }
+    lods_.push_back(std::move(lod_meshes));
+    lod_errors_.push_back(lod_error);
+  }
+}
+
+void ModelAsset::SetupBBOX() {
+// ---------- BBOX ------------- //
+    bbox_.center_ = 0.5f * (bbox_.min_ + bbox_.max_);
+    bbox_.size_ = bbox_.max_ - bbox_.min_;
+    bbox_.largest_dimension_ = std::max(bbox_.size_.x, std::max(bbox_.size_.y, bbox_.size_.z));
+    bbox_.ComputeBBoxVertices();
+    // BBOX vertices to VBO, EBO. The VAO is made by the drawing context, see GetBBoxVAO
+    glGenBuffers(1, &bbox_VBO_);
+    glGenBuffers(1, &bbox_EBO_);
+    // VBO
+    glBindBuffer(GL_ARRAY_BUFFER, bbox_VBO_);
+    glBufferData(GL_ARRAY_BUFFER, bbox_.vertices_.size() * sizeof(float), bbox_.vertices_.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // EBO
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bbox_EBO_);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, bbox_.indices_.size() * sizeof(unsigned int),bbox_.indices_.data() , GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void ModelAsset::SetBBox(const glm::vec3& v_min, const glm::vec3& v_max) {
+    bbox_.min_ = v_min;
+    bbox_.max_ = v_max;
+    bbox_.center_ = 0.5f * (bbox_.min_ + bbox_.max_);
+    bbox_.size_ = bbox_.max_ - bbox_.min_;
+    bbox_.largest_dimension_ = std::max(bbox_.size_.x, std::max(bbox_.size_.y, bbox_.size_.z));
+    bbox_.ComputeBBoxVertices();
+    glBindBuffer(GL_ARRAY_BUFFER, bbox_VBO_);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bbox_.vertices_.size() * sizeof(float), bbox_.vertices_.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+unsigned int ModelAsset::GetBBoxVAO() {
+    if (bbox_VAO_ == 0) {
+        glGenVertexArrays(1, &bbox_VAO_);
+        glBindVertexArray(bbox_VAO_);
+        glBindBuffer(GL_ARRAY_BUFFER, bbox_VBO_);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bbox_EBO_);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindVertexArray(0);
+    }
+    return bbox_VAO_;
+}
+
+// the assets of the same image file split its bytes, so that they add up to the texture once
+size_t ModelAsset::GetTextureBytes() const {
+  long holders = texture_.use_count();
+  return holders > 0 ? texture_->bytes / static_cast<size_t>(holders) : 0;
+}
+
+void ModelAsset::Normalize_UV(const glm::vec2& vt_min, float vt_max_delta) {
+    // normalize texture coordinates
+    for (auto& mesh : meshes_) {
+        NormalizeTexCoords(mesh->vertices_, vt_min, vt_max_delta);
+    }
+}
+
+// TEXTURE LOADING
+SharedTexture::~SharedTexture() {
+  glDeleteTextures(1, &id);
+}
+
+namespace {
+  std::mutex texture_cache_mutex;
+  std::unordered_map<std::string, std::weak_ptr<SharedTexture>> texture_cache; // by canonical path
+}
+
+std::shared_ptr<SharedTexture> TextureFromFile(const std::string& texture_path) {
+  std::error_code error;
+  std::string key = std::filesystem::weakly_canonical(texture_path, error).string();
+  if (error) key = texture_path;
+  {
+    std::lock_guard<std::mutex> lock(texture_cache_mutex);
+    auto cached = texture_cache.find(key);
+    if (cached != texture_cache.end()) {
+      if (std::shared_ptr<SharedTexture> texture = cached->second.lock()) return texture;
+    }
+  }
+  auto texture = std::make_shared<SharedTexture>();
+  glGenTextures(1, &texture->id);
+
+  int width, height, nr_components;
+  unsigned char* data = stbi_load(texture_path.c_str(), &width, &height, &nr_components, 0);
+  if (data) {
+    GLenum format;
+    if (nr_components == 1)
+      format = GL_RED;
+    else if (nr_components == 3)
+      format = GL_RGB;
+    else if (nr_components == 4)
+      format = GL_RGBA;
+
+    glBindTexture(GL_TEXTURE_2D, texture->id);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    stbi_image_free(data);
+  } else {
+    std::cout << "Texture failed to load at path: " << texture_path << std::endl;
+    stbi_image_free(data);
+    return texture; // not cached, the next asset tries again
+  }
+  GLint texel_bits = 0;
+  for (GLenum size : {GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE, GL_TEXTURE_ALPHA_SIZE}) {
+    GLint bits = 0;
+    glGetTextureLevelParameteriv(texture->id, 0, size, &bits);
+    texel_bits += bits;
+  }
+  texture->bytes = static_cast<size_t>(width) * height * texel_bits / 8 * 4 / 3;
+  glFinish(); // the other contexts use it from the cache
+
+  std::lock_guard<std::mutex> lock(texture_cache_mutex);
+  std::weak_ptr<SharedTexture>& cached = texture_cache[key];
+  if (std::shared_ptr<SharedTexture> other = cached.lock()) return other; // loaded by another thread meanwhile
+  cached = texture;
+  return texture;
+}
@@ -7,9 +7,13 @@
 #include <vector>
 #include <filesystem>
 #include <stdexcept>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 
 #include <glm/glm.hpp>
 
+#include "Utils/Files.h"
 #include "Utils/Geometry.h"
 
 namespace fs = std::filesystem;
@@ -48,7 +52,9 @@ void check_file_exists(std::string& path, const std::string& directory, bool thr
     }
 }
 
-void ParseMtlFile(std::string& mtllib_path, const std::string& mtl_name, const std::string& obj_dir, std::string& texture_path) {
+// require_texture: false resolves the texture path as if the file were there, without checking that it is
+void ParseMtlFile(std::string& mtllib_path, const std::string& mtl_name, const std::string& obj_dir, std::string& texture_path,
+                  bool require_texture = true) {
     check_file_exists(mtllib_path, obj_dir);
     std::ifstream mtllib_file(mtllib_path);
     if (!mtllib_file.is_open()) {
@@ -72,7 +78,11 @@ void ParseMtlFile(std::string& mtllib_path, const std::string& mtl_name, const s
             iss >> texture_path;
             std::string mtllib_dir, mtllib_name;
             GetDirAndBaseName(mtllib_path, mtllib_dir, mtllib_name);
-            check_file_exists(texture_path, mtllib_dir);
+            if (require_texture) {
+                check_file_exists(texture_path, mtllib_dir);
+            } else if (!fs::exists(texture_path)) {
+                texture_path = (fs::path(mtllib_dir) / texture_path).string();
+            }
             return;
         }
     }
@@ -89,7 +99,10 @@ void ParseObjFile(const std::string& obj_path,
                   std::vector<glm::vec3>& face_normals,
                   std::string& texture_path,
                   glm::vec3& v_min, glm::vec3& v_max,
-                  glm::vec2& vt_min, float& vt_max_delta) 
+                  glm::vec2& vt_min, float& vt_max_delta,
+                  unsigned int& num_ring_faces,
+                  std::vector<unsigned int>* corner_tex_coords,
+                  bool require_texture) 
 {
     std::ifstream obj_file(obj_path);
     if (!obj_file.is_open()) {
@@ -101,6 +114,9 @@ void ParseObjFile(const std::string& obj_path,
     std::vector<Face> temp_faces;
     // texture
     std::string mtllib_path, mtl_name;
+    // boundary ring of a chunk, the faces after its group line
+    num_ring_faces = 0;
+    bool in_ring = false;
     // ranges
     vt_min = glm::vec2(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
     glm::vec2 vt_max = glm::vec2(std::numeric_limits<float>::min(), std::numeric_limits<float>::min());
@@ -145,6 +161,8 @@ void ParseObjFile(const std::string& obj_path,
         {
             char slash;
             Face face;
+            face.vtIdx[0] = face.vtIdx[1] = face.vtIdx[2] = ~0u; // no "vt"
+            face.vnIdx[0] = face.vnIdx[1] = face.vnIdx[2] = ~0u;
             // Parse face indices
             for (int i = 0; i < 3; ++i) {
                 unsigned int vIdx;
@@ -165,6 +183,13 @@ void ParseObjFile(const std::string& obj_path,
                 }
             }
             temp_faces.push_back(face);
+            if (corner_tex_coords) corner_tex_coords->insert(corner_tex_coords->end(), face.vtIdx, face.vtIdx + 3);
+            if (in_ring) num_ring_faces++;
+        }
+        else if (token == "g") {
+            std::string group;
+            iss >> group;
+            in_ring = (group == kBoundaryRingGroup);
         }
 
         else if (token == "mtllib") {
@@ -201,5 +226,110 @@ void ParseObjFile(const std::string& obj_path,
     // get texture path
     std::string obj_directory, model_name;
     GetDirAndBaseName(obj_path, obj_directory, model_name);
-    ParseMtlFile(mtllib_path, mtl_name, obj_directory, texture_path);
+    ParseMtlFile(mtllib_path, mtl_name, obj_directory, texture_path, require_texture);
+}
+
+void GetMaterialFiles(const std::string& obj_path, std::string& mtllib_path, std::string& texture_path) {
+    mtllib_path.clear();
+    texture_path.clear();
+    std::ifstream obj_file(obj_path);
+    std::string line, mtl_name;
+    while (std::getline(obj_file, line)) {
+        if (line.compare(0, 7, "mtllib ") != 0 && line.compare(0, 7, "usemtl ") != 0) continue;
+        std::istringstream iss(line);
+        std::string token;
+        iss >> token;
+        iss >> (token == "mtllib" ? mtllib_path : mtl_name);
+    }
+    if (mtllib_path.empty() || mtl_name.empty()) return;
+    std::string obj_directory, model_name;
+    GetDirAndBaseName(obj_path, obj_directory, model_name);
+    try {
+        ParseMtlFile(mtllib_path, mtl_name, obj_directory, texture_path);
+    } catch (const std::exception&) {
+        if (!fs::exists(mtllib_path)) mtllib_path.clear();
+        texture_path.clear();
+    }
+}
+
+void NormalizeTexCoords(std::vector<Vertex>& vertices, const glm::vec2& vt_min, float vt_max_delta) {
+    for (auto& vertex : vertices) {
+        vertex.tex_coords_ = (vertex.tex_coords_ - vt_min) / vt_max_delta;
+    }
+}
+
+void LoadMeshData(const std::string& obj_path, MeshData& mesh) {
+    glm::vec2 vt_min;
+    float vt_max_delta;
+    ParseObjFile(obj_path, mesh.vertices, mesh.indices, mesh.face_normals, mesh.texture_path, mesh.v_min, mesh.v_max, vt_min, vt_max_delta,
+                 mesh.num_ring_faces, nullptr, false);
+    NormalizeTexCoords(mesh.vertices, vt_min, vt_max_delta);
+}
+
+void ParseObjPositions(const std::string& obj_path, std::vector<glm::vec3>& positions) {
+    std::ifstream obj_file(obj_path, std::ios::binary | std::ios::ate);
+    if (!obj_file.is_open()) {
+        throw std::runtime_error("Could not open .obj file: " + obj_path);
+    }
+    // one read of the whole file, then strtof in place: no line copies or streams per vertex
+    std::string text(static_cast<size_t>(obj_file.tellg()), '\0');
+    obj_file.seekg(0);
+    obj_file.read(&text[0], text.size());
+    positions.clear();
+    const char* cursor = text.c_str();
+    const char* end = cursor + text.size();
+    while (cursor < end) {
+        if (cursor[0] == 'v' && (cursor[1] == ' ' || cursor[1] == '\t')) {
+            char* next = nullptr;
+            glm::vec3 position;
+            position.x = std::strtof(cursor + 2, &next);
+            position.y = std::strtof(next, &next);
+            position.z = std::strtof(next, &next);
+            positions.push_back(position);
+            cursor = next;
+        }
+        const char* line_end = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+        cursor = line_end ? line_end + 1 : end;
+    }
+}
+
+namespace {
+    constexpr char kPositionsMagic[8] = {'B', 'P', 'M', 'P', 'O', 'S', '0', '1'};
+}
+
+void ReadPositionsFile(const std::string& path, std::vector<glm::vec3>& positions) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[8];
+    uint64_t count = 0;
+    if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, kPositionsMagic, sizeof(magic)) != 0 ||
+        !file.read(reinterpret_cast<char*>(&count), sizeof(count))) {
+        throw std::runtime_error("Not a positions file: " + path);
+    }
+    positions.resize(count);
+    if (!file.read(reinterpret_cast<char*>(positions.data()), count * sizeof(glm::vec3))) {
+        throw std::runtime_error("Truncated positions file: " + path);
+    }
+}
+
+void WritePositionsFile(const std::string& path, const std::vector<glm::vec3>& positions) {
+    // written next to the final name and renamed, a reader never sees a partial file
+    std::string temp_path = files::MakeTempPath(path);
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        uint64_t count = positions.size();
+        file.write(kPositionsMagic, sizeof(kPositionsMagic));
+        file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        file.write(reinterpret_cast<const char*>(positions.data()), count * sizeof(glm::vec3));
+        if (!file) {
+            file.close();
+            std::error_code error;
+            fs::remove(temp_path, error);
+            throw std::runtime_error("Could not write positions file: " + temp_path);
+        }
+    }
+    if (!files::RenameReplacing(temp_path, path)) {
+        std::error_code error;
+        fs::remove(temp_path, error);
+        throw std::runtime_error("Could not rename positions file: " + path);
+    }
 }
@@ -1,5 +1,8 @@
 // Scene.cpp
 #include "Scene/Scene.h"
+
+#include <algorithm>
+
 #include "Render/Renderer.h"
 #include <glm/gtc/type_ptr.hpp>
 
@@ -16,8 +19,47 @@ void Scene::SetupScene(const std::string& model_path) {
 //                      Model                        //
 // --------------------------------------------------//
 void Scene::AddModel(const std::string& path){
-	models_.emplace_back(std::make_unique<MeshModel>(path));
+	size_t content_hash = ModelAsset::ComputeContentHash(path, load_options_);
+	std::shared_ptr<ModelAsset> asset = assets_[content_hash].lock();
+	if (asset) {
+		std::cout << "Scene::AddModel() " << path << " is already loaded, adding an instance" << std::endl;
+	} else {
+		asset = std::make_shared<ModelAsset>(path, load_options_, content_hash);
+	}
+	AddModel(asset);
+}
+
+MeshModel* Scene::AddModel(std::shared_ptr<ModelAsset> asset){
+	// an asset loaded in the background may have been loaded meanwhile by another path, then that one is used
+	if (std::shared_ptr<ModelAsset> loaded = assets_[asset->content_hash_].lock()) {
+		asset = loaded;
+	} else {
+		assets_[asset->content_hash_] = asset;
+	}
+	std::string model_name = asset->model_name_;
+	size_t num_instances = std::count_if(models_.begin(), models_.end(), [&asset](const std::unique_ptr<MeshModel>& model) { return model->asset_ == asset; });
+	if (num_instances > 0) {
+		model_name += " (" + std::to_string(num_instances + 1) + ")";
+	}
+	models_.emplace_back(std::make_unique<MeshModel>(asset, model_name));
 	active_model_idx_ = models_.size() - 1;
+	return models_.back().get();
+}
+
+MeshModel* Scene::AddInstance(MeshModel* source){
+	std::shared_ptr<ModelAsset> asset = source->asset_;
+	models_.emplace_back(std::make_unique<MeshModel>(asset, asset->model_name_ + " (" + std::to_string(asset.use_count()) + ")"));
+	MeshModel* instance = models_.back().get();
+	instance->model_pitch_yaw_roll_ = source->model_pitch_yaw_roll_;
+	instance->model_scale_ = source->model_scale_;
+	// next to the source, one bounding box apart
+	instance->SetTranslation(source->GetTranslation() + glm::vec3(source->GetScale() * instance->GetBBox().size_.x * 1.2f, 0.0f, 0.0f));
+	instance->draw_fill_ = source->draw_fill_;
+	instance->draw_wireframe_ = source->draw_wireframe_;
+	instance->draw_points_ = source->draw_points_;
+	instance->draw_normals_ = source->draw_normals_;
+	active_model_idx_ = models_.size() - 1;
+	return instance;
 }
 
 MeshModel* Scene::GetActiveModel() {
@@ -38,6 +80,22 @@ MeshModel* Scene::GetModel(unsigned int idx) {
 	return nullptr;
 }
 
+size_t Scene::GetChangeStamp() const {
+	size_t stamp = models_.size();
+	auto combine = [&stamp](size_t value) { stamp = stamp * 31 + value; };
+	combine(static_cast<size_t>(active_camera_idx_));
+	for (const auto& camera : cameras_) {
+		combine(camera->version_);
+	}
+	for (const auto& model : models_) {
+		combine(model->version_);
+		combine(model->should_draw_ | model->draw_fill_ << 1 | model->draw_wireframe_ << 2 | model->draw_points_ << 3 |
+		        model->draw_bbox_ << 4 | model->draw_normals_ << 5);
+		combine(static_cast<size_t>(model->forced_lod_ + 1));
+	}
+	return stamp;
+}
+
 std::vector<std::unique_ptr<MeshModel>>& Scene::GetModels() { 
 	return models_;
 }
@@ -1,17 +1,19 @@
 #include "UI/Callbacks.h"
 
+#include <cfloat>
+
 #include "imgui.h"
-#include "imgui_impl_glfw.h"
-#include "imgui_impl_opengl3.h"
 
 #include "UI/ControlState.h" 
 #include "Scene/Scene.h"        
 #include "Scene/Camera.h"
+#include "Render/RenderThread.h"
 
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
 void KeyboardCallback(GLFWwindow *window, int key, int scancode, int action, int mods) {
+    renderer->RequestRedraw(); // the UI may react to any input
     if (const auto& io = ImGui::GetIO(); io.WantCaptureKeyboard) { return; }
     ControlState *control_state = static_cast<ControlState*>(glfwGetWindowUserPointer(window));
     Camera *active_camera = scene->GetActiveCamera();
@@ -32,6 +34,7 @@ void KeyboardCallback(GLFWwindow *window, int key, int scancode, int action, int
         {
         case GLFW_KEY_ESCAPE:
             glfwSetWindowShouldClose(window, true);
+            glfwPostEmptyEvent(); // wakes up the main thread, which is waiting for events
             break;
         case GLFW_KEY_H:
             if (control_state->ctrl_pressed) {
@@ -95,6 +98,7 @@ void FramebufferSizeCallback(GLFWwindow *window, int width, int height) {
 }
 
 void MousePosCallback(GLFWwindow *window, double x_pos_in, double y_pos_in) {
+    renderer->RequestRedraw();
     if (const auto& io = ImGui::GetIO(); io.WantCaptureMouse) { return; }
     ControlState* control_state = static_cast<ControlState*>(glfwGetWindowUserPointer(window));
 
@@ -128,6 +132,7 @@ void MousePosCallback(GLFWwindow *window, double x_pos_in, double y_pos_in) {
 }
 
 void ScrollCallback(GLFWwindow *window, double x_offset, double y_offset) {
+    renderer->RequestRedraw();
     if (const auto& io = ImGui::GetIO(); io.WantCaptureMouse) { return; }
     ControlState* control_state = static_cast<ControlState*>(glfwGetWindowUserPointer(window));
     Camera* active_camera = scene->GetActiveCamera();
@@ -141,6 +146,7 @@ void ScrollCallback(GLFWwindow *window, double x_offset, double y_offset) {
 }
 
 void MouseButtonCallback(GLFWwindow *window, int button, int action, int mods) {
+    renderer->RequestRedraw();
     if (const auto& io = ImGui::GetIO(); io.WantCaptureMouse) { return;}
     ControlState* control_state = static_cast<ControlState*>(glfwGetWindowUserPointer(window));
     if (button == GLFW_MOUSE_BUTTON_LEFT) {
@@ -150,3 +156,150 @@ void MouseButtonCallback(GLFWwindow *window, int button, int action, int mods) {
         control_state->right_mouse_pressed = (action == GLFW_PRESS);
     }
 }
+
+void WindowRefreshCallback(GLFWwindow *window) {
+    renderer->RequestRedraw(); // exposed or resized, the contents are damaged
+}
+
+// ---------------------------------------------------------------------------------------------
+namespace {
+    void PostToRenderThread(CommandQueue::Command command) {
+        if (render_thread != nullptr) { // not after shutdown, glfwTerminate may still send events
+            render_thread->Post(std::move(command));
+        }
+    }
+
+    // ImGui input from the event data alone. The GLFW backend would query the window for modifiers, cursor
+    // and size, which is main thread only, so the render thread feeds ImGui itself.
+    ImGuiKey ToImGuiKey(int key) {
+        if (key >= GLFW_KEY_0 && key <= GLFW_KEY_9) return static_cast<ImGuiKey>(ImGuiKey_0 + (key - GLFW_KEY_0));
+        if (key >= GLFW_KEY_A && key <= GLFW_KEY_Z) return static_cast<ImGuiKey>(ImGuiKey_A + (key - GLFW_KEY_A));
+        if (key >= GLFW_KEY_F1 && key <= GLFW_KEY_F12) return static_cast<ImGuiKey>(ImGuiKey_F1 + (key - GLFW_KEY_F1));
+        if (key >= GLFW_KEY_KP_0 && key <= GLFW_KEY_KP_9) return static_cast<ImGuiKey>(ImGuiKey_Keypad0 + (key - GLFW_KEY_KP_0));
+        switch (key) {
+            case GLFW_KEY_TAB: return ImGuiKey_Tab;
+            case GLFW_KEY_LEFT: return ImGuiKey_LeftArrow;
+            case GLFW_KEY_RIGHT: return ImGuiKey_RightArrow;
+            case GLFW_KEY_UP: return ImGuiKey_UpArrow;
+            case GLFW_KEY_DOWN: return ImGuiKey_DownArrow;
+            case GLFW_KEY_PAGE_UP: return ImGuiKey_PageUp;
+            case GLFW_KEY_PAGE_DOWN: return ImGuiKey_PageDown;
+            case GLFW_KEY_HOME: return ImGuiKey_Home;
+            case GLFW_KEY_END: return ImGuiKey_End;
+            case GLFW_KEY_INSERT: return ImGuiKey_Insert;
+            case GLFW_KEY_DELETE: return ImGuiKey_Delete;
+            case GLFW_KEY_BACKSPACE: return ImGuiKey_Backspace;
+            case GLFW_KEY_SPACE: return ImGuiKey_Space;
+            case GLFW_KEY_ENTER: return ImGuiKey_Enter;
+            case GLFW_KEY_ESCAPE: return ImGuiKey_Escape;
+            case GLFW_KEY_MINUS: return ImGuiKey_Minus;
+            case GLFW_KEY_PERIOD: return ImGuiKey_Period;
+            case GLFW_KEY_KP_DECIMAL: return ImGuiKey_KeypadDecimal;
+            case GLFW_KEY_KP_SUBTRACT: return ImGuiKey_KeypadSubtract;
+            case GLFW_KEY_KP_ADD: return ImGuiKey_KeypadAdd;
+            case GLFW_KEY_KP_ENTER: return ImGuiKey_KeypadEnter;
+            case GLFW_KEY_LEFT_SHIFT: return ImGuiKey_LeftShift;
+            case GLFW_KEY_LEFT_CONTROL: return ImGuiKey_LeftCtrl;
+            case GLFW_KEY_LEFT_ALT: return ImGuiKey_LeftAlt;
+            case GLFW_KEY_LEFT_SUPER: return ImGuiKey_LeftSuper;
+            case GLFW_KEY_RIGHT_SHIFT: return ImGuiKey_RightShift;
+            case GLFW_KEY_RIGHT_CONTROL: return ImGuiKey_RightCtrl;
+            case GLFW_KEY_RIGHT_ALT: return ImGuiKey_RightAlt;
+            case GLFW_KEY_RIGHT_SUPER: return ImGuiKey_RightSuper;
+            default: return ImGuiKey_None;
+        }
+    }
+
+    // mods of a modifier key's own event are from before it, so its action decides
+    void AddModifierEvents(ImGuiIO& io, int key, int action, int mods) {
+        bool pressed = (action != GLFW_RELEASE);
+        auto is_down = [&](int left, int right, int mod) { return (key == left || key == right) ? pressed : (mods & mod) != 0; };
+        io.AddKeyEvent(ImGuiMod_Ctrl, is_down(GLFW_KEY_LEFT_CONTROL, GLFW_KEY_RIGHT_CONTROL, GLFW_MOD_CONTROL));
+        io.AddKeyEvent(ImGuiMod_Shift, is_down(GLFW_KEY_LEFT_SHIFT, GLFW_KEY_RIGHT_SHIFT, GLFW_MOD_SHIFT));
+        io.AddKeyEvent(ImGuiMod_Alt, is_down(GLFW_KEY_LEFT_ALT, GLFW_KEY_RIGHT_ALT, GLFW_MOD_ALT));
+        io.AddKeyEvent(ImGuiMod_Super, is_down(GLFW_KEY_LEFT_SUPER, GLFW_KEY_RIGHT_SUPER, GLFW_MOD_SUPER));
+    }
+
+    void UpdateFramebufferScale(ImGuiIO& io) {
+        if (io.DisplaySize.x > 0.0f && io.DisplaySize.y > 0.0f) {
+            io.DisplayFramebufferScale = ImVec2(renderer->width_ / io.DisplaySize.x, renderer->height_ / io.DisplaySize.y);
+        }
+    }
+} // namespace
+
+void ForwardFramebufferSize(GLFWwindow *window, int width, int height) {
+    PostToRenderThread([=] {
+        FramebufferSizeCallback(window, width, height);
+        UpdateFramebufferScale(ImGui::GetIO());
+    });
+}
+
+void ForwardWindowSize(GLFWwindow *window, int width, int height) {
+    PostToRenderThread([=] {
+        ImGuiIO& io = ImGui::GetIO();
+        io.DisplaySize = ImVec2(static_cast<float>(width), static_cast<float>(height));
+        UpdateFramebufferScale(io);
+        renderer->RequestRedraw();
+    });
+}
+
+void ForwardKey(GLFWwindow *window, int key, int scancode, int action, int mods) {
+    PostToRenderThread([=] {
+        if (action == GLFW_PRESS || action == GLFW_RELEASE) { // ImGui repeats held keys itself
+            ImGuiIO& io = ImGui::GetIO();
+            AddModifierEvents(io, key, action, mods);
+            ImGuiKey imgui_key = ToImGuiKey(key);
+            io.AddKeyEvent(imgui_key, action == GLFW_PRESS);
+            io.SetKeyEventNativeData(imgui_key, key, scancode);
+        }
+        KeyboardCallback(window, key, scancode, action, mods);
+    });
+}
+
+void ForwardChar(GLFWwindow *window, unsigned int c) {
+    PostToRenderThread([=] {
+        ImGui::GetIO().AddInputCharacter(c);
+        renderer->RequestRedraw();
+    });
+}
+
+void ForwardMousePos(GLFWwindow *window, double x_pos_in, double y_pos_in) {
+    PostToRenderThread([=] {
+        ImGui::GetIO().AddMousePosEvent(static_cast<float>(x_pos_in), static_cast<float>(y_pos_in));
+        MousePosCallback(window, x_pos_in, y_pos_in);
+    });
+}
+
+void ForwardScroll(GLFWwindow *window, double x_offset, double y_offset) {
+    PostToRenderThread([=] {
+        ImGui::GetIO().AddMouseWheelEvent(static_cast<float>(x_offset), static_cast<float>(y_offset));
+        ScrollCallback(window, x_offset, y_offset);
+    });
+}
+
+void ForwardMouseButton(GLFWwindow *window, int button, int action, int mods) {
+    PostToRenderThread([=] {
+        ImGuiIO& io = ImGui::GetIO();
+        AddModifierEvents(io, GLFW_KEY_UNKNOWN, action, mods);
+        if (button >= 0 && button < ImGuiMouseButton_COUNT) io.AddMouseButtonEvent(button, action == GLFW_PRESS);
+        MouseButtonCallback(window, button, action, mods);
+    });
+}
+
+void ForwardWindowFocus(GLFWwindow *window, int focused) {
+    PostToRenderThread([=] {
+        ImGui::GetIO().AddFocusEvent(focused != 0);
+        renderer->RequestRedraw();
+    });
+}
+
+void ForwardCursorEnter(GLFWwindow *window, int entered) {
+    PostToRenderThread([=] {
+        if (!entered) ImGui::GetIO().AddMousePosEvent(-FLT_MAX, -FLT_MAX); // the next position event brings it back
+        renderer->RequestRedraw();
+    });
+}
+
+void ForwardWindowRefresh(GLFWwindow *window) {
+    PostToRenderThread([=] { WindowRefreshCallback(window); });
+}
@@ -2,24 +2,44 @@
 #include "Scene/Scene.h"
 #include "Render/Renderer.h"
 #include "Render/ShaderManager.h"
+#include "Scene/AssetLoader.h"
 #include <imgui.h>
 #include <imgui_impl_opengl3.h>
-#include <imgui_impl_glfw.h>
+
+void UI::SetupPlatform(GLFWwindow* window) {
+    // Setup Dear ImGui context. There is no platform backend: the callbacks in Callbacks.h forward the GLFW
+    // events and the window size to ImGui, since the window may be queried on the main thread only. The
+    // initial size is read here, before the render thread starts.
+    IMGUI_CHECKVERSION(); ImGui::CreateContext();
+    ImGuiIO& io = ImGui::GetIO();
+    io.ConfigFlags |= ImGuiConfigFlags_NoMouseCursorChange;
+    io.BackendPlatformName = "forwarded_glfw_events";
+    int width, height, framebuffer_width, framebuffer_height;
+    glfwGetWindowSize(window, &width, &height);
+    glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+    io.DisplaySize = ImVec2(static_cast<float>(width), static_cast<float>(height));
+    if (width > 0 && height > 0) {
+        io.DisplayFramebufferScale = ImVec2(static_cast<float>(framebuffer_width) / width, static_cast<float>(framebuffer_height) / height);
+    }
+    ImGui::StyleColorsDark();
+}
 
 UI::UI(Scene* scene, Renderer* renderer, GLFWwindow* window) : shader_manager_(ShaderManager::GetInstance()) {
 	scene_ = scene;
 	renderer_ = renderer;
-    // Setup Dear ImGui context
-    IMGUI_CHECKVERSION(); ImGui::CreateContext();
-    ImGuiIO& io = ImGui::GetIO(); (void)io;
-    ImGui::StyleColorsDark(); ImGui_ImplGlfw_InitForOpenGL(window, true); ImGui_ImplOpenGL3_Init("#version 460");
+    ImGui_ImplOpenGL3_Init("#version 460");
     // windows sizes
     is_model_list_init = false;
 }
 
 void UI::ShowUI(){
     // Start the Dear ImGui frame
-    ImGui_ImplOpenGL3_NewFrame(); ImGui_ImplGlfw_NewFrame(); ImGui::NewFrame();
+    auto now = std::chrono::steady_clock::now();
+    if (last_frame_time_ != std::chrono::steady_clock::time_point()) {
+        ImGui::GetIO().DeltaTime = std::max(std::chrono::duration<float>(now - last_frame_time_).count(), 1e-4f);
+    }
+    last_frame_time_ = now;
+    ImGui_ImplOpenGL3_NewFrame(); ImGui::NewFrame();
     ImGui::BeginMainMenuBar(); // Start the main menu bar
        
     if (ImGui::BeginMenu("Display")) {
@@ -38,7 +58,27 @@ void UI::ShowUI(){
             }
         }
         ImGui::MenuItem("Backface Culling", "", &(renderer_->is_backface_culling_));
+        ImGui::MenuItem("Meshlet Culling", "", &(renderer_->meshlet_culling_));
+        ImGui::MenuItem("Visibility Buffer", "", &(renderer_->visibility_buffer_));
+        ImGui::MenuItem("Dynamic Resolution", "", &(renderer_->dynamic_resolution_));
+        if (renderer_->dynamic_resolution_) {
+            ImGui::SliderFloat("Target GPU ms", &(renderer_->target_frame_milliseconds_), 2.0f, 50.0f, "%.1f");
+        }
         ImGui::MenuItem("Axes", "", &(renderer_->draw_axes_));
+        ImGui::Separator();
+        ImGui::MenuItem("Render On Demand", "", &(renderer_->render_on_demand_));
+        if (ImGui::SliderInt("Frame Cap", &(renderer_->frame_cap_), 0, 240, renderer_->frame_cap_ > 0 ? "%d fps" : "off")) {
+            renderer_->frame_cap_ = std::max(0, renderer_->frame_cap_);
+        }
+        ImGui::Separator();
+        ResidencyManager& residency = renderer_->residency_;
+        int budget_mb = static_cast<int>(residency.budget_bytes_ / (1024 * 1024));
+        if (ImGui::InputInt("GPU Budget (MB)", &budget_mb, 64, 1024)) {
+            residency.budget_bytes_ = static_cast<size_t>(std::max(0, budget_mb)) * 1024 * 1024;
+            renderer_->RequestRedraw();
+        }
+        ImGui::Text("%.1f MB resident, %u/%u assets evicted, %llu evictions", residency.resident_bytes_ / (1024.0 * 1024.0),
+                    residency.num_evicted_assets_, residency.num_assets_, residency.num_evictions_);
         ImGui::EndMenu();
     }
     
@@ -54,6 +94,72 @@ void UI::ShowUI(){
         if (ImGui::MenuItem("BPM", NULL, renderer_->texture_type_ == TextureType::BPM)) {
             renderer_->SetTextureType(TextureType::BPM);
         }
+        ImGui::Separator();
+        ImGui::MenuItem("Automatic (per model)", NULL, &(renderer_->auto_texture_type_));
+        if (renderer_->auto_texture_type_) {
+            ImGui::SliderFloat("BPM from px/triangle", &(renderer_->bpm_min_triangle_pixels_), 1.0f, 256.0f, "%.1f", ImGuiSliderFlags_Logarithmic);
+            ImGui::SliderFloat("Mobius from px/triangle", &(renderer_->mobius_min_triangle_pixels_), 0.1f, 64.0f, "%.1f", ImGuiSliderFlags_Logarithmic);
+            ImGui::TextDisabled("Models: %u linear | %u Mobius | %u BPM",
+                                renderer_->num_texture_type_models_[static_cast<int>(TextureType::LINEAR)],
+                                renderer_->num_texture_type_models_[static_cast<int>(TextureType::DIRECT_MOBIUS)],
+                                renderer_->num_texture_type_models_[static_cast<int>(TextureType::BPM)]);
+        }
+        ImGui::Separator();
+        ImGui::TextDisabled("BPM Matrix Exponential");
+        for (int i = 0; i < static_cast<int>(ExpMethod::TYPES_COUNT); ++i) {
+            ExpMethod exp_method = static_cast<ExpMethod>(i);
+            if (ImGui::MenuItem(GetExpMethodName(exp_method), NULL, renderer_->exp_method_ == exp_method)) {
+                renderer_->SetExpMethod(exp_method);
+            }
+        }
+        ImGui::Separator();
+        ImGui::TextDisabled("Per-Triangle Data");
+        if (ImGui::MenuItem("Split Buffers (fp32)", NULL, !renderer_->packed_bpm_records_)) {
+            renderer_->packed_bpm_records_ = false;
+        }
+        if (ImGui::MenuItem("Packed Records (fp16 ratios)", NULL, renderer_->packed_bpm_records_)) {
+            renderer_->packed_bpm_records_ = true;
+        }
+        ImGui::TextDisabled("GPU: split %.2f ms | packed %.2f ms", renderer_->layout_milliseconds_[0], renderer_->layout_milliseconds_[1]);
+        ImGui::Separator();
+        ImGui::MenuItem("Adaptive BPM", NULL, &(renderer_->adaptive_bpm_));
+        if (renderer_->adaptive_bpm_) {
+            ImGui::SliderFloat("Flat |log ratio|", &(renderer_->flat_log_ratio_tolerance_), 0.0f, 0.2f, "%.3f");
+            unsigned int num_faces = std::max(renderer_->num_adaptive_faces_, 1u);
+            ImGui::TextDisabled("Flat path %.1f%% | full BPM %.1f%% of triangles",
+                                100.0f * renderer_->num_adaptive_flat_faces_ / num_faces,
+                                100.0f * (renderer_->num_adaptive_faces_ - renderer_->num_adaptive_flat_faces_) / num_faces);
+        }
+        ImGui::TextDisabled("GPU: full BPM %.2f ms | adaptive %.2f ms", renderer_->adaptive_milliseconds_[0], renderer_->adaptive_milliseconds_[1]);
+        ImGui::EndMenu();
+    }
+    if (ImGui::BeginMenu("Deformation")) {
+        ImGui::MenuItem("Twist Models (GPU BPM recompute)", NULL, &(renderer_->deform_models_));
+        ImGui::SliderFloat("Twist (radians)", &(renderer_->deform_twist_), 0.0f, 3.0f, "%.2f");
+        ImGui::SliderFloat("Period (s)", &(renderer_->deform_period_seconds_), 0.5f, 20.0f, "%.1f");
+        ImGui::TextDisabled("%u deforming assets, recompute %.3f ms", renderer_->num_deforming_assets_, renderer_->deform_milliseconds_);
+        ImGui::Separator();
+        ImGui::MenuItem("Play OBJ Sequences", NULL, &(renderer_->play_sequences_));
+        ImGui::SliderFloat("Sequence FPS", &(renderer_->sequence_fps_), 1.0f, 120.0f, "%.0f");
+        ImGui::TextDisabled("%u playing, frame read %.2f ms, %u stalls", renderer_->num_playing_sequences_,
+                            renderer_->sequence_read_milliseconds_, renderer_->sequence_stalls_);
+        ImGui::Separator();
+        if (ImGui::MenuItem("Benchmark Recompute")) {
+            renderer_->deform_benchmark_.clear();
+            std::vector<ModelAsset*> assets;
+            for (auto& model : scene_->GetModels()) {
+                if (std::find(assets.begin(), assets.end(), model->GetAsset()) != assets.end()) continue;
+                assets.push_back(model->GetAsset());
+                renderer_->BenchmarkDeformation(model->asset_);
+            }
+        }
+        for (const auto& [num_faces, milliseconds] : renderer_->deform_benchmark_) {
+            ImGui::TextDisabled("%u triangles: %.3f ms (%.2f ns/triangle)", num_faces, milliseconds, 1e6 * milliseconds / num_faces);
+        }
+        if (!renderer_->deform_benchmark_.empty()) {
+            ImGui::TextDisabled("%u triangles: %.3f ms estimated, frame time %.1f ms", Renderer::kDeformTargetTriangles,
+                                renderer_->EstimateDeformMilliseconds(Renderer::kDeformTargetTriangles), renderer_->target_frame_milliseconds_);
+        }
         ImGui::EndMenu();
     }
     // get model name
@@ -63,6 +169,21 @@ void UI::ShowUI(){
             ImGui::Text("Active Model: %s", active_model->model_name_.c_str());
         }
     }
+    ImGui::Text("| GPU %.2f ms, frame %llu", renderer_->frame_timer_.GetSmoothedMilliseconds(), renderer_->num_frames_drawn_);
+    if (loader_ != nullptr && loader_->GetNumPending() > 0) {
+        ImGui::Text("| Loading %u models", loader_->GetNumPending());
+    }
+    if (loader_ != nullptr && loader_->GetNumPendingUpdates() > 0) {
+        ImGui::Text("| Updating %u models", loader_->GetNumPendingUpdates()); // BPM data or evicted data
+    }
+    if (renderer_->visibility_buffer_) {
+        ImGui::Text("| Resolve passes %u", renderer_->num_resolve_passes_);
+    }
+    if (renderer_->dynamic_resolution_) {
+        ImGui::Text("| Scale %.2f (%ux%u)", renderer_->resolution_scale_, renderer_->render_width_, renderer_->render_height_);
+    }
+    ImGui::Text("| Meshlets %u/%u, %u triangles, %llu fragments, %u batches", renderer_->num_drawn_meshlets_, renderer_->num_total_meshlets_,
+                renderer_->num_drawn_faces_, static_cast<unsigned long long>(renderer_->fragment_query_.GetResult()), renderer_->num_batches_);
     
 
     ImGui::EndMainMenuBar();
@@ -141,6 +262,67 @@ void UI::ShowModelListWindow() {
                 ImGui::Checkbox("Wireframe", &model->draw_wireframe_);
                 ImGui::Checkbox("Points", &model->draw_points_);
                 ImGui::Checkbox("Bounding Box", &model->draw_bbox_);
+                if (ImGui::Button("Add Instance")) {
+                    scene_->AddInstance(model);
+                }
+                ImGui::Text("%ld instances share this asset", model->asset_.use_count());
+                if (renderer_->auto_texture_type_) {
+                    ImGui::Text("Texture type %s, %.1f px/triangle", GetTextureTypeName(model->texture_type_), model->triangle_pixels_);
+                }
+                ImGui::Separator();
+                for (auto& mesh : model->GetMeshes()) {
+                    ImGui::Text("%u triangles, ACMR %.3f (%.3f before reorder)", mesh->num_faces_, mesh->acmr_, mesh->acmr_before_reorder_);
+                    ImGui::Text("%zu meshlets", mesh->meshlets_.size());
+                    BPMData computing = mesh->GetPrecomputeLevel();
+                    if (!mesh->HasBPMData(computing)) {
+                        ImGui::Text("Computing %s data: %u/%u triangles", computing == BPMData::FULL ? "BPM" : "Mobius",
+                                    mesh->num_ready_faces_.load(), mesh->num_faces_);
+                        continue;
+                    }
+                    if (!mesh->HasBPMData(BPMData::FULL)) {
+                        ImGui::Text(mesh->HasBPMData(BPMData::MOBIUS) ? "Mobius data only, log ratios are computed when BPM is used"
+                                                                      : "No BPM data, computed when a Mobius texture type is used");
+                        continue;
+                    }
+                    ImGui::Text("BPM data %.1f B/triangle split, %.1f B/triangle packed (UV error %.2e)",
+                                mesh->split_bytes_per_triangle_, mesh->packed_bytes_per_triangle_, mesh->record_max_uv_error_);
+                    if (mesh->classified_tolerance_ >= 0.0f) {
+                        if (mesh->IsDeforming()) { // flagged by the deform pass, the error is not measured
+                            ImGui::Text("Adaptive BPM: %u/%u flat triangles", mesh->num_flat_faces_, mesh->num_faces_);
+                        } else {
+                            ImGui::Text("Adaptive BPM: %u/%u flat triangles (UV error %.2e)", mesh->num_flat_faces_, mesh->num_faces_, mesh->flat_max_uv_error_);
+                        }
+                    }
+                }
+                if (model->GetNumLODs() > 1) {
+                    ImGui::Separator();
+                    ImGui::Text("LOD %u of %u", model->lod_, model->GetNumLODs());
+                    ImGui::RadioButton("Auto", &model->forced_lod_, -1);
+                    for (unsigned int lod = 0; lod < model->GetNumLODs(); ++lod) {
+                        unsigned int num_faces = 0;
+                        for (auto& mesh : model->GetLODMeshes(lod)) num_faces += mesh->num_faces_;
+                        std::string label = "LOD " + std::to_string(lod) + " (" + std::to_string(num_faces) + " triangles";
+                        if (lod > 0) label += ", error " + std::to_string(model->GetAsset()->lod_errors_[lod - 1]);
+                        label += ")";
+                        ImGui::RadioButton(label.c_str(), &model->forced_lod_, static_cast<int>(lod));
+                    }
+                }
+                if (model->GetAsset()->load_options_.incremental_edits) {
+                    ImGui::Separator();
+                    ImGui::SliderInt("Vertices", &edit_num_vertices_, 1, 10000, "%d", ImGuiSliderFlags_Logarithmic);
+                    ImGui::SliderFloat("Amplitude", &edit_amplitude_, 0.0f, 0.05f, "%.4f");
+                    if (ImGui::Button("Displace Vertices")) {
+                        DisplaceVertices(model);
+                    }
+                    if (has_edited_) {
+                        ImGui::SameLine();
+                        if (last_edit_milliseconds_ >= 0.0f) {
+                            ImGui::Text("updated in %.2f ms", last_edit_milliseconds_);
+                        } else {
+                            ImGui::Text("busy, try again"); // a precompute of the asset is running
+                        }
+                    }
+                }
                 ImGui::EndPopup();
 
             }
@@ -155,4 +337,25 @@ void UI::ShowModelListWindow() {
         } // End of for loop
     } // End of window
     ImGui::End();
-}
\ No newline at end of file
+}
+
+void UI::DisplaceVertices(MeshModel* model) {
+    ModelAsset* asset = model->GetAsset();
+    Mesh& mesh = *asset->meshes_[0];
+    if (mesh.vertices_.empty()) return;
+    std::uniform_int_distribution<unsigned int> vertex(0, static_cast<unsigned int>(mesh.vertices_.size()) - 1);
+    std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+    float amplitude = edit_amplitude_ * asset->bbox_.largest_dimension_;
+    std::vector<unsigned int> vertex_ids(edit_num_vertices_);
+    std::vector<glm::vec3> positions(edit_num_vertices_);
+    for (int i = 0; i < edit_num_vertices_; i++) {
+        unsigned int v = vertex(edit_random_);
+        vertex_ids[i] = mesh.source_vertices_.empty() ? v : mesh.source_vertices_[v]; // the edit takes OBJ vertices
+        positions[i] = mesh.vertices_[v].position_ + amplitude * offset(edit_random_) * mesh.vertices_[v].normal_;
+    }
+    auto begin = std::chrono::steady_clock::now();
+    bool updated = asset->UpdateVertices(0, vertex_ids, positions, {});
+    has_edited_ = true;
+    last_edit_milliseconds_ = updated ? std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - begin).count() : -1.0f;
+    if (updated) renderer_->RequestRedraw();
+}
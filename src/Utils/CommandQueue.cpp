@@ -0,0 +1,99 @@
+// CommandQueue.cpp
+#include "Utils/CommandQueue.h"
+
+#include <cstdint>
+
+CommandQueue::CommandQueue(size_t capacity) {
+	size_t size = 2;
+	while (size < capacity) size <<= 1;
+	mask_ = size - 1;
+	cells_ = std::make_unique<Cell[]>(size);
+	for (size_t i = 0; i < size; ++i) {
+		cells_[i].sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+bool CommandQueue::Push(Command command) {
+	return TryPush(command);
+}
+
+bool CommandQueue::TryPush(Command& command) {
+	size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+	Cell* cell;
+	while (true) {
+		cell = &cells_[pos & mask_];
+		size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+		if (diff == 0) { // free cell, claim it
+			if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+		} else if (diff < 0) { // the consumer has not freed it yet
+			return false;
+		} else { // another producer took it
+			pos = enqueue_pos_.load(std::memory_order_relaxed);
+		}
+	}
+	cell->command = std::move(command);
+	cell->sequence.store(pos + 1, std::memory_order_release);
+	// Either a consumer going to sleep sees this command in Empty, or this sees its count (the fences order the
+	// store before the load on both sides). It checks Empty under the mutex, so the notify cannot miss its wait.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleeping_consumers_.load(std::memory_order_relaxed) > 0) {
+		{ std::lock_guard<std::mutex> lock(wait_mutex_); }
+		wait_condition_.notify_one();
+	}
+	return true;
+}
+
+bool CommandQueue::Pop(Command& command) {
+	size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+	Cell* cell;
+	while (true) {
+		cell = &cells_[pos & mask_];
+		size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+		if (diff == 0) { // filled cell, claim it
+			if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+		} else if (diff < 0) { // empty
+			return false;
+		} else { // another consumer took it
+			pos = dequeue_pos_.load(std::memory_order_relaxed);
+		}
+	}
+	command = std::move(cell->command);
+	cell->command = nullptr;
+	cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+	std::atomic_thread_fence(std::memory_order_seq_cst); // as in TryPush, for producers in PushWait
+	if (sleeping_producers_.load(std::memory_order_relaxed) > 0) {
+		{ std::lock_guard<std::mutex> lock(wait_mutex_); }
+		space_condition_.notify_all();
+	}
+	return true;
+}
+
+bool CommandQueue::Empty() const {
+	size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+	return static_cast<intptr_t>(cells_[pos & mask_].sequence.load(std::memory_order_acquire)) - static_cast<intptr_t>(pos + 1) < 0;
+}
+
+bool CommandQueue::Full() const {
+	size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+	return static_cast<intptr_t>(cells_[pos & mask_].sequence.load(std::memory_order_acquire)) - static_cast<intptr_t>(pos) < 0;
+}
+
+void CommandQueue::WaitFor(std::chrono::duration<double> timeout) {
+	std::unique_lock<std::mutex> lock(wait_mutex_);
+	sleeping_consumers_.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	wait_condition_.wait_for(lock, timeout, [this] { return !Empty(); });
+	sleeping_consumers_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void CommandQueue::PushWait(Command command) {
+	while (!TryPush(command)) {
+		std::unique_lock<std::mutex> lock(wait_mutex_);
+		sleeping_producers_.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		space_condition_.wait(lock, [this] { return !Full(); });
+		sleeping_producers_.fetch_sub(1, std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,34 @@
+// Files.cpp
+#include "Utils/Files.h"
+
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+bool files::RenameReplacing(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+std::string files::MakeTempPath(const std::string& path) {
+	static std::atomic<unsigned int> next_temp{0};
+#ifdef _WIN32
+	unsigned long process = GetCurrentProcessId();
+#else
+	long process = static_cast<long>(getpid());
+#endif
+	size_t thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+	return path + "." + std::to_string(process) + "-" + std::to_string(thread) + "-" + std::to_string(next_temp++) + ".tmp";
+}
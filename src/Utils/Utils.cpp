@@ -30,11 +30,17 @@ GLFWwindow* initializeGLFW(ControlState** control_state_ptr) {
     *control_state_ptr = new ControlState(cg::constants::SCR_WIDTH, cg::constants::SCR_HEIGHT);
     glfwSetWindowUserPointer(window, *control_state_ptr);
     glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, FramebufferSizeCallback);
-    glfwSetMouseButtonCallback(window, MouseButtonCallback);
-    glfwSetCursorPosCallback(window, MousePosCallback);
-    glfwSetScrollCallback(window, ScrollCallback);
-    glfwSetKeyCallback(window, KeyboardCallback);
+    // the handlers run on the render thread, see RenderThread
+    glfwSetFramebufferSizeCallback(window, ForwardFramebufferSize);
+    glfwSetWindowSizeCallback(window, ForwardWindowSize);
+    glfwSetMouseButtonCallback(window, ForwardMouseButton);
+    glfwSetCursorPosCallback(window, ForwardMousePos);
+    glfwSetScrollCallback(window, ForwardScroll);
+    glfwSetKeyCallback(window, ForwardKey);
+    glfwSetCharCallback(window, ForwardChar);
+    glfwSetWindowFocusCallback(window, ForwardWindowFocus);
+    glfwSetCursorEnterCallback(window, ForwardCursorEnter);
+    glfwSetWindowRefreshCallback(window, ForwardWindowRefresh);
 
     // glad: load all OpenGL function pointers
     // ---------------------------------------
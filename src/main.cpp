@@ -1,8 +1,15 @@
 ﻿// entry point for the application.
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <cstdlib>
 #include <filesystem>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
 
 #include "Utils/Constants.h"
 
@@ -15,6 +22,10 @@
 #include "Scene/MeshModel.h"
 #include "PathConfig.h" // for RESOURCES_DIR
 #include "Render/Renderer.h"
+#include "Render/RenderThread.h"
+#include "Scene/AssetLoader.h"
+#include "Scene/MeshPartition.h"
+#include "Scene/MeshSequence.h"
 #include "Scene/Scene.h"
 #include "Render/Shader.h"
 #include "UI/UI.h"
@@ -23,49 +34,215 @@ GLFWwindow* initializeGLFW(ControlState** control_state_ptr);
 
 Scene* scene;
 Renderer* renderer;
+RenderThread* render_thread;
 
 namespace fs = std::filesystem;
 
 int main(int argc, char* argv[]) {
-    std::string model_path;
-    if (argc != 2) {
-        std::cout << "Usage: " << argv[0] << " <model_path>.obj" << std::endl;
+    auto startup_begin = std::chrono::high_resolution_clock::now();
+    std::vector<std::string> model_paths;
+    ModelLoadOptions load_options;
+    load_options.progressive_bpm = true; // BPM data being computed is drawn per ready triangle
+    int num_instances = 1;
+    int gpu_budget_mb = 0;
+    bool benchmark_deformation = false;
+    bool load_sequences = false;
+    bool write_positions_files = false;
+    unsigned int partition_triangles = 0; // models are partitioned into chunks of this size when set
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--reorder") {
+            load_options.reorder_triangles = true;
+        } else if (arg == "--gpu-budget" && i + 1 < argc) {
+            gpu_budget_mb = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--benchmark-deform") {
+            benchmark_deformation = true;
+        } else if (arg == "--sequence") {
+            load_sequences = true;
+        } else if (arg == "--sequence-cache") {
+            load_sequences = true;
+            write_positions_files = true;
+        } else if (arg == "--partition" && i + 1 < argc) {
+            partition_triangles = static_cast<unsigned int>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--editable") {
+            load_options.incremental_edits = true;
+        } else if (arg == "--no-progressive") {
+            load_options.progressive_bpm = false;
+        } else if (arg == "--lods" && i + 1 < argc) {
+            load_options.num_lods = static_cast<unsigned int>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--instances" && i + 1 < argc) {
+            num_instances = std::max(1, std::atoi(argv[++i]));
+        } else {
+            model_paths.push_back(arg);
+        }
+    }
+    if (model_paths.empty()) {
+        std::cout << "Usage: " << argv[0] << " <model_path>.obj [more models] [--reorder] [--lods N] [--instances N] [--no-progressive] [--editable] [--gpu-budget MB] [--benchmark-deform] [--sequence] [--sequence-cache] [--partition TRIANGLES]" << std::endl;
         fs::path default_model_path = fs::path(DEFAULT_DATA_DIR) / DEFAULT_MODEL_NAME;
-        model_path = default_model_path.string();
-        std::cout << "defaulting to: " << model_path  << std::endl;
-    } else {
-        model_path = argv[1];
+        model_paths.push_back(default_model_path.string());
+        std::cout << "defaulting to: " << model_paths[0]  << std::endl;
+    }
+    // out-of-core meshes: a manifest of chunks, written first from an OBJ with --partition
+    std::vector<mesh_partition::Manifest> manifests;
+    for (auto path = model_paths.begin(); path != model_paths.end();) {
+        bool is_manifest = fs::path(*path).extension() == mesh_partition::kManifestExtension;
+        if (!is_manifest && partition_triangles == 0) {
+            ++path;
+            continue;
+        }
+        mesh_partition::Manifest manifest;
+        bool loaded = is_manifest ? mesh_partition::ReadManifest(*path, manifest) : mesh_partition::LoadOrPartition(*path, partition_triangles, manifest);
+        if (loaded) {
+            manifests.push_back(std::move(manifest));
+        } else {
+            std::cerr << "ERROR::MAIN::PARTITION_FAILED: " << *path << std::endl;
+        }
+        path = model_paths.erase(path);
     }
     
     // Initialize GLFW
     ControlState* control_state = nullptr;
     GLFWwindow* window = initializeGLFW(&control_state); // stbi flip vertically
-    // configure global opengl state
-    // -----------------------------
+    UI::SetupPlatform(window);
+    auto loader = std::make_unique<AssetLoader>(window); // contexts sharing the window's objects
     scene = new Scene();
-    renderer = new Renderer(scene);
-    scene->SetupScene(model_path);
-    
-    // UI setup
-    UI ui = UI(scene,renderer, window);
+    scene->load_options_ = load_options;
+    scene->AddCamera();
 
-    // render loop
+    // render thread: owns the window's context from here on, input and finished loads reach it as commands
     // -----------
-    while (!glfwWindowShouldClose(window)) {
-        control_state->UpdateDeltaTime(static_cast<float>(glfwGetTime()));
-        renderer->Draw();
-        ui.ShowUI(); 
+    RenderThread render_loop(window);
+    render_thread = &render_loop;
+    std::promise<void> renderer_ready;
+    UI* render_ui = nullptr;
+    render_loop.Start([&] {
+        renderer = new Renderer(scene); // registers the shaders the loaders compile
+        UI ui = UI(scene, renderer, window);
+        ui.loader_ = loader.get();
+        render_ui = &ui;
+        renderer->residency_.budget_bytes_ = static_cast<size_t>(gpu_budget_mb) * 1024 * 1024;
+        // BPM data is computed by the loader when a texture type first needs it, evicted data is uploaded there
+        // again. Each step wakes the render thread and the asset goes along, so that its last reference is dropped there
+        renderer->compute_bpm_data_ = [&loader](std::shared_ptr<ModelAsset> asset) {
+            loader->Update(std::move(asset), [](std::shared_ptr<ModelAsset> asset) {
+                render_thread->Post([asset] { renderer->RequestRedraw(); });
+            });
+        };
+        renderer_ready.set_value();
+
+        // draws while something changes, otherwise sleeps until a command comes in
+        bool is_first_frame = true;
+        constexpr double kIdleWaitSeconds = 0.5;
+        while (!render_loop.IsStopping()) {
+            render_loop.RunCommands();
+            if (!renderer->NeedsRedraw()) {
+                render_loop.WaitForCommands(kIdleWaitSeconds);
+                continue;
+            }
+            auto frame_begin = std::chrono::steady_clock::now();
+            control_state->UpdateDeltaTime(static_cast<float>(glfwGetTime()));
+            renderer->Draw();
+            ui.ShowUI();
+
+            // GLFW: swap buffers
+            glfwSwapBuffers(window);
+            if (renderer->frame_cap_ > 0) {
+                auto frame_end = frame_begin + std::chrono::duration<double>(1.0 / renderer->frame_cap_);
+                std::this_thread::sleep_until(frame_end);
+            }
 
-        // GLFW: swap buffers and poll IO events
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+            if (is_first_frame && scene->HasModels()) {
+                // cold start compiles every used program, warm start loads them from the binary cache
+                ShaderManager& shader_manager = ShaderManager::GetInstance();
+                double startup_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startup_begin).count();
+                std::cout << "Startup: first frame with models after " << startup_ms << " ms (shader programs: " << shader_manager.shader_load_ms_ << " ms, "
+                          << shader_manager.num_cached_programs_ << " from binary cache, " << shader_manager.num_compiled_programs_ << " compiled)" << std::endl;
+                is_first_frame = false;
+            }
+        }
+        // commands left over may hold assets, whose GL objects are deleted with this context current
+        while (render_loop.RunCommands() > 0) {}
+        delete scene;
+        delete renderer;
+    });
+    renderer_ready.get_future().wait();
+
+    // models load in the background, each is added with its copies when it is ready
+    for (const std::string& path : model_paths) {
+        // a model path is the first frame of a sequence, the asset is loaded from it and plays the others
+        std::vector<std::string> frame_paths = load_sequences ? MeshSequence::FindFrames(path) : std::vector<std::string>();
+        loader->Load(path, load_options, [num_instances, benchmark_deformation, frame_paths, write_positions_files](std::shared_ptr<ModelAsset> asset) {
+            render_thread->Post([asset, num_instances, benchmark_deformation, frame_paths, write_positions_files] {
+                if (benchmark_deformation) renderer->BenchmarkDeformation(asset); // recompute time per triangle count
+                if (frame_paths.size() > 1 && !asset->sequence_) {
+                    asset->sequence_ = std::make_unique<MeshSequence>(frame_paths, *asset->GetMeshes()[0], write_positions_files);
+                    renderer->play_sequences_ = true;
+                    std::cout << "Sequence of " << asset->model_name_ << ": " << frame_paths.size() << " frames" << std::endl;
+                }
+                MeshModel* source = scene->AddModel(asset);
+                // copies on a square grid, sharing the loaded asset
+                int grid_size = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(num_instances))));
+                float spacing = 1.2f * source->GetScale() * source->GetBBox().largest_dimension_;
+                for (int k = 1; k < num_instances; ++k) {
+                    MeshModel* instance = scene->AddInstance(source);
+                    instance->SetTranslation(source->GetTranslation() + spacing * glm::vec3(k % grid_size, 0.0f, -(k / grid_size)));
+                }
+            });
+        });
+    }
+
+    // every chunk is an asset of its own, placed as the whole mesh would be. It is loaded when it first comes
+    // into view, its BPM data is kept in a store next to it, and it is resident only while in view, see
+    // Renderer::pending_chunks_ and ResidencyManager
+    if (!manifests.empty()) {
+        ModelLoadOptions chunk_options = load_options;
+        chunk_options.out_of_core = true;
+        chunk_options.reorder_triangles = false; // the chunk files are in that order already
+        chunk_options.num_lods = 1;
+        render_thread->Post([&loader, chunk_options, manifests = std::move(manifests)] {
+            renderer->load_chunk_ = [&loader, chunk_options](const Renderer::PendingChunk& chunk) {
+                float scale = chunk.scale;
+                glm::vec3 translation = chunk.translation;
+                loader->Load(chunk.path, chunk_options, [scale, translation](std::shared_ptr<ModelAsset> asset) {
+                    render_thread->Post([asset, scale, translation] {
+                        MeshModel* model = scene->AddModel(asset);
+                        model->SetScale(scale);
+                        model->SetTranslation(translation);
+                    });
+                });
+            };
+            for (const mesh_partition::Manifest& manifest : manifests) {
+                glm::vec3 center = 0.5f * (manifest.v_min + manifest.v_max);
+                glm::vec3 size = manifest.v_max - manifest.v_min;
+                float scale = 3.0f / std::max(size.x, std::max(size.y, size.z)); // as MeshModel::CenterModel
+                for (const mesh_partition::Chunk& chunk : manifest.chunks) {
+                    renderer->pending_chunks_.push_back({chunk.path, chunk.v_min, chunk.v_max, scale, -scale * center});
+                }
+            }
+            renderer->RequestRedraw();
+        });
+    }
+
+    // main thread: GLFW events only, the callbacks post them to the render thread
+    while (!glfwWindowShouldClose(window)) {
+        glfwWaitEvents();
     }
+    // the render thread lets go of the loader, then it waits for the loads in progress
+    std::promise<void> loader_released;
+    render_thread->Post([&] {
+        render_ui->loader_ = nullptr;
+        renderer->compute_bpm_data_ = [](std::shared_ptr<ModelAsset>) {}; // requests from here on are dropped
+        renderer->load_chunk_ = nullptr;
+        loader_released.set_value();
+    });
+    loader_released.get_future().wait();
+    loader.reset();
+    render_loop.Stop();
+    render_thread = nullptr;
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
     delete control_state;
-    delete scene;
-    delete renderer;  
 }
 
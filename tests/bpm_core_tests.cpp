@@ -0,0 +1,307 @@
+// Headless checks of bpm_core, run by ctest: the edge log ratio matrices, from the mu of either side of an
+// edge, are the baseline log ratios. A local update after a few vertices moved gives what a full precompute of
+// the edited mesh gives, and reuses the log ratio pairs of the edges. The BPM store of a sharded precompute is
+// the same, byte for byte, as the store of a single run for any shard and thread count, and a store reads back
+// as it was written. With the path of bpm_precompute as argument, the same is checked through the tool: a
+// single run against --adjacency, --shard I/N and --merge N. The model is a generated OBJ whose texture does
+// not exist.
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "BPM/Mobius.h"
+#include "BPM/Precompute.h"
+#include "BPM/Shard.h"
+#include "Scene/Parser.h"
+#include "Utils/Files.h"
+
+namespace fs = std::filesystem;
+
+static int num_failed = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cerr << "FAILED: " << #condition << " (" << __FILE__ << ":" << __LINE__ << ")" << std::endl; \
+            num_failed++; \
+        } \
+    } while (false)
+
+static std::vector<char> ReadBytes(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// curved grid of size x size quads, each split in two triangles, with texture coordinates and a material whose
+// texture is missing
+static void WriteGridObj(const fs::path& directory, int size) {
+    std::ofstream mtl(directory / "grid.mtl");
+    mtl << "newmtl grid\nmap_Kd missing.png\n";
+    std::ofstream obj(directory / "grid.obj");
+    obj << "mtllib grid.mtl\n";
+    for (int y = 0; y <= size; y++) {
+        for (int x = 0; x <= size; x++) {
+            float u = static_cast<float>(x) / size, v = static_cast<float>(y) / size;
+            obj << "v " << u << " " << 0.3f * std::sin(5.0f * u) * std::cos(4.0f * v) << " " << v << "\n";
+            obj << "vt " << u * u << " " << v << "\n";
+        }
+    }
+    obj << "usemtl grid\n";
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            int a = y * (size + 1) + x + 1, b = a + 1, c = a + size + 1, d = c + 1;
+            obj << "f " << a << "/" << a << " " << b << "/" << b << " " << d << "/" << d << "\n";
+            obj << "f " << a << "/" << a << " " << d << "/" << d << " " << c << "/" << c << "\n";
+        }
+    }
+}
+
+static BPMStoreData ComputeStore(const MeshData& mesh, const std::vector<int>& adjacency, uint64_t key,
+                                 unsigned int num_shards, unsigned int num_threads, const std::string& obj_path) {
+    for (unsigned int i = 0; i < num_shards; i++) {
+        BPMShard shard;
+        ComputeShard(mesh.vertices, mesh.indices, adjacency, key, i, num_shards, num_threads, shard);
+        CHECK(WriteShardFile(GetShardPath(obj_path, i, num_shards), shard));
+    }
+    ShardMerger merger(mesh.indices, key);
+    for (unsigned int i = 0; i < num_shards; i++) {
+        BPMShard shard;
+        CHECK(ReadShardFile(GetShardPath(obj_path, i, num_shards), key, mesh.GetNumFaces(), shard));
+        CHECK(merger.Add(shard));
+    }
+    BPMStoreData store;
+    CHECK(merger.Finish(store));
+    return store;
+}
+
+static void TestShardMerge(const std::string& obj_path) {
+    MeshData mesh;
+    LoadMeshData(obj_path, mesh);
+    CHECK(mesh.GetNumFaces() > 0);
+    CHECK(fs::path(mesh.texture_path) == fs::path(obj_path).parent_path() / "missing.png");
+    uint64_t key = ComputeFileKey(obj_path);
+    std::vector<int> adjacency = ComputeEdgeAdjacency(mesh.indices, mesh.vertices.size()), read_adjacency;
+    CHECK(WriteAdjacencyFile(obj_path + kAdjacencyExtension, key, adjacency));
+    CHECK(ReadAdjacencyFile(obj_path + kAdjacencyExtension, key, mesh.GetNumFaces(), read_adjacency));
+    CHECK(read_adjacency == adjacency);
+
+    std::string single_path = obj_path + ".single" + kBPMStoreExtension;
+    CHECK(WriteBPMStoreFile(single_path, ComputeStore(mesh, adjacency, key, 1, 1, obj_path)));
+    std::vector<char> single = ReadBytes(single_path);
+    CHECK(!single.empty());
+    for (unsigned int num_shards : {2u, 3u, 7u}) {
+        for (unsigned int num_threads : {1u, 3u}) {
+            std::string sharded_path = obj_path + ".sharded" + kBPMStoreExtension;
+            CHECK(WriteBPMStoreFile(sharded_path, ComputeStore(mesh, adjacency, key, num_shards, num_threads, obj_path)));
+            if (ReadBytes(sharded_path) != single) {
+                std::cerr << "FAILED: " << num_shards << " shards on " << num_threads << " threads differ from a single run" << std::endl;
+                num_failed++;
+            }
+        }
+    }
+}
+
+static void TestStoreRoundTrip(const std::string& obj_path) {
+    MeshData mesh;
+    LoadMeshData(obj_path, mesh);
+    uint64_t key = ComputeFileKey(obj_path);
+    BPMStoreData store = ComputeStore(mesh, ComputeEdgeAdjacency(mesh.indices, mesh.vertices.size()), key, 1, 2, obj_path);
+    CHECK(store.level == BPMData::FULL);
+    std::string store_path = obj_path + kBPMStoreExtension;
+    CHECK(WriteBPMStoreFile(store_path, BPMStoreData{})); // replaced by the next write
+    CHECK(WriteBPMStoreFile(store_path, store));
+
+    BPMStoreData read;
+    CHECK(ReadBPMStoreFile(store_path, key, store.num_faces, read));
+    CHECK(read.level == store.level);
+    CHECK(read.key == store.key);
+    CHECK(read.num_faces == store.num_faces);
+    CHECK(read.record_max_uv_error == store.record_max_uv_error);
+    CHECK(read.trans == store.trans);
+    CHECK(read.mobius == store.mobius);
+    CHECK(read.records == store.records);
+    CHECK(read.log_ratios == store.log_ratios);
+    CHECK(read.max_log_ratio == store.max_log_ratio);
+    CHECK(read.flat_uv_error == store.flat_uv_error);
+
+    BPMStoreData header;
+    CHECK(ReadBPMStoreHeader(store_path, header));
+    CHECK(header.level == store.level && header.key == key && header.num_faces == store.num_faces);
+    CHECK(!ReadBPMStoreFile(store_path, key + 1, store.num_faces, read));
+    CHECK(!ReadBPMStoreFile(store_path, key, store.num_faces + 1, read));
+}
+
+static bool NearlyEqual(const Mat2c& a, const Mat2c& b, float tolerance) {
+    return (a.ToEigenMatrix() - b.ToEigenMatrix()).norm() < tolerance;
+}
+
+// EdgeLogRatioMatrix from the stored mu of each side of an edge (p0, p1) against the baseline log ratio
+// log(M^-1 * M_nbr) of Mat2c::LogRatio. The second triangle goes along the edge as (p1, p0), or as (p0, p1)
+// when same_direction, which gives -mu and the negate bit.
+static void TestEdgeLogRatio(bool same_direction) {
+    Complex p0(0.0f, 0.0f), p1(1.0f, 0.1f), k(0.4f, 0.9f), l(0.6f, -0.8f);
+    Complex w0(0.1f, 0.1f), w1(0.9f, 0.2f), wk(0.5f, 0.8f), wl(0.55f, -0.5f);
+    std::array<Complex, 3> z = {p0, p1, k}, w = {w0, w1, wk};
+    std::array<Complex, 3> z_nbr = same_direction ? std::array<Complex, 3>{p0, p1, l} : std::array<Complex, 3>{p1, p0, l};
+    std::array<Complex, 3> w_nbr = same_direction ? std::array<Complex, 3>{w0, w1, wl} : std::array<Complex, 3>{w1, w0, wl};
+    Mat2c coeffs = ComputeMobiusCoefficients(z, w), coeffs_nbr = ComputeMobiusCoefficients(z_nbr, w_nbr);
+    Matrix2c eigen = coeffs.ToEigenMatrix(), eigen_nbr = coeffs_nbr.ToEigenMatrix();
+
+    // triangle 0 is (0, 1, 2), triangle 1 has the edge as its first one, slot 3
+    LogRatioLayout layout(2);
+    layout.Set(0, 0, 1, ComputeEdgeLogRatio(z, w, z_nbr, w_nbr, z[0]));
+    layout.Set(3, 0, 1, ComputeEdgeLogRatio(z_nbr, w_nbr, z, w, z_nbr[0]));
+    CHECK(layout.num_shared_ == 1);
+    CHECK(((layout.data_[3] & 1u) != 0) == same_direction);
+    Complex mu = GetEdgeLogRatio(layout.data_.data(), 0), mu_nbr = GetEdgeLogRatio(layout.data_.data(), 3);
+    CHECK(std::abs(mu) > 0.01f);
+    CHECK(NearlyEqual(EdgeLogRatioMatrix(mu, z[0], z[1]), coeffs.LogRatio(eigen_nbr), 1e-5f));
+    CHECK(NearlyEqual(EdgeLogRatioMatrix(mu_nbr, z_nbr[0], z_nbr[1]), coeffs_nbr.LogRatio(eigen), 1e-5f));
+}
+
+// A few grid vertices moved and their triangles computed again as Mesh::UpdateVertices does, with the edge
+// neighbors of the triangles, against a full precompute of the moved grid: frames, coefficients and the mu of
+// every triangle edge
+static void TestLocalUpdate(const std::string& obj_path) {
+    MeshData mesh;
+    LoadMeshData(obj_path, mesh);
+    uint64_t key = ComputeFileKey(obj_path);
+    uint32_t num_faces = mesh.GetNumFaces();
+    std::vector<int> adjacency = ComputeEdgeAdjacency(mesh.indices, mesh.vertices.size());
+    BPMStoreData store = ComputeStore(mesh, adjacency, key, 1, 1, obj_path);
+    std::vector<unsigned int> moved = {30, 31, 56, 200, 312, 313};
+    for (unsigned int v : moved) mesh.vertices[v].position_ += glm::vec3(0.01f, 0.08f, -0.02f);
+
+    std::vector<unsigned int> changed_faces, faces;
+    for (unsigned int f = 0; f < num_faces; f++) {
+        for (int k = 0; k < 3; k++) {
+            if (std::find(moved.begin(), moved.end(), mesh.indices[3 * f + k]) == moved.end()) continue;
+            changed_faces.push_back(f);
+            break;
+        }
+    }
+    faces = changed_faces;
+    for (unsigned int f : changed_faces) {
+        for (int e = 0; e < 3; e++) {
+            if (adjacency[3 * f + e] >= 0) faces.push_back(static_cast<unsigned int>(adjacency[3 * f + e]));
+        }
+    }
+    std::sort(faces.begin(), faces.end());
+    faces.erase(std::unique(faces.begin(), faces.end()), faces.end());
+    std::vector<int> neighbors;
+    for (unsigned int f : faces) neighbors.insert(neighbors.end(), &adjacency[3 * f], &adjacency[3 * f] + 3);
+    std::vector<glm::mat4> frames;
+    std::vector<TriangleBPM> bpms;
+    RecomputeTriangles(mesh.vertices.data(), mesh.indices.data(), faces, neighbors, true, frames, bpms);
+    for (size_t r = 0; r < faces.size(); r++) {
+        std::memcpy(&store.trans[faces[r] * sizeof(glm::mat4)], &frames[r], sizeof(glm::mat4));
+        std::memcpy(&store.mobius[faces[r] * sizeof(Mat2c)], &bpms[r].coeffs, sizeof(Mat2c));
+    }
+    std::vector<uint32_t> changed, free_pairs;
+    size_t num_ratios = store.log_ratios.size();
+    UpdateEdgeLogRatios(store.log_ratios, free_pairs, num_faces, changed_faces, faces, neighbors, bpms, changed);
+    CHECK(!changed.empty());
+    CHECK(store.log_ratios.size() == num_ratios);
+
+    BPMStoreData full = ComputeStore(mesh, adjacency, key, 1, 1, obj_path);
+    CHECK(store.trans == full.trans);
+    CHECK(store.mobius == full.mobius);
+    int num_different = 0;
+    for (size_t slot = 0; slot < 3 * size_t(num_faces); slot++) {
+        Complex mu = GetEdgeLogRatio(store.log_ratios.data(), slot), full_mu = GetEdgeLogRatio(full.log_ratios.data(), slot);
+        if (std::abs(mu - full_mu) > 1e-4f * std::max(1.0f, std::abs(full_mu))) num_different++;
+    }
+    CHECK(num_different == 0);
+}
+
+// The triangles (0, 1, 2) and (1, 0, 3) of an edge, whose sides stop matching and match again: the second side gets a pair of its
+// own, which it gives back, and takes again without the layout growing
+static void TestPairReuse() {
+    LogRatioLayout layout(2);
+    layout.Set(0, 0, 1, Complex(0.2f, 0.3f));
+    layout.Set(3, 1, 0, Complex(0.2f, 0.3f));
+    CHECK(layout.num_shared_ == 1);
+    std::vector<uint32_t> log_ratios = layout.data_, free_pairs, changed;
+    std::vector<unsigned int> faces = {0, 1};
+    std::vector<int> neighbors = {1, -1, -1, 0, -1, -1};
+    std::vector<TriangleBPM> bpms(2);
+    bpms[0].has_neighbor[0] = bpms[1].has_neighbor[0] = true;
+    auto update = [&](Complex mu, Complex mu_nbr) {
+        bpms[0].mu[0] = mu;
+        bpms[1].mu[0] = mu_nbr;
+        changed.clear();
+        UpdateEdgeLogRatios(log_ratios, free_pairs, 2, faces, faces, neighbors, bpms, changed);
+        CHECK(GetEdgeLogRatio(log_ratios.data(), 0) == mu);
+        CHECK(std::abs(GetEdgeLogRatio(log_ratios.data(), 3) - mu_nbr) < 1e-4f);
+    };
+    size_t shared_size = log_ratios.size();
+    update(Complex(0.5f, -0.1f), Complex(-0.5f, 0.1f));
+    CHECK(log_ratios.size() == shared_size && (log_ratios[3] & 1u) != 0);
+    update(Complex(0.5f, -0.1f), Complex(0.4f, 2.0f));
+    CHECK(log_ratios.size() == shared_size + 2 && free_pairs.empty());
+    CHECK(changed.back() == shared_size + 1);
+    update(Complex(0.1f, 0.1f), Complex(0.1f, 0.1f));
+    CHECK(log_ratios[0] == log_ratios[3] && free_pairs.size() == 1);
+    update(Complex(0.1f, 0.1f), Complex(0.3f, -1.0f));
+    CHECK(log_ratios.size() == shared_size + 2 && free_pairs.empty() && log_ratios[0] >> 1 != log_ratios[3] >> 1);
+}
+
+// its output goes to obj_path.log
+static int RunTool(const std::string& tool, const std::string& obj_path, const std::string& arguments) {
+    return std::system(("\"" + tool + "\" \"" + obj_path + "\" " + arguments + " > \"" + obj_path + ".log\"").c_str());
+}
+
+static void TestToolShardMerge(const std::string& tool, const std::string& obj_path) {
+    std::string store_path = obj_path + kBPMStoreExtension;
+    CHECK(RunTool(tool, obj_path, "--force --jobs 1 --threads 2") == 0);
+    std::vector<char> single = ReadBytes(store_path);
+    CHECK(!single.empty());
+    const unsigned int num_shards = 3;
+    CHECK(RunTool(tool, obj_path, "--adjacency") == 0);
+    for (unsigned int i = 0; i < num_shards; i++) {
+        CHECK(RunTool(tool, obj_path, "--shard " + std::to_string(i) + "/" + std::to_string(num_shards) + " --threads 2") == 0);
+    }
+    CHECK(RunTool(tool, obj_path, "--merge " + std::to_string(num_shards)) == 0);
+    CHECK(ReadBytes(store_path) == single);
+}
+
+int main(int argc, char** argv) {
+    fs::path directory = files::MakeTempPath((fs::temp_directory_path() / "bpm_core_tests").string());
+    fs::create_directories(directory);
+    WriteGridObj(directory, 24);
+    std::string obj_path = (directory / "grid.obj").string();
+    try {
+        TestEdgeLogRatio(false);
+        TestEdgeLogRatio(true);
+        TestShardMerge(obj_path);
+        TestStoreRoundTrip(obj_path);
+        TestLocalUpdate(obj_path);
+        TestPairReuse();
+        if (argc > 1) TestToolShardMerge(argv[1], obj_path);
+    } catch (const std::exception& e) {
+        std::cerr << "FAILED: " << e.what() << std::endl;
+        num_failed++;
+    }
+    for (const auto& entry : fs::directory_iterator(directory)) {
+        if (entry.path().extension() == ".tmp") {
+            std::cerr << "FAILED: temporary file left: " << entry.path().string() << std::endl;
+            num_failed++;
+        }
+    }
+    std::error_code error;
+    fs::remove_all(directory, error);
+    if (num_failed > 0) {
+        std::cerr << num_failed << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
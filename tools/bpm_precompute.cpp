@@ -0,0 +1,260 @@
+// Headless BPM precompute of OBJ models into the .bpm stores the viewer reads (see Mesh::OpenBPMStore), on the
+// CPU with bpm_core only. Directories are searched for .obj files, and the models are processed by a pool of
+// --jobs workers with --threads threads each. A model whose store is up to date is skipped unless --force.
+// For a single large model spread over processes and machines that share a filesystem:
+//   bpm_precompute model.obj --adjacency      once, writes model.obj.adj
+//   bpm_precompute model.obj --shard I/N      for every I in [0, N), writes model.obj.shard-I-of-N
+//   bpm_precompute model.obj --merge N        once all shards are there, writes model.obj.bpm
+// The store is the same, byte for byte, for any N and --threads (see BPM/Shard.h).
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "BPM/Precompute.h"
+#include "BPM/Shard.h"
+#include "Scene/Parser.h"
+
+namespace fs = std::filesystem;
+
+enum class Mode { MODELS, ADJACENCY, SHARD, MERGE };
+
+enum class ModelStatus { COMPUTED, UP_TO_DATE, FAILED };
+
+struct ModelResult {
+    ModelStatus status = ModelStatus::FAILED;
+    uint32_t num_faces = 0;
+    double seconds = 0.0;
+};
+
+static double SecondsSince(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+static bool LoadModel(const std::string& obj_path, MeshData& mesh) {
+    try {
+        LoadMeshData(obj_path, mesh);
+    } catch (const std::exception& e) {
+        std::cerr << "ERROR::BPM_PRECOMPUTE::PARSE_FAILED: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool IsUpToDate(const std::string& obj_path, uint64_t key) {
+    BPMStoreData header;
+    return ReadBPMStoreHeader(obj_path + kBPMStoreExtension, header) && header.key == key && header.level == BPMData::FULL;
+}
+
+// every step in this process, shard 0/1 and its merge
+static ModelResult PrecomputeModel(const std::string& obj_path, unsigned int num_threads, bool force) {
+    auto begin = std::chrono::steady_clock::now();
+    ModelResult result;
+    uint64_t key = ComputeFileKey(obj_path);
+    if (!force && IsUpToDate(obj_path, key)) {
+        result.status = ModelStatus::UP_TO_DATE;
+        return result;
+    }
+    MeshData mesh;
+    if (!LoadModel(obj_path, mesh)) return result;
+    std::vector<int> adjacency = ComputeEdgeAdjacency(mesh.indices, mesh.vertices.size());
+    BPMShard shard;
+    ComputeShard(mesh.vertices, mesh.indices, adjacency, key, 0, 1, num_threads, shard);
+    ShardMerger merger(mesh.indices, key);
+    BPMStoreData store;
+    if (!merger.Add(shard) || !merger.Finish(store) || !WriteBPMStoreFile(obj_path + kBPMStoreExtension, store)) return result;
+    result.status = ModelStatus::COMPUTED;
+    result.num_faces = mesh.GetNumFaces();
+    result.seconds = SecondsSince(begin);
+    return result;
+}
+
+// the .obj files of the paths, directories searched recursively, in a stable order. A file reached twice, by
+// overlapping paths or links, is listed once: two workers would write the same store.
+static std::vector<std::string> FindModels(const std::vector<std::string>& paths) {
+    std::vector<std::string> models;
+    std::unordered_set<std::string> listed; // canonical paths
+    auto add = [&](const std::string& model) {
+        std::error_code error;
+        fs::path canonical = fs::canonical(model, error);
+        // a missing file is listed as given, and fails when it is loaded
+        if (listed.insert(error ? model : canonical.string()).second) models.push_back(model);
+    };
+    for (const std::string& path : paths) {
+        std::error_code error;
+        if (!fs::is_directory(path, error)) {
+            add(path);
+            continue;
+        }
+        std::vector<std::string> found;
+        for (const auto& entry : fs::recursive_directory_iterator(path, fs::directory_options::skip_permission_denied, error)) {
+            if (entry.is_regular_file(error) && entry.path().extension() == ".obj") found.push_back(entry.path().string());
+        }
+        std::sort(found.begin(), found.end());
+        for (const std::string& model : found) add(model);
+    }
+    return models;
+}
+
+static int RunModels(const std::vector<std::string>& models, unsigned int num_jobs, unsigned int num_threads, bool force) {
+    auto begin = std::chrono::steady_clock::now();
+    std::atomic<size_t> next_model{0};
+    std::mutex output_mutex;
+    size_t num_done = 0, num_computed = 0, num_up_to_date = 0, num_failed = 0;
+    uint64_t num_faces = 0;
+    double model_seconds = 0.0;
+    auto worker = [&]() {
+        for (size_t i = next_model++; i < models.size(); i = next_model++) {
+            ModelResult result = PrecomputeModel(models[i], num_threads, force);
+            std::lock_guard<std::mutex> lock(output_mutex);
+            num_done++;
+            std::cout << "[" << num_done << "/" << models.size() << "] " << models[i] << ": ";
+            switch (result.status) {
+                case ModelStatus::COMPUTED:
+                    num_computed++;
+                    num_faces += result.num_faces;
+                    model_seconds += result.seconds;
+                    std::cout << result.num_faces << " triangles in " << result.seconds << " s" << std::endl;
+                    break;
+                case ModelStatus::UP_TO_DATE:
+                    num_up_to_date++;
+                    std::cout << "up to date" << std::endl;
+                    break;
+                case ModelStatus::FAILED:
+                    num_failed++;
+                    std::cout << "failed" << std::endl;
+                    break;
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < num_jobs; i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+
+    double seconds = SecondsSince(begin);
+    std::cout << num_computed << " computed, " << num_up_to_date << " up to date, " << num_failed << " failed in " << seconds << " s on "
+              << num_jobs << " workers x " << num_threads << " threads: " << num_faces / std::max(seconds, 1e-9) << " triangles/s";
+    if (model_seconds > 0.0) std::cout << ", " << model_seconds / std::max(seconds, 1e-9) << " models in parallel on average";
+    std::cout << std::endl;
+    return num_failed == 0 ? 0 : 1;
+}
+
+// one step of a sharded precompute of a single model
+static int RunShardStep(const std::string& obj_path, Mode mode, unsigned int shard, unsigned int num_shards, unsigned int num_threads) {
+    auto begin = std::chrono::steady_clock::now();
+    MeshData mesh;
+    if (!LoadModel(obj_path, mesh)) return 1;
+    uint32_t num_faces = mesh.GetNumFaces();
+    uint64_t key = ComputeFileKey(obj_path);
+    std::cout << obj_path << ": " << num_faces << " triangles, parsed in " << SecondsSince(begin) << " s" << std::endl;
+
+    std::string adjacency_path = obj_path + kAdjacencyExtension;
+    std::vector<int> adjacency;
+    if (mode == Mode::ADJACENCY) {
+        adjacency = ComputeEdgeAdjacency(mesh.indices, mesh.vertices.size());
+        return WriteAdjacencyFile(adjacency_path, key, adjacency) ? 0 : 1;
+    }
+    if (mode == Mode::SHARD) {
+        if (!ReadAdjacencyFile(adjacency_path, key, num_faces, adjacency)) {
+            std::cerr << "ERROR::BPM_PRECOMPUTE::NO_ADJACENCY: " << adjacency_path << ", run --adjacency first" << std::endl;
+            return 1;
+        }
+        auto compute_begin = std::chrono::steady_clock::now();
+        BPMShard result;
+        ComputeShard(mesh.vertices, mesh.indices, adjacency, key, shard, num_shards, num_threads, result);
+        double seconds = SecondsSince(compute_begin);
+        std::cout << "Shard " << shard << "/" << num_shards << ": triangles [" << result.first << ", " << result.end << ") in "
+                  << seconds << " s, " << (result.end - result.first) / std::max(seconds, 1e-9) << " triangles/s on "
+                  << num_threads << " threads" << std::endl;
+        return WriteShardFile(GetShardPath(obj_path, shard, num_shards), result) ? 0 : 1;
+    }
+
+    ShardMerger merger(mesh.indices, key);
+    for (unsigned int i = 0; i < num_shards; i++) {
+        std::string shard_path = GetShardPath(obj_path, i, num_shards);
+        BPMShard result;
+        if (!ReadShardFile(shard_path, key, num_faces, result) || !merger.Add(result)) {
+            std::cerr << "ERROR::BPM_PRECOMPUTE::INVALID_SHARD_FILE: " << shard_path << std::endl;
+            return 1;
+        }
+    }
+    BPMStoreData store;
+    if (!merger.Finish(store)) {
+        std::cerr << "ERROR::BPM_PRECOMPUTE::MISSING_TRIANGLES: " << obj_path << std::endl;
+        return 1;
+    }
+    std::string store_path = obj_path + kBPMStoreExtension;
+    if (!WriteBPMStoreFile(store_path, store)) return 1;
+    std::cout << "Wrote " << store_path << " in " << SecondsSince(begin) << " s" << std::endl;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> paths;
+    Mode mode = Mode::MODELS;
+    unsigned int shard = 0, num_shards = 1;
+    unsigned int num_jobs = 0, num_threads = 0; // from the hardware and the model count when not given
+    bool force = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--adjacency") {
+            mode = Mode::ADJACENCY;
+        } else if (arg == "--shard" && i + 1 < argc) {
+            mode = Mode::SHARD;
+            if (std::sscanf(argv[++i], "%u/%u", &shard, &num_shards) != 2 || num_shards == 0 || shard >= num_shards) {
+                std::cerr << "ERROR::BPM_PRECOMPUTE::INVALID_SHARD: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--merge" && i + 1 < argc) {
+            mode = Mode::MERGE;
+            num_shards = static_cast<unsigned int>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            num_jobs = static_cast<unsigned int>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            num_threads = static_cast<unsigned int>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--force") {
+            force = true;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
+        std::cout << "Usage: " << argv[0] << " <model_path>.obj | <directory> [more] [--jobs N] [--threads N] [--force]" << std::endl
+                  << "       " << argv[0] << " <model_path>.obj --adjacency | --shard I/N | --merge N [--threads N]" << std::endl;
+        return 1;
+    }
+    unsigned int num_cores = std::max(1u, std::thread::hardware_concurrency());
+
+    if (mode != Mode::MODELS) {
+        if (paths.size() != 1 || fs::is_directory(paths[0])) {
+            std::cerr << "ERROR::BPM_PRECOMPUTE::SHARDS_OF_ONE_MODEL: give a single .obj file" << std::endl;
+            return 1;
+        }
+        return RunShardStep(paths[0], mode, shard, num_shards, num_threads > 0 ? num_threads : num_cores);
+    }
+
+    std::vector<std::string> models = FindModels(paths);
+    if (models.empty()) {
+        std::cerr << "ERROR::BPM_PRECOMPUTE::NO_MODELS" << std::endl;
+        return 1;
+    }
+    // models in parallel first, the cores left over go to the triangles of each model
+    if (num_jobs == 0) num_jobs = static_cast<unsigned int>(std::min<size_t>(num_cores, models.size()));
+    num_jobs = static_cast<unsigned int>(std::min<size_t>(num_jobs, models.size()));
+    if (num_threads == 0) num_threads = std::max(1u, num_cores / num_jobs);
+    return RunModels(models, num_jobs, num_threads, force);
+}